@@ -13,9 +13,11 @@
 #include <service_handler.h>
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
+#include <algorithm>
 
 #define JSON_CONFIG_FILTER_ELEM "filter"
 #define JSON_CONFIG_PIPELINE_ELEM "pipeline"
+#define JSON_CONFIG_ASSETS_ELEM "assets"
 
 using namespace std;
 
@@ -29,7 +31,8 @@ using namespace std;
  * @param serviceName	Name of the service to which this pipeline applies
  */
 FilterPipeline::FilterPipeline(ManagementClient* mgtClient, StorageClient& storage, string serviceName) : 
-			mgtClient(mgtClient), storage(storage), serviceName(serviceName), m_ready(false)
+			mgtClient(mgtClient), storage(storage), serviceName(serviceName), m_ready(false),
+			m_routing(false)
 {
 }
 
@@ -38,6 +41,7 @@ FilterPipeline::FilterPipeline(ManagementClient* mgtClient, StorageClient& stora
  */
 FilterPipeline::~FilterPipeline()
 {
+	clearAssetRoutes();
 }
 
 /**
@@ -78,6 +82,9 @@ PLUGIN_HANDLE FilterPipeline::loadFilterPlugin(const string& filterName)
 bool FilterPipeline::loadFilters(const string& categoryName)
 {
 	vector<string> children;	// The Child categories of 'Filters'
+
+	// Routes of a previous configuration are not kept
+	clearAssetRoutes();
 	try
 	{
 		// Get the category with values and defaults
@@ -195,6 +202,13 @@ bool FilterPipeline::loadFilters(const string& categoryName)
 					// Add filter to filters vector
 					m_filters.push_back(currentFilter);
 				}
+
+				// Optional asset routing of the filters
+				if (theFilters.HasMember(JSON_CONFIG_ASSETS_ELEM) &&
+				    theFilters[JSON_CONFIG_ASSETS_ELEM].IsObject())
+				{
+					loadAssetRoutes(theFilters[JSON_CONFIG_ASSETS_ELEM]);
+				}
 			}
 		}
 
@@ -231,6 +245,378 @@ bool FilterPipeline::loadFilters(const string& categoryName)
 	}
 }
 
+/**
+ * Load the asset routing of the filters in the pipeline
+ *
+ * The routing is an object in the filter configuration item,
+ * alongside the pipeline, that maps a filter category name to a
+ * regular expression. Only the readings of the assets that match
+ * the expression are passed to that filter, the other readings
+ * bypass it and are merged with the filter output.
+ *
+ *	{
+ *		"pipeline" : [ "scale", "fft" ],
+ *		"assets" : { "fft" : "vibration.*" }
+ *	}
+ *
+ * Filters without an entry receive all the readings.
+ *
+ * @param routes	The JSON object with the asset routes
+ */
+void FilterPipeline::loadAssetRoutes(const Value& routes)
+{
+	bool routed = false;
+
+	clearAssetRoutes();
+	for (auto it = m_filters.begin(); it != m_filters.end(); ++it)
+	{
+		string pattern;
+		const char *name = (*it)->getName().c_str();
+		if (routes.HasMember(name) && routes[name].IsString())
+		{
+			pattern = routes[name].GetString();
+		}
+		try
+		{
+			m_assetRegex.push_back(regex(pattern));
+		}
+		catch (regex_error& e)
+		{
+			Logger::getLogger()->error("Invalid asset pattern '%s' for filter '%s', "
+						   "all the assets will be passed to the filter",
+						   pattern.c_str(),
+						   (*it)->getName().c_str());
+			pattern.clear();
+			m_assetRegex.push_back(regex());
+		}
+		if (!pattern.empty())
+		{
+			Logger::getLogger()->info("Filter '%s' is applied to assets matching '%s'",
+						  (*it)->getName().c_str(),
+						  pattern.c_str());
+			routed = true;
+		}
+		m_assetPatterns.push_back(pattern);
+	}
+
+	if (routed)
+	{
+		for (unsigned int i = 0; i < m_filters.size(); i++)
+		{
+			m_stages.push_back(new FilterStage(this, i));
+		}
+	}
+}
+
+/**
+ * Remove the asset routing of the pipeline, the stages and
+ * the cache of the filters each asset is routed through
+ */
+void FilterPipeline::clearAssetRoutes()
+{
+	for (auto it = m_stages.begin(); it != m_stages.end(); ++it)
+	{
+		delete *it;
+	}
+	m_stages.clear();
+	m_assetPatterns.clear();
+	m_assetRegex.clear();
+	m_assetRoutes.clear();
+}
+
+/**
+ * Set the output handle and function of a filter in the pipeline
+ *
+ * If the pipeline has asset routing the output of the filter is
+ * sent to its stage, which passes it on to the next filter or to
+ * the pipeline output.
+ *
+ * @param index		The index of the filter in the pipeline
+ * @param outHandle	The output handle, updated if routed
+ * @param output	The output function, updated if routed
+ */
+void FilterPipeline::setFilterOutput(unsigned int index,
+				     OUTPUT_HANDLE*& outHandle,
+				     OUTPUT_STREAM& output)
+{
+	if (!isRouted())
+	{
+		return;
+	}
+	FilterStage *stage = m_stages[index];
+	// Only the last stage uses the pipeline output
+	stage->m_outHandle = outHandle;
+	stage->m_output = output;
+	outHandle = (OUTPUT_HANDLE *)stage;
+	output = FilterPipeline::stageOutput;
+}
+
+/**
+ * Pass a reading set to the first filter of the pipeline
+ *
+ * The readings output by a routed pipeline are collected and
+ * passed to the pipeline output once all the filters have
+ * returned, in the order of the readings they come from. The
+ * position of each reading is looked up by its address, which
+ * is only valid for the duration of this call.
+ *
+ * @param readings	The readings to filter
+ */
+void FilterPipeline::ingest(READINGSET *readings)
+{
+	if (m_filters.empty())
+	{
+		return;
+	}
+	if (isRouted())
+	{
+		const vector<Reading *>& all = readings->getAllReadings();
+		for (unsigned long i = 0; i < all.size(); i++)
+		{
+			m_readingOrder[all[i]] = i;
+		}
+		m_routing = true;
+		routeReadings(0, readings);
+		m_routing = false;
+		outputRoutedReadings();
+	}
+	else
+	{
+		m_filters[0]->ingest(readings);
+	}
+}
+
+/**
+ * Pass the readings collected by a routed ingest to the pipeline
+ * output as a single reading set
+ *
+ * The sort is stable so that the readings a filter has added after
+ * a reading keep their position after it.
+ */
+void FilterPipeline::outputRoutedReadings()
+{
+	stable_sort(m_routedOutput.begin(), m_routedOutput.end(),
+		    [](const pair<unsigned long, Reading *>& a,
+		       const pair<unsigned long, Reading *>& b) {
+			return a.first < b.first;
+		    });
+	vector<Reading *> output;
+	output.reserve(m_routedOutput.size());
+	for (auto it = m_routedOutput.cbegin(); it != m_routedOutput.cend(); ++it)
+	{
+		output.push_back(it->second);
+	}
+	m_routedOutput.clear();
+	m_readingOrder.clear();
+
+	FilterStage *last = m_stages.back();
+	(*last->m_output)(last->m_outHandle, new ReadingSet(&output));
+}
+
+/**
+ * Return the position in the ingested reading set of a reading
+ * passed through a routed pipeline
+ *
+ * @param reading	The reading
+ * @return		The position of the reading, 0 if unknown
+ */
+unsigned long FilterPipeline::readingOrder(Reading *reading)
+{
+	auto it = m_readingOrder.find(reading);
+	return it == m_readingOrder.end() ? 0 : it->second;
+}
+
+/**
+ * Check if the readings of an asset are routed through a filter
+ *
+ * The regular expressions are evaluated once per asset name and
+ * the result cached for all the filters of the pipeline.
+ *
+ * @param index		The index of the filter in the pipeline
+ * @param assetName	The asset name
+ * @return		True if the filter is applied to the asset
+ */
+bool FilterPipeline::routesAsset(unsigned int index, const string& assetName)
+{
+	auto it = m_assetRoutes.find(assetName);
+	if (it == m_assetRoutes.end())
+	{
+		vector<bool> routes;
+		for (unsigned int i = 0; i < m_assetPatterns.size(); i++)
+		{
+			routes.push_back(m_assetPatterns[i].empty() ||
+					 regex_match(assetName, m_assetRegex[i]));
+		}
+		it = m_assetRoutes.emplace(assetName, routes).first;
+	}
+	return it->second[index];
+}
+
+/**
+ * Pass the readings to a filter of a routed pipeline
+ *
+ * The readings are partitioned once into the readings the filter
+ * applies to, which are passed to the filter, and the others, which
+ * are passed on to the next filter or to the pipeline output. If the
+ * filter applies to none of the readings it is not called at all.
+ *
+ * @param index		The index of the filter in the pipeline
+ * @param readings	The readings to filter
+ */
+void FilterPipeline::routeReadings(unsigned int index, READINGSET *readings)
+{
+	FilterStage *stage = m_stages[index];
+	FilterPlugin *filter = m_filters[index];
+	const vector<Reading *>& all = readings->getAllReadings();
+
+	if (m_assetPatterns[index].empty())
+	{
+		stage->m_inputOrder = all.empty() ? 0 : readingOrder(all[0]);
+		filter->ingest(readings);
+		return;
+	}
+
+	vector<Reading *> routed;
+	vector<Reading *> bypass;
+	for (auto it = all.cbegin(); it != all.cend(); ++it)
+	{
+		if (routesAsset(index, (*it)->getAssetName()))
+		{
+			routed.push_back(*it);
+		}
+		else
+		{
+			bypass.push_back(*it);
+		}
+	}
+
+	if (bypass.empty())
+	{
+		stage->m_inputOrder = routed.empty() ? 0 : readingOrder(routed[0]);
+		filter->ingest(readings);
+		return;
+	}
+	if (routed.empty())
+	{
+		// Nothing for this filter
+		forwardReadings(stage, readings);
+		return;
+	}
+
+	// The readings are now held by the routed and bypass sets
+	readings->clear();
+	delete readings;
+
+	stage->m_inputOrder = readingOrder(routed[0]);
+	filter->ingest(new ReadingSet(&routed));
+	forwardReadings(stage, new ReadingSet(&bypass));
+}
+
+/**
+ * Pass the readings out of a stage to the next filter
+ * or to the pipeline output
+ *
+ * While a reading set is passed through the pipeline the output of
+ * the last stage is collected, to be sent once the filters return.
+ *
+ * @param stage		The stage the readings come from
+ * @param readings	The readings
+ */
+void FilterPipeline::forwardReadings(FilterStage *stage, READINGSET *readings)
+{
+	if (stage->m_index + 1 < m_filters.size())
+	{
+		routeReadings(stage->m_index + 1, readings);
+	}
+	else if (m_routing)
+	{
+		const vector<Reading *>& all = readings->getAllReadings();
+		for (auto it = all.cbegin(); it != all.cend(); ++it)
+		{
+			m_routedOutput.push_back(pair<unsigned long, Reading *>(readingOrder(*it), *it));
+		}
+		readings->clear();
+		delete readings;
+	}
+	else
+	{
+		(*stage->m_output)(stage->m_outHandle, readings);
+	}
+}
+
+/**
+ * Output function of the filters in a routed pipeline
+ *
+ * Readings the filter has created take the position of the reading
+ * output before them, or of the first reading given to the filter.
+ *
+ * Static method
+ *
+ * @param outHandle	Pointer to the FilterStage of the filter
+ * @param readings	The filter output
+ */
+void FilterPipeline::stageOutput(OUTPUT_HANDLE *outHandle, READINGSET *readings)
+{
+	FilterStage *stage = (FilterStage *)outHandle;
+	FilterPipeline *pipeline = stage->m_pipeline;
+	if (pipeline->m_routing)
+	{
+		unsigned long order = stage->m_inputOrder;
+		const vector<Reading *>& all = readings->getAllReadings();
+		for (auto it = all.cbegin(); it != all.cend(); ++it)
+		{
+			auto known = pipeline->m_readingOrder.find(*it);
+			if (known == pipeline->m_readingOrder.end())
+			{
+				pipeline->m_readingOrder[*it] = order;
+			}
+			else
+			{
+				order = known->second;
+			}
+		}
+	}
+	pipeline->forwardReadings(stage, readings);
+}
+
+/**
+ * Group consecutive filters that support the "plugin_ingest_reading"
+ * entry point so that each group is executed in a single pass over
+ * the readings, without any intermediate reading set.
+ *
+ * Filters that do not support it are still chained through their
+ * "plugin_ingest" entry point.
+ */
+void FilterPipeline::fuseFilters()
+{
+	if (isRouted())
+	{
+		// Routed filters may see different readings
+		return;
+	}
+
+	FilterPlugin *head = NULL;
+	for (auto it = m_filters.begin(); it != m_filters.end(); ++it)
+	{
+		(*it)->unfuse();
+		if (!(*it)->canFuse())
+		{
+			head = NULL;
+		}
+		else if (head == NULL)
+		{
+			head = *it;
+		}
+		else
+		{
+			head->fuse(*it);
+			Logger::getLogger()->info("Filter '%s' is executed in the same pass as filter '%s'",
+						  (*it)->getName().c_str(),
+						  head->getName().c_str());
+		}
+	}
+}
+
 /**
  * Set the filter pipeline
  * 
@@ -277,29 +663,26 @@ bool FilterPipeline::setupFiltersPipeline(void *passToOnwardFilter, void *useFil
 		}
 
 		// Iterate the load filters set in the Ingest class m_filters member 
+		OUTPUT_HANDLE *outHandle;
+		OUTPUT_STREAM output;
 		if ((it + 1) != m_filters.end())
 		{
 			// Set next filter pointer as OUTPUT_HANDLE
-			if (!(*it)->init(updatedCfg,
-					(OUTPUT_HANDLE *)(*(it + 1)),
-					filterReadingSetFn(passToOnwardFilter)))
-			{
-				errMsg += (*it)->getName() + "'";
-				initErrors = true;
-				break;
-			}
+			outHandle = (OUTPUT_HANDLE *)(*(it + 1));
+			output = filterReadingSetFn(passToOnwardFilter);
 		}
 		else
 		{
 			// Set the Ingest class pointer as OUTPUT_HANDLE
-			if (!(*it)->init(updatedCfg,
-					 (OUTPUT_HANDLE *)(ingest),
-					 filterReadingSetFn(useFilteredData)))
-			{
-				errMsg += (*it)->getName() + "'";
-				initErrors = true;
-				break;
-			}
+			outHandle = (OUTPUT_HANDLE *)(ingest);
+			output = filterReadingSetFn(useFilteredData);
+		}
+		setFilterOutput(it - m_filters.begin(), outHandle, output);
+		if (!(*it)->init(updatedCfg, outHandle, output))
+		{
+			errMsg += (*it)->getName() + "'";
+			initErrors = true;
+			break;
 		}
 
 		if ((*it)->persistData())
@@ -325,6 +708,8 @@ bool FilterPipeline::setupFiltersPipeline(void *passToOnwardFilter, void *useFil
 		return false;
 	}
 
+	fuseFilters();
+
 	// Set filter pipeline is ready for data ingest
 	m_ready = true;
 
@@ -374,6 +759,9 @@ void FilterPipeline::cleanupFilters(const string& categoryName)
 		// Free filter
 		delete filter;
 	}
+	m_filters.clear();
+	m_filterCategories.clear();
+	clearAssetRoutes();
 }
 
 /**
@@ -53,9 +53,14 @@ FilterPlugin::FilterPlugin(const std::string& name,
   	pluginReconfigurePtr = (void (*)(PLUGIN_HANDLE, const string&))
 				      manager->resolveSymbol(handle,
 							     "plugin_reconfigure");
+	// Optional per reading entry point
+	pluginIngestReadingPtr = (INGEST_READING_FN)
+				 manager->resolveSymbol(handle, "plugin_ingest_reading");
 
 	// Set m_instance default value
 	m_instance = NULL;
+	m_outHandle = NULL;
+	m_output = NULL;
 
 	// Persist data initialised
 	m_plugin_data = NULL;	
@@ -83,6 +88,8 @@ PLUGIN_HANDLE FilterPlugin::init(const ConfigCategory& config,
 				 OUTPUT_HANDLE *outHandle,
 				 OUTPUT_STREAM outputFunc)
 {
+	m_outHandle = outHandle;
+	m_output = outputFunc;
 	m_instance = this->pluginInit(&config,
 				      outHandle,
 				      outputFunc);
@@ -167,9 +174,67 @@ void FilterPlugin::startData(const string& storedData)
  */
 void FilterPlugin::ingest(READINGSET* readings)
 {
+	if (!m_fused.empty())
+	{
+		return this->ingestFused(readings);
+	}
 	if (this->pluginIngestPtr)
 	{
         	return this->pluginIngestPtr(m_instance, readings);
 	}
 }
 
+/**
+ * Add the next filter of the pipeline to the run of filters
+ * that are executed in a single pass by this filter.
+ *
+ * Both filters must support the "plugin_ingest_reading" entry point.
+ *
+ * @param next	The next filter in the pipeline
+ */
+void FilterPlugin::fuse(FilterPlugin *next)
+{
+	if (m_fused.empty())
+	{
+		m_fused.push_back(this);
+	}
+	m_fused.push_back(next);
+}
+
+/**
+ * Execute the run of fused filters in a single pass over the readings
+ *
+ * Each reading is passed in turn to the "plugin_ingest_reading" entry
+ * point of every filter in the run and modified in place. Readings
+ * dropped by a filter are removed. The reading set is then passed to
+ * the output of the last filter in the run.
+ *
+ * @param readings	The reading set to ingest
+ */
+void FilterPlugin::ingestFused(READINGSET* readings)
+{
+	vector<Reading *>* data = readings->getAllReadingsPtr();
+	bool removed = false;
+
+	for (auto it = data->begin(); it != data->end(); ++it)
+	{
+		for (auto filter = m_fused.cbegin(); filter != m_fused.cend(); ++filter)
+		{
+			if (!(*(*filter)->pluginIngestReadingPtr)((*filter)->m_instance, *it))
+			{
+				delete *it;
+				*it = NULL;
+				removed = true;
+				break;
+			}
+		}
+	}
+	if (removed)
+	{
+		readings->compact();
+	}
+
+	FilterPlugin *last = m_fused.back();
+	(*last->m_output)(last->m_outHandle, readings);
+}
+
@@ -163,6 +163,28 @@ class DatapointValue {
 			m_type = T_FLOAT;
 		}
 
+		/**
+		 * Set the value of a datapoint to an array of floating
+		 * point values, this may also cause the type to be changed.
+		 * The datapoint takes ownership of the array and the
+		 * pointer passed is set to NULL.
+		 * @param values	The array of values to set
+		 */
+		void setValue(std::vector<double>*& values)
+		{
+			if (m_type == T_STRING)
+			{
+				delete m_value.str;
+			}
+			else if (m_type == T_FLOAT_ARRAY)
+			{
+				delete m_value.a;
+			}
+			m_value.a = values;
+			m_type = T_FLOAT_ARRAY;
+			values = NULL;
+		}
+
 		/**
 		 * Return the value as a string
 		 */
@@ -214,7 +236,27 @@ class DatapointValue {
 		{
 			return m_value.dpa;
 		}
-		
+
+		/**
+		 * Return the values of a T_FLOAT_ARRAY
+		 */
+		const std::vector<double>* getDpArr() const
+		{
+			return m_value.a;
+		}
+
+		/**
+		 * Take the values of a T_FLOAT_ARRAY, the caller owns
+		 * the returned array and the datapoint is left with an
+		 * empty array
+		 */
+		std::vector<double>* takeDpArr()
+		{
+			std::vector<double> *values = m_value.a;
+			m_value.a = new std::vector<double>();
+			return values;
+		}
+
 	private:
 		union data_t {
 			std::string*		str;
@@ -16,9 +16,36 @@
 #include <plugin_data.h>
 #include <reading_set.h>
 #include <filter_plugin.h>
+#include <regex>
+#include <unordered_map>
 
 typedef void (*filterReadingSetFn)(OUTPUT_HANDLE *outHandle, READINGSET* readings);
 
+class FilterPipeline;
+
+/**
+ * A filter of a pipeline that has asset routing.
+ *
+ * The filter output is sent to the stage, which passes it to the
+ * next stage or to the pipeline output. The readings that are not
+ * routed through the filter are passed on by the pipeline directly.
+ */
+class FilterStage
+{
+public:
+	FilterStage(FilterPipeline *pipeline, unsigned int index) :
+			m_pipeline(pipeline), m_index(index),
+			m_outHandle(NULL), m_output(NULL), m_inputOrder(0) {};
+
+	FilterPipeline*		m_pipeline;
+	unsigned int		m_index;
+	// Output handle and function of the last filter
+	OUTPUT_HANDLE*		m_outHandle;
+	OUTPUT_STREAM		m_output;
+	// Position of the first reading passed to the filter
+	unsigned long		m_inputOrder;
+};
+
 /**
  * The FilterPipeline class is used to represent a pipeline of filters 
  * applicable to a task/service. Methods are provided to load filters, 
@@ -48,15 +75,52 @@ public:
 	bool		setupFiltersPipeline(void *passToOnwardFilter,
 					     void *useFilteredData,
 					     void *ingest);
+	// Pass a reading set to the pipeline
+	void		ingest(READINGSET *readings);
 	// Check FilterPipeline is ready for data ingest
 	bool		isReady() { return m_ready; };
 	bool		hasChanged(const std::string pipeline) const { return m_pipeline != pipeline; }
 
 private:
 	PLUGIN_HANDLE	loadFilterPlugin(const std::string& filterName);
+	bool		routesAsset(unsigned int index, const std::string& assetName);
+	void		routeReadings(unsigned int index, READINGSET *readings);
+	void		forwardReadings(FilterStage *stage, READINGSET *readings);
+	void		outputRoutedReadings();
+	unsigned long	readingOrder(Reading *reading);
+	static void	stageOutput(OUTPUT_HANDLE *outHandle, READINGSET *readings);
 	bool		m_ready;
+	// Set while a reading set is passed through a routed pipeline
+	bool		m_routing;
+	// Position in the ingested set of the readings of a routed pipeline.
+	// The reading pointers are only compared, never dereferenced, and
+	// the map is cleared before the ingest returns, so no key outlives
+	// the ingest. A reading created by a filter at the address of one
+	// deleted during the same ingest takes the position of the deleted
+	// reading, it is still output exactly once.
+	std::unordered_map<Reading *, unsigned long>
+				m_readingOrder;
+	// Pipeline output of a routed ingest with the position of each reading
+	std::vector<std::pair<unsigned long, Reading *>>
+				m_routedOutput;
+	// Asset name regular expression of each filter, empty for all assets
+	std::vector<std::string>
+				m_assetPatterns;
+	std::vector<std::regex>	m_assetRegex;
+	// Cache of the filters each asset is routed through
+	std::unordered_map<std::string, std::vector<bool>>
+				m_assetRoutes;
 
 protected:
+	void		loadAssetRoutes(const rapidjson::Value& routes);
+	void		clearAssetRoutes();
+	void		setFilterOutput(unsigned int index,
+					OUTPUT_HANDLE*& outHandle,
+					OUTPUT_STREAM& output);
+	bool		isRouted() const { return !m_stages.empty(); };
+	void		fuseFilters();
+	std::vector<FilterStage *>
+				m_stages;
 	ManagementClient*	mgtClient;
 	StorageClient&		storage;
 	std::string		serviceName;
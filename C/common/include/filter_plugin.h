@@ -22,6 +22,8 @@ typedef ReadingSet READINGSET;
 typedef void OUTPUT_HANDLE;
 // Function pointer called by "plugin_ingest" plugin method
 typedef void (*OUTPUT_STREAM)(OUTPUT_HANDLE *, READINGSET *);
+// Optional "plugin_ingest_reading" plugin method, see filter.h
+typedef bool (*INGEST_READING_FN)(PLUGIN_HANDLE, Reading *);
 
 // FilterPlugin class
 class FilterPlugin : public Plugin
@@ -38,6 +40,9 @@ public:
 				     OUTPUT_STREAM outputFunc);
         void			shutdown();
         void			ingest(READINGSET *);
+	bool			canFuse() const { return pluginIngestReadingPtr != NULL; };
+	void			fuse(FilterPlugin *next);
+	void			unfuse() { m_fused.clear(); };
 	bool			persistData() { return info->options & SP_PERSIST_DATA; };
 	void			startData(const std::string& pluginData);
 	std::string		shutdownSaveData();
@@ -56,6 +61,9 @@ private:
 	void		(*pluginStartDataPtr)(PLUGIN_HANDLE,
 					      const std::string& pluginData);
 	void		(*pluginStartPtr)(PLUGIN_HANDLE);
+	INGEST_READING_FN
+			pluginIngestReadingPtr;
+	void		ingestFused(READINGSET *);
 
 public:
 	// Persist plugin data
@@ -64,6 +72,11 @@ public:
 private:
 	std::string	m_name;
         PLUGIN_HANDLE   m_instance;
+	OUTPUT_HANDLE*	m_outHandle;
+	OUTPUT_STREAM	m_output;
+	// Filters executed in the same pass, set in the first one of the run
+	std::vector<FilterPlugin *>
+			m_fused;
 };
 
 #endif
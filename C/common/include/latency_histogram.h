@@ -0,0 +1,177 @@
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+/*
+ * Fledge latency histogram
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <sstream>
+
+#define LATENCY_BUCKETS	24	// Power of two microsecond buckets, the last holds everything over ~4 seconds
+
+/**
+ * A histogram of operation latencies, together with the number of
+ * bytes received and sent by the operations.
+ *
+ * Bucket 0 counts operations that took at most 1 microsecond, bucket n
+ * those that took more than 2^(n-1) and at most 2^n microseconds. All
+ * counters are atomic so that operations may be recorded concurrently
+ * without taking a lock, the histogram may be read while it is updated.
+ */
+class LatencyHistogram {
+	public:
+		LatencyHistogram() : m_count(0), m_total(0), m_max(0), m_bytesIn(0), m_bytesOut(0)
+		{
+			for (int i = 0; i < LATENCY_BUCKETS; i++)
+			{
+				m_buckets[i] = 0;
+			}
+		};
+
+		/**
+		 * Record a single operation
+		 *
+		 * @param usec		The duration of the operation in microseconds
+		 * @param bytesIn	The number of bytes received by the operation
+		 * @param bytesOut	The number of bytes sent by the operation
+		 */
+		void		record(unsigned long usec, unsigned long bytesIn = 0, unsigned long bytesOut = 0)
+		{
+			m_buckets[bucket(usec)].fetch_add(1, std::memory_order_relaxed);
+			m_count.fetch_add(1, std::memory_order_relaxed);
+			m_total.fetch_add(usec, std::memory_order_relaxed);
+			m_bytesIn.fetch_add(bytesIn, std::memory_order_relaxed);
+			m_bytesOut.fetch_add(bytesOut, std::memory_order_relaxed);
+			unsigned long max = m_max.load(std::memory_order_relaxed);
+			while (usec > max && !m_max.compare_exchange_weak(max, usec, std::memory_order_relaxed))
+				;
+		};
+
+		unsigned long	count() const { return m_count.load(std::memory_order_relaxed); };
+
+		/**
+		 * Return an upper bound on the given percentile of the
+		 * recorded latencies, the bound is the upper limit of the
+		 * bucket that holds the percentile.
+		 *
+		 * @param percent	The percentile, between 0 and 100
+		 * @return unsigned long	The latency bound in microseconds
+		 */
+		unsigned long	percentile(double percent) const
+		{
+			unsigned long total = 0;
+			unsigned long counts[LATENCY_BUCKETS];
+			for (int i = 0; i < LATENCY_BUCKETS; i++)
+			{
+				counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+				total += counts[i];
+			}
+			if (total == 0)
+			{
+				return 0;
+			}
+			double target = total * percent / 100.0;
+			unsigned long seen = 0;
+			for (int i = 0; i < LATENCY_BUCKETS - 1; i++)
+			{
+				seen += counts[i];
+				if (seen >= target)
+				{
+					return 1UL << i;
+				}
+			}
+			return m_max.load(std::memory_order_relaxed);
+		};
+
+		/**
+		 * Return the histogram as a JSON object. Only buckets that
+		 * hold operations are included, keyed by the upper bound
+		 * of the bucket in microseconds.
+		 *
+		 * @return string	The JSON object
+		 */
+		std::string	toJSON() const
+		{
+			std::ostringstream convert;
+			unsigned long count = m_count.load(std::memory_order_relaxed);
+			convert << "{ \"count\" : " << count << ",";
+			convert << " \"averageUs\" : " << (count ? m_total.load(std::memory_order_relaxed) / count : 0) << ",";
+			convert << " \"maxUs\" : " << m_max.load(std::memory_order_relaxed) << ",";
+			convert << " \"p50Us\" : " << percentile(50) << ",";
+			convert << " \"p99Us\" : " << percentile(99) << ",";
+			convert << " \"bytesIn\" : " << m_bytesIn.load(std::memory_order_relaxed) << ",";
+			convert << " \"bytesOut\" : " << m_bytesOut.load(std::memory_order_relaxed) << ",";
+			convert << " \"buckets\" : {";
+			bool first = true;
+			for (int i = 0; i < LATENCY_BUCKETS; i++)
+			{
+				unsigned long n = m_buckets[i].load(std::memory_order_relaxed);
+				if (n)
+				{
+					convert << (first ? " " : ", ") << "\"" << (1UL << i) << "\" : " << n;
+					first = false;
+				}
+			}
+			convert << " } }";
+			return convert.str();
+		};
+
+	private:
+		static int	bucket(unsigned long usec)
+		{
+			int i = 0;
+			while (i < LATENCY_BUCKETS - 1 && (1UL << i) < usec)
+			{
+				i++;
+			}
+			return i;
+		};
+		std::atomic<unsigned long>	m_buckets[LATENCY_BUCKETS];
+		std::atomic<unsigned long>	m_count;
+		std::atomic<unsigned long>	m_total;
+		std::atomic<unsigned long>	m_max;
+		std::atomic<unsigned long>	m_bytesIn;
+		std::atomic<unsigned long>	m_bytesOut;
+};
+
+/**
+ * Times the scope in which it is declared and records the duration
+ * in a histogram when it goes out of scope. A null histogram disables
+ * the timer.
+ */
+class LatencyTimer {
+	public:
+		LatencyTimer(LatencyHistogram *histogram) : m_histogram(histogram), m_bytesIn(0), m_bytesOut(0)
+		{
+			if (m_histogram)
+			{
+				m_start = std::chrono::steady_clock::now();
+			}
+		};
+		~LatencyTimer()
+		{
+			if (m_histogram)
+			{
+				auto usec = std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now() - m_start).count();
+				m_histogram->record((unsigned long)usec, m_bytesIn, m_bytesOut);
+			}
+		};
+		void		bytes(unsigned long bytesIn, unsigned long bytesOut)
+		{
+			m_bytesIn = bytesIn;
+			m_bytesOut = bytesOut;
+		};
+	private:
+		LatencyHistogram			*m_histogram;
+		std::chrono::steady_clock::time_point	m_start;
+		unsigned long				m_bytesIn;
+		unsigned long				m_bytesOut;
+};
+#endif
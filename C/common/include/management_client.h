@@ -54,6 +54,7 @@ class ManagementClient {
 
 private:
     std::ostringstream 			m_urlbase;
+		std::string				m_unixSocket;
 		std::map<std::thread::id, HttpClient *> m_client_map;
 		HttpClient				*m_client;
 		std::string				*m_uuid;
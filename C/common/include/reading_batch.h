@@ -0,0 +1,43 @@
+#ifndef _READING_BATCH_H
+#define _READING_BATCH_H
+/*
+ * Fledge storage reading batch definitions.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <stdint.h>
+
+/*
+ * The version of the reading batch structures. A plugin must reject
+ * a batch with a version it does not support.
+ */
+#define READING_BATCH_VERSION	1
+
+/**
+ * A single reading within a batch. All strings are null terminated,
+ * the lengths exclude the terminator.
+ */
+typedef struct {
+	const char	*assetCode;
+	uint32_t	assetCodeLength;
+	const char	*userTs;	// The user timestamp as sent by the client or "now()"
+	uint32_t	userTsLength;
+	const char	*reading;	// The datapoints of the reading as a JSON object
+	uint32_t	readingLength;
+} ReadingBatchEntry;
+
+/**
+ * A batch of readings passed to the plugin_reading_append_batch entry
+ * point of a storage plugin. The batch, and the memory it refers to, is
+ * only valid for the duration of the call.
+ */
+typedef struct {
+	uint32_t		version;
+	uint32_t		count;
+	const ReadingBatchEntry	*readings;
+} ReadingBatch;
+
+#endif
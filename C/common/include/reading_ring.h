@@ -0,0 +1,74 @@
+#ifndef _READING_RING_H
+#define _READING_RING_H
+/*
+ * Fledge shared memory reading ring.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+#define RDS_RING_MAGIC		0x52494e47	// Marks a valid ring header
+#define RDS_RING_SIZE		(8 * 1024 * 1024)	// Default size of the ring data area
+
+/**
+ * The header at the start of the shared memory segment. The head and
+ * tail are free running byte counts, the position in the data area is
+ * found by masking with the size, which must be a power of two. They
+ * are kept in separate cache lines as each is written by only one side.
+ */
+typedef struct {
+	uint32_t			magic;
+	uint32_t			headerSize;
+	uint64_t			size;
+	alignas(64) std::atomic<uint64_t>	head;
+	std::atomic<uint32_t>		consumerWaiting;
+	alignas(64) std::atomic<uint64_t>	tail;
+	std::atomic<uint32_t>		producerWaiting;
+} RDSRingHeader;
+
+/**
+ * A single producer, single consumer ring of variable length records held
+ * in a shared memory segment. The producer creates the segment with
+ * memfd_create together with two eventfds, one to wake the consumer when
+ * data is written and one to wake the producer when space is freed. The
+ * descriptors are passed to the consumer process, which attaches to them.
+ *
+ * The ring itself is lock free, the eventfds are only written when the
+ * other side has indicated it is waiting.
+ */
+class ReadingRing {
+	public:
+		ReadingRing();
+		~ReadingRing();
+		bool		create(size_t size = RDS_RING_SIZE);
+		bool		attach(int memFd, int dataEvent, int spaceEvent);
+		bool		write(const char *data, uint32_t length, int timeout);
+		bool		next(std::string& record);
+		void		consume();
+		bool		idle();
+		void		clearEvent();
+		uint64_t	size() const { return m_size; };
+		int		memFd() const { return m_memFd; };
+		int		dataEvent() const { return m_dataEvent; };
+		int		spaceEvent() const { return m_spaceEvent; };
+	private:
+		bool		map(size_t length);
+		void		copyIn(uint64_t position, const void *data, size_t length);
+		void		copyOut(uint64_t position, void *data, size_t length);
+		void		signal(int fd);
+		RDSRingHeader	*m_header;
+		char		*m_data;
+		size_t		m_mapSize;
+		uint64_t	m_size;
+		uint64_t	m_mask;
+		uint32_t	m_pending;
+		int		m_memFd;
+		int		m_dataEvent;
+		int		m_spaceEvent;
+};
+#endif
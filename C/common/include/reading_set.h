@@ -47,6 +47,7 @@ class ReadingSet {
 		void				append(const std::vector<Reading *> &);
 		void				removeAll();
 		void				clear();
+		void				compact();
 
 	private:
 		unsigned long			m_count;
@@ -11,10 +11,12 @@
  */
 
 #define RDS_CONNECTION_MAGIC	0x344f4e4e
+#define RDS_RING_CONNECTION_MAGIC	0x52494e43	// Connection passes a shared memory ring
 #define	RDS_BLOCK_MAGIC		0x5244424b
 #define	RDS_READING_MAGIC	0x52444947
 #define RDS_ACK_MAGIC		0x4241434b
 #define RDS_NACK_MAGIC		0x4e41434b
+#define RDS_CHUNK_MAGIC		0x43484b41	// Acknowledges the readings of a block stored so far
 
 typedef struct {
 	uint32_t	magic;
@@ -37,6 +39,7 @@ typedef struct {
 typedef struct {
 	uint32_t	magic;
 	uint32_t	block;
+	uint32_t	count;		// Readings stored from the start of the block
 } RDSAcknowledge;
 
 typedef struct {
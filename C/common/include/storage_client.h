@@ -12,6 +12,7 @@
 #include <client_http.hpp>
 #include <reading.h>
 #include <reading_set.h>
+#include <reading_ring.h>
 #include <resultset.h>
 #include <purge_result.h>
 #include <query.h>
@@ -22,11 +23,21 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <mutex>
+#include <deque>
+#include <ctime>
+#include <future>
+#include <functional>
+#include <condition_variable>
 
 using HttpClient = SimpleWeb::Client<SimpleWeb::HTTP>;
 
 #define STREAM_BLK_SIZE 	50	// Readings to send per write call to a stream
 #define STREAM_THRESHOLD	25	// Switch to streamed mode above this number of readings per second
+#define STREAM_ACK_WINDOW	4	// Maximum number of unacknowledged blocks in flight on a stream
+#define STREAM_ACK_TIMEOUT	5000	// Milliseconds to wait for an acknowledgement when the window is full
+#define STREAM_RETRY_TIME	60	// Seconds to wait before retrying stream mode after a failure
+#define ASYNC_THREADS		2	// Number of I/O threads, each with a persistent connection, for asynchronous requests
 
 
 /**
@@ -58,24 +69,79 @@ class StorageClient {
 							  const std::string& callbackUrl);
 		bool		unregisterAssetNotification(const std::string& assetName,
 							    const std::string& callbackUrl);
+		std::future<bool>
+				readingAppendAsync(const std::vector<Reading *> & readings);
+		std::future<ReadingSet *>
+				readingFetchAsync(const unsigned long readingId, const unsigned long count);
+		std::future<ResultSet *>
+				queryTableAsync(const std::string& tableName, const Query& query);
 
 	private:
 		void		handleUnexpectedResponse(const char *operation,
 							const std::string& responseCode,
 							const std::string& payload);
 		HttpClient 	*getHttpClient(void);
+		bool		useStream(const std::vector<Reading *> & readings);
+		std::string	readingsPayload(const std::vector<Reading *> & readings);
+		bool		postReadings(const std::string& payload, size_t count);
+		ResultSet	*queryTablePayload(const std::string& tableName, const std::string& payload);
+		void		asyncSubmit(const std::function<void()>& task);
+		void		asyncWorker();
+		void		asyncShutdown();
 		bool		openStream();
+		bool		connectUnixStream(int port);
+		bool		sendConnectHeader(uint32_t token);
+		void		closeStream();
 		bool		streamReadings(const std::vector<Reading *> & readings);
+		bool		sendStreamData(const char *data, size_t length);
+		bool		ringFits(const std::string& block)
+				{
+					return block.length() + sizeof(uint32_t) <= m_ring->size();
+				};
+		bool		ringWrite(const std::string& block);
+		bool		streamClosed();
+		bool		ringDetached();
+		void		recoverRing();
+		bool		processStreamAcks(bool wait);
+		bool		resumeStream();
+		bool		streamFallback();
+		bool		flushStreamPending();
+		bool		streamBlockAppend(const std::string& block, uint32_t skip = 0);
+
+		/**
+		 * A block of readings sent on the reading stream that has not
+		 * been acknowledged, with the number of readings at the start
+		 * of the block the storage service has acknowledged storing.
+		 */
+		class StreamBlock {
+			public:
+				StreamBlock(uint32_t number, const std::string& data = std::string()) :
+					m_number(number), m_stored(0), m_data(data) {};
+				void		trim();
+				uint32_t	m_number;
+				uint32_t	m_stored;
+				std::string	m_data;
+		};
 
 		std::ostringstream 			m_urlbase;
 		std::string				m_host;
+		std::string				m_unixSocket;
 		std::map<std::thread::id, HttpClient *> m_client_map;
 		std::map<std::thread::id, std::atomic<int>> m_seqnum_map;
 		Logger					*m_logger;
 		pid_t					m_pid;
 		bool					m_streaming;
 		int					m_stream;
+		ReadingRing				*m_ring;
 		uint32_t				m_readingBlock;
+		std::mutex				m_streamMutex;
+		std::deque<StreamBlock>			m_streamPending;
+		time_t					m_streamRetry;
+		std::mutex				m_asyncMutex;
+		std::condition_variable			m_asyncCV;
+		std::deque<std::function<void()> >	m_asyncQueue;
+		std::vector<std::thread>		m_asyncThreads;
+		bool					m_asyncRunning;
 };
 
 #endif
@@ -0,0 +1,129 @@
+#ifndef _UNIX_SOCKET_H
+#define _UNIX_SOCKET_H
+/*
+ * Fledge Unix domain socket naming.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define UNIX_SOCKET_DIR		"/var/run/sockets"
+#define UNIX_SOCKET_PREFIX	"fledge."
+
+/**
+ * Return the directory of the Unix domain sockets of the services,
+ * $FLEDGE_DATA/var/run/sockets. The directory is only accessible by the
+ * user Fledge runs as, so that other users of the host can not connect
+ * to the services through it.
+ *
+ * @return	The directory of the Unix domain sockets
+ */
+inline std::string unixSocketDirectory()
+{
+	const char *data = getenv("FLEDGE_DATA");
+	if (data)
+	{
+		return std::string(data) + UNIX_SOCKET_DIR;
+	}
+	const char *root = getenv("FLEDGE_ROOT");
+	return std::string(root ? root : "/usr/local/fledge") + "/data" UNIX_SOCKET_DIR;
+}
+
+/**
+ * Return the path of the Unix domain socket on which a service listening
+ * on the given TCP port also accepts connections. An empty string is
+ * returned if the path is too long for a Unix domain socket.
+ *
+ * @param port	The TCP port of the service
+ * @return	The path of the Unix domain socket or an empty string
+ */
+inline std::string unixSocketName(unsigned short port)
+{
+	std::string name = unixSocketDirectory() + "/" UNIX_SOCKET_PREFIX + std::to_string(port);
+	if (name.length() >= sizeof(((struct sockaddr_un *)0)->sun_path))
+	{
+		return std::string();
+	}
+	return name;
+}
+
+/**
+ * Return the path of the Unix domain socket a service listening on the
+ * given TCP port should bind. The directory of the sockets is created
+ * if need be with access for its owner only, and a socket left behind
+ * by a service that has exited is removed. An empty string is returned
+ * if the directory is owned by another user, in which case the service
+ * only listens on its TCP port.
+ *
+ * @param port	The TCP port of the service
+ * @return	The path of the Unix domain socket or an empty string
+ */
+inline std::string unixSocketListenName(unsigned short port)
+{
+	std::string name = unixSocketName(port);
+	if (name.empty())
+	{
+		return name;
+	}
+	std::string dir = unixSocketDirectory();
+	for (size_t pos = dir.find('/', 1); pos != std::string::npos; pos = dir.find('/', pos + 1))
+	{
+		mkdir(dir.substr(0, pos).c_str(), 0755);
+	}
+	if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+	{
+		return std::string();
+	}
+
+	struct stat st;
+	if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid())
+	{
+		return std::string();
+	}
+	if ((st.st_mode & 0077) != 0 && chmod(dir.c_str(), 0700) != 0)
+	{
+		return std::string();
+	}
+	unlink(name.c_str());
+	return name;
+}
+
+/**
+ * Return the Unix domain socket to try when connecting to a service.
+ * Only services on this host are reachable via a Unix domain socket,
+ * an empty string is returned for other hosts.
+ *
+ * @param host	The host name or address of the service
+ * @param port	The TCP port of the service
+ * @return	The path of the Unix domain socket or an empty string
+ */
+inline std::string unixSocketFor(const std::string& host, unsigned short port)
+{
+	char hostname[HOST_NAME_MAX + 1];
+
+	if (host.compare("localhost") == 0 || host.compare(0, 4, "127.") == 0
+			|| host.compare("::1") == 0)
+	{
+		return unixSocketName(port);
+	}
+	if (gethostname(hostname, sizeof(hostname)) == 0)
+	{
+		hostname[HOST_NAME_MAX] = 0;
+		if (host.compare(hostname) == 0)
+		{
+			return unixSocketName(port);
+		}
+	}
+	return std::string();
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <rapidjson/document.h>
 #include <service_record.h>
 #include <string_utils.h>
+#include <unix_socket.h>
 #include <asset_tracking.h>
 
 using namespace std;
@@ -29,6 +30,7 @@ ostringstream urlbase;
 
 	m_logger = Logger::getLogger();
 	m_urlbase << hostname << ":" << port;
+	m_unixSocket = unixSocketFor(hostname, port);
 }
 
 /**
@@ -69,6 +71,8 @@ HttpClient *ManagementClient::getHttpClient() {
 
 		// Adding a new HttpClient
 		client = new HttpClient(m_urlbase.str());
+		// Prefer the Unix domain socket of a local core, falls back to TCP
+		client->config.local_socket = m_unixSocket;
 		m_client_map[thread_id] = client;
 	}
 	else
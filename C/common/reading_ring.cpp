@@ -0,0 +1,340 @@
+/*
+ * Fledge shared memory reading ring.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <reading_ring.h>
+#include <logger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <new>
+
+using namespace std;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The reading ring requires lock free 64 bit atomics");
+
+#define RING_HEADER_SIZE	4096	// Header space, keeps the data area page aligned
+
+/**
+ * Construct an empty reading ring, call create or attach to set it up
+ */
+ReadingRing::ReadingRing() : m_header(NULL), m_data(NULL), m_mapSize(0), m_size(0), m_mask(0),
+	m_pending(0), m_memFd(-1), m_dataEvent(-1), m_spaceEvent(-1)
+{
+}
+
+/**
+ * Unmap the shared memory and close the descriptors
+ */
+ReadingRing::~ReadingRing()
+{
+	if (m_header)
+	{
+		munmap(m_header, m_mapSize);
+	}
+	if (m_memFd != -1)
+	{
+		close(m_memFd);
+	}
+	if (m_dataEvent != -1)
+	{
+		close(m_dataEvent);
+	}
+	if (m_spaceEvent != -1)
+	{
+		close(m_spaceEvent);
+	}
+}
+
+/**
+ * Create the shared memory segment and eventfds as the producer
+ * side of the ring.
+ *
+ * @param size	The size of the data area, must be a power of two
+ * @return bool	True if the ring was created
+ */
+bool ReadingRing::create(size_t size)
+{
+	if (size == 0 || (size & (size - 1)) != 0)
+	{
+		Logger::getLogger()->error("Reading ring size %ld is not a power of two", size);
+		return false;
+	}
+	if ((m_memFd = memfd_create("fledge-readings", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+	{
+		Logger::getLogger()->warn("Unable to create shared memory for reading ring: %s", strerror(errno));
+		return false;
+	}
+	if (ftruncate(m_memFd, (off_t)(RING_HEADER_SIZE + size)) == -1)
+	{
+		Logger::getLogger()->warn("Unable to size shared memory for reading ring: %s", strerror(errno));
+		return false;
+	}
+	// Neither side can change the size of the segment once it is mapped
+	if (fcntl(m_memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+	{
+		Logger::getLogger()->warn("Unable to seal shared memory for reading ring: %s", strerror(errno));
+		return false;
+	}
+	if ((m_dataEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1
+			|| (m_spaceEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+	{
+		Logger::getLogger()->warn("Unable to create events for reading ring: %s", strerror(errno));
+		return false;
+	}
+	if (!map(RING_HEADER_SIZE + size))
+	{
+		return false;
+	}
+	new (m_header) RDSRingHeader;
+	m_header->magic = RDS_RING_MAGIC;
+	m_header->headerSize = RING_HEADER_SIZE;
+	m_header->size = size;
+	m_header->head.store(0);
+	m_header->tail.store(0);
+	m_header->consumerWaiting.store(0);
+	m_header->producerWaiting.store(0);
+	m_size = size;
+	m_mask = size - 1;
+	return true;
+}
+
+/**
+ * Attach to a ring created by another process as the consumer.
+ * The ring takes ownership of the descriptors. The shared memory must
+ * be sealed against shrinking, so that the producer can not truncate
+ * it while it is mapped.
+ *
+ * @param memFd		The shared memory descriptor
+ * @param dataEvent	The eventfd signalled when data is written
+ * @param spaceEvent	The eventfd signalled when space is freed
+ * @return bool		True if the ring is valid
+ */
+bool ReadingRing::attach(int memFd, int dataEvent, int spaceEvent)
+{
+struct stat	st;
+
+	m_memFd = memFd;
+	m_dataEvent = dataEvent;
+	m_spaceEvent = spaceEvent;
+	if (fstat(m_memFd, &st) == -1 || st.st_size < RING_HEADER_SIZE)
+	{
+		Logger::getLogger()->error("Reading ring shared memory is invalid");
+		return false;
+	}
+	int seals = fcntl(m_memFd, F_GET_SEALS);
+	if (seals == -1 || (seals & F_SEAL_SHRINK) == 0)
+	{
+		Logger::getLogger()->error("Reading ring shared memory is not sealed");
+		return false;
+	}
+	if (!map((size_t)st.st_size))
+	{
+		return false;
+	}
+	uint64_t size = m_header->size;
+	if (m_header->magic != RDS_RING_MAGIC || m_header->headerSize != RING_HEADER_SIZE
+			|| size == 0 || (size & (size - 1)) != 0
+			|| RING_HEADER_SIZE + size > (uint64_t)st.st_size)
+	{
+		Logger::getLogger()->error("Reading ring header is invalid");
+		return false;
+	}
+	m_size = size;
+	m_mask = size - 1;
+	return true;
+}
+
+/**
+ * Map the shared memory segment
+ *
+ * @param length	The length of the segment
+ */
+bool ReadingRing::map(size_t length)
+{
+	void *addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, m_memFd, 0);
+	if (addr == MAP_FAILED)
+	{
+		Logger::getLogger()->error("Unable to map reading ring: %s", strerror(errno));
+		return false;
+	}
+	m_header = (RDSRingHeader *)addr;
+	m_data = (char *)addr + RING_HEADER_SIZE;
+	m_mapSize = length;
+	return true;
+}
+
+/**
+ * Write a record to the ring, waiting for space if the ring is full.
+ *
+ * @param data		The record to write
+ * @param length	The length of the record
+ * @param timeout	Milliseconds to wait for space
+ * @return bool		False if the record does not fit or the wait timed out
+ */
+bool ReadingRing::write(const char *data, uint32_t length, int timeout)
+{
+	uint64_t need = sizeof(uint32_t) + length;
+	if (need > m_size)
+	{
+		Logger::getLogger()->error("Record of %d bytes is too large for the reading ring", length);
+		return false;
+	}
+	uint64_t head = m_header->head.load(memory_order_relaxed);
+	while (m_size - (head - m_header->tail.load()) < need)
+	{
+		m_header->producerWaiting.store(1);
+		if (m_size - (head - m_header->tail.load()) >= need)
+		{
+			break;
+		}
+		struct pollfd pfd;
+		pfd.fd = m_spaceEvent;
+		pfd.events = POLLIN;
+		int rval = poll(&pfd, 1, timeout);
+		if (rval == 0)
+		{
+			return false;
+		}
+		uint64_t count;
+		if (rval > 0 && read(m_spaceEvent, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		{
+			return false;
+		}
+	}
+	copyIn(head, &length, sizeof(length));
+	copyIn(head + sizeof(length), data, length);
+	m_header->head.store(head + need);
+	if (m_header->consumerWaiting.exchange(0))
+	{
+		signal(m_dataEvent);
+	}
+	return true;
+}
+
+/**
+ * Return a copy of the next record in the ring. The record remains in
+ * the ring until consume is called, allowing it to be recovered if the
+ * consumer fails before it has been processed.
+ *
+ * @param record	The record that was read
+ * @return bool		False if the ring is empty
+ */
+bool ReadingRing::next(string& record)
+{
+	uint64_t tail = m_header->tail.load(memory_order_relaxed);
+	uint64_t avail = m_header->head.load() - tail;
+	uint32_t length;
+
+	if (avail == 0)
+	{
+		return false;
+	}
+	copyOut(tail, &length, sizeof(length));
+	if (avail > m_size || avail < sizeof(length) + (uint64_t)length)
+	{
+		Logger::getLogger()->error("Reading ring is corrupt, %ld bytes available for a record of %d bytes",
+				avail, length);
+		return false;
+	}
+	record.resize(length);
+	copyOut(tail + sizeof(length), &record[0], length);
+	m_pending = sizeof(length) + length;
+	return true;
+}
+
+/**
+ * Remove the record returned by next from the ring
+ */
+void ReadingRing::consume()
+{
+	m_header->tail.store(m_header->tail.load(memory_order_relaxed) + m_pending);
+	m_pending = 0;
+	if (m_header->producerWaiting.exchange(0))
+	{
+		signal(m_spaceEvent);
+	}
+}
+
+/**
+ * Called by the consumer before waiting on the data event. The producer
+ * will signal the data event when it next writes a record.
+ *
+ * @return bool		True if the ring is empty and the consumer may wait
+ */
+bool ReadingRing::idle()
+{
+	m_header->consumerWaiting.store(1);
+	return m_header->head.load() == m_header->tail.load();
+}
+
+/**
+ * Clear the data event once the consumer has been woken
+ */
+void ReadingRing::clearEvent()
+{
+	uint64_t count;
+	while (read(m_dataEvent, &count, sizeof(count)) == sizeof(count))
+		;
+}
+
+/**
+ * Signal an eventfd
+ *
+ * @param fd	The eventfd to signal
+ */
+void ReadingRing::signal(int fd)
+{
+	uint64_t one = 1;
+	if (::write(fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN)
+	{
+		Logger::getLogger()->warn("Failed to signal reading ring event: %s", strerror(errno));
+	}
+}
+
+/**
+ * Copy data into the ring at the given position, wrapping
+ * at the end of the data area.
+ */
+void ReadingRing::copyIn(uint64_t position, const void *data, size_t length)
+{
+	size_t offset = position & m_mask;
+	size_t first = m_size - offset;
+	if (first >= length)
+	{
+		memcpy(m_data + offset, data, length);
+	}
+	else
+	{
+		memcpy(m_data + offset, data, first);
+		memcpy(m_data, (const char *)data + first, length - first);
+	}
+}
+
+/**
+ * Copy data out of the ring from the given position, wrapping
+ * at the end of the data area.
+ */
+void ReadingRing::copyOut(uint64_t position, void *data, size_t length)
+{
+	size_t offset = position & m_mask;
+	size_t first = m_size - offset;
+	if (first >= length)
+	{
+		memcpy(data, m_data + offset, length);
+	}
+	else
+	{
+		memcpy(data, m_data + offset, first);
+		memcpy((char *)data + first, m_data, length - first);
+	}
+}
@@ -15,6 +15,7 @@
 #include <time.h>
 #include <stdlib.h>
 #include <logger.h>
+#include <algorithm>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -209,6 +210,18 @@ ReadingSet::clear()
 	m_readings.clear();
 }
 
+/**
+ * Remove the NULL pointers left in the vector by readings
+ * that have been deleted in place and update the count
+ */
+void
+ReadingSet::compact()
+{
+	m_readings.erase(remove(m_readings.begin(), m_readings.end(), (Reading *)NULL),
+			 m_readings.end());
+	m_count = m_readings.size();
+}
+
 /**
  * Construct a reading from a JSON document
  *
@@ -13,6 +13,8 @@
 #include <reading_stream.h>
 #include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
 #include <service_record.h>
 #include <string>
 #include <sstream>
@@ -20,7 +22,11 @@
 #include <thread>
 #include <map>
 #include <string_utils.h>
+#include <unix_socket.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <errno.h>
 
 #define INSTRUMENT	0
@@ -39,19 +45,24 @@ std::mutex sto_mtx_client_map;
 /**
  * Storage Client constructor
  */
-StorageClient::StorageClient(const string& hostname, const unsigned short port) : m_streaming(false)
+StorageClient::StorageClient(const string& hostname, const unsigned short port) :
+	m_streaming(false), m_stream(-1), m_ring(NULL), m_readingBlock(0), m_streamRetry(0),
+	m_asyncRunning(true)
 {
 	m_host = hostname;
 	m_pid = getpid();
 	m_logger = Logger::getLogger();
 	m_urlbase << hostname << ":" << port;
+	m_unixSocket = unixSocketFor(hostname, port);
 }
 
 /**
  * Storage Client constructor
  * stores the provided HttpClient into the map
  */
-StorageClient::StorageClient(HttpClient *client) : m_streaming(false)
+StorageClient::StorageClient(HttpClient *client) :
+	m_streaming(false), m_stream(-1), m_ring(NULL), m_readingBlock(0), m_streamRetry(0),
+	m_asyncRunning(true)
 {
 
 	std::thread::id thread_id = std::this_thread::get_id();
@@ -63,12 +74,33 @@ StorageClient::StorageClient(HttpClient *client) : m_streaming(false)
 
 
 /**
- * Destructor for storage client
+ * Destructor for storage client. Any blocks still in flight on
+ * a reading stream are waited for, or sent via the HTTP interface,
+ * before the stream is closed.
  */
 StorageClient::~StorageClient()
 {
 	std::map<std::thread::id, HttpClient *>::iterator item;
 
+	asyncShutdown();
+
+	{
+		lock_guard<mutex> guard(m_streamMutex);
+		if (m_streaming)
+		{
+			// Let the storage service know nothing more will be sent
+			shutdown(m_stream, SHUT_WR);
+			while (!m_streamPending.empty() && processStreamAcks(true))
+				;
+			closeStream();
+		}
+		if (!streamFallback())
+		{
+			m_logger->error("Failed to append %d blocks of readings held from the reading stream",
+					m_streamPending.size());
+		}
+	}
+
 	// Deletes all the HttpClient objects created in the map
 	for (item  = m_client_map.begin() ; item  != m_client_map.end() ; ++item)
 	{
@@ -94,6 +126,8 @@ HttpClient *StorageClient::getHttpClient(void) {
 
 		// Adding a new HttpClient
 		client = new HttpClient(m_urlbase.str());
+		// Prefer the Unix domain socket of a local storage service, falls back to TCP
+		client->config.local_socket = m_unixSocket;
 		m_client_map[thread_id] = client;
 		m_seqnum_map[thread_id].store(0);
 		std::ostringstream ss;
@@ -137,37 +171,110 @@ bool StorageClient::readingAppend(Reading& reading)
 /**
  * Append multiple readings
  *
- * TODO implement a mechanism to force streamed or non-streamed mode
+ * If the rate at which readings are being appended exceeds STREAM_THRESHOLD
+ * readings per second the client will switch to using a reading stream to
+ * the storage service, avoiding the overhead of an HTTP request and JSON
+ * document per block. Should the stream fail the HTTP interface is used
+ * and stream mode is not retried for STREAM_RETRY_TIME seconds.
+ *
+ * @param readings	The readings to append
+ * @return bool		True if the readings were appended
  */
 bool StorageClient::readingAppend(const vector<Reading *>& readings)
 {
-#if INSTRUMENT
-	struct timeval	start, t1, t2;
-#endif
-	if (m_streaming)
+	if (!flushStreamPending())
+	{
+		return false;
+	}
+	if (useStream(readings))
 	{
 		return streamReadings(readings);
 	}
+	return postReadings(readingsPayload(readings), readings.size());
+}
+
+/**
+ * Check if a block of readings should be sent via a reading stream,
+ * switching to stream mode if the rate at which readings are being
+ * appended is above the stream threshold. The stream mode is checked
+ * and changed under the stream mutex, as streamReadings uses it.
+ *
+ * @param readings	The readings that are about to be appended
+ * @return bool		True if the readings should be streamed
+ */
+bool StorageClient::useStream(const vector<Reading *>& readings)
+{
+	lock_guard<mutex> guard(m_streamMutex);
+	if (m_streaming)
+	{
+		return true;
+	}
 	// See if we should switch to stream mode
-	struct timeval tmFirst, tmLast, dur;
-	readings[0]->getUserTimestamp(&tmFirst);
-	readings[readings.size()-1]->getUserTimestamp(&tmLast);
-	timersub(&tmLast, &tmFirst, &dur);
-	double timeSpan = dur.tv_sec + ((double)dur.tv_usec / 1000000);
-	double rate = (double)readings.size() / timeSpan;
-	// Stream functionality disabled
-	// if (rate > STREAM_THRESHOLD)
-	if (0)
+	if (readings.size() > 1 && time(0) >= m_streamRetry)
+	{
+		struct timeval tmFirst, tmLast, dur;
+		readings[0]->getUserTimestamp(&tmFirst);
+		readings[readings.size()-1]->getUserTimestamp(&tmLast);
+		timersub(&tmLast, &tmFirst, &dur);
+		double timeSpan = dur.tv_sec + ((double)dur.tv_usec / 1000000);
+		if (timeSpan < 0)
+		{
+			timeSpan = -timeSpan;
+		}
+		// Readings that share a timestamp are treated as arriving within one second
+		double rate = (double)readings.size() / (timeSpan > 0 ? timeSpan : 1.0);
+		if (rate > STREAM_THRESHOLD)
+		{
+			m_logger->info("Reading rate %.1f readings per second above threshold, attempting to switch to stream mode", rate);
+			if (openStream())
+			{
+				m_logger->info("Successfully switched to stream mode for readings");
+				return true;
+			}
+			m_logger->warn("Failed to switch to streaming mode, will retry in %d seconds", STREAM_RETRY_TIME);
+			m_streamRetry = time(0) + STREAM_RETRY_TIME;
+		}
+	}
+	return false;
+}
+
+/**
+ * Create the JSON payload used to append a block of readings
+ *
+ * @param readings	The readings to append
+ * @return string	The JSON payload
+ */
+string StorageClient::readingsPayload(const vector<Reading *>& readings)
+{
+	ostringstream convert;
+	convert << "{ \"readings\" : [ ";
+	for (vector<Reading *>::const_iterator it = readings.cbegin();
+					 it != readings.cend(); ++it)
 	{
-		m_logger->info("Reading rate %.1f readings per second above threshold, attmempting to switch to stream mode", rate);
-		if (openStream())
+		if (it != readings.cbegin())
 		{
-			m_logger->info("Successfully switch to stream mode for readings");
-			return streamReadings(readings);
+			convert << ", ";
 		}
-		m_logger->warn("Failed to switch to streaming mode");
+		convert << (*it)->toJSON();
 	}
-	static HttpClient *httpClient = this->getHttpClient(); // to initialize m_seqnum_map[thread_id] for this thread
+	convert << " ] }";
+	return convert.str();
+}
+
+/**
+ * Send a JSON payload of readings to the storage service
+ *
+ * @param payload	The JSON payload created by readingsPayload
+ * @param count		The number of readings in the payload
+ * @return bool		True if the readings were appended
+ */
+bool StorageClient::postReadings(const string& payload, size_t count)
+{
+#if INSTRUMENT
+	struct timeval	start, end;
+#endif
+	// Initialises m_seqnum_map[thread_id] before it is used, this may be a new asynchronous I/O thread
+	HttpClient *httpClient = this->getHttpClient();
 	try {
 		std::thread::id thread_id = std::this_thread::get_id();
 		ostringstream ss;
@@ -181,38 +288,19 @@ bool StorageClient::readingAppend(const vector<Reading *>& readings)
 #if INSTRUMENT
 		gettimeofday(&start, NULL);
 #endif
-		ostringstream convert;
-		convert << "{ \"readings\" : [ ";
-		for (vector<Reading *>::const_iterator it = readings.cbegin();
-						 it != readings.cend(); ++it)
-		{
-			if (it != readings.cbegin())
-			{
-				convert << ", ";
-			}
-			convert << (*it)->toJSON();
-		}
-		convert << " ] }";
-#if INSTRUMENT
-		gettimeofday(&t1, NULL);
-#endif
-		auto res = this->getHttpClient()->request("POST", "/storage/reading", convert.str(), headers);
+		auto res = httpClient->request("POST", "/storage/reading", payload, headers);
 #if INSTRUMENT
-		gettimeofday(&t2, NULL);
+		gettimeofday(&end, NULL);
 #endif
 		if (res->status_code.compare("200 OK") == 0)
 		{
 #if INSTRUMENT
 			struct timeval tm;
-			timersub(&t1, &start, &tm);
-			double buildTime, requestTime;
-			buildTime = tm.tv_sec + ((double)tm.tv_usec / 1000000);
-			timersub(&t2, &t1, &tm);
-			requestTime = tm.tv_sec + ((double)tm.tv_usec / 1000000);
-			m_logger->info("Appended %d readings in %.3f seconds. Took %.3f seconds to build request", readings.size(), requestTime, buildTime);
-			m_logger->info("%.1f Readings per second, request building %.2f%% of time", readings.size() / (buildTime + requestTime),
-					(buildTime * 100) / (requestTime + buildTime));
-			m_logger->info("Request block size %dK", strlen(convert.str().c_str())/1024);
+			timersub(&end, &start, &tm);
+			double requestTime = tm.tv_sec + ((double)tm.tv_usec / 1000000);
+			m_logger->info("Appended %d readings in %.3f seconds", count, requestTime);
+			m_logger->info("%.1f Readings per second", count / requestTime);
+			m_logger->info("Request block size %dK", payload.length() / 1024);
 #endif
 			return true;
 		}
@@ -407,13 +495,22 @@ PurgeResult StorageClient::readingPurgeBySize(unsigned long size, unsigned long
  */
 ResultSet *StorageClient::queryTable(const std::string& tableName, const Query& query)
 {
-	try {
-		ostringstream convert;
+	return queryTablePayload(tableName, query.toJSON());
+}
 
-		convert << query.toJSON();
+/**
+ * Query a table using a query that has already been converted to JSON
+ *
+ * @param tablename	The name of the table to query
+ * @param payload	The JSON query payload
+ * @return ResultSet*	The resultset of the query
+ */
+ResultSet *StorageClient::queryTablePayload(const std::string& tableName, const std::string& payload)
+{
+	try {
 		char url[128];
 		snprintf(url, sizeof(url), "/storage/table/%s/query", tableName.c_str());
-		auto res = this->getHttpClient()->request("PUT", url, convert.str());
+		auto res = this->getHttpClient()->request("PUT", url, payload);
 		ostringstream resultPayload;
 		resultPayload << res->content.rdbuf();
 		if (res->status_code.compare("200 OK") == 0)
@@ -1048,7 +1145,14 @@ bool StorageClient::unregisterAssetNotification(const string& assetName,
 	}
 	return false;
 }
-
+/**
+ * Request a reading stream from the storage service and connect
+ * to it. The storage service returns the port to connect to and a
+ * single use token that must be sent once the connection is made.
+ * Called with the stream mutex held, as is every use of the stream.
+ *
+ * @return bool		True if the stream was created and connected
+ */
 bool StorageClient::openStream()
 {
 	try {
@@ -1082,37 +1186,52 @@ bool StorageClient::openStream()
 			}
 		       	port = doc["port"].GetInt();
 			token = doc["token"].GetInt();
-			if ((m_stream = socket(AF_INET, SOCK_STREAM, 0)) == -1)
-        		{
-				m_logger->error("Unable to create socket");
-				return false;
-			}
-			struct sockaddr_in serv_addr;
-			hostent *server;
-			if ((server = gethostbyname(m_host.c_str())) == NULL)
+			if (!m_unixSocket.empty() && connectUnixStream(port))
 			{
-				m_logger->error("Unable to resolve hostname for reading stream: %s", m_host.c_str());
-				return false;
+				m_logger->debug("Connected to reading stream via Unix domain socket");
+				// The storage service is local, pass readings via shared memory
+				m_ring = new ReadingRing();
+				if (!m_ring->create())
+				{
+					delete m_ring;
+					m_ring = NULL;
+				}
 			}
-			bzero((char *) &serv_addr, sizeof(serv_addr));
-			serv_addr.sin_family = AF_INET;
-			bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
-			serv_addr.sin_port = htons(port);
-			if (connect(m_stream, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0)
+			else
 			{
-				Logger::getLogger()->warn("Unable to connect to storage streaming server: %s, %d", m_host.c_str(), port);
-				return false;
+				if ((m_stream = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+				{
+					m_logger->error("Unable to create socket");
+					return false;
+				}
+				struct sockaddr_in serv_addr;
+				hostent *server;
+				if ((server = gethostbyname(m_host.c_str())) == NULL)
+				{
+					m_logger->error("Unable to resolve hostname for reading stream: %s", m_host.c_str());
+					closeStream();
+					return false;
+				}
+				bzero((char *) &serv_addr, sizeof(serv_addr));
+				serv_addr.sin_family = AF_INET;
+				bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
+				serv_addr.sin_port = htons(port);
+				if (connect(m_stream, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0)
+				{
+					Logger::getLogger()->warn("Unable to connect to storage streaming server: %s, %d", m_host.c_str(), port);
+					closeStream();
+					return false;
+				}
 			}
-			RDSConnectHeader conhdr;
-			conhdr.magic = RDS_CONNECTION_MAGIC;
-			conhdr.token = token;
-			if (write(m_stream, &conhdr, sizeof(conhdr)) != sizeof(conhdr))
+			if (!sendConnectHeader(token))
 			{
 				Logger::getLogger()->warn("Failed to write connection header: %s", strerror(errno));
+				closeStream();
 				return false;
 			}
 			m_streaming = true;
-			m_logger->info("Storage stream succesfully created");
+			m_logger->info("Storage stream succesfully created%s",
+					m_ring ? " using shared memory" : "");
 			return true;
 		}
 		ostringstream resultPayload;
@@ -1122,162 +1241,874 @@ bool StorageClient::openStream()
 	} catch (exception& ex) {
 		m_logger->error("Failed to create reading stream: %s", ex.what());
 	}
-	m_logger->error("Fallen through!");
 	return false;
 }
 
+/**
+ * Connect to the Unix domain socket of a reading stream. The storage
+ * service listens on a Unix domain socket named after the stream port,
+ * in the sockets directory of Fledge, as well as on the port itself.
+ *
+ * @param port		The port of the stream
+ * @return bool		True if the stream is connected
+ */
+bool StorageClient::connectUnixStream(int port)
+{
+	struct sockaddr_un addr;
+	string name = unixSocketName(port);
+
+	if (name.empty())
+	{
+		return false;
+	}
+	if ((m_stream = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	{
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, name.data(), name.length());
+	if (connect(m_stream, (struct sockaddr *)&addr,
+			offsetof(struct sockaddr_un, sun_path) + name.length()) < 0)
+	{
+		closeStream();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Send the connection header for a stream. If the stream uses a
+ * shared memory ring the descriptors of the ring are passed with
+ * the header.
+ *
+ * @param token		The token returned when the stream was created
+ * @return bool		True if the header was sent
+ */
+bool StorageClient::sendConnectHeader(uint32_t token)
+{
+	RDSConnectHeader conhdr;
+	conhdr.magic = m_ring ? RDS_RING_CONNECTION_MAGIC : RDS_CONNECTION_MAGIC;
+	conhdr.token = token;
+
+	struct iovec iov;
+	iov.iov_base = &conhdr;
+	iov.iov_len = sizeof(conhdr);
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	int fds[3];
+	char control[CMSG_SPACE(sizeof(fds))];
+	if (m_ring)
+	{
+		fds[0] = m_ring->memFd();
+		fds[1] = m_ring->dataEvent();
+		fds[2] = m_ring->spaceEvent();
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	}
+	return sendmsg(m_stream, &msg, MSG_NOSIGNAL) == sizeof(conhdr);
+}
+
+/**
+ * Close the reading stream. Blocks that have not been acknowledged
+ * remain queued so they may be resent or sent via the HTTP interface.
+ * Called with the stream mutex held.
+ */
+void StorageClient::closeStream()
+{
+	if (m_stream != -1)
+	{
+		close(m_stream);
+		m_stream = -1;
+	}
+	if (m_ring)
+	{
+		delete m_ring;
+		m_ring = NULL;
+	}
+	m_streaming = false;
+}
+
 /**
  * Stream a set of readings to the storage service.
  *
- * TODO Deal with acknowledgements, add error checking/recovery
+ * The readings are serialised into a single block which is retained
+ * until the storage service acknowledges it. Up to STREAM_ACK_WINDOW
+ * blocks may be in flight at any time. The storage service also
+ * acknowledges each chunk of a large block as it is committed. If the
+ * stream fails the client will reconnect and resend the readings that
+ * were not acknowledged, if that is not possible they are sent via the
+ * HTTP interface instead.
+ *
+ * Should the HTTP interface also fail the blocks are held by the client
+ * and appended before any later readings. If none of the readings
+ * passed to this call were stored false is returned and the caller
+ * retains them, otherwise the rest of the block is held with the others.
+ *
+ * When the stream uses a shared memory ring the block is written to the
+ * ring rather than the socket. Blocks the storage service has not yet
+ * consumed from the ring are recovered if the stream fails. A block too
+ * large for the ring is sent via the HTTP interface on its own, without
+ * touching the ring.
  *
  * @param readings	The readings to stream
- * @return bool		True if the readings have been sent
+ * @return bool		True if the readings have been sent or are held
  */
 bool StorageClient::streamReadings(const std::vector<Reading *> & readings)
 {
 RDSBlockHeader   		blkhdr;
-RDSReadingHeader 		rdhdrs[STREAM_BLK_SIZE];
-register RDSReadingHeader	*phdr;
-struct { const void *iov_base; size_t iov_len;} iovs[STREAM_BLK_SIZE * 4], *iovp;
-string				payloads[STREAM_BLK_SIZE];
-struct timeval			tm[STREAM_BLK_SIZE];
-ssize_t				n, length = 0;
+RDSReadingHeader 		rdhdr;
+struct timeval			tm;
+size_t				sent = 0;
 string				lastAsset;
+bool				ok = true;
 
-
+	lock_guard<mutex> guard(m_streamMutex);
 	if (!m_streaming)
 	{
 		return false;
 	}
 
 	/*
-	 * Assemble and write the block header. This header contains information
+	 * Assemble the block header. This header contains information
 	 * to synchronise the blocks of data and also the number of readings
 	 * to expect within the block.
 	 */
 	blkhdr.magic = RDS_BLOCK_MAGIC;
 	blkhdr.blockNumber = m_readingBlock++;
 	blkhdr.count = readings.size();
-	if ((n = write(m_stream, &blkhdr, sizeof(blkhdr))) != sizeof(blkhdr))
-	{
-		if (errno == EPIPE || errno == ECONNRESET)
-		{
-			Logger::getLogger()->warn("Storage service has closed stream unexpectedly");
-			m_streaming = false;
-		}
-		else
-		{
-			Logger::getLogger()->error("Failed to write block header: %s", sys_errlist[errno]);
-		}
-		return false;
-	}
+	m_streamPending.emplace_back(blkhdr.blockNumber);
+	string& block = m_streamPending.back().m_data;
+	block.append((const char *)&blkhdr, sizeof(blkhdr));
 
 	/*
-	 * Use the writev scatter/gather interface to send the reading headers and reading data.
-	 * We sent chunks of data in order to allow the parallel sendign and unpacking process
-	 * at the two ends. The chunk size is STREAM_BLK_SIZE readings.
+	 * Serialise the reading headers and reading data into the block.
+	 * We send chunks of data in order to allow the parallel sending and
+	 * unpacking process at the two ends. The chunk size is STREAM_BLK_SIZE
+	 * readings.
 	 */
-	iovp = iovs;
-	phdr = rdhdrs;
-	int offset = 0;
 	for (int i = 0; i < readings.size(); i++)
 	{
-		phdr->magic = RDS_READING_MAGIC;
-		phdr->readingNo = i;
-		string assetCode = readings[i]->getAssetName();
+		rdhdr.magic = RDS_READING_MAGIC;
+		rdhdr.readingNo = i;
+		const string& assetCode = readings[i]->getAssetName();
 		if (i > 0 && assetCode.compare(lastAsset) == 0)
 		{
 			// Asset name is unchanged so don't send it
-			phdr->assetLength = 0;
+			rdhdr.assetLength = 0;
 		}
 		else
 		{
 			// Asset name has changed or this is the first asset in the block
 			lastAsset = assetCode;
-			phdr->assetLength = assetCode.length() + 1;
+			rdhdr.assetLength = assetCode.length() + 1;
+		}
+
+		// Always generate the JSON variant of the data points and send
+		string payload = readings[i]->getDatapointsJSON();
+		rdhdr.payloadLength = payload.length() + 1;
+
+		block.append((const char *)&rdhdr, sizeof(rdhdr));
+		readings[i]->getUserTimestamp(&tm);
+		block.append((const char *)&tm, sizeof(tm));
+		if (rdhdr.assetLength)
+		{
+			block.append(assetCode.c_str(), rdhdr.assetLength);
+		}
+		block.append(payload.c_str(), rdhdr.payloadLength);
+
+		if (ok && !m_ring && (i + 1) % STREAM_BLK_SIZE == 0)
+		{
+			ok = sendStreamData(block.data() + sent, block.length() - sent);
+			sent = block.length();
+		}
+	}
+	if (m_ring)
+	{
+		if (!ringFits(block))
+		{
+			ok = streamBlockAppend(block);
+			m_streamPending.pop_back();
+			return ok;
+		}
+		if (ringWrite(block))
+		{
+			m_streamPending.pop_back();
+			return true;
 		}
+		recoverRing();
+		ok = false;
+	}
+	else if (ok && sent < block.length())	// Remaining data to be sent to finish the block
+	{
+		ok = sendStreamData(block.data() + sent, block.length() - sent);
+	}
+
+	if (ok)
+	{
+		// Collect acknowledgements, waiting for one if the window is full
+		ok = processStreamAcks(false);
+		while (ok && m_streamPending.size() >= STREAM_ACK_WINDOW)
+		{
+			ok = processStreamAcks(true);
+		}
+	}
+	if (ok)
+	{
+		return true;
+	}
+
+	m_logger->warn("Reading stream to the storage service has failed, attempting to reconnect");
+	closeStream();
+	if (resumeStream())
+	{
+		return true;
+	}
+	m_streamRetry = time(0) + STREAM_RETRY_TIME;
+	m_logger->warn("Unable to resume the reading stream, reverting to the HTTP interface for %d seconds",
+			STREAM_RETRY_TIME);
+	if (streamFallback())
+	{
+		return true;
+	}
+	if (!m_streamPending.empty() && m_streamPending.back().m_number == blkhdr.blockNumber
+			&& m_streamPending.back().m_stored == 0
+			&& ((const RDSBlockHeader *)m_streamPending.back().m_data.data())->count == blkhdr.count)
+	{
+		// Nothing from this block was stored, the caller keeps the readings
+		m_streamPending.pop_back();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Write data to the reading stream, handling partial writes.
+ *
+ * @param data		The data to write
+ * @param length	The number of bytes to write
+ * @return bool		True if all the data was written
+ */
+bool StorageClient::sendStreamData(const char *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t n = send(m_stream, data, length, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EPIPE || errno == ECONNRESET)
+			{
+				m_logger->warn("Storage service has closed stream unexpectedly");
+			}
+			else
+			{
+				m_logger->error("Write to reading stream failed: %s", strerror(errno));
+			}
+			return false;
+		}
+		data += n;
+		length -= n;
+	}
+	return true;
+}
+
+/**
+ * Write a block to the shared memory ring of the stream. If the ring is
+ * full the write waits for the storage service to consume blocks for as
+ * long as the stream remains connected. The block must fit in the ring.
+ *
+ * @param block		The serialised block
+ * @return bool		True if the block was written to the ring
+ */
+bool StorageClient::ringWrite(const string& block)
+{
+	if (streamClosed())
+	{
+		return false;
+	}
+	while (!m_ring->write(block.data(), block.length(), STREAM_ACK_TIMEOUT))
+	{
+		if (streamClosed())
+		{
+			return false;
+		}
+		m_logger->warn("Storage service has not consumed readings from the shared memory ring for %d ms",
+				STREAM_ACK_TIMEOUT);
+	}
+	return true;
+}
+
+/**
+ * Check if the storage service has closed the stream. The storage service
+ * sends nothing on a stream that uses a shared memory ring, so a readable
+ * socket means the connection has been closed.
+ *
+ * @return bool		True if the stream has been closed
+ */
+bool StorageClient::streamClosed()
+{
+	struct pollfd pfd;
+	pfd.fd = m_stream;
+	pfd.events = POLLIN | POLLRDHUP;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) == 0)
+	{
+		return false;
+	}
+	m_logger->warn("Storage service has closed stream unexpectedly");
+	return true;
+}
+
+/**
+ * Wait for the storage service to detach from the shared memory ring.
+ * The storage service detaches from the ring before it closes the
+ * stream, so the stream being closed acknowledges the detach.
+ *
+ * @return bool		True if the storage service has detached
+ */
+bool StorageClient::ringDetached()
+{
+	struct pollfd pfd;
+	char buf[64];
 
-		// Alwayts generate the JSON variant of the data points and send
-		payloads[offset] = readings[i]->getDatapointsJSON();
-		phdr->payloadLength = payloads[offset].length() + 1;
-
-		// Add the reading header
-		iovp->iov_base = phdr;
-		iovp->iov_len = sizeof(RDSReadingHeader);
-		length += iovp->iov_len;
-		iovp++;
-
-		// Reading user timestamp
-		readings[i]->getUserTimestamp(&tm[offset]);
-		iovp->iov_base = &tm[offset];
-		iovp->iov_len = sizeof(struct timeval);
-		length += iovp->iov_len;
-		iovp++;
-
-		// If the asset code has changed than add that
-		if (phdr->assetLength)
+	pfd.fd = m_stream;
+	pfd.events = POLLIN | POLLRDHUP;
+	while (true)
+	{
+		pfd.revents = 0;
+		int rval = poll(&pfd, 1, STREAM_ACK_TIMEOUT);
+		if (rval < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (rval <= 0)
+		{
+			return false;
+		}
+		ssize_t n = recv(m_stream, buf, sizeof(buf), MSG_DONTWAIT);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
 		{
-			iovp->iov_base = readings[i]->getAssetName().c_str();
-			iovp->iov_len = phdr->assetLength;
-			length += iovp->iov_len;
-			iovp++;
+			return true;
 		}
+	}
+}
+
+/**
+ * Recover the blocks the storage service has not consumed from the
+ * shared memory ring. They are queued ahead of any other pending blocks
+ * so they can be resent.
+ *
+ * The ring is only read once the storage service has detached from it,
+ * otherwise the blocks are left for the storage service to consume.
+ */
+void StorageClient::recoverRing()
+{
+	deque<StreamBlock> recovered;
+	string record;
+
+	if (!ringDetached())
+	{
+		m_logger->warn("Storage service has not detached from the shared memory ring, "
+				"the readings left in the ring are not recovered");
+		return;
+	}
+
+	while (m_ring->next(record))
+	{
+		const RDSBlockHeader *blkhdr = (const RDSBlockHeader *)record.data();
+		recovered.emplace_back(blkhdr->blockNumber, record);
+		m_ring->consume();
+	}
+	m_streamPending.insert(m_streamPending.begin(), recovered.begin(), recovered.end());
+}
+
+/**
+ * Process acknowledgements from the storage service. Acknowledged blocks
+ * are removed from the set of pending blocks, blocks the storage service
+ * failed to store are sent again using the HTTP interface. The chunks of
+ * a block the storage service has committed so far are recorded so they
+ * are not resent.
+ *
+ * If a block the storage service failed to store can not be sent using
+ * the HTTP interface it is held and the stream is treated as failed.
+ *
+ * @param wait		Wait for at least one acknowledgement to arrive
+ * @return bool		False if the stream has failed
+ */
+bool StorageClient::processStreamAcks(bool wait)
+{
+struct pollfd	pfd;
+int		timeout = wait ? STREAM_ACK_TIMEOUT : 0;
 
-		// Add the data points themselves
-		iovp->iov_base = payloads[offset].c_str();
-		iovp->iov_len = phdr->payloadLength;
-		length += iovp->iov_len;
-		iovp++;
+	pfd.fd = m_stream;
+	pfd.events = POLLIN;
+	while (!m_streamPending.empty())
+	{
+		pfd.revents = 0;
+		int rval = poll(&pfd, 1, timeout);
+		if (rval < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			m_logger->error("Failed to poll reading stream: %s", strerror(errno));
+			return false;
+		}
+		if (rval == 0)
+		{
+			if (timeout)
+			{
+				m_logger->warn("Timed out waiting for acknowledgement of block %d",
+						m_streamPending.front().m_number);
+				return false;
+			}
+			return true;
+		}
 
-		offset++;
-		if (offset == STREAM_BLK_SIZE - 1)
+		RDSAcknowledge ack;
+		ssize_t n = recv(m_stream, &ack, sizeof(ack), MSG_WAITALL);
+		if (n != sizeof(ack))
+		{
+			if (n == 0)
+			{
+				m_logger->warn("Storage service has closed stream unexpectedly");
+			}
+			else
+			{
+				m_logger->error("Failed to read stream acknowledgement: %s", strerror(errno));
+			}
+			return false;
+		}
+		if (ack.magic != RDS_ACK_MAGIC && ack.magic != RDS_NACK_MAGIC
+				&& ack.magic != RDS_CHUNK_MAGIC)
+		{
+			m_logger->error("Unexpected acknowledgement 0x%x on reading stream", ack.magic);
+			return false;
+		}
+		auto it = m_streamPending.begin();
+		while (it != m_streamPending.end() && it->m_number != ack.block)
+		{
+			++it;
+		}
+		if (it == m_streamPending.end())
+		{
+			m_logger->debug("Acknowledgement for unknown block %d", ack.block);
+		}
+		else if (ack.magic == RDS_CHUNK_MAGIC)
+		{
+			// Part of the block is committed, keep waiting for the rest
+			it->m_stored = ack.count;
+			continue;
+		}
+		else
 		{
-			n = writev(m_stream, (const iovec *)iovs, iovp - iovs);
-			if (n < length)
+			if (ack.magic == RDS_NACK_MAGIC)
 			{
-				if (errno == EPIPE || errno == ECONNRESET)
+				// The readings the service did store are not sent again
+				m_logger->warn("Storage service failed to store block %d after %d readings, "
+						"resending the rest via HTTP", ack.block, ack.count);
+				it->m_stored = ack.count;
+				if (!streamBlockAppend(it->m_data, it->m_stored))
 				{
-					Logger::getLogger()->error("Stream has been closed by the storage service");
-					m_streaming = false;
+					return false;
 				}
-				else
+			}
+			m_streamPending.erase(it);
+		}
+		// Only wait for the first acknowledgement, then collect what has arrived
+		timeout = 0;
+	}
+	return true;
+}
+
+/**
+ * Reconnect a reading stream that has failed and resend the blocks
+ * that had not been acknowledged. Only the readings of each block that
+ * follow the chunks the storage service acknowledged are resent.
+ *
+ * @return bool		True if the stream has been resumed
+ */
+bool StorageClient::resumeStream()
+{
+	if (!openStream())
+	{
+		return false;
+	}
+	if (m_ring)
+	{
+		while (!m_streamPending.empty())
+		{
+			StreamBlock& pending = m_streamPending.front();
+			pending.trim();
+			if (!ringFits(pending.m_data))
+			{
+				if (!streamBlockAppend(pending.m_data))
 				{
-					Logger::getLogger()->error("Write of block short, %d < %d: %s",
-							n, length, sys_errlist[errno]);
+					closeStream();
+					return false;
 				}
+			}
+			else if (!ringWrite(pending.m_data))
+			{
+				recoverRing();
+				closeStream();
 				return false;
 			}
-			else if (n > length)
-				Logger::getLogger()->fatal("Long write %d < %d", length, n);
-			offset = 0;
-			length = 0;
-			iovp = iovs;
-			phdr = rdhdrs;
+			m_streamPending.pop_front();
 		}
-		else
+		m_logger->info("Reading stream resumed using shared memory");
+		return true;
+	}
+	for (auto& pending : m_streamPending)
+	{
+		pending.trim();
+		if (!sendStreamData(pending.m_data.data(), pending.m_data.length()))
 		{
-			phdr++;
+			closeStream();
+			return false;
 		}
 	}
-	if (length)	// Remaining data to be sent to finish the block
+	bool ok = processStreamAcks(false);
+	while (ok && m_streamPending.size() >= STREAM_ACK_WINDOW)
+	{
+		ok = processStreamAcks(true);
+	}
+	if (!ok)
+	{
+		closeStream();
+		return false;
+	}
+	m_logger->info("Reading stream resumed, %d blocks resent", m_streamPending.size());
+	return true;
+}
+
+/**
+ * Send any blocks that were not acknowledged on the stream
+ * via the HTTP interface. The readings of a block the storage
+ * service has acknowledged are not sent again.
+ *
+ * A block that can not be appended is held, along with the blocks
+ * that follow it, so they are appended before any later readings.
+ *
+ * @return bool		True if all the blocks were appended
+ */
+bool StorageClient::streamFallback()
+{
+	while (!m_streamPending.empty())
 	{
-		if ((n = writev(m_stream, (const iovec *)iovs, iovp - iovs)) < length)
+		StreamBlock& pending = m_streamPending.front();
+		if (!streamBlockAppend(pending.m_data, pending.m_stored))
 		{
-			if (errno == EPIPE || errno == ECONNRESET)
+			m_logger->warn("Unable to append readings from the reading stream, "
+					"holding %d blocks of readings", m_streamPending.size());
+			return false;
+		}
+		m_streamPending.pop_front();
+	}
+	return true;
+}
+
+/**
+ * Append the blocks held after the reading stream failed using the
+ * HTTP interface. These must be stored before any later readings.
+ *
+ * @return bool		True if no blocks of readings are held
+ */
+bool StorageClient::flushStreamPending()
+{
+	lock_guard<mutex> guard(m_streamMutex);
+	if (m_streaming || m_streamPending.empty())
+	{
+		return true;
+	}
+	return streamFallback();
+}
+
+/**
+ * Remove the readings the storage service has acknowledged from the
+ * start of a block, so that only the rest of the block is resent. The
+ * remaining readings are renumbered and the first of them is given
+ * its asset code.
+ */
+void StorageClient::StreamBlock::trim()
+{
+	RDSBlockHeader	blkhdr;
+	RDSReadingHeader rdhdr;
+	const char	*asset = NULL;
+
+	if (m_stored == 0)
+	{
+		return;
+	}
+	const char *ptr = m_data.data();
+	memcpy(&blkhdr, ptr, sizeof(blkhdr));
+	ptr += sizeof(blkhdr);
+	uint32_t skip = m_stored < blkhdr.count ? m_stored : blkhdr.count;
+	for (uint32_t i = 0; i < skip; i++)
+	{
+		memcpy(&rdhdr, ptr, sizeof(rdhdr));
+		ptr += sizeof(rdhdr) + sizeof(struct timeval);
+		if (rdhdr.assetLength)
+		{
+			asset = ptr;
+		}
+		ptr += rdhdr.assetLength + rdhdr.payloadLength;
+	}
+
+	string data;
+	blkhdr.count -= skip;
+	data.append((const char *)&blkhdr, sizeof(blkhdr));
+	for (uint32_t i = 0; i < blkhdr.count; i++)
+	{
+		memcpy(&rdhdr, ptr, sizeof(rdhdr));
+		const char *body = ptr + sizeof(rdhdr) + sizeof(struct timeval);
+		uint32_t assetLength = rdhdr.assetLength;
+		rdhdr.readingNo = i;
+		if (i == 0 && assetLength == 0)
+		{
+			// The asset code was sent with a reading that has been stored
+			rdhdr.assetLength = strlen(asset) + 1;
+		}
+		data.append((const char *)&rdhdr, sizeof(rdhdr));
+		data.append(ptr + sizeof(rdhdr), sizeof(struct timeval));
+		if (rdhdr.assetLength != assetLength)
+		{
+			data.append(asset, rdhdr.assetLength);
+		}
+		data.append(body, assetLength + rdhdr.payloadLength);
+		ptr = body + assetLength + rdhdr.payloadLength;
+	}
+	m_data = data;
+	m_stored = 0;
+}
+
+/**
+ * Append a serialised stream block using the HTTP interface. The
+ * block is unpacked into the JSON document the readings endpoint
+ * expects.
+ *
+ * @param block		The serialised stream block
+ * @param skip		The number of readings at the start of the block
+ *			that have already been stored
+ * @return bool		True if the readings were appended
+ */
+bool StorageClient::streamBlockAppend(const string& block, uint32_t skip)
+{
+	const char *ptr = block.data();
+	const RDSBlockHeader *blkhdr = (const RDSBlockHeader *)ptr;
+	char	ts[60], micro_s[10];
+	string	asset;
+
+	ptr += sizeof(RDSBlockHeader);
+	if (skip >= blkhdr->count)
+	{
+		return true;
+	}
+	ostringstream convert;
+	convert << "{ \"readings\" : [ ";
+	for (uint32_t i = 0; i < blkhdr->count; i++)
+	{
+		RDSReadingHeader rdhdr;
+		struct timeval tm;
+		memcpy(&rdhdr, ptr, sizeof(rdhdr));
+		ptr += sizeof(rdhdr);
+		memcpy(&tm, ptr, sizeof(tm));
+		ptr += sizeof(tm);
+		if (rdhdr.assetLength)
+		{
+			// The asset code is sent as a JSON string
+			rapidjson::StringBuffer buffer;
+			rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+			writer.String(ptr);
+			asset = buffer.GetString();
+			ptr += rdhdr.assetLength;
+		}
+		if (i < skip)
+		{
+			ptr += rdhdr.payloadLength;
+			continue;
+		}
+		struct tm timeinfo;
+		gmtime_r(&tm.tv_sec, &timeinfo);
+		std::strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
+		snprintf(micro_s, sizeof(micro_s), ".%06lu", tm.tv_usec);
+		if (i > skip)
+		{
+			convert << ", ";
+		}
+		convert << "{\"asset_code\":" << asset;
+		convert << ",\"user_ts\":\"" << ts << micro_s << "+00:00";
+		convert << "\",\"reading\":" << ptr << "}";
+		ptr += rdhdr.payloadLength;
+	}
+	convert << " ] }";
+
+	try {
+		auto res = this->getHttpClient()->request("POST", "/storage/reading", convert.str());
+		if (res->status_code.compare("200 OK") == 0)
+		{
+			return true;
+		}
+		ostringstream resultPayload;
+		resultPayload << res->content.rdbuf();
+		handleUnexpectedResponse("Append readings", res->status_code, resultPayload.str());
+	} catch (exception& ex) {
+		m_logger->error("Failed to append readings: %s", ex.what());
+	}
+	return false;
+}
+
+/**
+ * Append a block of readings without waiting for the storage service
+ * to respond. The payload is created before the call returns, so the
+ * caller is free to delete the readings once this call returns and
+ * may build the next block whilst this one is in flight.
+ *
+ * When the client is in stream mode the readings are written to the
+ * stream by the calling thread and the returned future is already
+ * satisfied; the stream itself allows several blocks to be in flight.
+ *
+ * @param readings	The readings to append
+ * @return future	Resolves to true if the readings were appended
+ */
+future<bool> StorageClient::readingAppendAsync(const vector<Reading *>& readings)
+{
+	if (!flushStreamPending())
+	{
+		promise<bool> result;
+		result.set_value(false);
+		return result.get_future();
+	}
+	if (useStream(readings))
+	{
+		promise<bool> result;
+		result.set_value(streamReadings(readings));
+		return result.get_future();
+	}
+	auto task = make_shared<packaged_task<bool()> >(
+			bind(&StorageClient::postReadings, this, readingsPayload(readings), readings.size()));
+	future<bool> result = task->get_future();
+	asyncSubmit([task]() { (*task)(); });
+	return result;
+}
+
+/**
+ * Fetch a block of readings without waiting for the storage service
+ * to respond. Any exception raised by the fetch is rethrown when
+ * the result is retrieved from the future.
+ *
+ * @param readingId	The ID of the reading which should be the first one to send
+ * @param count		Maximum number if readings to return
+ * @return future	Resolves to the set of readings
+ */
+future<ReadingSet *> StorageClient::readingFetchAsync(const unsigned long readingId, const unsigned long count)
+{
+	auto task = make_shared<packaged_task<ReadingSet *()> >(
+			bind(&StorageClient::readingFetch, this, readingId, count));
+	future<ReadingSet *> result = task->get_future();
+	asyncSubmit([task]() { (*task)(); });
+	return result;
+}
+
+/**
+ * Query a table without waiting for the storage service to respond.
+ * The query is converted to JSON before the call returns.
+ *
+ * @param tablename	The name of the table to query
+ * @param query		The query payload
+ * @return future	Resolves to the resultset of the query
+ */
+future<ResultSet *> StorageClient::queryTableAsync(const std::string& tableName, const Query& query)
+{
+	auto task = make_shared<packaged_task<ResultSet *()> >(
+			bind(&StorageClient::queryTablePayload, this, tableName, query.toJSON()));
+	future<ResultSet *> result = task->get_future();
+	asyncSubmit([task]() { (*task)(); });
+	return result;
+}
+
+/**
+ * Queue a request for the asynchronous I/O threads. The threads are
+ * created on first use, each one has its own persistent connection
+ * to the storage service via getHttpClient.
+ *
+ * A client created with an existing HttpClient has no address with which
+ * to create further connections, the request is run by the calling thread.
+ *
+ * @param task	The request to run
+ */
+void StorageClient::asyncSubmit(const function<void()>& task)
+{
+	if (m_urlbase.str().empty())
+	{
+		task();
+		return;
+	}
+	lock_guard<mutex> guard(m_asyncMutex);
+	if (m_asyncThreads.empty())
+	{
+		for (int i = 0; i < ASYNC_THREADS; i++)
+		{
+			m_asyncThreads.push_back(thread(&StorageClient::asyncWorker, this));
+		}
+	}
+	m_asyncQueue.push_back(task);
+	m_asyncCV.notify_one();
+}
+
+/**
+ * Asynchronous I/O thread, runs queued requests until the client
+ * is shutdown and the queue has been drained.
+ */
+void StorageClient::asyncWorker()
+{
+	while (true)
+	{
+		function<void()> task;
+		{
+			unique_lock<mutex> lck(m_asyncMutex);
+			while (m_asyncRunning && m_asyncQueue.empty())
 			{
-				Logger::getLogger()->error("Stream has been closed by the storage service");
-				m_streaming = false;
+				m_asyncCV.wait(lck);
 			}
-			else
+			if (m_asyncQueue.empty())
 			{
-				Logger::getLogger()->error("Write of block short, %d < %d: %s",
-						n, length, sys_errlist[errno]);
+				return;
 			}
-			return false;
+			task = m_asyncQueue.front();
+			m_asyncQueue.pop_front();
 		}
-		else if (n > length)
-			Logger::getLogger()->fatal("Long write %d < %d", length, n);
+		task();
 	}
-	return true;
+}
+
+/**
+ * Complete any outstanding asynchronous requests and stop the I/O threads
+ */
+void StorageClient::asyncShutdown()
+{
+	{
+		lock_guard<mutex> guard(m_asyncMutex);
+		m_asyncRunning = false;
+		m_asyncCV.notify_all();
+	}
+	for (auto& t : m_asyncThreads)
+	{
+		t.join();
+	}
+	m_asyncThreads.clear();
 }
@@ -14,6 +14,17 @@
 #include <config_category.h>
 #include <filter_plugin.h>
 
+/**
+ * Filters that modify or drop readings one at a time may export,
+ * in addition to "plugin_ingest", the optional entry point
+ *
+ *	bool plugin_ingest_reading(PLUGIN_HANDLE handle, Reading *reading);
+ *
+ * The reading is modified in place and the filter returns false
+ * to remove it from the data stream. Consecutive filters in a
+ * pipeline that export it are executed in a single pass over the
+ * readings and their "plugin_ingest" entry point is not called.
+ */
 class FledgeFilter{
 	public:
 		FledgeFilter(const std::string& filterName,
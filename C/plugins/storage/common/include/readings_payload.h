@@ -0,0 +1,40 @@
+#ifndef _READINGS_PAYLOAD_H
+#define _READINGS_PAYLOAD_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <reading_batch.h>
+#include <string>
+#include <vector>
+
+/**
+ * Converts a JSON readings payload, { "readings" : [ ... ] }, into a
+ * ReadingBatch. The storage service uses it to pass the payload of an
+ * append to a plugin that supports batches, the plugins use it to append
+ * the JSON payload passed to their appendReadings as they append a batch.
+ *
+ * A copy of the payload is parsed in situ with a SAX reader, no document
+ * is built. The handler records where the asset code, user timestamp and
+ * reading of each element lie in the copy, so that the reading is kept as
+ * the JSON text it was sent as, compacted in place, rather than being
+ * serialised again.
+ */
+class ReadingsPayload {
+	public:
+		ReadingsPayload();
+		bool			parse(const char *payload);
+		const ReadingBatch	*batch() const { return &m_batch; };
+		const std::string&	error() const { return m_error; };
+	private:
+		class Handler;
+		std::vector<char>		m_buffer;
+		std::vector<ReadingBatchEntry>	m_entries;
+		ReadingBatch			m_batch;
+		std::string			m_error;
+};
+#endif
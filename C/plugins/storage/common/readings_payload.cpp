@@ -0,0 +1,400 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_payload.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/error/en.h>
+#include <string.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/*
+ * The depths of the values of the payload, the depth being the number
+ * of containers a value is in
+ */
+#define PAYLOAD_DEPTH	1	// The members of the payload object
+#define ELEMENT_DEPTH	2	// The elements of the readings array
+#define PROPERTY_DEPTH	3	// The properties of an element
+
+/*
+ * The properties of an element that are passed in the batch
+ */
+#define ASSET_CODE	0
+#define USER_TS		1
+#define READING		2
+#define PROPERTIES	3
+
+static const char *properties[] = { "asset_code", "user_ts", "reading" };
+
+/**
+ * The SAX handler of the readings payload. The reader calls it for each
+ * token of the payload, after the token has been taken from the stream,
+ * so that the offset of the stream locates the token in the buffer.
+ *
+ * The payload is parsed in situ, the reader decodes each string in place
+ * and terminates it. The strings of the elements are used where they lie,
+ * the text of the strings within a reading is restored from the payload.
+ */
+class ReadingsPayload::Handler : public BaseReaderHandler<UTF8<>, ReadingsPayload::Handler> {
+	public:
+		Handler(ReadingsPayload& payload, const char *text, InsituStringStream& stream) :
+			m_payload(payload), m_text(text), m_stream(stream), m_depth(0),
+			m_readingsKey(false), m_readings(false), m_found(false), m_property(-1),
+			m_readingDepth(0), m_readingStart(0) {};
+		bool	Default();
+		bool	String(const char *str, SizeType length, bool copy);
+		bool	Key(const char *str, SizeType length, bool copy);
+		bool	StartObject();
+		bool	EndObject(SizeType memberCount);
+		bool	StartArray();
+		bool	EndArray(SizeType elementCount);
+		bool	found() const { return m_found; };
+	private:
+		bool	value(bool object);
+		bool	fail(const char *error);
+		void	restore(const char *str, SizeType length);
+		ReadingsPayload&	m_payload;
+		const char		*m_text;	// The payload the buffer is a copy of
+		InsituStringStream&	m_stream;
+		int			m_depth;
+		bool			m_readingsKey;	// The last member of the payload is readings
+		bool			m_readings;	// Within the readings array
+		bool			m_found;	// The readings array has been found
+		int			m_property;	// The property of the last key of an element
+		int			m_readingDepth;	// The depth within the reading, 0 outside it
+		size_t			m_readingStart;
+		bool			m_properties[PROPERTIES];
+		ReadingBatchEntry	m_entry;
+};
+
+/**
+ * Record the failure of the parse
+ *
+ * @param error	The reason for the failure
+ * @return bool	False, to stop the reader
+ */
+bool ReadingsPayload::Handler::fail(const char *error)
+{
+	m_payload.m_error = error;
+	return false;
+}
+
+/**
+ * Check a value against the position it is at in the payload. This is
+ * called before the depth is changed by a container that starts.
+ *
+ * @param object	True if the value is an object
+ * @return bool		False if the value is not valid where it is
+ */
+bool ReadingsPayload::Handler::value(bool object)
+{
+	if (m_readingDepth)
+	{
+		return true;
+	}
+	if (m_depth == PAYLOAD_DEPTH && m_readingsKey)
+	{
+		return fail("Payload is missing the readings array");
+	}
+	if (m_depth == ELEMENT_DEPTH && m_readings)
+	{
+		if (!object)
+		{
+			return fail("Each reading in the readings array must be an object");
+		}
+		memset(m_properties, 0, sizeof(m_properties));
+		m_property = -1;
+	}
+	else if (m_depth == PROPERTY_DEPTH && m_readings)
+	{
+		if (m_property == READING && !object)
+		{
+			return fail("The reading of each element must be an object");
+		}
+		else if (m_property == ASSET_CODE || m_property == USER_TS)
+		{
+			return fail("The asset_code and user_ts of each reading must be strings");
+		}
+	}
+	return true;
+}
+
+/**
+ * A number, boolean or null value
+ */
+bool ReadingsPayload::Handler::Default()
+{
+	return value(false);
+}
+
+/**
+ * Restore the text of a string within a reading that the reader has
+ * decoded in place. The decoded string starts where the text did.
+ *
+ * @param str		The decoded string
+ * @param length	The length of the decoded string
+ */
+void ReadingsPayload::Handler::restore(const char *str, SizeType length)
+{
+	char *buffer = &m_payload.m_buffer[0];
+	size_t start = str - buffer;
+	if (m_text[start + length] == '"' && !memchr(m_text + start, '\\', length))
+	{
+		// There were no escape sequences, only the closing quote was replaced
+		buffer[start + length] = '"';
+		return;
+	}
+	size_t end = start;
+	while (m_text[end] != '"')
+	{
+		end += m_text[end] == '\\' ? 2 : 1;
+	}
+	memcpy(buffer + start, m_text + start, end - start);
+}
+
+/**
+ * A string value
+ */
+bool ReadingsPayload::Handler::String(const char *str, SizeType length, bool copy)
+{
+	if (m_readingDepth)
+	{
+		restore(str, length);
+		return true;
+	}
+	if (m_depth != PROPERTY_DEPTH || !m_readings
+			|| (m_property != ASSET_CODE && m_property != USER_TS))
+	{
+		return value(false);
+	}
+	if (m_property == ASSET_CODE)
+	{
+		m_entry.assetCode = str;
+		m_entry.assetCodeLength = length;
+	}
+	else
+	{
+		m_entry.userTs = str;
+		m_entry.userTsLength = length;
+	}
+	m_properties[m_property] = true;
+	return true;
+}
+
+/**
+ * The key of a member of an object
+ */
+bool ReadingsPayload::Handler::Key(const char *str, SizeType length, bool copy)
+{
+	if (m_readingDepth)
+	{
+		restore(str, length);
+		return true;
+	}
+	if (m_depth == PAYLOAD_DEPTH)
+	{
+		m_readingsKey = length == 8 && strncmp(str, "readings", length) == 0;
+	}
+	else if (m_depth == PROPERTY_DEPTH)
+	{
+		m_property = -1;
+		for (int p = 0; p < PROPERTIES; p++)
+		{
+			if (length == strlen(properties[p]) && strncmp(str, properties[p], length) == 0)
+			{
+				m_property = p;
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * The start of an object, the stream follows its opening brace
+ */
+bool ReadingsPayload::Handler::StartObject()
+{
+	if (!value(true))
+	{
+		return false;
+	}
+	if (m_readingDepth)
+	{
+		m_readingDepth++;
+	}
+	else if (m_depth == PROPERTY_DEPTH && m_readings && m_property == READING)
+	{
+		m_readingDepth = 1;
+		m_readingStart = m_stream.Tell() - 1;
+	}
+	m_depth++;
+	return true;
+}
+
+/**
+ * The end of an object, the stream follows its closing brace
+ */
+bool ReadingsPayload::Handler::EndObject(SizeType memberCount)
+{
+	m_depth--;
+	if (m_readingDepth && --m_readingDepth == 0)
+	{
+		m_entry.reading = &m_payload.m_buffer[m_readingStart];
+		m_entry.readingLength = m_stream.Tell() - m_readingStart;
+		m_properties[READING] = true;
+	}
+	else if (!m_readingDepth && m_depth == ELEMENT_DEPTH && m_readings)
+	{
+		for (int p = 0; p < PROPERTIES; p++)
+		{
+			if (!m_properties[p])
+			{
+				return fail("Each reading must have an asset_code, user_ts and reading");
+			}
+		}
+		m_payload.m_entries.push_back(m_entry);
+	}
+	return true;
+}
+
+/**
+ * The start of an array
+ */
+bool ReadingsPayload::Handler::StartArray()
+{
+	if (m_depth == PAYLOAD_DEPTH && m_readingsKey && !m_readingDepth)
+	{
+		m_readingsKey = false;
+		m_readings = true;
+		m_found = true;
+	}
+	else if (!value(false))
+	{
+		return false;
+	}
+	if (m_readingDepth)
+	{
+		m_readingDepth++;
+	}
+	m_depth++;
+	return true;
+}
+
+/**
+ * The end of an array
+ */
+bool ReadingsPayload::Handler::EndArray(SizeType elementCount)
+{
+	m_depth--;
+	if (m_readingDepth)
+	{
+		m_readingDepth--;
+	}
+	else if (m_depth == PAYLOAD_DEPTH)
+	{
+		m_readings = false;
+	}
+	return true;
+}
+
+/**
+ * Remove the whitespace between the tokens of a JSON value in place
+ *
+ * @param json		The value
+ * @param length	The length of the value
+ * @return size_t	The length of the compacted value
+ */
+static size_t compact(char *json, size_t length)
+{
+	size_t out = 0;
+	bool inString = false;
+	for (size_t i = 0; i < length; i++)
+	{
+		char c = json[i];
+		if (inString)
+		{
+			if (c == '\\')
+			{
+				json[out++] = c;
+				c = json[++i];
+			}
+			else if (c == '"')
+			{
+				inString = false;
+			}
+		}
+		else if (c == ' ' || c == '\n' || c == '\t' || c == '\r')
+		{
+			continue;
+		}
+		else if (c == '"')
+		{
+			inString = true;
+		}
+		json[out++] = c;
+	}
+	return out;
+}
+
+/**
+ * Construct an empty readings payload
+ */
+ReadingsPayload::ReadingsPayload()
+{
+	m_batch.version = READING_BATCH_VERSION;
+	m_batch.count = 0;
+	m_batch.readings = NULL;
+}
+
+/**
+ * Parse a readings payload into the batch
+ *
+ * @param payload	The JSON readings payload
+ * @return bool		True if the payload was parsed, otherwise error()
+ *			returns the reason
+ */
+bool ReadingsPayload::parse(const char *payload)
+{
+	m_entries.clear();
+	m_error.clear();
+	m_batch.count = 0;
+	m_batch.readings = NULL;
+
+	m_buffer.assign(payload, payload + strlen(payload) + 1);
+	InsituStringStream stream(&m_buffer[0]);
+	Handler handler(*this, payload, stream);
+	Reader reader;
+	ParseResult ok = reader.Parse<kParseInsituFlag>(stream, handler);
+	if (!ok)
+	{
+		if (m_error.empty())
+		{
+			m_error = GetParseError_En(ok.Code());
+		}
+		return false;
+	}
+	if (!handler.found())
+	{
+		m_error = "Payload is missing a readings array";
+		return false;
+	}
+
+	// Compact and terminate the readings now the parse is complete
+	char *buffer = &m_buffer[0];
+	for (auto& entry : m_entries)
+	{
+		char *reading = buffer + (entry.reading - buffer);
+		entry.readingLength = compact(reading, entry.readingLength);
+		reading[entry.readingLength] = 0;
+	}
+	m_batch.count = m_entries.size();
+	m_batch.readings = m_entries.data();
+	return true;
+}
@@ -10,6 +10,7 @@
 #include <connection.h>
 #include <connection_manager.h>
 #include <sql_buffer.h>
+#include <readings_payload.h>
 #include <iostream>
 #include <libpq-fe.h>
 #include "rapidjson/document.h"
@@ -306,6 +307,7 @@ Connection::Connection()
 	const char *defaultConninfo = "dbname = fledge";
 	char *connInfo = NULL;
 	
+	m_latest = false;
 	if ((connInfo = getenv("DB_CONNECTION")) == NULL)
 	{
 		connInfo = (char *)defaultConninfo;
@@ -1445,101 +1447,94 @@ bool Connection::formatDate(char *formatted_date, size_t buffer_size, const char
 
 
 /**
- * Append a set of readings to the readings table
+ * Append a set of readings to the readings table. The payload is parsed
+ * into a batch that refers to the JSON text of each reading, rather than
+ * into a document from which each reading is serialised again.
  */
 int Connection::appendReadings(const char *readings)
 {
-Document 	doc;
-SQLBuffer	sql;
-int		row = 0;
-bool 		add_row = false;
+ReadingsPayload payload;
 
-	ParseResult ok = doc.Parse(readings);
-	if (!ok)
+	if (!payload.parse(readings))
 	{
- 		raiseError("appendReadings", GetParseError_En(doc.GetParseError()));
+		raiseError("appendReadings", payload.error().c_str());
 		return -1;
 	}
+	return appendReadingBatch(payload.batch());
+}
 
-	sql.append("INSERT INTO fledge.readings ( user_ts, asset_code, reading ) VALUES ");
+/**
+ * Append a batch of readings to the readings table. The batch has been
+ * parsed by the storage service so the insert is built directly from
+ * the values of each reading.
+ *
+ * If the latest readings are kept the latest reading of each asset
+ * inserted is upserted into the readings_latest table by the same
+ * statement, replacing the row of the asset unless that has a later
+ * user timestamp.
+ *
+ * @param batch		The batch of readings
+ * @return int		The number of readings appended or -1 on failure
+ */
+int Connection::appendReadingBatch(const ReadingBatch *batch)
+{
+SQLBuffer	sql;
+int		row = 0;
+static const regex function("[a-zA-Z][a-zA-Z0-9_]*\\(.*\\)");
 
-	if (!doc.HasMember("readings"))
+	if (batch->version != READING_BATCH_VERSION)
 	{
-		raiseError("appendReadings", "Payload is missing a readings array");
-	return -1;
+		raiseError("appendReadings", "Unsupported reading batch version %d", batch->version);
+		return -1;
 	}
-	Value &rdings = doc["readings"];
-	if (!rdings.IsArray())
+
+	if (m_latest)
 	{
-		raiseError("appendReadings", "Payload is missing the readings array");
-		return -1;
+		sql.append("WITH inserted AS (");
 	}
-	for (Value::ConstValueIterator itr = rdings.Begin(); itr != rdings.End(); ++itr)
+	sql.append("INSERT INTO fledge.readings ( user_ts, asset_code, reading ) VALUES ");
+	for (uint32_t i = 0; i < batch->count; i++)
 	{
-		if (!itr->IsObject())
+		const ReadingBatchEntry *entry = &batch->readings[i];
+		char formatted_date[LEN_BUFFER_DATE] = {0};
+		bool isFunction = regex_match(entry->userTs, function);
+		if (!isFunction && !formatDate(formatted_date, sizeof(formatted_date), entry->userTs))
 		{
-			raiseError("appendReadings",
-					"Each reading in the readings array must be an object");
-			return -1;
+			raiseError("appendReadings", "Invalid date |%s|", entry->userTs);
+			continue;
 		}
-		add_row = true;
-
-		const char *str = (*itr)["user_ts"].GetString();
-		// Check if the string is a function
-		string s (str);
-		regex e ("[a-zA-Z][a-zA-Z0-9_]*\\(.*\\)");
-		if (regex_match (s,e))
+		sql.append(row ? ", (" : "(");
+		if (isFunction)
 		{
-			if (row)
-				sql.append(", (");
-			else
-				sql.append('(');
-
-			sql.append(str);
+			sql.append(entry->userTs);
 		}
 		else
 		{
-			char formatted_date[LEN_BUFFER_DATE] = {0};
-			if (! formatDate(formatted_date, sizeof(formatted_date), str) )
-			{
-				raiseError("appendReadings", "Invalid date |%s|", str);
-				add_row = false;
-			}
-			else
-			{
-				if (row)
-				{
-					sql.append(", (");
-				}
-				else
-				{
-					sql.append('(');
-				}
-
-				sql.append('\'');
-				sql.append(formatted_date);
-				sql.append('\'');
-			}
-		}
-
-		if (add_row)
-		{
-			row++;
-
-			// Handles - asset_code
-			sql.append(",\'");
-			sql.append((*itr)["asset_code"].GetString());
-			sql.append("', '");
-
-			// Handles - reading
-			StringBuffer buffer;
-			Writer<StringBuffer> writer(buffer);
-			(*itr)["reading"].Accept(writer);
-			sql.append(escape(buffer.GetString()));
-			sql.append("\' ");
-
-			sql.append(')');
+			sql.append('\'');
+			sql.append(formatted_date);
+			sql.append('\'');
 		}
+		sql.append(",'");
+		sql.append(escape(entry->assetCode));
+		sql.append("', '");
+		sql.append(escape(entry->reading));
+		sql.append("' )");
+		row++;
+	}
+	if (row == 0)
+	{
+		return 0;
+	}
+	if (m_latest)
+	{
+		sql.append(" RETURNING id, asset_code, reading, user_ts), latest AS ("
+			"INSERT INTO fledge.readings_latest AS l ( asset_code, id, reading, user_ts ) "
+			"SELECT DISTINCT ON (asset_code) asset_code, id, reading, user_ts FROM inserted "
+			"ORDER BY asset_code, user_ts DESC, id DESC "
+			"ON CONFLICT (asset_code) DO UPDATE SET id = EXCLUDED.id, "
+			"reading = EXCLUDED.reading, user_ts = EXCLUDED.user_ts "
+			"WHERE l.user_ts <= EXCLUDED.user_ts) "
+			"SELECT count(*) FROM inserted");
 	}
 	sql.append(';');
 
@@ -1550,8 +1545,15 @@ bool 		add_row = false;
 	delete[] query;
 	if (PQresultStatus(res) == PGRES_COMMAND_OK)
 	{
+		int rows = atoi(PQcmdTuples(res));
 		PQclear(res);
-		return atoi(PQcmdTuples(res));
+		return rows;
+	}
+	if (PQresultStatus(res) == PGRES_TUPLES_OK)
+	{
+		int rows = atoi(PQgetvalue(res, 0, 0));
+		PQclear(res);
+		return rows;
 	}
  	raiseError("appendReadings", PQerrorMessage(dbConnection));
 	PQclear(res);
@@ -1582,7 +1584,75 @@ char	sqlbuffer[200];
 }
 
 /**
- * Purge readings from the reading table
+ * Seed the table of the latest reading of each asset, which is created
+ * with the schema, from the readings already held if it is empty. The
+ * appends and purges keep the table up to date from then on.
+ *
+ * @return bool		True if the table is in place
+ */
+bool Connection::seedLatestReadings()
+{
+	const char *query = "INSERT INTO fledge.readings_latest ( asset_code, id, reading, user_ts ) "
+			"SELECT DISTINCT ON (asset_code) asset_code, id, reading, user_ts FROM fledge.readings "
+			"WHERE NOT EXISTS (SELECT 1 FROM fledge.readings_latest) "
+			"ORDER BY asset_code, user_ts DESC, id DESC;";
+
+	logSQL("ReadingsLatest", query);
+	PGresult *res = PQexec(dbConnection, query);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+	{
+		Logger::getLogger()->error("Failed to seed the latest readings: %s",
+				PQerrorMessage(dbConnection));
+		PQclear(res);
+		return false;
+	}
+	PQclear(res);
+	return true;
+}
+
+/**
+ * Return the latest reading of each asset, or of one asset, from the
+ * readings_latest table rather than the readings. The readings are
+ * returned as fetchReadings returns them, without the ts, ordered by
+ * asset code.
+ *
+ * @param asset		The asset code or NULL for every asset
+ * @param resultSet	Set to the readings as JSON
+ * @return bool		True if the readings were retrieved
+ */
+bool Connection::latestReadings(const char *asset, string& resultSet)
+{
+	if (!m_latest)
+	{
+		raiseError("latest", "The latest readings are not kept");
+		return false;
+	}
+
+	string query = "SELECT id, asset_code, reading, user_ts AT TIME ZONE 'UTC' as \"user_ts\" "
+			"FROM fledge.readings_latest";
+	if (asset)
+	{
+		query += " WHERE asset_code = '" + escape(asset) + "'";
+	}
+	query += " ORDER BY asset_code;";
+
+	logSQL("ReadingsLatest", query.c_str());
+	PGresult *res = PQexec(dbConnection, query.c_str());
+	if (PQresultStatus(res) == PGRES_TUPLES_OK)
+	{
+		mapResultSet(res, resultSet);
+		PQclear(res);
+		return true;
+	}
+ 	raiseError("latest", PQerrorMessage(dbConnection));
+	PQclear(res);
+	return false;
+}
+
+/**
+ * Purge readings from the reading table. If the latest readings are kept
+ * those of the assets whose latest reading is purged are replaced in the
+ * transaction of the purge.
  */
 unsigned int  Connection::purgeReadings(unsigned long age, unsigned int flags, unsigned long sent, std::string& result)
 {
@@ -1649,6 +1719,11 @@ long numReadings = 0;
 		sql.append(sent);
 	}
 	sql.append(';');
+	if (m_latest)
+	{
+		// The readings and the latest readings of their assets are updated together
+		PQclear(PQexec(dbConnection, "BEGIN;"));
+	}
 	const char *query = sql.coalesce();
 	logSQL("ReadingsPurge", query);
 	PGresult *res = PQexec(dbConnection, query);
@@ -1657,10 +1732,30 @@ long numReadings = 0;
 	{
 		PQclear(res);
  		raiseError("retrieve", PQerrorMessage(dbConnection));
+		if (m_latest)
+		{
+			PQclear(PQexec(dbConnection, "ROLLBACK;"));
+		}
 		return 0;
 	}
 	unsigned int deletedRows = (unsigned int)atoi(PQcmdTuples(res));
 	PQclear(res);
+	if (m_latest)
+	{
+		if (deletedRows > 0 && !purgedLatestReadings())
+		{
+			PQclear(PQexec(dbConnection, "ROLLBACK;"));
+			return 0;
+		}
+		res = PQexec(dbConnection, "COMMIT;");
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			PQclear(res);
+			raiseError("purge", PQerrorMessage(dbConnection));
+			return 0;
+		}
+		PQclear(res);
+	}
 
 	SQLBuffer retainedBuffer;
 	retainedBuffer.append("SELECT count(*) FROM fledge.readings WHERE id > ");
@@ -1703,6 +1798,43 @@ long numReadings = 0;
 	return deletedRows;
 }
 
+/**
+ * Replace the rows of the latest readings whose reading has been purged
+ * with the remaining reading of the asset that has the latest user
+ * timestamp, and remove those of assets that have no readings left.
+ * Called in the transaction of the purge, the readings of an asset are
+ * found with the asset code and user timestamp index.
+ *
+ * A row that an append has replaced since the purge deleted its reading
+ * is left as it is.
+ *
+ * @return bool		False if the latest readings could not be updated
+ */
+bool Connection::purgedLatestReadings()
+{
+	const char *query = "INSERT INTO fledge.readings_latest AS l ( asset_code, id, reading, user_ts ) "
+			"SELECT DISTINCT ON (asset_code) asset_code, id, reading, user_ts FROM fledge.readings "
+			"WHERE asset_code IN (SELECT asset_code FROM fledge.readings_latest p WHERE NOT EXISTS "
+			"(SELECT 1 FROM fledge.readings r WHERE r.id = p.id)) "
+			"ORDER BY asset_code, user_ts DESC, id DESC "
+			"ON CONFLICT (asset_code) DO UPDATE SET id = EXCLUDED.id, "
+			"reading = EXCLUDED.reading, user_ts = EXCLUDED.user_ts "
+			"WHERE NOT EXISTS (SELECT 1 FROM fledge.readings r WHERE r.id = l.id); "
+			"DELETE FROM fledge.readings_latest p WHERE NOT EXISTS "
+			"(SELECT 1 FROM fledge.readings r WHERE r.id = p.id);";
+
+	logSQL("ReadingsPurge", query);
+	PGresult *res = PQexec(dbConnection, query);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+	{
+		raiseError("purge", PQerrorMessage(dbConnection));
+		PQclear(res);
+		return false;
+	}
+	PQclear(res);
+	return true;
+}
+
 /**
  * Map a SQL result set to a JSON document
  */
@@ -20,6 +20,7 @@ ConnectionManager::ConnectionManager()
 {
 	lastError.message = NULL;
 	lastError.entryPoint = NULL;
+	m_latest = false;
 	if (getenv("FLEDGE_TRACE_SQL"))
 		m_logSQL = true;
 	else
@@ -117,6 +118,7 @@ Connection *conn = 0;
 	idleLock.unlock();
 	if (conn)
 	{
+		conn->setLatest(m_latest);
 		inUseLock.lock();
 		inUse.push_front(conn);
 		inUseLock.unlock();
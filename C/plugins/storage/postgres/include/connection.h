@@ -14,6 +14,7 @@
 #include <string>
 #include <rapidjson/document.h>
 #include <libpq-fe.h>
+#include <reading_batch.h>
 
 class Connection {
 	public:
@@ -26,10 +27,14 @@ class Connection {
 		int		update(const std::string& table, const std::string& data);
 		int		deleteRows(const std::string& table, const std::string& condition);
 		int		appendReadings(const char *readings);
+		int		appendReadingBatch(const ReadingBatch *batch);
 		bool		fetchReadings(unsigned long id, unsigned int blksize, std::string& resultSet);
+		bool		seedLatestReadings();
+		bool		latestReadings(const char *asset, std::string& resultSet);
 		unsigned int	purgeReadings(unsigned long age, unsigned int flags, unsigned long sent, std::string& results);
 		long		tableSize(const std::string& table);
 		void		setTrace(bool flag) { m_logSQL = flag; };
+		void		setLatest(bool flag) { m_latest = flag; };
     		static bool 	formatDate(char *formatted_date, size_t formatted_date_size, const char *date);
 		int		create_table_snapshot(const std::string& table, const std::string& id);
 		int		load_table_snapshot(const std::string& table, const std::string& id);
@@ -40,6 +45,8 @@ class Connection {
 
 	private:
 		bool		m_logSQL;
+		bool		m_latest;
+		bool		purgedLatestReadings();
 		void		raiseError(const char *operation, const char *reason,...);
 		PGconn		*dbConnection;
 		void		mapResultSet(PGresult *res, std::string& resultSet);
@@ -28,6 +28,7 @@ class ConnectionManager {
 		void                      release(Connection *);
 		void			  shutdown();
 		void			  setError(const char *, const char *, bool);
+		void			  setLatest(bool latest) { m_latest = latest; };
 		PLUGIN_ERROR		  *getError()
 					  {
 						return &lastError;
@@ -43,6 +44,7 @@ class ConnectionManager {
 		std::mutex                   errorLock;
 		PLUGIN_ERROR		     lastError;
 		bool			     m_logSQL;
+		bool			     m_latest;
 };
 
 #endif
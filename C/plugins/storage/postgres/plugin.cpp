@@ -53,13 +53,17 @@ PLUGIN_INFORMATION *plugin_info()
 /**
  * Initialise the plugin, called to get the plugin handle
  * In the case of Postgres we also get a pool of connections
- * to use.
+ * to use, and seed the table of the latest readings if need be.
  */
 PLUGIN_HANDLE plugin_init()
 {
 ConnectionManager *manager = ConnectionManager::getInstance();
 
 	manager->growPool(5);
+	Connection *connection = manager->allocate();
+	bool latest = connection->seedLatestReadings();
+	manager->release(connection);
+	manager->setLatest(latest);
 	return manager;
 }
 
@@ -133,6 +137,19 @@ Connection        *connection = manager->allocate();
 	return result;;
 }
 
+/**
+ * Append a batch of readings to the readings buffer
+ */
+int plugin_reading_append_batch(PLUGIN_HANDLE handle, const ReadingBatch *batch)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocate();
+
+	int result = connection->appendReadingBatch(batch);
+	manager->release(connection);
+	return result;
+}
+
 /**
  * Fetch a block of readings from the readings buffer
  */
@@ -147,6 +164,21 @@ std::string	  resultSet;
 	return strdup(resultSet.c_str());
 }
 
+/**
+ * Return the latest reading of each asset, or of a single asset if
+ * asset is not NULL. NULL is returned on failure.
+ */
+char *plugin_reading_latest(PLUGIN_HANDLE handle, const char *asset)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocate();
+std::string	  resultSet;
+
+	bool rval = connection->latestReadings(asset, resultSet);
+	manager->release(connection);
+	return rval ? strdup(resultSet.c_str()) : NULL;
+}
+
 /**
  * Retrieve some readings from the readings buffer
  */
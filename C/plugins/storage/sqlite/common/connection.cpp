@@ -11,23 +11,7 @@
 #include <connection_manager.h>
 #include <common.h>
 #include <utils.h>
-
-/*
- * Control the way purge deletes readings. The block size sets a limit as to how many rows
- * get deleted in each call, whilst the sleep interval controls how long the thread sleeps
- * between deletes. The idea is to not keep the database locked too long and allow other threads
- * to have access to the database between blocks.
- */
-#define PURGE_SLEEP_MS 500
-#define PURGE_DELETE_BLOCK_SIZE	20
-#define TARGET_PURGE_BLOCK_DEL_TIME	(70*1000) 	// 70 msec
-#define PURGE_BLOCK_SZ_GRANULARITY	5 	// 5 rows
-#define MIN_PURGE_DELETE_BLOCK_SIZE	20
-#define MAX_PURGE_DELETE_BLOCK_SIZE	1500
-#define RECALC_PURGE_BLOCK_SIZE_NUM_BLOCKS	30	// recalculate purge block size after every 30 blocks
-
-#define PURGE_SLOWDOWN_AFTER_BLOCKS 5
-#define PURGE_SLOWDOWN_SLEEP_MS 500
+#include <readings_timestamp.h>
 
 /**
  * SQLite3 storage plugin for Fledge
@@ -38,34 +22,21 @@ using namespace rapidjson;
 
 #define CONNECT_ERROR_THRESHOLD		5*60	// 5 minutes
 
-#define MAX_RETRIES			40	// Maximum no. of retries when a lock is encountered
-#define RETRY_BACKOFF			100	// Multipler to backoff DB retry on lock
+#define BUSY_TIMEOUT			5000	// Milliseconds SQLite waits for a lock held by another connection
 
 /*
  * The following allows for conditional inclusion of code that tracks the top queries
- * run by the storage plugin and the number of times a particular statement has to
- * be retried because of the database being busy./
+ * run by the storage plugin.
  */
 #define DO_PROFILE		0
-#define DO_PROFILE_RETRIES	0
 #if DO_PROFILE
 #include <profile.h>
 
 #define	TOP_N_STATEMENTS		10	// Number of statements to report in top n
-#define RETRY_REPORT_THRESHOLD		1000	// Report retry statistics every X calls
 
 QueryProfile profiler(TOP_N_STATEMENTS);
-unsigned long retryStats[MAX_RETRIES] = { 0,0,0,0,0,0,0,0,0,0 };
-unsigned long numStatements = 0;
-int	      maxQueue = 0;
 #endif
 
-static std::atomic<int> m_waiting(0);
-static std::atomic<int> m_writeAccessOngoing(0);
-static std::mutex	db_mutex;
-static std::condition_variable	db_cv;
-static int purgeBlockSize = PURGE_DELETE_BLOCK_SIZE;
-
 #define START_TIME std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
 #define END_TIME std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now(); \
 				 auto usecs = std::chrono::duration_cast<std::chrono::microseconds>( t2 - t1 ).count();
@@ -424,28 +395,51 @@ bool retCode;
 
 #ifndef SQLITE_SPLIT_READINGS
 /**
- * Create a SQLite3 database connection
+ * Return the path of the SQLite3 database file
+ *
+ * @return string	The database path
  */
-Connection::Connection()
+string Connection::databasePath()
 {
-	string dbPath;
 	const char *defaultConnection = getenv("DEFAULT_SQLITE_DB_FILE");
 
-	m_logSQL = false;
-	m_queuing = 0;
-	m_streamOpenTransaction = true;
-
 	if (defaultConnection == NULL)
 	{
-		// Set DB base path
-		dbPath = getDataDir();
-		// Add the filename
-		dbPath += _DB_NAME;
-	}
-	else
-	{
-		dbPath = defaultConnection;
+		// Set DB base path and add the filename
+		return getDataDir() + _DB_NAME;
 	}
+	return defaultConnection;
+}
+
+/**
+ * Create a SQLite3 database connection
+ *
+ * @param readOnly	Open the database read-only, for a connection that
+ *			only reads the readings
+ */
+Connection::Connection(bool readOnly)
+{
+	string dbPath = databasePath();
+
+	m_readOnly = readOnly;
+	m_logSQL = false;
+	m_queuing = 0;
+	m_streamOpenTransaction = true;
+	m_statements = NULL;
+	m_writer = NULL;
+	m_partitions = NULL;
+	m_partitionGeneration = 0;
+	m_partitionRetry = 0;
+	m_columns = NULL;
+	m_columnsGeneration = 0;
+	m_epochTimestamps = getenv("FLEDGE_READINGS_EPOCH_TIMESTAMPS") != NULL;
+	m_timestampView = false;
+	m_migrateId = 0;
+	m_migrateMaxId = 0;
+	m_incrementalVacuum = false;
+	m_rollups = NULL;
+	m_rollupsMinId = 0;
+	m_latest = NULL;
 
 	// Allow usage of URI for filename
 	sqlite3_config(SQLITE_CONFIG_URI, 1);
@@ -461,7 +455,7 @@ Connection::Connection()
 	 */
 	if (sqlite3_open_v2(dbPath.c_str(),
 			    &dbHandle,
-			    SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX,
+			    (readOnly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE) | SQLITE_OPEN_NOMUTEX,
 			    NULL) != SQLITE_OK)
 	{
 		const char* dbErrMsg = sqlite3_errmsg(dbHandle);
@@ -486,18 +480,25 @@ Connection::Connection()
 		int rc;
 		char *zErrMsg = NULL;
 
-		rc = sqlite3_exec(dbHandle, "PRAGMA busy_timeout = 100; PRAGMA cache_size = -4000; PRAGMA journal_mode = WAL; PRAGMA secure_delete = off; PRAGMA journal_size_limit = 4096000;", NULL, NULL, &zErrMsg);
+		// SQLite waits for the locks held by other connections
+		sqlite3_busy_timeout(dbHandle, BUSY_TIMEOUT);
+
+		const char *pragmas = readOnly ? "PRAGMA cache_size = -4000;"
+			: "PRAGMA cache_size = -4000; PRAGMA journal_mode = WAL; PRAGMA secure_delete = off; PRAGMA journal_size_limit = 4096000;";
+		rc = sqlite3_exec(dbHandle, pragmas, NULL, NULL, &zErrMsg);
 		if (rc != SQLITE_OK)
 		{
-			const char* errMsg = "Failed to set 'PRAGMA busy_timeout = 5000; PRAGMA cache_size = -4000; PRAGMA journal_mode = WAL; PRAGMA secure_delete = off; PRAGMA journal_size_limit = 4096000;'";
-			Logger::getLogger()->error("%s : error %s",
-						   errMsg,
+			Logger::getLogger()->error("Failed to set '%s' : error %s",
+						   pragmas,
 						   zErrMsg);
 			connectErrorTime = time(0);
 
 			sqlite3_free(zErrMsg);
 		}
 
+		// Conversions of the timestamps of the readings
+		ReadingsTimestamp::registerFunctions(dbHandle);
+
 		/*
 		 * Build the ATTACH DATABASE command in order to get
 		 * 'fledge.' prefix in all SQL queries
@@ -545,7 +546,34 @@ Connection::Connection()
  */
 Connection::~Connection()
 {
+	delete m_latest;
+	delete m_statements;
 	sqlite3_close_v2(dbHandle);
+	if (m_partitions)
+	{
+		// Closing the connection detached the partitions
+		for (auto& alias : m_attached)
+		{
+			m_partitions->detached(alias);
+		}
+	}
+}
+
+/**
+ * Return a prepared statement for the SQL text from the statement cache
+ * of the connection. The statement is owned by the cache, the caller
+ * must reset rather than finalize it once done.
+ *
+ * @param sql		The SQL text of the statement
+ * @return sqlite3_stmt*	The statement or NULL if it could not be prepared
+ */
+sqlite3_stmt *Connection::prepare(const string& sql)
+{
+	if (!m_statements)
+	{
+		m_statements = new StatementCache(dbHandle);
+	}
+	return m_statements->prepare(sql);
 }
 
 /**
@@ -789,6 +817,8 @@ Document	document;
 SQLBuffer	sql;
 // Extra constraints to add to where clause
 SQLBuffer	jsonConstraints;
+// Values of the where clause bound to the statement
+vector<const Value *>	bindings;
 
 	try {
 		if (dbHandle == NULL)
@@ -943,7 +973,7 @@ SQLBuffer	jsonConstraints;
 			 
 				if (document.HasMember("where"))
 				{
-					if (!jsonWhereClause(document["where"], sql, true))
+					if (!jsonWhereClause(document["where"], sql, true, false, &bindings))
 					{
 						return false;
 					}
@@ -976,10 +1006,14 @@ SQLBuffer	jsonConstraints;
 
 		logSQL("CommonRetrive", query);
 
-		// Prepare the SQL statement and get the result set
-		rc = sqlite3_prepare_v2(dbHandle, query, -1, &stmt, NULL);
+		/*
+		 * Get the prepared SQL statement from the cache, the values of
+		 * the where clause are bound so that the statement is reused
+		 * whatever the values, and the result set
+		 */
+		stmt = prepare(query);
 
-		if (rc != SQLITE_OK)
+		if (stmt == NULL || !bindValues(stmt, bindings))
 		{
 			raiseError("retrieve", sqlite3_errmsg(dbHandle));
 			Logger::getLogger()->error("SQL statement: %s", query);
@@ -990,8 +1024,8 @@ SQLBuffer	jsonConstraints;
 		// Call result set mapping
 		rc = mapResultSet(stmt, resultSet);
 
-		// Delete result set
-		sqlite3_finalize(stmt);
+		// Release the statement for reuse
+		sqlite3_reset(stmt);
 
 		// Check result set mapping errors
 		if (rc != SQLITE_DONE)
@@ -1137,15 +1171,11 @@ std::size_t arr = data.find("inserts");
 	int rc;
 
 	// Exec INSERT statement: no callback, no result set
-	m_writeAccessOngoing.fetch_add(1);
 	rc = SQLexec(dbHandle,
 		     query,
 		     NULL,
 		     NULL,
 		     &zErrMsg);
-	m_writeAccessOngoing.fetch_sub(1);
-	if (m_writeAccessOngoing == 0)
-		db_cv.notify_all();
 
 	// Check exec result
 	if (rc != SQLITE_OK )
@@ -1512,15 +1542,11 @@ SQLBuffer	sql;
 	int rc;
 
 	// Exec the UPDATE statement: no callback, no result set
-	m_writeAccessOngoing.fetch_add(1);
 	rc = SQLexec(dbHandle,
 		     query,
 		     NULL,
 		     NULL,
 		     &zErrMsg);
-	m_writeAccessOngoing.fetch_sub(1);
-	if (m_writeAccessOngoing == 0)
-		db_cv.notify_all();
 
 	// Check result code
 	if (rc != SQLITE_OK)
@@ -2336,12 +2362,53 @@ bool Connection::jsonModifiers(const Value& payload,
 	return true;
 }
 
+/**
+ * Return the epoch timestamp a condition on the user timestamp of the
+ * readings compares with, if it is a range condition on a time that is
+ * in a form that may be converted.
+ *
+ * @param whereClause	The where clause
+ * @param usecs		Set to the time in microseconds since the epoch
+ * @return bool		True if the condition compares with an epoch timestamp
+ */
+static bool epochCondition(const Value& whereClause, int64_t& usecs)
+{
+	string cond = whereClause["condition"].GetString();
+	const Value& value = whereClause["value"];
+	if (!cond.compare("older") || !cond.compare("newer"))
+	{
+		if (!value.IsInt())
+		{
+			return false;
+		}
+		// As datetime('now', '-N seconds') the time is in whole seconds
+		usecs = (ReadingsTimestamp::now() / 1000000 - value.GetInt()) * 1000000;
+		return true;
+	}
+	if (cond.compare("<") && cond.compare("<=") && cond.compare(">") && cond.compare(">="))
+	{
+		return false;
+	}
+	return value.IsString() && ReadingsTimestamp::parse(value.GetString(), usecs);
+}
+
 /**
  * Convert a JSON where clause into a SQLite3 where clause
  *
+ * When epochTimestamps is set the readings have epoch timestamps and
+ * their view has the user_ts_epoch column, the user timestamp as it is
+ * stored. Ranges of user timestamps are then compared with that column
+ * so that they are found from the index of the user timestamps rather
+ * than by formatting the timestamp of every reading.
+ *
+ * When bindings is given the values the columns are compared with are
+ * added to it and a parameter put in their place, so that the statement
+ * may be cached and reused whatever the values. The values must be
+ * bound with bindValues before the statement is stepped.
  */
 bool Connection::jsonWhereClause(const Value& whereClause,
-				 SQLBuffer& sql, bool convertLocaltime)
+				 SQLBuffer& sql, bool convertLocaltime, bool epochTimestamps,
+				 vector<const Value *> *bindings)
 {
 	if (!whereClause.IsObject())
 	{
@@ -2365,10 +2432,27 @@ bool Connection::jsonWhereClause(const Value& whereClause,
 		return false;
 	}
 
-	sql.append(whereClause["column"].GetString());
+	int64_t usecs;
+	bool epoch = epochTimestamps && !convertLocaltime
+			&& strcmp(whereClause["column"].GetString(), "user_ts") == 0
+			&& epochCondition(whereClause, usecs);
+	sql.append(epoch ? "user_ts_epoch" : whereClause["column"].GetString());
 	sql.append(' ');
 	string cond = whereClause["condition"].GetString();
-	if (!cond.compare("older"))
+	if (epoch)
+	{
+		if (!cond.compare("older"))
+			sql.append("< ");
+		else if (!cond.compare("newer"))
+			sql.append("> ");
+		else
+		{
+			sql.append(cond);
+			sql.append(' ');
+		}
+		sql.append((long)usecs);
+	}
+	else if (!cond.compare("older"))
 	{
 		if (!whereClause["value"].IsInt())
 		{
@@ -2416,7 +2500,12 @@ bool Connection::jsonWhereClause(const Value& whereClause,
 					sql.append(", ");
 				}
 				field++;
-				if (itr->IsNumber())
+				if (bindings && (itr->IsNumber() || itr->IsString()))
+				{
+					sql.append('?');
+					bindings->push_back(&(*itr));
+				}
+				else if (itr->IsNumber())
 				{
 					if (itr->IsInt())
 					{
@@ -2462,7 +2551,12 @@ bool Connection::jsonWhereClause(const Value& whereClause,
 	{
 		sql.append(cond);
 		sql.append(' ');
-		if (whereClause["value"].IsInt())
+		if (bindings && (whereClause["value"].IsInt() || whereClause["value"].IsString()))
+		{
+			sql.append('?');
+			bindings->push_back(&whereClause["value"]);
+		}
+		else if (whereClause["value"].IsInt())
 		{
 			sql.append(whereClause["value"].GetInt());
 		} else if (whereClause["value"].IsString())
@@ -2476,7 +2570,7 @@ bool Connection::jsonWhereClause(const Value& whereClause,
 	if (whereClause.HasMember("and"))
 	{
 		sql.append(" AND ");
-		if (!jsonWhereClause(whereClause["and"], sql, convertLocaltime))
+		if (!jsonWhereClause(whereClause["and"], sql, convertLocaltime, epochTimestamps, bindings))
 		{
 			return false;
 		}
@@ -2484,7 +2578,7 @@ bool Connection::jsonWhereClause(const Value& whereClause,
 	if (whereClause.HasMember("or"))
 	{
 		sql.append(" OR ");
-		if (!jsonWhereClause(whereClause["or"], sql, convertLocaltime))
+		if (!jsonWhereClause(whereClause["or"], sql, convertLocaltime, epochTimestamps, bindings))
 		{
 			return false;
 		}
@@ -2493,6 +2587,35 @@ bool Connection::jsonWhereClause(const Value& whereClause,
 	return true;
 }
 
+/**
+ * Bind the values of a where clause to the parameters of a statement,
+ * in the order jsonWhereClause added them
+ *
+ * @param stmt		The prepared statement
+ * @param bindings	The values to bind
+ * @return bool		False if a value could not be bound
+ */
+bool Connection::bindValues(sqlite3_stmt *stmt, const vector<const Value *>& bindings)
+{
+	int param = 1;
+	for (auto value : bindings)
+	{
+		int rc;
+		if (value->IsString())
+			rc = sqlite3_bind_text(stmt, param, value->GetString(), value->GetStringLength(), SQLITE_TRANSIENT);
+		else if (value->IsInt64())
+			rc = sqlite3_bind_int64(stmt, param, value->GetInt64());
+		else
+			rc = sqlite3_bind_double(stmt, param, value->GetDouble());
+		if (rc != SQLITE_OK)
+		{
+			return false;
+		}
+		param++;
+	}
+	return true;
+}
+
 /**
  * This routine uses SQLit3 JSON1 extension functions
  */
@@ -2686,7 +2809,8 @@ void Connection::logSQL(const char *tag, const char *stmt)
 
 #ifndef SQLITE_SPLIT_READINGS
 /**
- * SQLITE wrapper to rety statements when the database is locked
+ * SQLITE wrapper to execute statements. A lock held by another connection
+ * is waited for by SQLite, up to the busy timeout of the connection.
  *
  * @param	db	The open SQLite database
  * @param	sql	The SQL to execute
@@ -2697,131 +2821,65 @@ void Connection::logSQL(const char *tag, const char *stmt)
 int Connection::SQLexec(sqlite3 *db, const char *sql, int (*callback)(void*,int,char**,char**),
   			void *cbArg, char **errmsg)
 {
-int retries = 0, rc;
+int rc;
 
-	do {
 #if DO_PROFILE
-		ProfileItem *prof = new ProfileItem(sql);
+	ProfileItem *prof = new ProfileItem(sql);
 #endif
-		rc = sqlite3_exec(db, sql, callback, cbArg, errmsg);
+	rc = sqlite3_exec(db, sql, callback, cbArg, errmsg);
 #if DO_PROFILE
-		prof->complete();
-		profiler.insert(prof);
+	prof->complete();
+	profiler.insert(prof);
 #endif
-		retries++;
-		if (rc == SQLITE_LOCKED || rc == SQLITE_BUSY)
-		{
-#if DO_PROFILE_RETRIES
-			m_qMutex.lock();
-			m_waiting.fetch_add(1);
-			if (maxQueue < m_waiting)
-				maxQueue = m_waiting;
-			m_qMutex.unlock();
-#endif
-			int interval = (1 * RETRY_BACKOFF);
-			std::this_thread::sleep_for(std::chrono::milliseconds(interval));
-			if (retries > 9) Logger::getLogger()->info("SQLexec: retry %d of %d, rc=%s, errmsg=%s, DB connection @ %p, slept for %d msecs",
-						retries, MAX_RETRIES, (rc==SQLITE_LOCKED)?"SQLITE_LOCKED":"SQLITE_BUSY", sqlite3_errmsg(db), this, interval);
-#if DO_PROFILE_RETRIES
-			m_qMutex.lock();
-			m_waiting.fetch_sub(1);
-			m_qMutex.unlock();
-#endif
-			if (sqlite3_get_autocommit(db)==0) // if transaction is still open, do rollback
-			{
-				int rc2;
-				char *zErrMsg = NULL;
-				rc2=SQLexec(db,
-					"ROLLBACK TRANSACTION;",
-					NULL,
-					NULL,
-					&zErrMsg);
-				if (rc2 != SQLITE_OK)
-				{
-					raiseError("rollback", zErrMsg);
-					sqlite3_free(zErrMsg);
-				}
-			}
-		}
-	} while (retries < MAX_RETRIES && (rc == SQLITE_LOCKED || rc == SQLITE_BUSY));
-#if DO_PROFILE_RETRIES
-	retryStats[retries-1]++;
-	if (++numStatements > RETRY_REPORT_THRESHOLD - 1)
+	if (rc == SQLITE_LOCKED || rc == SQLITE_BUSY)
 	{
-		numStatements = 0;
-		Logger *log = Logger::getLogger();
-		log->info("Storage layer statement retry profile");
-		for (int i = 0; i < MAX_RETRIES-1; i++)
+		Logger::getLogger()->error("SQLexec: database still %s after %d msecs, DB connection @ %p",
+				(rc==SQLITE_LOCKED) ? "locked" : "busy", BUSY_TIMEOUT, this);
+		if (sqlite3_get_autocommit(db)==0) // if transaction is still open, do rollback
 		{
-			log->info("%2d: %d", i, retryStats[i]);
-			retryStats[i] = 0;
+			int rc2;
+			char *zErrMsg = NULL;
+			rc2=sqlite3_exec(db,
+				"ROLLBACK TRANSACTION;",
+				NULL,
+				NULL,
+				&zErrMsg);
+			if (rc2 != SQLITE_OK)
+			{
+				raiseError("rollback", zErrMsg);
+				sqlite3_free(zErrMsg);
+			}
 		}
-		log->info("Too many retries: %d", retryStats[MAX_RETRIES-1]);
-		retryStats[MAX_RETRIES-1] = 0;
-		log->info("Maximum retry queue length: %d", maxQueue);
-		maxQueue = 0;
-	}
-#endif
-
-	if (rc == SQLITE_LOCKED)
-	{
-		Logger::getLogger()->error("Database still locked after maximum retries");
-	}
-	if (rc == SQLITE_BUSY)
-	{
-		Logger::getLogger()->error("Database still busy after maximum retries");
 	}
 
 	return rc;
 }
 #endif
 
+/**
+ * SQLITE wrapper to step a prepared statement. A lock held by another
+ * connection is waited for by SQLite, up to the busy timeout of the
+ * connection.
+ *
+ * @param	statement	The prepared statement
+ * @return	The result of sqlite3_step
+ */
 int Connection::SQLstep(sqlite3_stmt *statement)
 {
-int retries = 0, rc;
+int rc;
 
-	do {
 #if DO_PROFILE
-		ProfileItem *prof = new ProfileItem(sqlite3_sql(statement));
+	ProfileItem *prof = new ProfileItem(sqlite3_sql(statement));
 #endif
-		rc = sqlite3_step(statement);
+	rc = sqlite3_step(statement);
 #if DO_PROFILE
-		prof->complete();
-		profiler.insert(prof);
+	prof->complete();
+	profiler.insert(prof);
 #endif
-		retries++;
-		if (rc == SQLITE_LOCKED || rc == SQLITE_BUSY)
-		{
-			int interval = (retries * RETRY_BACKOFF);
-			usleep(interval);	// sleep retries milliseconds
-			if (retries > 5) Logger::getLogger()->info("SQLstep: retry %d of %d, rc=%s, DB connection @ %p, slept for %d msecs",
-						retries, MAX_RETRIES, (rc==SQLITE_LOCKED)?"SQLITE_LOCKED":"SQLITE_BUSY", this, interval);
-		}
-	} while (retries < MAX_RETRIES && (rc == SQLITE_LOCKED || rc == SQLITE_BUSY));
-#if DO_PROFILE_RETRIES
-	retryStats[retries-1]++;
-	if (++numStatements > 1000)
-	{
-		numStatements = 0;
-		Logger *log = Logger::getLogger();
-		log->info("Storage layer statement retry profile");
-		for (int i = 0; i < MAX_RETRIES-1; i++)
-		{
-			log->info("%2d: %d", i, retryStats[i]);
-			retryStats[i] = 0;
-		}
-		log->info("Too many retries: %d", retryStats[MAX_RETRIES-1]);
-		retryStats[MAX_RETRIES-1] = 0;
-	}
-#endif
-
-	if (rc == SQLITE_LOCKED)
-	{
-		Logger::getLogger()->error("Database still locked after maximum retries");
-	}
-	if (rc == SQLITE_BUSY)
+	if (rc == SQLITE_LOCKED || rc == SQLITE_BUSY)
 	{
-		Logger::getLogger()->error("Database still busy after maximum retries");
+		Logger::getLogger()->error("SQLstep: database still %s after %d msecs, DB connection @ %p",
+				(rc==SQLITE_LOCKED) ? "locked" : "busy", BUSY_TIMEOUT, this);
 	}
 
 	return rc;
@@ -2874,15 +2932,11 @@ SQLBuffer	sql;
 	int rc;
 
 	// Exec the DELETE statement: no callback, no result set
-	m_writeAccessOngoing.fetch_add(1);
 	rc = SQLexec(dbHandle,
 		     query,
 		     NULL,
 		     NULL,
 		     &zErrMsg);
-	m_writeAccessOngoing.fetch_sub(1);
-	if (m_writeAccessOngoing == 0)
-		db_cv.notify_all();
 
 	// Check result code
 	if (rc == SQLITE_OK)
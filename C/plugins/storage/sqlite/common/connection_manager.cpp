@@ -9,6 +9,11 @@
  */
 #include <connection_manager.h>
 #include <connection.h>
+#include <readings_writer.h>
+#include <readings_partitions.h>
+#include <readings_columns.h>
+#include <readings_rollups.h>
+#include <libgen.h>
 
 
 ConnectionManager *ConnectionManager::instance = 0;
@@ -20,6 +25,10 @@ ConnectionManager::ConnectionManager()
 {
 	lastError.message = NULL;
 	lastError.entryPoint = NULL;
+	m_writer = NULL;
+	m_partitions = NULL;
+	m_columns = NULL;
+	m_rollups = NULL;
 	if (getenv("FLEDGE_TRACE_SQL"))
 		m_trace = true;
 	else
@@ -32,7 +41,89 @@ ConnectionManager::ConnectionManager()
  */
 void ConnectionManager::shutdown()
 {
+	delete m_writer;
+	m_writer = NULL;
 	shrinkPool(idle.size());
+	while (!idleReaders.empty())
+	{
+		delete idleReaders.front();
+		idleReaders.pop_front();
+	}
+	delete m_partitions;
+	m_partitions = NULL;
+	delete m_columns;
+	m_columns = NULL;
+	delete m_rollups;
+	m_rollups = NULL;
+}
+
+/**
+ * Start the single writer of the readings table. The appends and purges
+ * of the connections allocated from the pool are then executed by the
+ * writer thread on its own connection.
+ *
+ * If FLEDGE_READINGS_PARTITION_HOURS is set the readings are partitioned
+ * into a database file per that number of hours, in the directory of the
+ * Fledge database. Otherwise if FLEDGE_READINGS_COLUMNAR is set the
+ * numeric datapoints of the readings are held in typed columns of a
+ * table per asset.
+ *
+ * If FLEDGE_READINGS_ROLLUPS is set to a list of bucket sizes in seconds,
+ * such as 60,3600, the readings are rolled up into buckets of those sizes
+ * and the timebucket queries of those sizes answered from the rollups.
+ *
+ * If FLEDGE_READINGS_CONTINUOUS_PURGE is set the retention of the last
+ * purge by age is applied continuously, in small increments, between the
+ * purge requests. This does not apply to partitioned readings.
+ */
+void ConnectionManager::startWriter()
+{
+	if (m_writer == NULL)
+	{
+#ifndef SQLITE_SPLIT_READINGS
+		const char *hours = getenv("FLEDGE_READINGS_PARTITION_HOURS");
+		if (hours && atoi(hours) > 0)
+		{
+			std::string path = Connection::databasePath();
+			m_partitions = new ReadingsPartitions(dirname(&path[0]), atoi(hours));
+		}
+		else if (getenv("FLEDGE_READINGS_COLUMNAR"))
+		{
+			m_columns = new ReadingsColumns();
+		}
+		const char *rollups = getenv("FLEDGE_READINGS_ROLLUPS");
+		if (rollups && *rollups)
+		{
+			m_rollups = new ReadingsRollups(rollups);
+		}
+#endif
+		m_writer = new ReadingsWriter(m_partitions, m_columns, m_rollups);
+		if (m_partitions == NULL && getenv("FLEDGE_READINGS_CONTINUOUS_PURGE"))
+		{
+			m_writer->purgeScheduler().setContinuous(true);
+		}
+	}
+}
+
+/**
+ * Return the purge generation, which changes whenever readings are
+ * removed other than by a purge request: by an increment of the
+ * continuous purge or by the removal of a partition.
+ *
+ * @return unsigned long	The purge generation
+ */
+unsigned long ConnectionManager::purgeGeneration()
+{
+	unsigned long generation = 0;
+	if (m_writer)
+	{
+		generation += m_writer->purgeScheduler().totalRemoved();
+	}
+	if (m_partitions)
+	{
+		generation += m_partitions->removals();
+	}
+	return generation;
 }
 
 /**
@@ -118,6 +209,10 @@ Connection *conn = 0;
 	idleLock.unlock();
 	if (conn)
 	{
+		conn->setWriter(m_writer);
+		conn->setPartitions(m_partitions);
+		conn->setColumns(m_columns);
+		conn->setRollups(m_rollups);
 		inUseLock.lock();
 		inUse.push_front(conn);
 		inUseLock.unlock();
@@ -125,6 +220,36 @@ Connection *conn = 0;
 	return conn;
 }
 
+/**
+ * Allocate a connection that only reads the readings. These connections
+ * open the database read-only, the readings are written by the writer
+ * thread alone. If no reader is idle a new one is added.
+ */
+Connection *ConnectionManager::allocateReader()
+{
+Connection *conn = 0;
+
+	idleLock.lock();
+	if (idleReaders.empty())
+	{
+		conn = new Connection(true);
+	}
+	else
+	{
+		conn = idleReaders.front();
+		idleReaders.pop_front();
+	}
+	idleLock.unlock();
+	conn->setWriter(m_writer);
+	conn->setPartitions(m_partitions);
+	conn->setColumns(m_columns);
+	conn->setRollups(m_rollups);
+	inUseLock.lock();
+	inUse.push_front(conn);
+	inUseLock.unlock();
+	return conn;
+}
+
 /**
  * Release a connection back to the idle pool for
  * reallocation.
@@ -137,7 +262,10 @@ void ConnectionManager::release(Connection *conn)
 	inUse.remove(conn);
 	inUseLock.unlock();
 	idleLock.lock();
-	idle.push_back(conn);
+	if (conn->readOnly())
+		idleReaders.push_back(conn);
+	else
+		idle.push_back(conn);
 	idleLock.unlock();
 }
 
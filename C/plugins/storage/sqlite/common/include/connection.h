@@ -16,6 +16,14 @@
 #include <sqlite3.h>
 #include <mutex>
 #include <reading_stream.h>
+#include <reading_batch.h>
+#include <statement_cache.h>
+#include <readings_partitions.h>
+#include <readings_columns.h>
+#include <readings_timestamp.h>
+#include <readings_rollups.h>
+#include <readings_latest.h>
+#include <vector>
 
 
 #define LEN_BUFFER_DATE 100
@@ -65,11 +73,16 @@ int countCallback(void *data,
 
 bool applyDateFormat(const std::string& inFormat, std::string& outFormat);
 
+class ReadingsWriter;
+
 class Connection {
 	public:
-		Connection();
+		Connection(bool readOnly = false);
 		~Connection();
+		bool		readOnly() const { return m_readOnly; };
 #ifndef SQLITE_SPLIT_READINGS
+		static std::string
+				databasePath();
 		bool		retrieve(const std::string& table,
 					 const std::string& condition,
 					 std::string& resultSet);
@@ -82,9 +95,11 @@ class Connection {
 		bool		get_table_snapshots(const std::string& table, std::string& resultSet);
 #endif
 		int		appendReadings(const char *readings);
+		int		appendReadingBatch(const ReadingBatch *batch, std::string *rows = NULL);
 		int 	readingStream(ReadingStream **readings, bool commit);
 		bool		fetchReadings(unsigned long id, unsigned int blksize,
 						std::string& resultSet);
+		bool		latestReadings(const char *asset, std::string& resultSet);
 		bool		retrieveReadings(const std::string& condition,
 						 std::string& resultSet);
 		unsigned int	purgeReadings(unsigned long age, unsigned int flags,
@@ -96,8 +111,17 @@ class Connection {
 		bool		formatDate(char *formatted_date, size_t formatted_date_size, const char *date);
 		bool		aggregateQuery(const rapidjson::Value& payload, std::string& resultSet);
 		bool        getNow(std::string& Now);
+		void		setWriter(ReadingsWriter *writer) { m_writer = writer; };
+		void		setPartitions(ReadingsPartitions *partitions) { m_partitions = partitions; };
+		void		setColumns(ReadingsColumns *columns) { m_columns = columns; };
+		void		setRollups(ReadingsRollups *rollups) { m_rollups = rollups; };
 
 	private:
+		friend class	ReadingsWriter;
+		friend class	ReadingsInserter;
+		friend class	ReadingsLatest;
+		ReadingsWriter	*m_writer;
+		bool		m_readOnly;
 		bool 		m_streamOpenTransaction;
 		int		m_queuing;
 		std::mutex	m_qMutex;
@@ -108,8 +132,63 @@ class Connection {
 		bool		m_logSQL;
 		void		raiseError(const char *operation, const char *reason,...);
 		sqlite3		*dbHandle;
+		StatementCache	*m_statements;
+		sqlite3_stmt	*prepare(const std::string& sql);
+#ifndef SQLITE_SPLIT_READINGS
+#endif
+		int		purgeBlock(const char *sql, unsigned long limit, unsigned long& usecs);
+		ReadingsPartitions
+				*m_partitions;
+		unsigned long	m_partitionGeneration;
+		time_t		m_partitionRetry;
+		std::vector<std::string>
+				m_attached;
+		bool		syncPartitions();
+		std::string	readingsTable();
+		std::string	appendTable();
+		void		removeOldestPartition();
+		unsigned long	lastReadingId();
+		bool		readingIds(const std::string& schema, unsigned long& minId, unsigned long& maxId);
+		time_t		readingTime(const std::string& schema, unsigned long id);
+		unsigned int	purgePartitions(bool byRows, unsigned long param, unsigned int flags,
+						unsigned long sent, std::string& result,
+						bool legacy = true);
+		ReadingsColumns	*m_columns;
+		unsigned long	m_columnsGeneration;
+		std::vector<ReadingsColumns::AssetTable>
+				m_columnTables;
+		bool		syncColumns();
+		int		insertColumnar(const char *user_ts, int64_t usecs, const char *asset_code,
+						const rapidjson::Value& reading);
+		int		insertColumnar(const char *user_ts, int64_t usecs, const char *asset_code,
+						const char *reading, size_t length);
+		std::string	columnarDatapoints();
+		bool		m_epochTimestamps;
+		bool		m_timestampView;
+		unsigned long	m_migrateId;
+		unsigned long	m_migrateMaxId;
+		bool		userTimestamp(const char *&user_ts, char *formatted, int64_t& usecs, int64_t now);
+		void		bindTimestamp(sqlite3_stmt *stmt, int column, const char *user_ts, int64_t usecs);
+		std::string	timestampColumns(const std::string& prefix);
+		bool		epochFilters();
+		bool		startTimestampMigration();
+		bool		migrateTimestamps();
+		bool		m_incrementalVacuum;
+		bool		setupVacuum();
+		unsigned long	incrementalVacuum();
+		int		purgeIncrement(unsigned long age, bool retainUnsent, unsigned long sent,
+						unsigned long blockSize, int& unsentPurged);
+		ReadingsRollups	*m_rollups;
+		unsigned long	m_rollupsMinId;
+		std::string	rollupSource();
+		bool		updateRollups();
+		bool		rollupQuery(const rapidjson::Value& where, unsigned long size, SQLBuffer& sql);
+		ReadingsLatest	*m_latest;
 		int		mapResultSet(void *res, std::string& resultSet);
-		bool		jsonWhereClause(const rapidjson::Value& whereClause, SQLBuffer&, bool convertLocaltime = false);
+		bool		jsonWhereClause(const rapidjson::Value& whereClause, SQLBuffer&, bool convertLocaltime = false,
+					bool epochTimestamps = false,
+					std::vector<const rapidjson::Value *> *bindings = NULL);
+		bool		bindValues(sqlite3_stmt *stmt, const std::vector<const rapidjson::Value *>& bindings);
 		bool		jsonModifiers(const rapidjson::Value&, SQLBuffer&, bool isTableReading = false);
 		bool		jsonAggregates(const rapidjson::Value&,
 					       const rapidjson::Value&,
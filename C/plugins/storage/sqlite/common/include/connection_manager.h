@@ -15,6 +15,10 @@
 #include <mutex>
 
 class Connection;
+class ReadingsWriter;
+class ReadingsPartitions;
+class ReadingsColumns;
+class ReadingsRollups;
 
 /**
  * Singleton class to manage SQLite3 connection pool
@@ -25,8 +29,12 @@ class ConnectionManager {
 		void                      growPool(unsigned int);
 		unsigned int              shrinkPool(unsigned int);
 		Connection                *allocate();
+		Connection                *allocateReader();
 		void                      release(Connection *);
 		void			  shutdown();
+		void			  startWriter();
+		ReadingsWriter		  *getWriter() { return m_writer; };
+		unsigned long		  purgeGeneration();
 		void			  setError(const char *, const char *, bool);
 		PLUGIN_ERROR		  *getError()
 					  {
@@ -40,12 +48,17 @@ class ConnectionManager {
 		static ConnectionManager     *instance;
 	protected:
 		std::list<Connection *>      idle;
+		std::list<Connection *>      idleReaders;
 		std::list<Connection *>      inUse;
 		std::mutex                   idleLock;
 		std::mutex                   inUseLock;
 		std::mutex                   errorLock;
 		PLUGIN_ERROR		     lastError;
 		bool			     m_trace;
+		ReadingsWriter		     *m_writer;
+		ReadingsPartitions	     *m_partitions;
+		ReadingsColumns		     *m_columns;
+		ReadingsRollups		     *m_rollups;
 };
 
 #endif
@@ -0,0 +1,79 @@
+#ifndef _READINGS_COLUMNS_H
+#define _READINGS_COLUMNS_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <sqlite3.h>
+
+#define COLUMNS_TABLE_PREFIX	"readings_asset_"
+#define COLUMNS_ASSETS_MAX	200	// Assets with a table, the view of the readings is a compound select of one per asset
+#define COLUMNS_COLUMNS_MAX	100	// Typed columns per asset, further datapoints are kept in the reading
+
+/**
+ * The columnar layout of the numeric datapoints of the readings. Each
+ * asset has a table, keyed by the id of the reading, with an INTEGER or
+ * REAL column for each numeric datapoint of the asset. The datapoints that
+ * do not have a column remain in the JSON reading of the readings table.
+ *
+ * The tables are catalogued in the readings_assets table together with the
+ * first reading id stored in the columnar layout, the readings of the asset
+ * before that id hold all of their datapoints as JSON.
+ *
+ * Tables and columns are only added by the readings writer, within its
+ * transactions. The changes are published to the other connections, by
+ * incrementing the generation, once the transaction has completed.
+ *
+ * Column names are not case sensitive, a datapoint whose name only differs
+ * in case from one that has a column is kept in the reading, as are those
+ * for which the column could not be added.
+ *
+ * When a reading is read back its typed datapoints are added to those
+ * kept as JSON, so they follow the other datapoints of the reading
+ * rather than being in the order they were appended in.
+ */
+class ReadingsColumns {
+	public:
+		class Column {
+			public:
+				std::string	datapoint;
+				bool		integer;
+		};
+		class AssetTable {
+			public:
+				std::string		assetCode;
+				std::string		table;
+				unsigned long		firstId;
+				std::vector<Column>	columns;
+				std::unordered_map<std::string, int>
+							index;	// Column of each datapoint, -1 if kept in the reading
+		};
+
+		ReadingsColumns();
+		bool		load(sqlite3 *db);
+		void		publish();
+		bool		pending() const { return m_pending; };
+		unsigned long	generation() const { return m_generation; };
+		unsigned long	tables(std::vector<AssetTable>& tables);
+		AssetTable	*table(sqlite3 *db, const std::string& assetCode);
+		int		column(sqlite3 *db, AssetTable& table, const std::string& datapoint, bool integer);
+		static std::string
+				columnName(const std::string& datapoint);
+	private:
+		std::map<std::string, AssetTable>	m_tables;
+		std::vector<AssetTable>			m_published;
+		bool					m_pending;
+		std::atomic<unsigned long>		m_generation;
+		std::mutex				m_mutex;
+};
+#endif
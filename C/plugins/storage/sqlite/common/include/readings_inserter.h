@@ -0,0 +1,81 @@
+#ifndef _READINGS_INSERTER_H
+#define _READINGS_INSERTER_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_timestamp.h>
+#include <string>
+
+#define INSERT_MAX_ROWS		256	// Most readings inserted by one statement
+#define INSERT_ROWS_FACTOR	4	// Ratio between the numbers of rows of the statements
+
+class Connection;
+
+/**
+ * Inserts the readings of a batch into a readings table with multi-row
+ * insert statements, rather than stepping a single row statement for
+ * each reading.
+ *
+ * The readings added are held until there are enough to fill the largest
+ * statement, which has INSERT_MAX_ROWS rows or fewer if the parameters of
+ * that many rows exceed the limit of the connection. The readings left at
+ * the end of the batch are inserted by statements of fewer rows, each a
+ * quarter of the size of the one before. The statements are taken from
+ * the statement cache of the connection.
+ *
+ * The readings inserted are added to the latest readings of the assets
+ * when the connection keeps them, and those are updated by flush. They
+ * may also be collected as the rows a readings fetch would return for
+ * them, without reading them back.
+ */
+class ReadingsInserter {
+	public:
+		ReadingsInserter(Connection *connection, const std::string& table,
+					bool epoch, int64_t now, bool escape = true);
+		bool		add(const char *userTs, int64_t usecs,
+					const char *assetCode, int assetCodeLength,
+					const char *reading, int readingLength);
+		bool		flush();
+		int		rows() const { return m_rows; };
+		void		collect(std::string *rows);
+		/**
+		 * Return if the rows collected are those of consecutive ids
+		 */
+		bool		contiguous() const { return m_contiguous; };
+	private:
+		bool		insert(int first, int count);
+		void		collectRows(int first, int count, int64_t id);
+		/**
+		 * A reading waiting to be inserted
+		 */
+		class Row {
+			public:
+				char		userTs[TIMESTAMP_BUFFER_LEN];
+				int64_t		usecs;
+				const char	*assetCode;
+				int		assetCodeLength;
+				const char	*reading;
+				int		readingLength;
+				std::string	escaped;
+		};
+		Connection		*m_connection;
+		std::string		m_table;
+		bool			m_epoch;
+		bool			m_escape;
+		int64_t			m_now;
+		char			m_ts[TIMESTAMP_BUFFER_LEN];
+		int			m_params;
+		int			m_maxRows;
+		Row			m_pending[INSERT_MAX_ROWS];
+		int			m_count;
+		int			m_rows;
+		std::string		*m_collect;
+		int64_t			m_nextId;
+		bool			m_contiguous;
+};
+#endif
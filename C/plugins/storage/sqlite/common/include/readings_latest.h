@@ -0,0 +1,56 @@
+#ifndef _READINGS_LATEST_H
+#define _READINGS_LATEST_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+class Connection;
+
+/**
+ * The latest reading of each asset, kept in the fledge.readings_latest
+ * table so that the current value of every asset is read from a row per
+ * asset rather than from the index of the readings.
+ *
+ * The readings inserted by an append are added as they are inserted,
+ * keeping the reading with the latest user timestamp of each asset, and
+ * are written to the table in the transaction of the append. A row is
+ * only replaced by a reading whose user timestamp is the same or later.
+ * The user timestamps of the table are microseconds since the epoch,
+ * whatever the form of those of the readings.
+ *
+ * Purges remove the readings with the lowest ids, the rows of the table
+ * whose reading has been purged are then replaced from the readings that
+ * remain, in the transaction of the purge.
+ */
+class ReadingsLatest {
+	public:
+		ReadingsLatest();
+		static bool	seed(Connection *connection);
+		void		add(const char *assetCode, int assetCodeLength, int64_t id,
+					int64_t usecs, const char *reading, int readingLength);
+		bool		update(Connection *connection);
+		static bool	purged(Connection *connection, unsigned long limit);
+		void		clear();
+	private:
+		/**
+		 * The latest reading of an asset appended by the transaction
+		 */
+		class Latest {
+			public:
+				int64_t		id;
+				int64_t		usecs;
+				std::string	reading;
+		};
+		typedef std::unordered_map<std::string, Latest>	Assets;
+		Assets			m_assets;
+		Assets::iterator	m_last;
+};
+#endif
@@ -0,0 +1,90 @@
+#ifndef _READINGS_PARTITIONS_H
+#define _READINGS_PARTITIONS_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <time.h>
+
+#define PARTITION_PREFIX	"readings_"
+#define PARTITION_MAX		8	// Partitions attached at once, SQLite allows 10 attached databases by default
+#define PARTITION_REMOVED	"-removed"	// Suffix of the file that marks a partition as removed
+#define PARTITION_RETRY		60	// Seconds between attempts to remove a partition to make room for a new one
+
+/**
+ * The time partitioned layout of the readings. Each partition is a
+ * database file, in the same directory as the Fledge database, that holds
+ * the readings inserted during a window of time. The partitions are
+ * attached to every connection that uses the readings and purged by
+ * removing whole partitions.
+ *
+ * The generation is incremented whenever a partition is added or removed,
+ * connections compare it with the generation they last attached to. The
+ * removals count the partitions removed, with their readings, since the
+ * service started.
+ *
+ * Connections report the partitions they attach and detach. The files of
+ * a removed partition are only deleted once no connection has it
+ * attached, until then it still counts towards the limit of partitions
+ * so no new partition is created.
+ *
+ * The retention of the last purge request is kept so that the oldest
+ * partition is only removed to make room for a new one if that purge
+ * would remove it. Partitions are never removed before a purge request
+ * has been made.
+ */
+class ReadingsPartitions {
+	public:
+		class Partition {
+			public:
+				std::string	alias;	// The schema name the partition is attached as
+				std::string	path;
+				time_t		start;
+		};
+
+		ReadingsPartitions(const std::string& directory, unsigned int hours);
+		unsigned long	generation() const { return m_generation; };
+		unsigned long	partitions(std::vector<Partition>& partitions);
+		bool		find(time_t when, Partition& partition);
+		bool		create(time_t when, unsigned long lastId, Partition& partition);
+		bool		full();
+		void		remove(const std::string& alias);
+		void		attached(const std::string& alias);
+		void		detached(const std::string& alias);
+		time_t		end(const Partition& partition) const { return partition.start + m_window; };
+		unsigned long	purgedId() const { return m_purgedId; };
+		unsigned long	removals() const { return m_removals; };
+		void		setRetention(bool byRows, unsigned long param,
+					unsigned int flags, unsigned long sent);
+		bool		retention(bool& byRows, unsigned long& param,
+					unsigned int& flags, unsigned long& sent);
+	private:
+		Partition	partition(time_t start);
+		void		deleteFiles(const Partition& partition);
+		bool		merge(const Partition& from, const Partition& into);
+		std::string			m_directory;
+		time_t				m_window;
+		std::vector<Partition>		m_partitions;
+		std::vector<Partition>		m_removed;	// Removed but still attached
+		std::map<std::string, unsigned int>
+						m_attachments;
+		std::atomic<unsigned long>	m_generation;
+		std::atomic<unsigned long>	m_removals;
+		unsigned long			m_purgedId;
+		bool				m_retention;
+		bool				m_byRows;
+		unsigned long			m_param;
+		unsigned int			m_flags;
+		unsigned long			m_sent;
+		std::mutex			m_mutex;
+};
+#endif
@@ -0,0 +1,80 @@
+#ifndef _READINGS_PURGE_H
+#define _READINGS_PURGE_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <mutex>
+#include <chrono>
+
+#define PURGE_TARGET_BLOCK_US		(70*1000)	// Time a block of deletes should take when there are no appends
+#define PURGE_MIN_TARGET_BLOCK_US	(5*1000)	// Time a block should take however busy the appends are
+#define PURGE_BLOCK_SZ_GRANULARITY	5		// Rows
+#define MIN_PURGE_DELETE_BLOCK_SIZE	20
+#define MAX_PURGE_DELETE_BLOCK_SIZE	10000
+#define PURGE_MAX_PAUSE_MS		500		// Longest pause between increments of the continuous purge
+#define PURGE_LOAD_WINDOW_US		(1000*1000)	// Period over which the load of the appends is measured
+#define PURGE_IDLE_INTERVAL_MS		(10*1000)	// Interval of a continuous purge that finds nothing to delete
+#define PURGE_PROGRESS_INTERVAL		10		// Seconds between progress reports of a purge
+#define PURGE_VACUUM_PAGES		100		// Pages freed by each incremental vacuum
+
+/**
+ * Schedules the deletes of the purge of the readings so that the purge
+ * is spread out rather than contending with the appends in bursts.
+ *
+ * The writer of the readings records the time taken by each transaction
+ * of appends and by each block of deletes. The size of the next block
+ * is chosen so that it takes a target time, the target shrinking as the
+ * share of the time of the writer taken by appends grows. Each block is
+ * a work item of the writer, so the appends queued meanwhile run before
+ * the next block.
+ *
+ * A continuous purge applies the age retention of the last purge
+ * request in small increments while the writer has time to spare, the
+ * pause before the next increment growing with the share of the appends.
+ * The readings it removes are reported by the next purge request.
+ */
+class PurgeScheduler {
+	public:
+		PurgeScheduler();
+		void		appended(unsigned long usecs);
+		void		purged(int rows, unsigned long usecs);
+		unsigned long	blockSize();
+		void		setContinuous(bool continuous) { m_continuous = continuous; };
+		void		setRetention(unsigned long age, bool retainUnsent, unsigned long sent);
+		bool		retention(unsigned long& age, bool& retainUnsent, unsigned long& sent);
+		bool		due();
+		void		increment(int removed, int unsentPurged);
+		void		takeRemoved(unsigned long& removed, unsigned long& unsentPurged);
+		unsigned long	totalRemoved();
+		void		vacuumed(unsigned long pages);
+		std::string	toJSON();
+	private:
+		unsigned long	pauseMs();
+		void		updateLoad(std::chrono::steady_clock::time_point now);
+		std::mutex	m_mutex;
+		double		m_costPerRow;		// Microseconds to delete a row
+		double		m_load;			// Share of the time of the writer taken by appends
+		unsigned long	m_lastBlockUs;
+		std::chrono::steady_clock::time_point
+				m_windowStart;
+		unsigned long	m_windowAppendUs;
+		bool		m_continuous;
+		bool		m_retention;
+		unsigned long	m_age;
+		bool		m_retainUnsent;
+		unsigned long	m_sent;
+		std::chrono::steady_clock::time_point
+				m_next;
+		unsigned long	m_removed;
+		unsigned long	m_unsentPurged;
+		unsigned long	m_totalRemoved;
+		unsigned long	m_blocks;
+		unsigned long	m_vacuumPages;
+};
+#endif
@@ -0,0 +1,48 @@
+#ifndef _READINGS_ROLLUPS_H
+#define _READINGS_ROLLUPS_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+
+#define ROLLUPS_TABLE		"readings_rollup_buckets"
+#define ROLLUPS_BLOCK		10000	// Readings added to the rollups in one statement
+#define ROLLUPS_INTERVAL_MS	1000	// Interval at which the readings appended are added to the rollups
+#define ROLLUPS_MARGIN		1	// Seconds between a time bound and a bucket taken from a rollup
+
+/**
+ * The rollups of the readings, the min, max, sum and count of each
+ * datapoint of each asset per time bucket, for a number of bucket sizes.
+ * They answer the timebucket queries of all the datapoints of the assets
+ * without reading the readings of the buckets they hold.
+ *
+ * A bucket is numbered as the timebucket queries number it, the user
+ * timestamp in seconds divided by the size and rounded, so that the
+ * buckets of a rollup are those of a query of the same size.
+ *
+ * The buckets of every rollup are held in fledge.readings_rollup_buckets
+ * by bucket size, and the last reading id added to each rollup is kept in
+ * the readings_rollups catalogue. Both tables are created with the schema.
+ * The readings writer adds the readings appended since to the rollups at
+ * intervals. The readings not yet added are read by the queries.
+ */
+class ReadingsRollups {
+	public:
+		ReadingsRollups(const std::string& sizes);
+		const std::vector<unsigned long>&
+				sizes() const { return m_sizes; };
+		bool		has(unsigned long size) const;
+		bool		seed(sqlite3 *db);
+		static std::string
+				bucket(const std::string& column, unsigned long size);
+	private:
+		std::vector<unsigned long>	m_sizes;
+};
+#endif
@@ -0,0 +1,38 @@
+#ifndef _READINGS_TIMESTAMP_H
+#define _READINGS_TIMESTAMP_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <stdint.h>
+#include <sqlite3.h>
+
+#define TIMESTAMP_BUFFER_LEN	40
+#define TIMESTAMP_MIGRATE_BLOCK	10000	// Readings whose timestamps are migrated in one statement
+
+/**
+ * Conversion of the timestamps of the readings between text and the
+ * number of microseconds since the epoch, the form in which they are
+ * stored when the readings use epoch timestamps.
+ *
+ * The conversions are also registered as SQL functions on a connection:
+ *
+ *   fledge_epoch(value)		The microseconds since the epoch of a text timestamp
+ *   fledge_ts(value, digits, zone)	The text of a timestamp with digits of fractional
+ *					seconds, followed by +00:00 if zone is non zero
+ *
+ * Both functions return values that are already in the form requested,
+ * and values that can not be converted, as they are.
+ */
+class ReadingsTimestamp {
+	public:
+		static bool	parse(const char *text, int64_t& usecs);
+		static int	format(int64_t usecs, int digits, bool zone, char *buffer);
+		static int64_t	now();
+		static void	registerFunctions(sqlite3 *db);
+};
+#endif
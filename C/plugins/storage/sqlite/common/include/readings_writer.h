@@ -0,0 +1,98 @@
+#ifndef _READINGS_WRITER_H
+#define _READINGS_WRITER_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <latency_histogram.h>
+#include <readings_purge.h>
+
+#define WRITER_GROUP_MAX	64	// Maximum number of appends committed in one transaction
+
+class Connection;
+class ReadingsPartitions;
+class ReadingsColumns;
+class ReadingsRollups;
+
+/**
+ * The single writer of the readings table. A thread owns a dedicated
+ * database connection and executes the work queued by the other
+ * connections, the appends and the blocks of rows deleted by a purge.
+ *
+ * Appends that are queued together are executed in a single transaction,
+ * each append uses a savepoint so that a failing append does not affect
+ * the others. Each purge block is executed in a transaction of its own,
+ * the appends queued while a purge is in progress run between its blocks.
+ * The purge scheduler of the writer sizes those blocks and runs
+ * the increments of the continuous purge.
+ *
+ * The readings appended are added to the rollups at intervals, in a
+ * transaction of their own, and while the writer is idle when the rollups
+ * are behind the readings.
+ *
+ * The connection of the writer keeps the latest reading of each asset,
+ * updated in the transaction of each append.
+ */
+class ReadingsWriter {
+	public:
+		enum WorkType { Append, Purge };
+		/**
+		 * The work to execute on the connection of the writer, returns
+		 * the number of rows affected or -1 on failure.
+		 */
+		typedef std::function<int(Connection *)>	WorkFunction;
+
+		ReadingsWriter(ReadingsPartitions *partitions = NULL, ReadingsColumns *columns = NULL,
+				ReadingsRollups *rollups = NULL);
+		~ReadingsWriter();
+		int		execute(WorkFunction work, WorkType type);
+		std::string	statistics();
+		void		run();
+		PurgeScheduler&	purgeScheduler() { return m_purge; };
+		bool		migrating() const { return m_migrating; };
+	private:
+		class Work {
+			public:
+				Work(WorkFunction work, WorkType type) : work(work), type(type),
+							result(-1), done(false),
+							queued(std::chrono::steady_clock::now()) {};
+				WorkFunction		work;
+				WorkType		type;
+				int			result;
+				bool			done;
+				std::chrono::steady_clock::time_point
+							queued;
+		};
+		void		commit(std::deque<Work *>& group);
+		void		purgeIncrement();
+		Connection			*m_connection;
+		std::deque<Work *>		m_queue;
+		std::mutex			m_mutex;
+		std::condition_variable		m_cv;
+		std::condition_variable		m_doneCv;
+		bool				m_running;
+		std::atomic<bool>		m_migrating;
+		bool				m_vacuum;
+		bool				m_rollup;
+		bool				m_rollupBehind;
+		std::chrono::steady_clock::time_point
+						m_rollupNext;
+		PurgeScheduler			m_purge;
+		std::thread			*m_thread;
+		LatencyHistogram		m_appendWait;
+		LatencyHistogram		m_purgeWait;
+		LatencyHistogram		m_transactions;
+};
+#endif
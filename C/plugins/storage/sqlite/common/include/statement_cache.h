@@ -0,0 +1,51 @@
+#ifndef _STATEMENT_CACHE_H
+#define _STATEMENT_CACHE_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <sqlite3.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+
+#define STATEMENT_CACHE_SIZE	64	// Prepared statements held per connection
+
+/**
+ * A least recently used cache of the prepared statements of a single
+ * SQLite connection, keyed by the SQL text of the statement.
+ *
+ * Only statements whose values are bound as parameters, such as those
+ * of the readings append, fetch and purge and of the common retrieve,
+ * should be cached. Queries generated with their values inline would
+ * each take an entry that is rarely reused and evict the statements
+ * that are.
+ *
+ * Statements returned by the cache are reset and have no parameters bound,
+ * they remain owned by the cache and must not be finalized by the caller.
+ * The caller should reset the statement once it has finished with it so
+ * that the statement does not hold a read transaction open.
+ */
+class StatementCache {
+	public:
+		StatementCache(sqlite3 *db, unsigned int size = STATEMENT_CACHE_SIZE);
+		~StatementCache();
+		sqlite3_stmt	*prepare(const std::string& sql);
+		void		clear();
+		unsigned long	hits() const { return m_hits; };
+		unsigned long	misses() const { return m_misses; };
+	private:
+		typedef std::pair<std::string, sqlite3_stmt *>	Entry;
+		sqlite3			*m_db;
+		unsigned int		m_size;
+		std::list<Entry>	m_lru;
+		std::unordered_map<std::string, std::list<Entry>::iterator>
+					m_index;
+		unsigned long		m_hits;
+		unsigned long		m_misses;
+};
+#endif
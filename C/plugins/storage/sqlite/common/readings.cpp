@@ -13,7 +13,12 @@
 #include <connection_manager.h>
 #include <common.h>
 #include <reading_stream.h>
+#include <readings_writer.h>
+#include <readings_payload.h>
+#include <readings_inserter.h>
+#include <readings_latest.h>
 #include <random>
+#include <algorithm>
 
 // 1 enable performance tracking
 #define INSTRUMENT	0
@@ -27,27 +32,10 @@
 #define	RDS_ASSET_CODE(stream, x)		stream[x]->assetCode
 #define	RDS_PAYLOAD(stream, x)			&(stream[x]->assetCode[0]) + stream[x]->assetCodeLength
 
-// Retry mechanism
-#define PREP_CMD_MAX_RETRIES		20	    // Maximum no. of retries when a lock is encountered
-#define PREP_CMD_RETRY_BASE 		50    // Base time to wait for
-#define PREP_CMD_RETRY_BACKOFF		50 	// Variable time to wait for
-
 /*
- * Control the way purge deletes readings. The block size sets a limit as to how many rows
- * get deleted in each call, whilst the sleep interval controls how long the thread sleeps
- * between deletes. The idea is to not keep the database locked too long and allow other threads
- * to have access to the database between blocks.
+ * Purge deletes readings in blocks, sized and paced by the purge scheduler
+ * of the readings writer so that the appends are not held up by the purge.
  */
-#define PURGE_SLEEP_MS 500
-#define PURGE_DELETE_BLOCK_SIZE	20
-#define TARGET_PURGE_BLOCK_DEL_TIME	(70*1000) 	// 70 msec
-#define PURGE_BLOCK_SZ_GRANULARITY	5 	// 5 rows
-#define MIN_PURGE_DELETE_BLOCK_SIZE	20
-#define MAX_PURGE_DELETE_BLOCK_SIZE	1500
-#define RECALC_PURGE_BLOCK_SIZE_NUM_BLOCKS	30	// recalculate purge block size after every 30 blocks
-
-#define PURGE_SLOWDOWN_AFTER_BLOCKS 5
-#define PURGE_SLOWDOWN_SLEEP_MS 500
 
 #define SECONDS_PER_DAY "86400.0"
 // 2440587.5 is the julian day at 1/1/1970 0:00 UTC.
@@ -66,34 +54,19 @@ using namespace rapidjson;
 
 #define CONNECT_ERROR_THRESHOLD		5*60	// 5 minutes
 
-#define MAX_RETRIES			40	// Maximum no. of retries when a lock is encountered
-#define RETRY_BACKOFF			100	// Multipler to backoff DB retry on lock
-
 /*
  * The following allows for conditional inclusion of code that tracks the top queries
- * run by the storage plugin and the number of times a particular statement has to
- * be retried because of the database being busy./
+ * run by the storage plugin.
  */
 #define DO_PROFILE		0
-#define DO_PROFILE_RETRIES	0
 #if DO_PROFILE
 #include <profile.h>
 
 #define	TOP_N_STATEMENTS		10	// Number of statements to report in top n
-#define RETRY_REPORT_THRESHOLD		1000	// Report retry statistics every X calls
 
 QueryProfile profiler(TOP_N_STATEMENTS);
-unsigned long retryStats[MAX_RETRIES] = { 0,0,0,0,0,0,0,0,0,0 };
-unsigned long numStatements = 0;
-int	      maxQueue = 0;
 #endif
 
-static std::atomic<int> m_waiting(0);
-static std::atomic<int> m_writeAccessOngoing(0);
-static std::mutex	db_mutex;
-static std::condition_variable	db_cv;
-static int purgeBlockSize = PURGE_DELETE_BLOCK_SIZE;
-
 #define START_TIME std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
 #define END_TIME std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now(); \
 				 auto usecs = std::chrono::duration_cast<std::chrono::microseconds>( t2 - t1 ).count();
@@ -210,108 +183,128 @@ bool Connection::aggregateQuery(const Value& payload, string& resultSet)
 	// JSON format aggregated data
 	sql.append(", '{' || group_concat('\"' || x || '\" : ' || resd, ', ') || '}' AS reading ");
 
-	// subquery
-	sql.append("FROM ( SELECT  x, asset_code, max(timestamp) AS timestamp, ");
-	// Add min
-	sql.append("'{\"min\" : ' || min(theval) || ', ");
-	// Add max
-	sql.append("\"max\" : ' || max(theval) || ', ");
-	// Add avg
-	sql.append("\"average\" : ' || avg(theval) || ', ");
-	// Add count
-	sql.append("\"count\" : ' || count(theval) || ', ");
-	// Add sum
-	sql.append("\"sum\" : ' || sum(theval) || '}' AS resd ");
-
-	if (size < 1)
-	{
-		// Add max(user_ts)
-		sql.append(", max(" + timeColumn + ") AS " + timeColumn + " ");
-	}
-
-	// subquery
-	sql.append("FROM ( SELECT asset_code, ");
-	sql.append(timeColumn);
-
-	if (size >= 1)
-	{
-		sql.append(", datetime(");
-	}
-	else
+	if (!timeColumn.compare("user_ts") && size >= 1 && fmod(size, 1.0) == 0.0
+			&& rollupQuery(payload["where"], (unsigned long)size, sql))
 	{
-		sql.append(", (");
-	}
-
-	// Size formatted string
-	string size_format;
-	if (fmod(size, 1.0) == 0.0)
-	{
-		size_format = to_string(int(size));
+		// The buckets are answered from the rollup of the bucket size
 	}
 	else
 	{
-		size_format = to_string(size);
-	}
+		// subquery
+		sql.append("FROM ( SELECT  x, asset_code, max(timestamp) AS timestamp, ");
+		// Add min
+		sql.append("'{\"min\" : ' || min(theval) || ', ");
+		// Add max
+		sql.append("\"max\" : ' || max(theval) || ', ");
+		// Add avg
+		sql.append("\"average\" : ' || avg(theval) || ', ");
+		// Add count
+		sql.append("\"count\" : ' || count(theval) || ', ");
+		// Add sum
+		sql.append("\"sum\" : ' || sum(theval) || '}' AS resd ");
+
+		if (size < 1)
+		{
+			// Add max(user_ts)
+			sql.append(", max(" + timeColumn + ") AS " + timeColumn + " ");
+		}
 
-	// Add timebucket size
-	// Unix Time is (Julian Day - JulianDay(1/1/1970 0:00 UTC) * Seconds_per_day
-	if (size != 1)
-	{
-		sql.append(size_format);
-		sql.append(" * round((julianday(");
-		sql.append(timeColumn);
-		sql.append(") - " + string(JULIAN_DAY_START_UNIXTIME) + ") * " + string(SECONDS_PER_DAY) + " / ");
-		sql.append(size_format);
-		sql.append(")");
-	}
-	else
-	{
-		sql.append("round((julianday(");
+		// subquery
+		sql.append("FROM ( SELECT asset_code, ");
 		sql.append(timeColumn);
-		sql.append(") - " + string(JULIAN_DAY_START_UNIXTIME) + ") * " + string(SECONDS_PER_DAY) + " / 1)");
-	}
-	if (size >= 1)
-	{
-		sql.append(", 'unixepoch') AS \"timestamp\", reading, ");
-	}
-	else
-	{
-		sql.append(") AS \"timestamp\", reading, ");
-	}
 
-	// Get all datapoints in 'reading' field
-	sql.append("json_each.key AS x, json_each.value AS theval FROM fledge.readings, json_each(readings.reading) ");
+		if (size >= 1)
+		{
+			sql.append(", datetime(");
+		}
+		else
+		{
+			sql.append(", (");
+		}
 
-	// Add where condition
-	sql.append("WHERE ");
-	if (!jsonWhereClause(payload["where"], sql))
-	{
-		raiseError("retrieve", "aggregateQuery: failure while building WHERE clause");
-		return false;
-	}
+		// Size formatted string
+		string size_format;
+		if (fmod(size, 1.0) == 0.0)
+		{
+			size_format = to_string(int(size));
+		}
+		else
+		{
+			size_format = to_string(size);
+		}
 
-	// close subquery
-	sql.append(") tmp ");
+		// Add timebucket size
+		// Unix Time is (Julian Day - JulianDay(1/1/1970 0:00 UTC) * Seconds_per_day
+		if (size != 1)
+		{
+			sql.append(size_format);
+			sql.append(" * round((julianday(");
+			sql.append(timeColumn);
+			sql.append(") - " + string(JULIAN_DAY_START_UNIXTIME) + ") * " + string(SECONDS_PER_DAY) + " / ");
+			sql.append(size_format);
+			sql.append(")");
+		}
+		else
+		{
+			sql.append("round((julianday(");
+			sql.append(timeColumn);
+			sql.append(") - " + string(JULIAN_DAY_START_UNIXTIME) + ") * " + string(SECONDS_PER_DAY) + " / 1)");
+		}
+		if (size >= 1)
+		{
+			sql.append(", 'unixepoch') AS \"timestamp\", reading, ");
+		}
+		else
+		{
+			sql.append(") AS \"timestamp\", reading, ");
+		}
 
-	// Add group by
-	// Unix Time is (Julian Day - JulianDay(1/1/1970 0:00 UTC) * Seconds_per_day
-	sql.append(" GROUP BY x, asset_code, ");
-	sql.append("round((julianday(");
-	sql.append(timeColumn);
-	sql.append(") - " + string(JULIAN_DAY_START_UNIXTIME) + ") * " + string(SECONDS_PER_DAY) + " / ");
+		// Get all datapoints in 'reading' field
+		if (m_columns && syncColumns() && !m_columnTables.empty())
+		{
+			// The numeric datapoints are read from the columns of the asset tables
+			sql.append("x, theval FROM (");
+			sql.append(columnarDatapoints());
+			sql.append(") readings ");
+		}
+		else
+		{
+			sql.append("json_each.key AS x, json_each.value AS theval FROM ");
+			sql.append(readingsTable());
+			sql.append(", json_each(readings.reading) ");
+		}
 
-	if (size != 1)
-	{
-		sql.append(size_format);
-	}
-	else
-	{
-		sql.append('1');
-	}
-	sql.append(") ");
+		// Add where condition
+		sql.append("WHERE ");
+		if (!jsonWhereClause(payload["where"], sql, false, epochFilters()))
+		{
+			raiseError("retrieve", "aggregateQuery: failure while building WHERE clause");
+			return false;
+		}
+
+		// close subquery
+		sql.append(") tmp ");
+
+		// Add group by
+		// Unix Time is (Julian Day - JulianDay(1/1/1970 0:00 UTC) * Seconds_per_day
+		sql.append(" GROUP BY x, asset_code, ");
+		sql.append("round((julianday(");
+		sql.append(timeColumn);
+		sql.append(") - " + string(JULIAN_DAY_START_UNIXTIME) + ") * " + string(SECONDS_PER_DAY) + " / ");
 
-	// close subquery
-	sql.append(") tbl ");
+		if (size != 1)
+		{
+			sql.append(size_format);
+		}
+		else
+		{
+			sql.append('1');
+		}
+		sql.append(") ");
+
+		// close subquery
+		sql.append(") tbl ");
+	}
 
 	// Add final group and sort
 	sql.append("GROUP BY timestamp, asset_code ORDER BY timestamp DESC");
@@ -383,34 +376,30 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 	int i;
 	bool add_row = false;
 	const char *user_ts;
-	string now;
 	char ts[60], micro_s[10];
 	char formatted_date[LEN_BUFFER_DATE] = {0};
 	struct tm timeinfo;
 	const char *asset_code;
 	const char *payload;
-	string reading;
-
-	// Retry mechanism
-	int retries = 0;
-	int sleep_time_ms = 0;
 
 	// SQLite related
-	sqlite3_stmt *stmt;
 	int sqlite3_resut;
 	int rowNumber = -1;
 
+	if (m_writer)
+	{
+		// The rows are inserted by the writer thread on its connection
+		return m_writer->execute([readings, commit](Connection *writer) {
+					return writer->readingStream(readings, commit);
+				}, ReadingsWriter::Append);
+	}
+
 #if INSTRUMENT
 	struct timeval start, t1, t2, t3, t4, t5;
 #endif
 
-	const char *sql_cmd = "INSERT INTO fledge.readings ( asset_code, reading, user_ts ) VALUES  (?,?,?)";
-
-	if (sqlite3_prepare_v2(dbHandle, sql_cmd, strlen(sql_cmd), &stmt, NULL) != SQLITE_OK)
-	{
-		raiseError("readingStream", sqlite3_errmsg(dbHandle));
-		return -1;
-	}
+	int64_t usecs, now_usecs = ReadingsTimestamp::now();
+	ReadingsInserter inserter(this, appendTable(), m_epochTimestamps, now_usecs);
 
 	// The handling of the commit parameter is overridden as using a pool of connections every execution receives
 	// a differen one, so a commit at every run is executed.
@@ -419,7 +408,7 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 
 	if (m_streamOpenTransaction)
 	{
-		if (sqlite3_exec(dbHandle, "BEGIN TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+		if (sqlite3_exec(dbHandle, "SAVEPOINT stream", NULL, NULL, NULL) != SQLITE_OK)
 		{
 			raiseError("readingStream", sqlite3_errmsg(dbHandle));
 			return -1;
@@ -442,24 +431,25 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 
 			// Handles - reading
 			payload = RDS_PAYLOAD(readings, i);
-			reading = escape(payload);
 
 			// Handles - user_ts
-			memset(&timeinfo, 0, sizeof(struct tm));
-			gmtime_r(&RDS_USER_TIMESTAMP(readings, i).tv_sec, &timeinfo);
-			std::strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
-			snprintf(micro_s, sizeof(micro_s), ".%06lu", RDS_USER_TIMESTAMP(readings, i).tv_usec);
-
-			formatted_date[0] = {0};
-			strncat(ts, micro_s, 10);
-			user_ts = ts;
-			if (strcmp(user_ts, "now()") == 0)
+			usecs = (int64_t)RDS_USER_TIMESTAMP(readings, i).tv_sec * 1000000
+				+ RDS_USER_TIMESTAMP(readings, i).tv_usec;
+			if (m_epochTimestamps)
 			{
-				getNow(now);
-				user_ts = now.c_str();
+				// The timestamp is stored as it is, without formatting
+				user_ts = NULL;
 			}
 			else
 			{
+				memset(&timeinfo, 0, sizeof(struct tm));
+				gmtime_r(&RDS_USER_TIMESTAMP(readings, i).tv_sec, &timeinfo);
+				std::strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
+				snprintf(micro_s, sizeof(micro_s), ".%06lu", RDS_USER_TIMESTAMP(readings, i).tv_usec);
+
+				formatted_date[0] = {0};
+				strncat(ts, micro_s, 10);
+				user_ts = ts;
 				if (!formatDate(formatted_date, sizeof(formatted_date), user_ts))
 				{
 					raiseError("appendReadings", "Invalid date |%s|", user_ts);
@@ -471,82 +461,48 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 				}
 			}
 
-			if (add_row)
+			if (add_row && m_columns)
 			{
-				if (stmt != NULL)
+				if (insertColumnar(user_ts, usecs, asset_code, payload, strlen(payload)) < 0)
 				{
-					sqlite3_bind_text(stmt, 1, asset_code,      -1, SQLITE_STATIC);
-					sqlite3_bind_text(stmt, 2, reading.c_str(), -1, SQLITE_STATIC);
-					sqlite3_bind_text(stmt, 3, user_ts,         -1, SQLITE_STATIC);
-
-					retries =0;
-					sleep_time_ms = 0;
-
-					// Retry mechanism in case SQLlite DB is locked
-					do {
-						// Insert the row using a lock to ensure one insert at time
-						{
-							m_writeAccessOngoing.fetch_add(1);
-							unique_lock<mutex> lck(db_mutex);
-
-							sqlite3_resut = sqlite3_step(stmt);
-
-							m_writeAccessOngoing.fetch_sub(1);
-							db_cv.notify_all();
-						}
-
-						if (sqlite3_resut == SQLITE_LOCKED  )
-						{
-							sleep_time_ms = PREP_CMD_RETRY_BASE + (random() %  PREP_CMD_RETRY_BACKOFF);
-							retries++;
-
-							Logger::getLogger()->info("SQLITE_LOCKED - record :%d: - retry number :%d: sleep time ms :%d:",i, retries, sleep_time_ms);
-
-							std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_ms));
-						}
-						if (sqlite3_resut == SQLITE_BUSY)
-						{
-							ostringstream threadId;
-							threadId << std::this_thread::get_id();
-
-							sleep_time_ms = PREP_CMD_RETRY_BASE + (random() %  PREP_CMD_RETRY_BACKOFF);
-							retries++;
-
-							Logger::getLogger()->info("SQLITE_BUSY - thread :%s: - record :%d: - retry number :%d: sleep time ms :%d:", threadId.str().c_str() ,i , retries, sleep_time_ms);
-
-							std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_ms));
-						}
-					} while (retries < PREP_CMD_MAX_RETRIES && (sqlite3_resut == SQLITE_LOCKED || sqlite3_resut == SQLITE_BUSY));
-
-					if (sqlite3_resut == SQLITE_DONE)
-					{
-						rowNumber++;
+					sqlite3_exec(dbHandle, "ROLLBACK TO stream; RELEASE stream;", NULL, NULL, NULL);
+					m_streamOpenTransaction = true;
+					return -1;
+				}
+			}
+			else if (add_row)
+			{
+				if (!inserter.add(user_ts, usecs, asset_code, strlen(asset_code),
+							payload, strlen(payload)))
+				{
+					raiseError("appendReadings",
+							   "Inserting rows into SQLIte using a prepared command - asset_code :%s: error :%s:",
+							   asset_code,
+							   sqlite3_errmsg(dbHandle));
 
-						sqlite3_clear_bindings(stmt);
-						sqlite3_reset(stmt);
-					}
-					else
-					{
-						raiseError("appendReadings",
-								   "Inserting a row into SQLIte using a prepared command - asset_code :%s: error :%s: reading :%s: ",
-								   asset_code,
-								   sqlite3_errmsg(dbHandle),
-								   reading.c_str());
-
-						sqlite3_exec(dbHandle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-						m_streamOpenTransaction = true;
-						return -1;
-					}
+					sqlite3_exec(dbHandle, "ROLLBACK TO stream; RELEASE stream;", NULL, NULL, NULL);
+					m_streamOpenTransaction = true;
+					return -1;
 				}
 			}
 		}
+		if (!inserter.flush())
+		{
+			raiseError("appendReadings",
+					   "Inserting rows into SQLIte using a prepared command - error :%s:",
+					   sqlite3_errmsg(dbHandle));
+
+			sqlite3_exec(dbHandle, "ROLLBACK TO stream; RELEASE stream;", NULL, NULL, NULL);
+			m_streamOpenTransaction = true;
+			return -1;
+		}
 		rowNumber = i;
 
 	} catch (exception e) {
 
 		raiseError("appendReadings", "Inserting a row into SQLIte using a prepared command - error :%s:", e.what());
 
-		sqlite3_exec(dbHandle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+		sqlite3_exec(dbHandle, "ROLLBACK TO stream; RELEASE stream;", NULL, NULL, NULL);
 		m_streamOpenTransaction = true;
 		return -1;
 	}
@@ -557,7 +513,7 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 
 	if (commit)
 	{
-		sqlite3_resut = sqlite3_exec(dbHandle, "END TRANSACTION", NULL, NULL, NULL);
+		sqlite3_resut = sqlite3_exec(dbHandle, "RELEASE stream", NULL, NULL, NULL);
 		if (sqlite3_resut != SQLITE_OK)
 		{
 			raiseError("appendReadings", "Executing the commit of the transaction - error :%s:", sqlite3_errmsg(dbHandle));
@@ -566,14 +522,6 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 		m_streamOpenTransaction = true;
 	}
 
-	if(stmt != NULL)
-	{
-		if (sqlite3_finalize(stmt) != SQLITE_OK)
-		{
-			raiseError("appendReadings","freeing SQLite in memory structure - error :%s:", sqlite3_errmsg(dbHandle));
-		}
-	}
-
 #if INSTRUMENT
 	gettimeofday(&t2, NULL);
 #endif
@@ -601,241 +549,120 @@ int Connection::readingStream(ReadingStream **readings, bool commit)
 
 #ifndef SQLITE_SPLIT_READINGS
 /**
- * Append a set of readings to the readings table
+ * Append a set of readings to the readings table. The payload is parsed
+ * into a batch that refers to the JSON text of each reading, rather than
+ * into a document from which each reading is serialised again.
  */
 int Connection::appendReadings(const char *readings)
 {
-// Default template parameter uses UTF8 and MemoryPoolAllocator.
-Document doc;
-int      row = 0;
-bool     add_row = false;
-
-// Variables related to the SQLite insert using prepared command
-const char   *user_ts;
-const char   *asset_code;
-string        reading;
-sqlite3_stmt *stmt;
-int           sqlite3_resut;
-string        now;
-
-// Retry mechanism
-int retries = 0;
-int sleep_time_ms = 0;
+ReadingsPayload payload;
 
-	ostringstream threadId;
-	threadId << std::this_thread::get_id();
-
-#if INSTRUMENT
-	Logger::getLogger()->setMinLevel("debug");
-	Logger::getLogger()->debug("appendReadings start thread :%s:", threadId.str().c_str());
-	Logger::getLogger()->setMinLevel("warning");
-
-	struct timeval	start, t1, t2, t3, t4, t5;
-#endif
-
-#if INSTRUMENT
-	gettimeofday(&start, NULL);
-#endif
-
-	ParseResult ok = doc.Parse(readings);
-	if (!ok)
+	if (!payload.parse(readings))
 	{
- 		raiseError("appendReadings", GetParseError_En(doc.GetParseError()));
+		raiseError("appendReadings", payload.error().c_str());
 		return -1;
 	}
+	return appendReadingBatch(payload.batch());
+}
+
+/**
+ * Append a batch of readings to the readings table. The batch has been
+ * parsed by the storage service, the values of each reading are bound
+ * to multi-row insert statements as they are.
+ *
+ * If rows is given it is set to the readings appended as fetchReadings
+ * returns them, built from the batch rather than read back. It is left
+ * empty if they can not be, because not every reading of the batch was
+ * appended or they were not given consecutive ids.
+ *
+ * @param batch		The batch of readings
+ * @param rows		Set to the readings appended, may be NULL
+ * @return int		The number of readings appended or -1 on failure
+ */
+int Connection::appendReadingBatch(const ReadingBatch *batch, string *rows)
+{
+int		row = 0;
+bool		failed = false;
+char		formatted_date[LEN_BUFFER_DATE];
 
-	if (!doc.HasMember("readings"))
+	if (batch->version != READING_BATCH_VERSION)
 	{
- 		raiseError("appendReadings", "Payload is missing a readings array");
+		raiseError("appendReadings", "Unsupported reading batch version %d", batch->version);
 		return -1;
 	}
-	Value &readingsValue = doc["readings"];
-	if (!readingsValue.IsArray())
+
+	if (m_writer)
 	{
-		raiseError("appendReadings", "Payload is missing the readings array");
-		return -1;
+		// The rows are inserted by the writer thread on its connection
+		return m_writer->execute([batch, rows](Connection *writer) {
+					return writer->appendReadingBatch(batch, rows);
+				}, ReadingsWriter::Append);
 	}
 
-	const char *sql_cmd="INSERT INTO fledge.readings ( user_ts, asset_code, reading ) VALUES  (?,?,?)";
-
-	// Execute one transaction at time
-	m_writeAccessOngoing.fetch_add(1);
-	unique_lock<mutex> lck(db_mutex);
-
-	sqlite3_prepare_v2(dbHandle, sql_cmd, strlen(sql_cmd), &stmt, NULL);
-	sqlite3_exec(dbHandle, "BEGIN TRANSACTION", NULL, NULL, NULL);
-
-#if INSTRUMENT
-		gettimeofday(&t1, NULL);
-#endif
-
-	for (Value::ConstValueIterator itr = readingsValue.Begin(); itr != readingsValue.End(); ++itr)
+	// The time is taken once, for the ts and the now() user_ts of the batch
+	int64_t usecs = 0, now_usecs = ReadingsTimestamp::now();
+	ReadingsInserter inserter(this, appendTable(), m_epochTimestamps, now_usecs);
+	string collected;
+	if (rows)
 	{
-		if (!itr->IsObject())
-		{
-			raiseError("appendReadings","Each reading in the readings array must be an object");
-			sqlite3_exec(dbHandle, "ROLLBACK TRANSACTION;", NULL, NULL, NULL);
+		rows->clear();
+		inserter.collect(&collected);
+	}
 
-			// Unlock
-			m_writeAccessOngoing.fetch_sub(1);
-			db_cv.notify_all();
-			return -1;
-		}
+	sqlite3_exec(dbHandle, "SAVEPOINT append", NULL, NULL, NULL);
 
-		add_row = true;
+	for (uint32_t i = 0; i < batch->count; i++)
+	{
+		const ReadingBatchEntry *entry = &batch->readings[i];
 
 		// Handles - user_ts
-		char formatted_date[LEN_BUFFER_DATE] = {0};
-		user_ts = (*itr)["user_ts"].GetString();
-		if (strcmp(user_ts, "now()") == 0)
+		const char *user_ts = entry->userTs;
+		if (!userTimestamp(user_ts, formatted_date, usecs, now_usecs))
 		{
-			getNow(now);
-			user_ts = now.c_str();
+			raiseError("appendReadings", "Invalid date |%s|", user_ts);
+			continue;
 		}
-		else
+
+		if (m_columns)
 		{
-			if (! formatDate(formatted_date, sizeof(formatted_date), user_ts) )
-			{
-				raiseError("appendReadings", "Invalid date |%s|", user_ts);
-				add_row = false;
-			}
-			else
+			if (insertColumnar(user_ts, usecs, entry->assetCode, entry->reading, entry->readingLength) < 0)
 			{
-				user_ts = formatted_date;
+				sqlite3_exec(dbHandle, "ROLLBACK TO append; RELEASE append;", NULL, NULL, NULL);
+				return -1;
 			}
+			row++;
+			continue;
 		}
 
-		if (add_row)
+		if (!inserter.add(user_ts, usecs, entry->assetCode, entry->assetCodeLength,
+					entry->reading, entry->readingLength))
 		{
-			// Handles - asset_code
-			asset_code = (*itr)["asset_code"].GetString();
-
-			// Handles - reading
-			StringBuffer buffer;
-			Writer<StringBuffer> writer(buffer);
-			(*itr)["reading"].Accept(writer);
-			reading = escape(buffer.GetString());
-
-			if(stmt != NULL) {
-
-				sqlite3_bind_text(stmt, 1, user_ts         ,-1, SQLITE_STATIC);
-				sqlite3_bind_text(stmt, 2, asset_code      ,-1, SQLITE_STATIC);
-				sqlite3_bind_text(stmt, 3, reading.c_str(), -1, SQLITE_STATIC);
-
-				retries =0;
-				sleep_time_ms = 0;
-
-				// Retry mechanism in case SQLlite DB is locked
-				do {
-					// Insert the row using a lock to ensure one insert at time
-					sqlite3_resut = sqlite3_step(stmt);
-
-					if (sqlite3_resut == SQLITE_LOCKED  )
-					{
-						sleep_time_ms = PREP_CMD_RETRY_BASE + (random() %  PREP_CMD_RETRY_BACKOFF);
-						retries++;
-
-						Logger::getLogger()->info("SQLITE_LOCKED - thread :%s: - record N. :%d: - retry number :%d: sleep time ms :%d:" ,
-							threadId.str().c_str(),
-							row,
-							retries,
-							sleep_time_ms);
-						std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_ms));
-					}
-					if (sqlite3_resut == SQLITE_BUSY)
-					{
-						sleep_time_ms = PREP_CMD_RETRY_BASE + (random() %  PREP_CMD_RETRY_BACKOFF);
-						retries++;
-
-						Logger::getLogger()->info("SQLITE_BUSY - thread :%s: - record N. :%d: - retry number :%d: sleep time ms :%d:",
-							threadId.str().c_str(),
-							row,
-							retries,
-							sleep_time_ms);
-
-						std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_ms));
-					}
-				} while (retries < PREP_CMD_MAX_RETRIES && (sqlite3_resut == SQLITE_LOCKED || sqlite3_resut == SQLITE_BUSY));
-
-				if (sqlite3_resut == SQLITE_DONE)
-				{
-					row++;
-
-					sqlite3_clear_bindings(stmt);
-					sqlite3_reset(stmt);
-				}
-				else
-				{
-					raiseError("appendReadings","Inserting a row into SQLIte using a prepared command - asset_code :%s: error :%s: reading :%s: ",
-						asset_code,
-						sqlite3_errmsg(dbHandle),
-						reading.c_str());
-
-					sqlite3_exec(dbHandle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-
-					// Unlock
-					m_writeAccessOngoing.fetch_sub(1);
-					db_cv.notify_all();
-					return -1;
-				}
-			}
+			failed = true;
+			break;
 		}
 	}
 
-	sqlite3_resut = sqlite3_exec(dbHandle, "END TRANSACTION", NULL, NULL, NULL);
-	if (sqlite3_resut != SQLITE_OK)
+	if (failed || !inserter.flush())
 	{
-		raiseError("appendReadings", "Executing the commit of the transaction :%s:", sqlite3_errmsg(dbHandle));
-		row = -1;
+		raiseError("appendReadings", "Inserting rows into SQLite using a prepared command - error :%s:",
+			sqlite3_errmsg(dbHandle));
+		sqlite3_exec(dbHandle, "ROLLBACK TO append; RELEASE append;", NULL, NULL, NULL);
+		return -1;
 	}
+	row += inserter.rows();
 
-	// Unlock
-	m_writeAccessOngoing.fetch_sub(1);
-	db_cv.notify_all();
-
-
-#if INSTRUMENT
-		gettimeofday(&t2, NULL);
-#endif
-
-	if(stmt != NULL)
+	if (sqlite3_exec(dbHandle, "RELEASE append", NULL, NULL, NULL) != SQLITE_OK)
 	{
-		if (sqlite3_finalize(stmt) != SQLITE_OK)
-		{
-			raiseError("appendReadings","freeing SQLite in memory structure - error :%s:", sqlite3_errmsg(dbHandle));
-		}
+		raiseError("appendReadings", "Executing the commit of the transaction :%s:", sqlite3_errmsg(dbHandle));
+		return -1;
 	}
 
-#if INSTRUMENT
-		gettimeofday(&t3, NULL);
-#endif
-
-#if INSTRUMENT
-		struct timeval tm;
-		double timeT1, timeT2, timeT3;
-
-		timersub(&t1, &start, &tm);
-		timeT1 = tm.tv_sec + ((double)tm.tv_usec / 1000000);
-
-		timersub(&t2, &t1, &tm);
-		timeT2 = tm.tv_sec + ((double)tm.tv_usec / 1000000);
-
-		timersub(&t3, &t2, &tm);
-		timeT3 = tm.tv_sec + ((double)tm.tv_usec / 1000000);
-
-		Logger::getLogger()->setMinLevel("debug");
-		Logger::getLogger()->debug("Appended readings buffer size :%d: row count :%d: :%s: ", strlen(readings), row, threadId.str().c_str());
-
-		Logger::getLogger()->debug("Timing - thread :%s: - JSON handling %.3f seconds - inserts execution %.3f seconds - sqlite3_finalize %.3f seconds ",
-								   threadId.str().c_str(),
-		                           timeT1,
-		                           timeT2,
-		                           timeT3
-
-		);
-		Logger::getLogger()->debug("appendReadings end thread :%s:", threadId.str().c_str());
-		Logger::getLogger()->setMinLevel("warning");
-#endif
+	// Columnar readings and those with invalid dates are not collected
+	if (rows && row > 0 && row == inserter.rows() && row == (int)batch->count
+			&& inserter.contiguous())
+	{
+		*rows = "{\"count\":" + to_string(row) + ",\"rows\":[" + collected + "]}";
+	}
 
 	return row;
 }
@@ -857,42 +684,60 @@ bool Connection::fetchReadings(unsigned long id,
 			       unsigned int blksize,
 			       std::string& resultSet)
 {
-char sqlbuffer[512];
-char *zErrMsg = NULL;
 int rc;
-int retrieve;
+string table = "fledge.readings";
+
+	if (m_partitions && syncPartitions())
+	{
+		/*
+		 * Fetch from the first partition that holds readings at or
+		 * after the id, the next fetch continues in the partition
+		 * that follows it
+		 */
+		vector<string> schemas = m_attached;
+		schemas.insert(schemas.begin(), "fledge");
+		for (auto& schema : schemas)
+		{
+			unsigned long minId, maxId;
+			if (readingIds(schema, minId, maxId) && maxId >= id)
+			{
+				table = schema + ".readings";
+				break;
+			}
+		}
+	}
+	else if (m_columns)
+	{
+		table = readingsTable();
+	}
+
+	// Epoch timestamps are formatted in UTC without the timezone
+	string timestamps = m_epochTimestamps ?
+		"fledge_ts(user_ts, 6, 0) AS user_ts, fledge_ts(ts, 3, 0) AS ts" : R"(
+		strftime('%Y-%m-%d %H:%M:%S', user_ts, 'utc')  ||
+		substr(user_ts, instr(user_ts, '.'), 7) AS user_ts,
+		strftime('%Y-%m-%d %H:%M:%f', ts, 'utc') AS ts)";
 
 	// SQL command to extract the data from the fledge.readings
-	const char *sql_cmd = R"(
+	string sql_cmd = R"(
 	SELECT
 		id,
 		asset_code,
 		reading,
-		strftime('%%Y-%%m-%%d %%H:%%M:%%S', user_ts, 'utc')  ||
-		substr(user_ts, instr(user_ts, '.'), 7) AS user_ts,
-		strftime('%%Y-%%m-%%d %%H:%%M:%%f', ts, 'utc') AS ts
-	FROM fledge.readings
-	WHERE id >= %lu
+		)" + timestamps + R"(
+	FROM )" + table + R"(
+	WHERE id >= ?
 	ORDER BY id ASC
-	LIMIT %u;
+	LIMIT ?;
 	)";
 
 	/*
 	 * This query assumes datetime values are in 'localtime'
 	 */
-	snprintf(sqlbuffer,
-		 sizeof(sqlbuffer),
-		 sql_cmd,
-		 id,
-		 blksize);
-	logSQL("ReadingsFetch", sqlbuffer);
+	logSQL("ReadingsFetch", sql_cmd.c_str());
 	sqlite3_stmt *stmt;
-	// Prepare the SQL statement and get the result set
-	if (sqlite3_prepare_v2(dbHandle,
-			       sqlbuffer,
-			       -1,
-			       &stmt,
-			       NULL) != SQLITE_OK)
+	// Get the prepared SQL statement, bind the block and get the result set
+	if ((stmt = prepare(sql_cmd)) == NULL)
 	{
 		raiseError("retrieve", sqlite3_errmsg(dbHandle));
 
@@ -901,11 +746,14 @@ int retrieve;
 	}
 	else
 	{
+		sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+		sqlite3_bind_int(stmt, 2, blksize);
+
 		// Call result set mapping
 		rc = mapResultSet(stmt, resultSet);
 
-		// Delete result set
-		sqlite3_finalize(stmt);
+		// Release the statement for reuse
+		sqlite3_reset(stmt);
 
 		// Check result set errors
 		if (rc != SQLITE_DONE)
@@ -924,40 +772,105 @@ int retrieve;
 }
 
 /**
- * Perform a query against the readings table
- *
- * retrieveReadings, used by the API, returns timestamp in localtime.
+ * Return the latest reading of each asset, or of one asset, from the
+ * readings_latest table rather than the readings. The readings are
+ * returned as fetchReadings returns them, without the ts, ordered by
+ * asset code. The purges replace the rows whose reading they remove, a
+ * row that refers to a purged reading before the purge commits is not
+ * returned.
  *
+ * @param asset		The asset code or NULL for every asset
+ * @param resultSet	Set to the readings as JSON
+ * @return bool		True if the readings were retrieved
  */
-bool Connection::retrieveReadings(const string& condition, string& resultSet)
+bool Connection::latestReadings(const char *asset, string& resultSet)
 {
-// Default template parameter uses UTF8 and MemoryPoolAllocator.
-Document	document;
-SQLBuffer	sql;
-// Extra constraints to add to where clause
-SQLBuffer	jsonConstraints;
-bool		isAggregate = false;
+	if (m_partitions)
+	{
+		syncPartitions();
+	}
 
-	try {
-		if (dbHandle == NULL)
+	// The purges remove the readings below the smallest id held
+	unsigned long minId = 0;
+	bool found = false;
+	vector<string> schemas = m_attached;
+	schemas.insert(schemas.begin(), "fledge");
+	for (auto& schema : schemas)
+	{
+		unsigned long first, last;
+		if (readingIds(schema, first, last) && (!found || first < minId))
 		{
-			raiseError("retrieve", "No SQLite 3 db connection available");
-			return false;
+			minId = first;
+			found = true;
 		}
+	}
+	if (!found)
+	{
+		minId = lastReadingId() + 1;
+	}
 
-		if (condition.empty())
-		{
-			const char *sql_cmd = R"(
-					SELECT
+	string sql_cmd = "SELECT id, asset_code, reading, fledge_ts(user_ts, 6, 0) AS user_ts "
+			"FROM fledge.readings_latest WHERE id >= ?";
+	sql_cmd += asset ? " AND asset_code = ? ORDER BY asset_code;" : " ORDER BY asset_code;";
+	logSQL("ReadingsLatest", sql_cmd.c_str());
+
+	sqlite3_stmt *stmt = prepare(sql_cmd);
+	if (stmt == NULL)
+	{
+		raiseError("latest", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)minId);
+	if (asset)
+	{
+		sqlite3_bind_text(stmt, 2, asset, -1, SQLITE_STATIC);
+	}
+	int rc = mapResultSet(stmt, resultSet);
+	sqlite3_reset(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		raiseError("latest", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Perform a query against the readings table
+ *
+ * retrieveReadings, used by the API, returns timestamp in localtime.
+ *
+ */
+bool Connection::retrieveReadings(const string& condition, string& resultSet)
+{
+// Default template parameter uses UTF8 and MemoryPoolAllocator.
+Document	document;
+SQLBuffer	sql;
+// Extra constraints to add to where clause
+SQLBuffer	jsonConstraints;
+bool		isAggregate = false;
+
+	try {
+		if (dbHandle == NULL)
+		{
+			raiseError("retrieve", "No SQLite 3 db connection available");
+			return false;
+		}
+
+		if (condition.empty())
+		{
+			const char *sql_cmd = R"(
+					SELECT
 						id,
 						asset_code,
 						reading,
 						strftime(')" F_DATEH24_SEC R"(', user_ts, 'localtime')  ||
 						substr(user_ts, instr(user_ts, '.'), 7) AS user_ts,
 						strftime(')" F_DATEH24_MS R"(', ts, 'localtime') AS ts
-					FROM fledge.readings)";
+					FROM )";
 
 			sql.append(sql_cmd);
+			sql.append(readingsTable());
 		}
 		else
 		{
@@ -986,7 +899,7 @@ bool		isAggregate = false;
 				{
 					return false;
 				}
-				sql.append(" FROM fledge.");
+				sql.append(" FROM ");
 			}
 			else if (document.HasMember("return"))
 			{
@@ -1175,7 +1088,7 @@ bool		isAggregate = false;
 					}
 					col++;
 				}
-				sql.append(" FROM fledge.");
+				sql.append(" FROM ");
 			}
 			else
 			{
@@ -1193,18 +1106,18 @@ bool		isAggregate = false;
 						strftime(')" F_DATEH24_SEC R"(', user_ts, 'localtime')  ||
 						substr(user_ts, instr(user_ts, '.'), 7) AS user_ts,
 						strftime(')" F_DATEH24_MS R"(', ts, 'localtime') AS ts
-					FROM fledge.)";
+					FROM )";
 
 				sql.append(sql_cmd);
 			}
-			sql.append("readings");
+			sql.append(readingsTable());
 			if (document.HasMember("where"))
 			{
 				sql.append(" WHERE ");
 			 
 				if (document.HasMember("where"))
 				{
-					if (!jsonWhereClause(document["where"], sql))
+					if (!jsonWhereClause(document["where"], sql, false, epochFilters()))
 					{
 						return false;
 					}
@@ -1291,6 +1204,7 @@ long numReadings = 0;
 unsigned long rowidLimit = 0, minrowidLimit = 0, maxrowidLimit = 0, rowidMin;
 struct timeval startTv, endTv;
 int blocks = 0;
+unsigned long continuousRemoved = 0;
 
 	Logger *logger = Logger::getLogger();
 
@@ -1299,8 +1213,19 @@ int blocks = 0;
 	result += " \"unsentRetained\" : 0, ";
 	result += " \"readings\" : 0 }";
 
+	if (m_partitions)
+	{
+		m_partitions->setRetention(false, age, flags, sent);
+		return purgePartitions(false, age, flags, sent, result);
+	}
+
 	logger->info("Purge starting...");
 	gettimeofday(&startTv, NULL);
+	if (m_writer)
+	{
+		m_writer->purgeScheduler().setRetention(age, (flags & 0x01) == 0x01, sent);
+		continuousRemoved = m_writer->purgeScheduler().totalRemoved();
+	}
 	/*
 	 * We fetch the current rowid and limit the purge process to work on just
 	 * those rows present in the database when the purge process started.
@@ -1342,6 +1267,13 @@ int blocks = 0;
 		}
 	}
 
+	/*
+	 * While the timestamps are migrated the readings hold both forms, the
+	 * integer timestamps sort before the text ones so they are compared
+	 * as epoch timestamps whichever form the connection uses.
+	 */
+	bool epochCompare = m_epochTimestamps || (m_writer && m_writer->migrating());
+
 	if (age == 0)
 	{
 		/*
@@ -1349,7 +1281,17 @@ int blocks = 0;
 		 * So set age based on the data we have and continue.
 		 */
 		SQLBuffer oldest;
-		oldest.append("SELECT (strftime('%s','now', 'utc') - strftime('%s', MIN(user_ts)))/360 FROM fledge.readings where rowid <= ");
+		if (epochCompare)
+		{
+			// Timestamps not yet migrated are only read if there are no others
+			oldest.append("SELECT (");
+			oldest.append((long)(ReadingsTimestamp::now() / 1000000));
+			oldest.append(" - fledge_epoch(MIN(user_ts)) / 1000000)/360 FROM fledge.readings where rowid <= ");
+		}
+		else
+		{
+			oldest.append("SELECT (strftime('%s','now', 'utc') - strftime('%s', MIN(user_ts)))/360 FROM fledge.readings where rowid <= ");
+		}
 		oldest.append(rowidLimit);
 		oldest.append(';');
 		const char *query = oldest.coalesce();
@@ -1396,6 +1338,18 @@ int blocks = 0;
 
 		unsigned long m=l;
 
+		// e.g. select id from readings where rowid = 219867307 AND user_ts < datetime('now' , '-24 hours');
+		sqlite3_stmt *midStmt = prepare(epochCompare ?
+				"select id from fledge.readings where rowid = ? AND fledge_epoch(user_ts) < ?;" :
+				"select id from fledge.readings where rowid = ? AND user_ts < datetime('now' , ?);");
+		if (midStmt == NULL)
+		{
+			raiseError("purge - phase 1, fetching midRowId ", sqlite3_errmsg(dbHandle));
+			return 0;
+		}
+		string ageModifier = "-" + to_string(age) + " hours";
+		int64_t ageLimit = ReadingsTimestamp::now() - (int64_t)age * 3600 * 1000000;
+
 		while (l <= r)
 		{
 			unsigned long midRowId = 0;
@@ -1403,26 +1357,25 @@ int blocks = 0;
 		    	m = l + (r - l) / 2;
 			if (prev_m == m) break;
 
-			// e.g. select id from readings where rowid = 219867307 AND user_ts < datetime('now' , '-24 hours', 'utc');
-			SQLBuffer sqlBuffer;
-			sqlBuffer.append("select id from fledge.readings where rowid = ");
-			sqlBuffer.append(m);
-			sqlBuffer.append(" AND user_ts < datetime('now' , '-");
-			sqlBuffer.append(age);
-			sqlBuffer.append(" hours');");
-			const char *query = sqlBuffer.coalesce();
-
-
-			rc = SQLexec(dbHandle,
-			query,
-			rowidCallback,
-			&midRowId,
-			&zErrMsg);
+			sqlite3_bind_int64(midStmt, 1, (sqlite3_int64)m);
+			if (epochCompare)
+			{
+				sqlite3_bind_int64(midStmt, 2, (sqlite3_int64)ageLimit);
+			}
+			else
+			{
+				sqlite3_bind_text(midStmt, 2, ageModifier.c_str(), -1, SQLITE_STATIC);
+			}
+			rc = SQLstep(midStmt);
+			if (rc == SQLITE_ROW)
+			{
+				midRowId = (unsigned long)sqlite3_column_int64(midStmt, 0);
+			}
+			sqlite3_reset(midStmt);
 
-			if (rc != SQLITE_OK)
+			if (rc != SQLITE_ROW && rc != SQLITE_DONE)
 			{
-	 			raiseError("purge - phase 1, fetching midRowId ", zErrMsg);
-				sqlite3_free(zErrMsg);
+	 			raiseError("purge - phase 1, fetching midRowId ", sqlite3_errmsg(dbHandle));
 				return 0;
 			}
 
@@ -1485,97 +1438,37 @@ int blocks = 0;
 			unsentPurged = unsent;
 		}
 	}
-	if (m_writeAccessOngoing)
-	{
-		while (m_writeAccessOngoing)
-		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		}
-	}
 
 	unsigned int deletedRows = 0;
-	char *zErrMsg = NULL;
-	unsigned int rowsAffected, totTime=0, prevBlocks=0, prevTotTime=0;
+	int rowsAffected;
+	const char *query = "DELETE FROM fledge.readings WHERE rowid <= ?;";
+	time_t progress = time(0);
 	logger->info("Purge about to delete readings # %ld to %ld", rowidMin, rowidLimit);
 	while (rowidMin < rowidLimit)
 	{
 		blocks++;
-		rowidMin += purgeBlockSize;
+		rowidMin += m_writer ? m_writer->purgeScheduler().blockSize() : MIN_PURGE_DELETE_BLOCK_SIZE;
 		if (rowidMin > rowidLimit)
 		{
 			rowidMin = rowidLimit;
 		}
-		SQLBuffer sql;
-		sql.append("DELETE FROM fledge.readings WHERE rowid <= ");
-		sql.append(rowidMin);
-		sql.append(';');
-		const char *query = sql.coalesce();
 		logSQL("ReadingsPurge", query);
 
-		int rc;
-		{
-		unique_lock<mutex> lck(db_mutex);
-		if (m_writeAccessOngoing) db_cv.wait(lck);
-
-		START_TIME;
-		// Exec DELETE query: no callback, no resultset
-		rc = SQLexec(dbHandle,
-			     query,
-			     NULL,
-			     NULL,
-			     &zErrMsg);
-		END_TIME;
-
-		// Release memory for 'query' var
-		delete[] query;
-
-		totTime += usecs;
-
-		if(usecs>150000)
-		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(100+usecs/10000));
-		}
-		}
-
-		if (rc != SQLITE_OK)
+		unsigned long usecs;
+		if ((rowsAffected = purgeBlock(query, rowidMin, usecs)) < 0)
 		{
-			raiseError("purge - phase 3", zErrMsg);
-			sqlite3_free(zErrMsg);
 			return 0;
 		}
-
-		// Get db changes
-		rowsAffected = sqlite3_changes(dbHandle);
 		deletedRows += rowsAffected;
 		logger->debug("Purge delete block #%d with %d readings", blocks, rowsAffected);
 
-		if(blocks % RECALC_PURGE_BLOCK_SIZE_NUM_BLOCKS == 0)
-		{
-			int prevAvg = prevTotTime/(prevBlocks?prevBlocks:1);
-			int currAvg = (totTime-prevTotTime)/(blocks-prevBlocks);
-			int avg = ((prevAvg?prevAvg:currAvg)*5 + currAvg*5) / 10; // 50% weightage for long term avg and 50% weightage for current avg
-			prevBlocks = blocks;
-			prevTotTime = totTime;
-			int deviation = abs(avg - TARGET_PURGE_BLOCK_DEL_TIME);
-			logger->debug("blocks=%d, totTime=%d usecs, prevAvg=%d usecs, currAvg=%d usecs, avg=%d usecs, TARGET_PURGE_BLOCK_DEL_TIME=%d usecs, deviation=%d usecs", 
-							blocks, totTime, prevAvg, currAvg, avg, TARGET_PURGE_BLOCK_DEL_TIME, deviation);
-			if (deviation > TARGET_PURGE_BLOCK_DEL_TIME/10)
-			{
-				float ratio = (float)TARGET_PURGE_BLOCK_DEL_TIME / (float)avg;
-				if (ratio > 2.0) ratio = 2.0;
-				if (ratio < 0.5) ratio = 0.5;
-				purgeBlockSize = (float)purgeBlockSize * ratio;
-				purgeBlockSize = purgeBlockSize / PURGE_BLOCK_SZ_GRANULARITY * PURGE_BLOCK_SZ_GRANULARITY;
-				if (purgeBlockSize < MIN_PURGE_DELETE_BLOCK_SIZE)
-					purgeBlockSize = MIN_PURGE_DELETE_BLOCK_SIZE;
-				if (purgeBlockSize > MAX_PURGE_DELETE_BLOCK_SIZE)
-					purgeBlockSize = MAX_PURGE_DELETE_BLOCK_SIZE;
-				logger->debug("Changed purgeBlockSize to %d", purgeBlockSize);
-			}
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (time(0) - progress >= PURGE_PROGRESS_INTERVAL)
+		{
+			progress = time(0);
+			logger->info("Purge progress: %u readings deleted in %d blocks, readings up to # %ld remain to be purged",
+					deletedRows, blocks, rowidLimit);
 		}
-		//Logger::getLogger()->debug("Purge delete block #%d with %d readings", blocks, rowsAffected);
-	} while (rowidMin  < rowidLimit);
+	}
 
 	unsentRetained = maxrowidLimit - rowidLimit;
 
@@ -1586,6 +1479,18 @@ int blocks = 0;
 		unsentPurged = deletedRows;
 	}
 
+	if (m_writer)
+	{
+		// Readings of this purge may have been removed by the continuous purge meanwhile
+		numReadings -= m_writer->purgeScheduler().totalRemoved() - continuousRemoved;
+
+		// Add the readings removed by the continuous purge since the last request
+		unsigned long removed, unsent;
+		m_writer->purgeScheduler().takeRemoved(removed, unsent);
+		deletedRows += removed;
+		unsentPurged += unsent;
+	}
+
 	ostringstream convert;
 
 	convert << "{ \"removed\" : " << deletedRows << ", ";
@@ -1617,6 +1522,12 @@ unsigned long limit = 0;
 
 	Logger *logger = Logger::getLogger();
 
+	if (m_partitions)
+	{
+		m_partitions->setRetention(true, rows, flags, sent);
+		return purgePartitions(true, rows, flags, sent, result);
+	}
+
 	logger->info("Purge by Rows called");
 	if ((flags & 0x01) == 0x01)
 	{
@@ -1625,21 +1536,25 @@ unsigned long limit = 0;
 	}
 	logger->info("Purge by Rows called with flags %x, rows %d, limit %d", flags, rows, limit);
 	// Don't save unsent rows
-	int rowcount;
+	int rowcount = -1;
 	do {
 		char *zErrMsg = NULL;
 		int rc;
-		rc = SQLexec(dbHandle,
-		     "select count(rowid) from readings;",
-		     rowidCallback,
-		     &rowcount,
-		     &zErrMsg);
-
-		if (rc != SQLITE_OK)
+		if (rowcount < 0)
 		{
-			raiseError("purge - phaase 0, fetching row count", zErrMsg);
-			sqlite3_free(zErrMsg);
-			return 0;
+			// The readings are counted once, the count is then reduced by each block deleted
+			rc = SQLexec(dbHandle,
+			     "select count(rowid) from fledge.readings;",
+			     rowidCallback,
+			     &rowcount,
+			     &zErrMsg);
+
+			if (rc != SQLITE_OK)
+			{
+				raiseError("purge - phaase 0, fetching row count", zErrMsg);
+				sqlite3_free(zErrMsg);
+				return 0;
+			}
 		}
 		if (rowcount <= rows)
 		{
@@ -1648,7 +1563,7 @@ unsigned long limit = 0;
 		}
 		int minId;
 		rc = SQLexec(dbHandle,
-		     "select min(id) from readings;",
+		     "select min(id) from fledge.readings;",
 		     rowidCallback,
 		     &minId,
 		     &zErrMsg);
@@ -1661,7 +1576,7 @@ unsigned long limit = 0;
 		}
 		int maxId;
 		rc = SQLexec(dbHandle,
-		     "select max(id) from readings;",
+		     "select max(id) from fledge.readings;",
 		     rowidCallback,
 		     &maxId,
 		     &zErrMsg);
@@ -1672,31 +1587,25 @@ unsigned long limit = 0;
 			sqlite3_free(zErrMsg);
 			return 0;
 		}
-		int deletePoint = minId + 10000;
+		int deletePoint = minId + (m_writer ? m_writer->purgeScheduler().blockSize() : MIN_PURGE_DELETE_BLOCK_SIZE);
 		if (maxId - deletePoint < rows || deletePoint > maxId)
 			deletePoint = maxId - rows;
 		if (limit && limit > deletePoint)
 		{
 			deletePoint = limit;
 		}
-		SQLBuffer sql;
-
 		logger->info("RowCount %d, Max Id %d, min Id %d, delete point %d", rowcount, maxId, minId, deletePoint);
 
-		sql.append("delete from readings where id <= ");
-		sql.append(deletePoint);
-		const char *query = sql.coalesce();
 		{
-			unique_lock<mutex> lck(db_mutex);
-			if (m_writeAccessOngoing) db_cv.wait(lck);
-
-			// Exec DELETE query: no callback, no resultset
-			rc = SQLexec(dbHandle, query, NULL, NULL, &zErrMsg);
-			int rowsAffected = sqlite3_changes(dbHandle);
+			unsigned long usecs;
+			int rowsAffected = purgeBlock("DELETE FROM fledge.readings WHERE id <= ?;", deletePoint, usecs);
+			if (rowsAffected < 0)
+			{
+				return 0;
+			}
 			deletedRows += rowsAffected;
 			numReadings = rowcount - rowsAffected;
-			// Release memory for 'query' var
-			delete[] query;
+			rowcount = numReadings;
 			logger->debug("Deleted %d rows", rowsAffected);
 			if (rowsAffected == 0)
 			{
@@ -1711,7 +1620,6 @@ unsigned long limit = 0;
 				unsentPurged += rowsAffected;
 			}
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	} while (rowcount > rows);
 
 	if (limit)
@@ -1719,6 +1627,15 @@ unsigned long limit = 0;
 		unsentRetained = numReadings - rows;
 	}
 
+	if (m_writer)
+	{
+		// Add the readings removed by the continuous purge since the last request
+		unsigned long removed, unsent;
+		m_writer->purgeScheduler().takeRemoved(removed, unsent);
+		deletedRows += removed;
+		unsentPurged += unsent;
+	}
+
 
 	ostringstream convert;
 
@@ -1733,3 +1650,1444 @@ unsigned long limit = 0;
 }
 
 
+
+/**
+ * Delete a block of readings, on the connection of the writer thread
+ * when there is one so that the delete is queued with the appends.
+ *
+ * @param sql		The delete statement, the limit is its only parameter
+ * @param limit		The limit of the block to delete
+ * @param usecs		Set to the time taken by the delete
+ * @return int		The number of readings deleted or -1 on failure
+ */
+int Connection::purgeBlock(const char *sql, unsigned long limit, unsigned long& usecs)
+{
+	if (m_writer)
+	{
+		return m_writer->execute([sql, limit, &usecs](Connection *writer) {
+					return writer->purgeBlock(sql, limit, usecs);
+				}, ReadingsWriter::Purge);
+	}
+
+	sqlite3_stmt *stmt = prepare(sql);
+	if (stmt == NULL)
+	{
+		raiseError("purge - phase 3", sqlite3_errmsg(dbHandle));
+		return -1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	bool savepoint = m_columns || m_latest;
+	if (m_latest)
+	{
+		// The view of the readings can not be recreated once the savepoint is open
+		readingsTable();
+	}
+	if (savepoint)
+	{
+		// The readings, their datapoints in the asset tables and the
+		// latest readings of the assets are updated together
+		sqlite3_exec(dbHandle, "SAVEPOINT purge", NULL, NULL, NULL);
+	}
+	// Exec DELETE statement: no resultset
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)limit);
+	int rc = SQLstep(stmt);
+	sqlite3_reset(stmt);
+	int deleted = sqlite3_changes(dbHandle);
+
+	if (rc == SQLITE_DONE && m_columns)
+	{
+		// Delete the numeric datapoints of the readings from the asset tables
+		vector<ReadingsColumns::AssetTable> tables;
+		m_columns->tables(tables);
+		for (auto& table : tables)
+		{
+			stmt = prepare("DELETE FROM fledge." + table.table + " WHERE id <= ?;");
+			if (stmt == NULL)
+			{
+				rc = SQLITE_ERROR;
+				break;
+			}
+			sqlite3_bind_int64(stmt, 1, (sqlite3_int64)limit);
+			rc = SQLstep(stmt);
+			sqlite3_reset(stmt);
+			if (rc != SQLITE_DONE)
+				break;
+		}
+	}
+
+	if (rc == SQLITE_DONE && m_latest && deleted > 0 && !ReadingsLatest::purged(this, limit))
+	{
+		rc = SQLITE_ERROR;
+	}
+
+	if (rc != SQLITE_DONE)
+	{
+		raiseError("purge - phase 3", sqlite3_errmsg(dbHandle));
+		if (savepoint)
+		{
+			sqlite3_exec(dbHandle, "ROLLBACK TO purge; RELEASE purge;", NULL, NULL, NULL);
+		}
+		return -1;
+	}
+	if (savepoint)
+	{
+		sqlite3_exec(dbHandle, "RELEASE purge", NULL, NULL, NULL);
+	}
+	usecs = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	return deleted;
+}
+
+/**
+ * Delete a block of the readings that are older than the given age, an
+ * increment of the continuous purge. Only called by the readings writer.
+ *
+ * The block is the oldest blockSize readings, of which those up to the
+ * newest that is older than the age are deleted.
+ *
+ * @param age		The age in hours of the readings to retain
+ * @param retainUnsent	Retain the readings that have not been sent
+ * @param sent		The last reading id that has been sent
+ * @param blockSize	The number of readings in the block
+ * @param unsentPurged	Set to the number of readings deleted that had not been sent
+ * @return int		The number of readings deleted or -1 on failure
+ */
+int Connection::purgeIncrement(unsigned long age, bool retainUnsent, unsigned long sent,
+				unsigned long blockSize, int& unsentPurged)
+{
+	unsigned long minId, maxId;
+	unsentPurged = 0;
+	if (!readingIds("fledge", minId, maxId))
+	{
+		return 0;
+	}
+	unsigned long end = minId + blockSize - 1;
+	if (retainUnsent && sent)
+	{
+		if (sent < minId)
+		{
+			return 0;
+		}
+		end = min(end, sent);
+	}
+
+	// Timestamps of either form are compared as epochs, a migration may be in progress
+	sqlite3_stmt *stmt = prepare(
+			"SELECT id FROM fledge.readings WHERE id <= ? AND fledge_epoch(user_ts) < ? ORDER BY id DESC LIMIT 1;");
+	if (stmt == NULL)
+	{
+		raiseError("purge", sqlite3_errmsg(dbHandle));
+		return -1;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)end);
+	sqlite3_bind_int64(stmt, 2, (sqlite3_int64)(ReadingsTimestamp::now() - (int64_t)age * 3600 * 1000000));
+	unsigned long limit = 0;
+	if (SQLstep(stmt) == SQLITE_ROW)
+	{
+		limit = (unsigned long)sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_reset(stmt);
+	if (limit == 0)
+	{
+		return 0;
+	}
+
+	unsigned long usecs;
+	int removed = purgeBlock("DELETE FROM fledge.readings WHERE id <= ?;", limit, usecs);
+	if (removed > 0 && limit > sent)
+	{
+		unsentPurged = min((unsigned long)removed, limit - sent);
+	}
+	return removed;
+}
+
+/**
+ * Check whether free pages of the database are returned to the file
+ * system by incremental vacuums. If FLEDGE_READINGS_INCREMENTAL_VACUUM is
+ * set an existing database is converted to incremental vacuum, this
+ * takes a full vacuum of the database. Databases created by the Fledge
+ * schema already use incremental vacuum.
+ *
+ * @return bool		True if the database uses incremental vacuum
+ */
+bool Connection::setupVacuum()
+{
+	int mode = 0;
+	sqlite3_stmt *stmt = prepare("PRAGMA fledge.auto_vacuum;");
+	if (stmt && SQLstep(stmt) == SQLITE_ROW)
+	{
+		mode = sqlite3_column_int(stmt, 0);
+	}
+	if (stmt)
+	{
+		sqlite3_reset(stmt);
+	}
+
+	if (mode != 2 && getenv("FLEDGE_READINGS_INCREMENTAL_VACUUM"))
+	{
+		Logger::getLogger()->info("Converting the database to incremental vacuum");
+		char *zErrMsg = NULL;
+		if (sqlite3_exec(dbHandle, "PRAGMA fledge.auto_vacuum = INCREMENTAL; VACUUM fledge;",
+					NULL, NULL, &zErrMsg) == SQLITE_OK)
+		{
+			mode = 2;
+		}
+		else
+		{
+			raiseError("vacuum", "Failed to convert the database to incremental vacuum: %s", zErrMsg);
+			sqlite3_free(zErrMsg);
+		}
+	}
+	m_incrementalVacuum = mode == 2;
+	return m_incrementalVacuum;
+}
+
+/**
+ * Return some of the free pages of the database to the file system
+ *
+ * @return unsigned long	The number of pages returned
+ */
+unsigned long Connection::incrementalVacuum()
+{
+	if (!m_incrementalVacuum)
+	{
+		return 0;
+	}
+	unsigned long pages = 0;
+	sqlite3_stmt *stmt = prepare("PRAGMA fledge.freelist_count;");
+	if (stmt && SQLstep(stmt) == SQLITE_ROW)
+	{
+		pages = (unsigned long)sqlite3_column_int64(stmt, 0);
+	}
+	if (stmt)
+	{
+		sqlite3_reset(stmt);
+	}
+	if (pages == 0)
+	{
+		return 0;
+	}
+
+	string sql = "PRAGMA fledge.incremental_vacuum(" + to_string(PURGE_VACUUM_PAGES) + ");";
+	if (sqlite3_exec(dbHandle, sql.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+	{
+		raiseError("vacuum", "Incremental vacuum failed: %s", sqlite3_errmsg(dbHandle));
+		return 0;
+	}
+	return min(pages, (unsigned long)PURGE_VACUUM_PAGES);
+}
+
+/**
+ * Attach the readings partitions that have been created and detach
+ * those that have been removed since the connection last attached to
+ * them, then recreate the view of the readings in all of the partitions.
+ * The readings table of the Fledge database is part of the view, it
+ * holds the readings inserted before the readings were partitioned.
+ *
+ * Databases can not be attached or detached within a transaction, the
+ * partitions are left as they are if a transaction is open.
+ *
+ * @return bool		True if the partitions are attached
+ */
+bool Connection::syncPartitions()
+{
+	if (!m_partitions || m_partitionGeneration == m_partitions->generation()
+			|| !sqlite3_get_autocommit(dbHandle))
+	{
+		return true;
+	}
+
+	vector<ReadingsPartitions::Partition> partitions;
+	unsigned long generation = m_partitions->partitions(partitions);
+
+	vector<string> attached;
+	for (auto& alias : m_attached)
+	{
+		bool exists = false;
+		for (auto& partition : partitions)
+		{
+			if (partition.alias == alias)
+				exists = true;
+		}
+		if (!exists)
+		{
+			string sql = "DETACH DATABASE " + alias + ";";
+			if (sqlite3_exec(dbHandle, sql.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+			{
+				raiseError("partitions", "Failed to detach %s: %s", alias.c_str(), sqlite3_errmsg(dbHandle));
+				attached.push_back(alias);
+			}
+			else
+			{
+				m_partitions->detached(alias);
+			}
+		}
+	}
+	for (auto& partition : partitions)
+	{
+		if (find(m_attached.begin(), m_attached.end(), partition.alias) == m_attached.end())
+		{
+			string sql = "ATTACH DATABASE '" + partition.path + "' AS " + partition.alias + ";";
+			if (sqlite3_exec(dbHandle, sql.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+			{
+				raiseError("partitions", "Failed to attach %s: %s", partition.path.c_str(), sqlite3_errmsg(dbHandle));
+				continue;
+			}
+			m_partitions->attached(partition.alias);
+		}
+		attached.push_back(partition.alias);
+	}
+	m_attached = attached;
+
+	string view = "DROP VIEW IF EXISTS temp.readings; CREATE TEMP VIEW readings AS "
+			"SELECT id, asset_code, reading, " + timestampColumns("") + " FROM fledge.readings";
+	for (auto& alias : m_attached)
+	{
+		view += " UNION ALL SELECT id, asset_code, reading, " + timestampColumns("") + " FROM " + alias + ".readings";
+	}
+	m_timestampView = false;
+	view += ";";
+	if (sqlite3_exec(dbHandle, view.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+	{
+		raiseError("partitions", "Failed to create the readings view: %s", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	m_partitionGeneration = generation;
+	return true;
+}
+
+/**
+ * Return the table or view to read the readings from. A view is used for
+ * partitioned or columnar readings and when the readings have epoch
+ * timestamps.
+ *
+ * @return string	The readings table or the view of the readings
+ */
+string Connection::readingsTable()
+{
+	if (m_partitions && syncPartitions() && m_partitionGeneration)
+	{
+		return "temp.readings";
+	}
+	if (m_columns && syncColumns() && !m_columnTables.empty())
+	{
+		return "temp.readings";
+	}
+	if (m_epochTimestamps && !m_timestampView)
+	{
+		// A view of the readings with their timestamps as text
+		string view = "DROP VIEW IF EXISTS temp.readings; CREATE TEMP VIEW readings AS "
+				"SELECT id, asset_code, reading, " + timestampColumns("") + " FROM fledge.readings;";
+		if (sqlite3_exec(dbHandle, view.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+		{
+			raiseError("readings", "Failed to create the readings view: %s", sqlite3_errmsg(dbHandle));
+			return "fledge.readings";
+		}
+		m_timestampView = true;
+	}
+	return m_epochTimestamps ? "temp.readings" : "fledge.readings";
+}
+
+/**
+ * Return the table to append readings to. When the readings are
+ * partitioned this is the partition for the current time, which is
+ * created if need be.
+ *
+ * @return string	The readings table to append to
+ */
+string Connection::appendTable()
+{
+	if (!m_partitions)
+	{
+		return "fledge.readings";
+	}
+
+	// The partitions must be attached to find the last id assigned
+	syncPartitions();
+	time_t now = time(0);
+	ReadingsPartitions::Partition partition;
+	if (!m_partitions->find(now, partition) && m_partitions->full())
+	{
+		removeOldestPartition();
+	}
+	if (!m_partitions->find(now, partition)
+			&& !m_partitions->create(now, lastReadingId(), partition))
+	{
+		/*
+		 * Continue to append to the newest partition, until those
+		 * removed have been detached by every connection
+		 */
+		vector<ReadingsPartitions::Partition> partitions;
+		m_partitions->partitions(partitions);
+		if (partitions.empty())
+		{
+			return "fledge.readings";
+		}
+		partition = partitions.back();
+	}
+	syncPartitions();
+	if (find(m_attached.begin(), m_attached.end(), partition.alias) == m_attached.end())
+	{
+		return "fledge.readings";
+	}
+	return partition.alias + ".readings";
+}
+
+/**
+ * Make room for a new partition when the limit of partitions has been
+ * reached, by applying the retention of the last purge request to the
+ * partitions. The oldest partition is only removed if that purge would
+ * remove it, unsent readings are kept if the purge retains them. Until
+ * a partition can be removed the readings continue to be appended to the
+ * newest partition, this is checked at most once every PARTITION_RETRY
+ * seconds.
+ */
+void Connection::removeOldestPartition()
+{
+	time_t now = time(0);
+	if (now < m_partitionRetry)
+	{
+		return;
+	}
+	m_partitionRetry = now + PARTITION_RETRY;
+
+	bool byRows;
+	unsigned long param, sent;
+	unsigned int flags;
+	if (m_partitions->retention(byRows, param, flags, sent))
+	{
+		// The readings inserted before partitioning do not take a partition
+		string result;
+		purgePartitions(byRows, param, flags, sent, result, false);
+	}
+	if (m_partitions->full())
+	{
+		Logger::getLogger()->warn("The limit of %d readings partitions has been reached and "
+				"the purge retains the oldest partition, readings are appended "
+				"to the newest partition", PARTITION_MAX);
+	}
+}
+
+/**
+ * Return the time of the insertion of a reading, in seconds since the epoch
+ *
+ * @param schema	The schema, fledge or a partition
+ * @param id		The id of the reading
+ * @return time_t	The time or 0 if the reading is not found
+ */
+time_t Connection::readingTime(const string& schema, unsigned long id)
+{
+	time_t when = 0;
+	sqlite3_stmt *stmt = prepare(schema == "fledge" && !m_epochTimestamps ?
+			"SELECT strftime('%s', ts) FROM fledge.readings WHERE id = ?;" :
+			"SELECT fledge_epoch(ts) / 1000000 FROM " + schema + ".readings WHERE id = ?;");
+	if (stmt)
+	{
+		sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+		if (SQLstep(stmt) == SQLITE_ROW)
+		{
+			when = (time_t)sqlite3_column_int64(stmt, 0);
+		}
+		sqlite3_reset(stmt);
+	}
+	return when;
+}
+
+/**
+ * Return the last reading id assigned in the readings table or any of
+ * the attached partitions.
+ *
+ * @return unsigned long	The last reading id
+ */
+unsigned long Connection::lastReadingId()
+{
+	unsigned long lastId = 0;
+
+	vector<string> schemas = m_attached;
+	schemas.insert(schemas.begin(), "fledge");
+	for (auto& schema : schemas)
+	{
+		sqlite3_stmt *stmt = prepare("SELECT seq FROM " + schema + ".sqlite_sequence WHERE name = 'readings';");
+		if (stmt && SQLstep(stmt) == SQLITE_ROW)
+		{
+			lastId = max(lastId, (unsigned long)sqlite3_column_int64(stmt, 0));
+		}
+		if (stmt)
+		{
+			sqlite3_reset(stmt);
+		}
+	}
+	return lastId;
+}
+
+/**
+ * Return the range of reading ids held by the readings table of a schema
+ *
+ * @param schema	The schema, fledge or a partition
+ * @param minId		Set to the smallest id
+ * @param maxId		Set to the largest id
+ * @return bool		True if the table holds any readings
+ */
+bool Connection::readingIds(const string& schema, unsigned long& minId, unsigned long& maxId)
+{
+	bool found = false;
+
+	sqlite3_stmt *stmt = prepare("SELECT min(id), max(id) FROM " + schema + ".readings;");
+	if (stmt && SQLstep(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+	{
+		minId = (unsigned long)sqlite3_column_int64(stmt, 0);
+		maxId = (unsigned long)sqlite3_column_int64(stmt, 1);
+		found = true;
+	}
+	if (stmt)
+	{
+		sqlite3_reset(stmt);
+	}
+	return found;
+}
+
+/**
+ * Purge the partitioned readings by removing whole partitions, oldest
+ * first. The partition readings are currently appended to is never
+ * removed. The readings inserted before the readings were partitioned
+ * are treated as the oldest partition and deleted in blocks.
+ *
+ * The age of a partition is that of its newest reading, if it is newer
+ * than the end of its window of time.
+ *
+ * @param byRows	True to purge by rows rather than by age
+ * @param param		The age in hours or the number of rows to retain
+ * @param flags		The purge flags, bit 0 set retains unsent readings
+ * @param sent		The last reading id that has been sent
+ * @param result	Set to the result of the purge as JSON
+ * @param legacy	False to keep the readings inserted before partitioning
+ * @return unsigned int	The number of readings removed
+ */
+unsigned int Connection::purgePartitions(bool byRows, unsigned long param, unsigned int flags,
+					unsigned long sent, string& result, bool legacy)
+{
+	class Source {
+		public:
+			string		schema;
+			unsigned long	minId;
+			unsigned long	maxId;
+			time_t		end;
+			unsigned long	count() const { return maxId - minId + 1; };
+			unsigned long	unsent(unsigned long sent) const
+			{
+				return maxId > sent ? maxId - max(sent, minId - 1) : 0;
+			};
+	};
+
+	syncPartitions();
+	vector<ReadingsPartitions::Partition> partitions;
+	m_partitions->partitions(partitions);
+
+	vector<Source> sources;
+	Source readings;
+	readings.schema = "fledge";
+	if (readingIds(readings.schema, readings.minId, readings.maxId))
+	{
+		readings.end = readingTime(readings.schema, readings.maxId);
+		sources.push_back(readings);
+	}
+	for (auto& partition : partitions)
+	{
+		if (find(m_attached.begin(), m_attached.end(), partition.alias) == m_attached.end())
+		{
+			continue;
+		}
+		Source source;
+		source.schema = partition.alias;
+		source.end = m_partitions->end(partition);
+		if (!readingIds(source.schema, source.minId, source.maxId))
+		{
+			// An empty partition
+			source.minId = 1;
+			source.maxId = 0;
+		}
+		else
+		{
+			// Readings may have been appended after the end of the window
+			source.end = max(source.end, readingTime(source.schema, source.maxId));
+		}
+		sources.push_back(source);
+	}
+
+	unsigned long total = 0;
+	for (auto& source : sources)
+	{
+		total += source.count();
+	}
+
+	time_t cutoff = time(0) - param * 3600;
+	unsigned long removed = 0, unsentPurged = 0, unsentRetained = 0, removedId = 0;
+	size_t i = 0;
+	for (; i < sources.size(); i++)
+	{
+		Source& source = sources[i];
+		if (source.schema != "fledge" && i == sources.size() - 1)
+			break;	// The partition being appended to
+		if (byRows ? total - removed - source.count() < param : source.end > cutoff)
+			break;
+		if ((flags & 0x01) && source.maxId > sent)
+			break;
+
+		if (source.schema == "fledge")
+		{
+			if (!legacy)
+				continue;
+			// Delete in blocks so that the appends are not held up by the whole delete
+			unsigned long block = m_writer ? m_writer->purgeScheduler().blockSize() : MIN_PURGE_DELETE_BLOCK_SIZE;
+			unsigned long limit = source.minId - 1, deleted = 0;
+			int rowsAffected = 0;
+			while (limit < source.maxId)
+			{
+				unsigned long usecs;
+				limit = min(limit + block, source.maxId);
+				if ((rowsAffected = purgeBlock("DELETE FROM fledge.readings WHERE id <= ?;", limit, usecs)) < 0)
+					break;
+				deleted += (unsigned long)rowsAffected;
+			}
+			if (rowsAffected < 0)
+			{
+				removed += deleted;
+				unsentPurged += deleted;
+				break;
+			}
+		}
+		else
+		{
+			m_partitions->remove(source.schema);
+			removedId = source.maxId;
+		}
+		removed += source.count();
+		unsentPurged += sent ? source.unsent(sent) : source.count();
+	}
+	for (; i < sources.size(); i++)
+	{
+		unsentRetained += sources[i].unsent(sent);
+	}
+	syncPartitions();
+	if (removedId && m_writer)
+	{
+		// Replace the latest readings that were in the partitions removed
+		m_writer->execute([removedId](Connection *writer) {
+				writer->syncPartitions();
+				return !writer->m_latest || ReadingsLatest::purged(writer, removedId) ? 0 : -1;
+			}, ReadingsWriter::Purge);
+	}
+	else if (removedId && m_latest)
+	{
+		ReadingsLatest::purged(this, removedId);
+	}
+
+	ostringstream convert;
+
+	convert << "{ \"removed\" : " << removed << ", ";
+	convert << " \"unsentPurged\" : " << unsentPurged << ", ";
+	convert << " \"unsentRetained\" : " << unsentRetained << ", ";
+	convert << " \"readings\" : " << total - removed << " }";
+
+	result = convert.str();
+	Logger::getLogger()->info("Purge of readings partitions complete: %s", result.c_str());
+	return removed;
+}
+
+/**
+ * Recreate the view of the readings when asset tables or columns have
+ * been added since the connection last created it. The view combines
+ * the readings that hold all of their datapoints as JSON with those of
+ * each asset table, whose numeric datapoints are patched into the JSON
+ * reading. A datapoint that is NULL in the asset table is not added.
+ * The patched datapoints follow those that are held in the JSON reading.
+ *
+ * The view is left as it is if a transaction is open.
+ *
+ * @return bool		True if the view is in place
+ */
+bool Connection::syncColumns()
+{
+	if (!m_columns || m_columnsGeneration == m_columns->generation()
+			|| !sqlite3_get_autocommit(dbHandle))
+	{
+		return true;
+	}
+
+	vector<ReadingsColumns::AssetTable> tables;
+	unsigned long generation = m_columns->tables(tables);
+
+	string view = "DROP VIEW IF EXISTS temp.readings;";
+	if (!tables.empty())
+	{
+		view += " CREATE TEMP VIEW readings AS "
+			"SELECT r.id, r.asset_code, r.reading, " + timestampColumns("r.") + " FROM fledge.readings r "
+			"LEFT JOIN fledge.readings_assets a ON a.asset_code = r.asset_code "
+			"WHERE a.id IS NULL OR r.id < a.first_id";
+		for (auto& table : tables)
+		{
+			view += " UNION ALL SELECT r.id, r.asset_code, json_patch(r.reading, json_patch('{}', json_object(";
+			for (size_t i = 0; i < table.columns.size(); i++)
+			{
+				const string& datapoint = table.columns[i].datapoint;
+				view += (i ? ", '" : "'") + escape(datapoint) + "', c."
+					+ ReadingsColumns::columnName(datapoint);
+			}
+			view += "))), " + timestampColumns("r.") + " FROM fledge." + table.table
+				+ " c JOIN fledge.readings r ON r.id = c.id";
+		}
+		view += ";";
+	}
+	m_timestampView = false;
+	if (sqlite3_exec(dbHandle, view.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+	{
+		raiseError("columns", "Failed to create the readings view: %s", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	m_columnTables = tables;
+	m_columnsGeneration = generation;
+	return true;
+}
+
+/**
+ * Insert a reading using the columnar layout. The numeric datapoints are
+ * inserted in the table of the asset and the remaining datapoints as the
+ * JSON reading of the readings table. The reading is inserted as JSON if
+ * the asset has no table.
+ *
+ * @param user_ts	The formatted user timestamp of the reading
+ * @param usecs		The user timestamp in microseconds since the epoch
+ * @param asset_code	The asset code of the reading
+ * @param reading	The datapoints of the reading
+ * @return int		1 if the reading was inserted or -1 on failure
+ */
+int Connection::insertColumnar(const char *user_ts, int64_t usecs, const char *asset_code, const Value& reading)
+{
+	ReadingsColumns::AssetTable *table = NULL;
+	if (reading.IsObject())
+	{
+		table = m_columns->table(dbHandle, asset_code);
+	}
+
+	vector<pair<int, const Value *>> values;
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	if (table)
+	{
+		writer.StartObject();
+		for (Value::ConstMemberIterator itr = reading.MemberBegin(); itr != reading.MemberEnd(); ++itr)
+		{
+			int column = -1;
+			if (itr->value.IsDouble() || itr->value.IsInt64())
+			{
+				column = m_columns->column(dbHandle, *table,
+						string(itr->name.GetString(), itr->name.GetStringLength()),
+						!itr->value.IsDouble());
+				for (auto& value : values)
+				{
+					if (value.first == column)
+						column = -1;	// A repeated datapoint
+				}
+			}
+			if (column >= 0)
+			{
+				values.push_back(make_pair(column, &itr->value));
+			}
+			else
+			{
+				writer.Key(itr->name.GetString(), itr->name.GetStringLength());
+				itr->value.Accept(writer);
+			}
+		}
+		writer.EndObject();
+	}
+	else
+	{
+		reading.Accept(writer);
+	}
+	// Quotes are doubled as they are for the readings held as JSON
+	string json = escape(buffer.GetString());
+
+	sqlite3_stmt *stmt = prepare(m_epochTimestamps ?
+			"INSERT INTO fledge.readings ( user_ts, asset_code, reading, ts ) VALUES  (?,?,?,?)" :
+			"INSERT INTO fledge.readings ( user_ts, asset_code, reading ) VALUES  (?,?,?)");
+	if (stmt == NULL)
+	{
+		raiseError("appendReadings", sqlite3_errmsg(dbHandle));
+		return -1;
+	}
+	bindTimestamp(stmt, 1, user_ts, usecs);
+	if (m_epochTimestamps)
+	{
+		sqlite3_bind_int64(stmt, 4, (sqlite3_int64)ReadingsTimestamp::now());
+	}
+	sqlite3_bind_text(stmt, 2, asset_code, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 3, json.c_str(), json.length(), SQLITE_STATIC);
+	int rc = SQLstep(stmt);
+	sqlite3_reset(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		raiseError("appendReadings", "Inserting a row into SQLIte using a prepared command - asset_code :%s: error :%s: reading :%s: ",
+			asset_code,
+			sqlite3_errmsg(dbHandle),
+			json.c_str());
+		return -1;
+	}
+	if (!table)
+	{
+		return 1;
+	}
+
+	string sql = "INSERT INTO fledge." + table->table + " (id";
+	for (auto& value : values)
+	{
+		sql += ", " + ReadingsColumns::columnName(table->columns[value.first].datapoint);
+	}
+	sql += ") VALUES (last_insert_rowid()";
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		sql += ", ?";
+	}
+	sql += ");";
+	if ((stmt = prepare(sql)) == NULL)
+	{
+		raiseError("appendReadings", sqlite3_errmsg(dbHandle));
+		return -1;
+	}
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		if (table->columns[values[i].first].integer)
+			sqlite3_bind_int64(stmt, i + 1, (sqlite3_int64)values[i].second->GetInt64());
+		else
+			sqlite3_bind_double(stmt, i + 1, values[i].second->GetDouble());
+	}
+	rc = SQLstep(stmt);
+	sqlite3_reset(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		raiseError("appendReadings", "Inserting the datapoints of asset_code :%s: into %s error :%s:",
+			asset_code,
+			table->table.c_str(),
+			sqlite3_errmsg(dbHandle));
+		return -1;
+	}
+	return 1;
+}
+
+/**
+ * Insert a reading, whose datapoints are a JSON object, using the
+ * columnar layout
+ *
+ * @param user_ts	The formatted user timestamp of the reading
+ * @param usecs		The user timestamp in microseconds since the epoch
+ * @param asset_code	The asset code of the reading
+ * @param reading	The datapoints of the reading as JSON
+ * @param length	The length of the JSON
+ * @return int		1 if the reading was inserted or -1 on failure
+ */
+int Connection::insertColumnar(const char *user_ts, int64_t usecs, const char *asset_code, const char *reading, size_t length)
+{
+	Document doc;
+	if (doc.Parse(reading, length).HasParseError())
+	{
+		raiseError("appendReadings", "Invalid reading for asset_code :%s: %s",
+				asset_code, GetParseError_En(doc.GetParseError()));
+		return -1;
+	}
+	if (insertColumnar(user_ts, usecs, asset_code, doc) < 0)
+	{
+		return -1;
+	}
+	if (m_latest)
+	{
+		// The id of the asset table is that of the reading
+		if (!m_epochTimestamps)
+		{
+			ReadingsTimestamp::parse(user_ts, usecs);
+		}
+		string json = escape(string(reading, length));
+		m_latest->add(asset_code, strlen(asset_code), sqlite3_last_insert_rowid(dbHandle),
+				usecs, json.c_str(), json.length());
+	}
+	return 1;
+}
+
+/**
+ * Return a query of the datapoints of the readings, a row for each
+ * datapoint with the columns of the readings table and the name and
+ * value of the datapoint as x and theval. The numeric datapoints are
+ * read from the columns of the asset tables rather than the JSON.
+ *
+ * @return string	The query
+ */
+string Connection::columnarDatapoints()
+{
+	string sql = "SELECT readings.id, asset_code, reading, " + timestampColumns("") + ", json_each.key AS x, json_each.value AS theval "
+			"FROM fledge.readings, json_each(readings.reading)";
+	for (auto& table : m_columnTables)
+	{
+		if (table.columns.empty())
+		{
+			continue;
+		}
+		// Unpivot the columns, a row per column of each reading
+		string names = "CASE n.column1", values = "CASE n.column1", columns = "";
+		for (size_t i = 0; i < table.columns.size(); i++)
+		{
+			const string& datapoint = table.columns[i].datapoint;
+			names += " WHEN " + to_string(i) + " THEN '" + escape(datapoint) + "'";
+			values += " WHEN " + to_string(i) + " THEN c." + ReadingsColumns::columnName(datapoint);
+			columns += (i ? ", (" : "(") + to_string(i) + ")";
+		}
+		sql += " UNION ALL SELECT * FROM (SELECT r.id, r.asset_code, r.reading, " + timestampColumns("r.") + ", "
+			+ names + " END AS x, " + values + " END AS theval FROM fledge." + table.table
+			+ " c JOIN fledge.readings r ON r.id = c.id, (VALUES " + columns + ") n) WHERE theval IS NOT NULL";
+	}
+	return sql;
+}
+
+/**
+ * Convert the user timestamp of a reading to the form in which it is
+ * stored. The timestamp is formatted as text or, when the readings use
+ * epoch timestamps, converted to microseconds since the epoch without
+ * formatting it unless it is not in the usual form.
+ *
+ * @param user_ts	The user timestamp, set to the formatted timestamp
+ * @param formatted	A buffer of LEN_BUFFER_DATE for the formatted timestamp
+ * @param usecs		Set to the microseconds since the epoch when the
+ *			readings use epoch timestamps
+ * @param now		The time of the batch of the reading, in microseconds
+ *			since the epoch, that now() is replaced by
+ * @return bool		False if the timestamp is invalid
+ */
+bool Connection::userTimestamp(const char *&user_ts, char *formatted, int64_t& usecs, int64_t now)
+{
+	if (strcmp(user_ts, "now()") == 0)
+	{
+		usecs = now;
+		if (!m_epochTimestamps)
+		{
+			// Milliseconds, as SQLITE3_NOW_READING has them
+			ReadingsTimestamp::format(now / 1000 * 1000, 6, true, formatted);
+			user_ts = formatted;
+		}
+		return true;
+	}
+	if (m_epochTimestamps && ReadingsTimestamp::parse(user_ts, usecs))
+	{
+		return true;
+	}
+	if (!formatDate(formatted, LEN_BUFFER_DATE, user_ts))
+	{
+		return false;
+	}
+	user_ts = formatted;
+	return !m_epochTimestamps || ReadingsTimestamp::parse(user_ts, usecs);
+}
+
+/**
+ * Bind the user timestamp of a reading, returned by userTimestamp, to
+ * a parameter of an insert statement
+ *
+ * @param stmt		The insert statement
+ * @param column	The parameter of the user timestamp
+ * @param user_ts	The formatted user timestamp
+ * @param usecs		The user timestamp in microseconds since the epoch
+ */
+void Connection::bindTimestamp(sqlite3_stmt *stmt, int column, const char *user_ts, int64_t usecs)
+{
+	if (m_epochTimestamps)
+	{
+		sqlite3_bind_int64(stmt, column, (sqlite3_int64)usecs);
+	}
+	else
+	{
+		sqlite3_bind_text(stmt, column, user_ts, -1, SQLITE_STATIC);
+	}
+}
+
+/**
+ * Return the timestamp columns of the readings to select in a view of
+ * the readings. Epoch timestamps are formatted as the text timestamps
+ * are stored, so that the queries of the readings are unchanged. The
+ * user timestamp as it is stored is added as user_ts_epoch, for the
+ * where clauses to compare with.
+ *
+ * @param prefix	The prefix of the columns, the table and a period
+ * @return string	The user_ts and ts columns
+ */
+string Connection::timestampColumns(const string& prefix)
+{
+	if (!m_epochTimestamps)
+	{
+		return prefix + "user_ts, " + prefix + "ts";
+	}
+	return "fledge_ts(" + prefix + "user_ts, 6, 1) AS user_ts, fledge_ts(" + prefix + "ts, 3, 1) AS ts, "
+		+ prefix + "user_ts AS user_ts_epoch";
+}
+
+/**
+ * Return whether the ranges of user timestamps of the where clauses of
+ * the readings are compared with the epoch timestamps as they are stored.
+ * While timestamps are migrated the readings hold both forms, those are
+ * then compared in the form of the view.
+ *
+ * @return bool		True if the epoch timestamps are compared
+ */
+bool Connection::epochFilters()
+{
+	return m_epochTimestamps && !(m_writer && m_writer->migrating());
+}
+
+/**
+ * Check whether the readings table holds timestamps in the other form
+ * to that of the connection, as it does when epoch timestamps have been
+ * enabled or disabled for an existing database. The migration of those
+ * timestamps is then made by calls to migrateTimestamps.
+ *
+ * The index on user_ts orders the integer timestamps before the text
+ * timestamps, so only one end of the index need be read.
+ *
+ * @return bool		True if there are timestamps to migrate
+ */
+bool Connection::startTimestampMigration()
+{
+	sqlite3_stmt *stmt = prepare(m_epochTimestamps ?
+			"SELECT typeof(MAX(user_ts)) = 'text' FROM fledge.readings;" :
+			"SELECT typeof(MIN(user_ts)) = 'integer' FROM fledge.readings;");
+	if (stmt == NULL)
+	{
+		raiseError("migrateTimestamps", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	bool migrate = SQLstep(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0);
+	sqlite3_reset(stmt);
+
+	if (migrate && readingIds("fledge", m_migrateId, m_migrateMaxId))
+	{
+		Logger::getLogger()->info("Migrating the timestamps of readings %lu to %lu to %s",
+				m_migrateId, m_migrateMaxId,
+				m_epochTimestamps ? "epoch timestamps" : "text");
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Migrate the timestamps of the next block of readings to the form
+ * used by the connection.
+ *
+ * @return bool		True if there are further timestamps to migrate
+ */
+bool Connection::migrateTimestamps()
+{
+	sqlite3_stmt *stmt = prepare(m_epochTimestamps ?
+			"UPDATE fledge.readings SET user_ts = fledge_epoch(user_ts), ts = fledge_epoch(ts) "
+				"WHERE id >= ? AND id < ? AND typeof(user_ts) = 'text';" :
+			"UPDATE fledge.readings SET user_ts = fledge_ts(user_ts, 6, 1), ts = fledge_ts(ts, 3, 1) "
+				"WHERE id >= ? AND id < ? AND typeof(user_ts) = 'integer';");
+	if (stmt == NULL)
+	{
+		raiseError("migrateTimestamps", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)m_migrateId);
+	sqlite3_bind_int64(stmt, 2, (sqlite3_int64)(m_migrateId + TIMESTAMP_MIGRATE_BLOCK));
+	int rc = SQLstep(stmt);
+	sqlite3_reset(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		raiseError("migrateTimestamps", "Failed to migrate the timestamps of readings from %lu: %s",
+				m_migrateId, sqlite3_errmsg(dbHandle));
+		return false;
+	}
+
+	m_migrateId += TIMESTAMP_MIGRATE_BLOCK;
+	if (m_migrateId > m_migrateMaxId)
+	{
+		Logger::getLogger()->info("Migrated the timestamps of the readings");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Return a query of the datapoints of the readings, a row for each
+ * datapoint with the id, asset_code and user_ts of the reading and the
+ * name and value of the datapoint as x and theval.
+ *
+ * @return string	The query, in parentheses
+ */
+string Connection::rollupSource()
+{
+	if (m_columns && syncColumns() && !m_columnTables.empty())
+	{
+		return "(" + columnarDatapoints() + ")";
+	}
+	return "(SELECT readings.id AS id, asset_code, user_ts, " + string(m_epochTimestamps ? "user_ts_epoch, " : "")
+		+ "json_each.key AS x, json_each.value AS theval FROM " + readingsTable() + " readings, json_each(readings.reading))";
+}
+
+/**
+ * Add the next block of the readings appended since the last call to
+ * each of the rollups, merging their aggregates with those of the
+ * buckets already held. Once readings have been purged the buckets
+ * older than that of the oldest reading are removed from the rollups.
+ *
+ * Only called by the readings writer, outside of its transactions.
+ *
+ * @return bool		True if there are further readings to add
+ */
+bool Connection::updateRollups()
+{
+	if (!m_rollups)
+	{
+		return false;
+	}
+
+	string source = rollupSource();
+	unsigned long lastId = lastReadingId(), minId = 0;
+	vector<string> schemas = m_attached;
+	schemas.insert(schemas.begin(), "fledge");
+	for (auto& schema : schemas)
+	{
+		unsigned long first, last;
+		if (readingIds(schema, first, last) && (minId == 0 || first < minId))
+		{
+			minId = first;
+		}
+	}
+
+	if (sqlite3_exec(dbHandle, "SAVEPOINT rollups", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		raiseError("rollups", sqlite3_errmsg(dbHandle));
+		return false;
+	}
+	bool more = false;
+	int rc = SQLITE_DONE;
+	for (auto size : m_rollups->sizes())
+	{
+		string sizeText = to_string(size);
+		sqlite3_stmt *stmt = prepare("SELECT last_id FROM fledge.readings_rollups WHERE size = ?;");
+		if (stmt == NULL)
+		{
+			rc = SQLITE_ERROR;
+			break;
+		}
+		sqlite3_bind_int64(stmt, 1, (sqlite3_int64)size);
+		unsigned long from = lastId;
+		if ((rc = SQLstep(stmt)) == SQLITE_ROW)
+		{
+			from = (unsigned long)sqlite3_column_int64(stmt, 0);
+			rc = SQLITE_DONE;
+		}
+		sqlite3_reset(stmt);
+		if (rc != SQLITE_DONE)
+		{
+			break;
+		}
+
+		unsigned long to = min(from + ROLLUPS_BLOCK, lastId);
+		if (to > from)
+		{
+			// A datapoint that is NULL in a bucket does not replace the aggregates of the others
+			string bucket = ReadingsRollups::bucket("user_ts", size);
+			stmt = prepare("INSERT OR REPLACE INTO fledge." ROLLUPS_TABLE " "
+					"(size, asset_code, datapoint, bucket, min, max, sum, count) "
+					"SELECT " + sizeText + ", n.asset_code, n.datapoint, n.bucket, "
+					"CASE WHEN r.min IS NULL OR n.min < r.min THEN n.min ELSE r.min END, "
+					"CASE WHEN r.max IS NULL OR n.max > r.max THEN n.max ELSE r.max END, "
+					"CASE WHEN r.sum IS NULL THEN n.sum WHEN n.sum IS NULL THEN r.sum ELSE r.sum + n.sum END, "
+					"n.count + coalesce(r.count, 0) "
+					"FROM (SELECT asset_code, x AS datapoint, " + bucket + " AS bucket, "
+					"min(theval) AS min, max(theval) AS max, sum(theval) AS sum, count(theval) AS count "
+					"FROM " + source + " WHERE id > ? AND id <= ? GROUP BY 1, 2, 3 "
+					"HAVING datapoint IS NOT NULL AND bucket IS NOT NULL) n "
+					"LEFT JOIN fledge." ROLLUPS_TABLE " r ON r.size = " + sizeText + " AND r.asset_code = n.asset_code "
+					"AND r.datapoint = n.datapoint AND r.bucket = n.bucket;");
+			if (stmt == NULL)
+			{
+				rc = SQLITE_ERROR;
+				break;
+			}
+			sqlite3_bind_int64(stmt, 1, (sqlite3_int64)from);
+			sqlite3_bind_int64(stmt, 2, (sqlite3_int64)to);
+			rc = SQLstep(stmt);
+			sqlite3_reset(stmt);
+			if (rc != SQLITE_DONE)
+			{
+				break;
+			}
+
+			stmt = prepare("UPDATE fledge.readings_rollups SET last_id = ? WHERE size = ?;");
+			if (stmt == NULL)
+			{
+				rc = SQLITE_ERROR;
+				break;
+			}
+			sqlite3_bind_int64(stmt, 1, (sqlite3_int64)to);
+			sqlite3_bind_int64(stmt, 2, (sqlite3_int64)size);
+			rc = SQLstep(stmt);
+			sqlite3_reset(stmt);
+			if (rc != SQLITE_DONE)
+			{
+				break;
+			}
+			more = more || to < lastId;
+		}
+
+		if (minId > m_rollupsMinId)
+		{
+			// The readings up to minId have been purged
+			stmt = prepare("DELETE FROM fledge." ROLLUPS_TABLE " WHERE size = " + sizeText + " AND bucket < (SELECT "
+					+ ReadingsRollups::bucket("user_ts", size) + " FROM "
+					+ readingsTable() + " WHERE id = ?);");
+			if (stmt == NULL)
+			{
+				rc = SQLITE_ERROR;
+				break;
+			}
+			sqlite3_bind_int64(stmt, 1, (sqlite3_int64)minId);
+			rc = SQLstep(stmt);
+			sqlite3_reset(stmt);
+			if (rc != SQLITE_DONE)
+			{
+				break;
+			}
+		}
+	}
+
+	if (rc != SQLITE_DONE)
+	{
+		raiseError("rollups", "Failed to update the readings rollups: %s", sqlite3_errmsg(dbHandle));
+		sqlite3_exec(dbHandle, "ROLLBACK TO rollups; RELEASE rollups;", NULL, NULL, NULL);
+		return false;
+	}
+	if (sqlite3_exec(dbHandle, "RELEASE rollups", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		raiseError("rollups", "Failed to commit the readings rollups: %s", sqlite3_errmsg(dbHandle));
+		sqlite3_exec(dbHandle, "ROLLBACK TO rollups; RELEASE rollups;", NULL, NULL, NULL);
+		return false;
+	}
+	m_rollupsMinId = max(m_rollupsMinId, minId);
+	return more;
+}
+
+/**
+ * Append the subquery of the aggregates of a timebucket query of all the
+ * datapoints that takes the buckets from a rollup. The buckets that lie
+ * within the time bounds of the where clause, by more than a margin,
+ * are read from the rollup. The readings of the buckets at the bounds,
+ * and those not yet added to the rollup, are aggregated as the query
+ * would aggregate them and merged with the buckets of the rollup.
+ *
+ * The buckets up to that of the oldest reading may hold the aggregates
+ * of readings that have since been purged, their readings are aggregated
+ * rather than read from the rollup. The last reading id added to the
+ * rollup and the oldest reading are read by the query itself, so that
+ * they are those of the same snapshot as the rollup.
+ *
+ * Only a where clause that is a conjunction of conditions on asset_code
+ * and bounds on user_ts can be answered from a rollup.
+ *
+ * @param where		The where clause of the query
+ * @param size		The bucket size of the query
+ * @param sql		The query to append the subquery to
+ * @return bool		False if the query can not be answered from a
+ *			rollup, in which case nothing is appended
+ */
+bool Connection::rollupQuery(const Value& where, unsigned long size, SQLBuffer& sql)
+{
+	if (!m_rollups || !m_rollups->has(size))
+	{
+		return false;
+	}
+
+	string assets;
+	bool lower = false, upper = false;
+	int64_t lowerBound = 0, upperBound = 0;	// Microseconds since the epoch
+	for (const Value *cond = &where; cond; cond = cond->HasMember("and") ? &(*cond)["and"] : NULL)
+	{
+		if (!cond->IsObject() || cond->HasMember("or") || !cond->HasMember("column")
+				|| !cond->HasMember("condition") || !cond->HasMember("value")
+				|| !(*cond)["column"].IsString() || !(*cond)["condition"].IsString())
+		{
+			return false;
+		}
+		string column = (*cond)["column"].GetString();
+		string condition = (*cond)["condition"].GetString();
+		const Value& value = (*cond)["value"];
+		if (column.compare("asset_code") == 0)
+		{
+			if (condition.compare("=") == 0 && value.IsString())
+			{
+				assets += " AND asset_code = '" + escape(value.GetString()) + "'";
+			}
+			else if (condition.compare("in") == 0 && value.IsArray() && value.Size())
+			{
+				assets += " AND asset_code IN (";
+				for (SizeType i = 0; i < value.Size(); i++)
+				{
+					if (!value[i].IsString())
+						return false;
+					assets += (i ? ", '" : "'") + escape(value[i].GetString()) + "'";
+				}
+				assets += ")";
+			}
+			else
+			{
+				return false;
+			}
+			continue;
+		}
+		if (column.compare("user_ts") != 0)
+		{
+			return false;
+		}
+
+		int64_t usecs;
+		if ((condition.compare("newer") == 0 || condition.compare("older") == 0) && value.IsInt())
+		{
+			usecs = ReadingsTimestamp::now() - (int64_t)value.GetInt() * 1000000;
+		}
+		else if (value.IsString())
+		{
+			// The bound must compare as text as it does in time
+			char formatted[TIMESTAMP_BUFFER_LEN];
+			const char *text = value.GetString();
+			if (strlen(text) < 19 || text[10] != ' ' || !ReadingsTimestamp::parse(text, usecs))
+				return false;
+			ReadingsTimestamp::format(usecs, 0, false, formatted);
+			if (strncmp(formatted, text, 19) != 0)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+
+		if (condition.compare("newer") == 0 || condition.compare(">") == 0 || condition.compare(">=") == 0)
+		{
+			lowerBound = lower ? max(lowerBound, usecs) : usecs;
+			lower = true;
+		}
+		else if (condition.compare("older") == 0 || condition.compare("<") == 0 || condition.compare("<=") == 0)
+		{
+			upperBound = upper ? min(upperBound, usecs) : usecs;
+			upper = true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	// The first and last buckets that lie within the bounds
+	double seconds = (double)size;
+	long long first = 0, last = 0;
+	if (lower)
+	{
+		first = (long long)floor((lowerBound / 1000000.0 + ROLLUPS_MARGIN) / seconds + 0.5) + 1;
+	}
+	if (upper)
+	{
+		last = (long long)ceil((upperBound / 1000000.0 - ROLLUPS_MARGIN) / seconds - 0.5) - 1;
+	}
+	if (lower && upper && first > last)
+	{
+		return false;
+	}
+
+	sqlite3_stmt *stmt = prepare("SELECT last_id FROM fledge.readings_rollups WHERE size = ?;");
+	if (stmt == NULL)
+	{
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)size);
+	bool found = SQLstep(stmt) == SQLITE_ROW;
+	sqlite3_reset(stmt);
+	if (!found)
+	{
+		return false;
+	}
+
+	string buckets = "1", from, to;
+	char bound[TIMESTAMP_BUFFER_LEN];
+	if (lower)
+	{
+		buckets += " AND bucket >= " + to_string(first);
+		ReadingsTimestamp::format((int64_t)(((first - 0.5) * seconds + ROLLUPS_MARGIN) * 1000000), 6, false, bound);
+		from = bound;
+	}
+	if (upper)
+	{
+		buckets += " AND bucket <= " + to_string(last);
+		ReadingsTimestamp::format((int64_t)(((last + 0.5) * seconds - ROLLUPS_MARGIN) * 1000000), 6, false, bound);
+		to = bound;
+	}
+	string sizeText = to_string(size);
+	string source = rollupSource();
+	string lastId = "(SELECT last_id FROM fledge.readings_rollups WHERE size = " + sizeText + ")";
+
+	// The bucket of the oldest reading and the time from which the buckets after it start
+	string oldestId = "SELECT min(id) AS id FROM fledge.readings";
+	for (auto& schema : m_attached)
+	{
+		oldestId += " UNION ALL SELECT min(id) FROM " + schema + ".readings";
+	}
+	string purged = "(SELECT " + ReadingsRollups::bucket("user_ts", size) + " FROM " + readingsTable()
+			+ " WHERE id = (SELECT min(id) FROM (" + oldestId + ")))";
+	string after = "strftime('%Y-%m-%d %H:%M:%f', (" + purged + " + 0.5) * " + sizeText
+			+ " + " + to_string(ROLLUPS_MARGIN) + ", 'unixepoch')";
+	if (lower)
+	{
+		after = "max('" + from + "', " + after + ")";
+	}
+	buckets += " AND bucket > " + purged;
+
+	SQLBuffer subquery;
+	subquery.append("FROM ( SELECT x, asset_code, datetime(" + sizeText + " * bucket, 'unixepoch') AS timestamp, ");
+	subquery.append("'{\"min\" : ' || min(mn) || ', ");
+	subquery.append("\"max\" : ' || max(mx) || ', ");
+	subquery.append("\"average\" : ' || (total(sm) / sum(cnt)) || ', ");
+	subquery.append("\"count\" : ' || sum(cnt) || ', ");
+	subquery.append("\"sum\" : ' || sum(sm) || '}' AS resd ");
+
+	// The buckets of the rollup
+	subquery.append("FROM ( SELECT datapoint AS x, asset_code, bucket, min AS mn, max AS mx, sum AS sm, count AS cnt ");
+	subquery.append("FROM fledge." ROLLUPS_TABLE " WHERE size = " + sizeText + " AND " + buckets + assets);
+
+	/*
+	 * The readings before and after the buckets of the rollup, and those
+	 * in between that are not yet in the rollup. Each is a range of the
+	 * user_ts index or of the ids, the LIMIT keeps the range of ids from
+	 * being merged into the where clause.
+	 */
+	subquery.append(" UNION ALL SELECT x, asset_code, bucket, min(theval), max(theval), sum(theval), count(theval) FROM (");
+	string select = " SELECT id, asset_code, x, theval, " + ReadingsRollups::bucket("user_ts", size) + " AS bucket FROM ";
+	subquery.append(select + source + " readings WHERE ");
+	if (!jsonWhereClause(where, subquery, false, epochFilters()))
+		return false;
+	subquery.append(" AND readings.user_ts < " + after + " UNION ALL");
+	if (upper)
+	{
+		subquery.append(select + source + " readings WHERE ");
+		if (!jsonWhereClause(where, subquery, false, epochFilters()))
+			return false;
+		subquery.append(" AND readings.user_ts >= max('" + to + "', " + after + ") UNION ALL");
+	}
+	subquery.append(select + "(SELECT * FROM " + source + " WHERE id > " + lastId + " LIMIT -1) readings WHERE ");
+	if (!jsonWhereClause(where, subquery, false, epochFilters()))
+		return false;
+	subquery.append(" AND readings.user_ts >= " + after);
+	if (upper)
+		subquery.append(" AND readings.user_ts < '" + to + "'");
+	subquery.append(" ) WHERE NOT (" + buckets + ") OR id > " + lastId);
+	subquery.append(" GROUP BY x, asset_code, bucket ) GROUP BY x, asset_code, bucket ) tbl ");
+
+	const char *text = subquery.coalesce();
+	sql.append(text);
+	delete[] text;
+	return true;
+}
@@ -0,0 +1,260 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_columns.h>
+#include <logger.h>
+#include <string.h>
+
+using namespace std;
+
+/**
+ * Construct the columnar layout, the tables are read by load
+ */
+ReadingsColumns::ReadingsColumns() : m_pending(false), m_generation(0)
+{
+}
+
+/**
+ * Load the catalogue of the asset tables and their columns from the
+ * database, creating the catalogue if it does not exist. The tables
+ * loaded are not published to the other connections.
+ *
+ * @param db	The database connection of the readings writer
+ * @return bool	True if the catalogue was loaded
+ */
+bool ReadingsColumns::load(sqlite3 *db)
+{
+	char *zErrMsg = NULL;
+	if (sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS fledge.readings_assets ("
+				"id INTEGER PRIMARY KEY AUTOINCREMENT, "
+				"asset_code TEXT NOT NULL UNIQUE, "
+				"first_id INTEGER NOT NULL);",
+				NULL, NULL, &zErrMsg) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to create the readings assets catalogue: %s", zErrMsg);
+		sqlite3_free(zErrMsg);
+		return false;
+	}
+
+	map<string, AssetTable> tables;
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, "SELECT id, asset_code, first_id FROM fledge.readings_assets;",
+				-1, &stmt, NULL) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to read the readings assets catalogue: %s", sqlite3_errmsg(db));
+		return false;
+	}
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		AssetTable table;
+		table.table = COLUMNS_TABLE_PREFIX + to_string(sqlite3_column_int64(stmt, 0));
+		table.assetCode = (const char *)sqlite3_column_text(stmt, 1);
+		table.firstId = (unsigned long)sqlite3_column_int64(stmt, 2);
+		tables[table.assetCode] = table;
+	}
+	sqlite3_finalize(stmt);
+
+	for (auto& entry : tables)
+	{
+		AssetTable& table = entry.second;
+		string sql = "PRAGMA fledge.table_info(" + table.table + ");";
+		if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+		{
+			continue;
+		}
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			const char *name = (const char *)sqlite3_column_text(stmt, 1);
+			const char *type = (const char *)sqlite3_column_text(stmt, 2);
+			if (strncmp(name, "d_", 2) == 0)
+			{
+				Column column;
+				column.datapoint = name + 2;
+				column.integer = type && strcasecmp(type, "INTEGER") == 0;
+				table.index[column.datapoint] = table.columns.size();
+				table.columns.push_back(column);
+			}
+		}
+		sqlite3_finalize(stmt);
+	}
+	m_tables = tables;
+	return true;
+}
+
+/**
+ * Publish the asset tables to the other connections
+ */
+void ReadingsColumns::publish()
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_published.clear();
+	for (auto& entry : m_tables)
+	{
+		m_published.push_back(entry.second);
+	}
+	m_pending = false;
+	m_generation++;
+}
+
+/**
+ * Return the asset tables that have been published
+ *
+ * @param tables	Set to the asset tables
+ * @return unsigned long	The generation of the tables returned
+ */
+unsigned long ReadingsColumns::tables(vector<AssetTable>& tables)
+{
+	lock_guard<mutex> guard(m_mutex);
+	tables = m_published;
+	return m_generation;
+}
+
+/**
+ * Return the table of an asset, creating it if need be. Only called
+ * by the readings writer.
+ *
+ * @param db		The database connection of the readings writer
+ * @param assetCode	The asset code
+ * @return AssetTable*	The table or NULL if the asset does not have one
+ */
+ReadingsColumns::AssetTable *ReadingsColumns::table(sqlite3 *db, const string& assetCode)
+{
+	auto it = m_tables.find(assetCode);
+	if (it != m_tables.end())
+	{
+		return &it->second;
+	}
+	if (m_tables.size() >= COLUMNS_ASSETS_MAX)
+	{
+		return NULL;
+	}
+
+	// The readings of the asset appended from now on use the columnar layout
+	AssetTable table;
+	table.assetCode = assetCode;
+	table.firstId = 1;
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, "SELECT seq FROM fledge.sqlite_sequence WHERE name = 'readings';",
+				-1, &stmt, NULL) == SQLITE_OK)
+	{
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			table.firstId = (unsigned long)sqlite3_column_int64(stmt, 0) + 1;
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	if (sqlite3_prepare_v2(db, "INSERT INTO fledge.readings_assets (asset_code, first_id) VALUES (?, ?);",
+				-1, &stmt, NULL) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to add asset %s to the readings assets catalogue: %s",
+				assetCode.c_str(), sqlite3_errmsg(db));
+		return NULL;
+	}
+	sqlite3_bind_text(stmt, 1, assetCode.c_str(), -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, (sqlite3_int64)table.firstId);
+	int rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		Logger::getLogger()->error("Failed to add asset %s to the readings assets catalogue: %s",
+				assetCode.c_str(), sqlite3_errmsg(db));
+		return NULL;
+	}
+	table.table = COLUMNS_TABLE_PREFIX + to_string(sqlite3_last_insert_rowid(db));
+
+	string sql = "CREATE TABLE fledge." + table.table + " (id INTEGER PRIMARY KEY);";
+	char *zErrMsg = NULL;
+	if (sqlite3_exec(db, sql.c_str(), NULL, NULL, &zErrMsg) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to create the readings table %s for asset %s: %s",
+				table.table.c_str(), assetCode.c_str(), zErrMsg);
+		sqlite3_free(zErrMsg);
+		return NULL;
+	}
+	Logger::getLogger()->info("Created readings table %s for asset %s",
+			table.table.c_str(), assetCode.c_str());
+
+	m_pending = true;
+	return &(m_tables[assetCode] = table);
+}
+
+/**
+ * Return the column of a numeric datapoint of an asset, adding the
+ * column if need be. Only called by the readings writer.
+ *
+ * A datapoint that can not have a column is recorded as kept in the
+ * reading, so that adding the column is not attempted again.
+ *
+ * @param db		The database connection of the readings writer
+ * @param table		The table of the asset
+ * @param datapoint	The name of the datapoint
+ * @param integer	True if the value is an integer, else a real
+ * @return int		The index of the column or -1 if the value has no column
+ */
+int ReadingsColumns::column(sqlite3 *db, AssetTable& table, const string& datapoint, bool integer)
+{
+	auto it = table.index.find(datapoint);
+	if (it != table.index.end())
+	{
+		// Values of the other numeric type are kept in the reading
+		return it->second >= 0 && table.columns[it->second].integer == integer ? it->second : -1;
+	}
+	if (table.columns.size() >= COLUMNS_COLUMNS_MAX)
+	{
+		return -1;
+	}
+	for (auto& column : table.columns)
+	{
+		if (strcasecmp(column.datapoint.c_str(), datapoint.c_str()) == 0)
+		{
+			// The column name is taken by a datapoint that differs in case
+			table.index[datapoint] = -1;
+			return -1;
+		}
+	}
+
+	string sql = "ALTER TABLE fledge." + table.table + " ADD COLUMN "
+			+ columnName(datapoint) + (integer ? " INTEGER;" : " REAL;");
+	char *zErrMsg = NULL;
+	if (sqlite3_exec(db, sql.c_str(), NULL, NULL, &zErrMsg) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to add datapoint %s to the readings table %s, it is kept in the reading: %s",
+				datapoint.c_str(), table.table.c_str(), zErrMsg);
+		sqlite3_free(zErrMsg);
+		table.index[datapoint] = -1;
+		return -1;
+	}
+
+	Column column;
+	column.datapoint = datapoint;
+	column.integer = integer;
+	table.index[datapoint] = table.columns.size();
+	table.columns.push_back(column);
+	m_pending = true;
+	return table.columns.size() - 1;
+}
+
+/**
+ * Return the quoted name of the column of a datapoint
+ *
+ * @param datapoint	The name of the datapoint
+ * @return string	The column name
+ */
+string ReadingsColumns::columnName(const string& datapoint)
+{
+	string name = "\"d_";
+	for (auto c : datapoint)
+	{
+		if (c == '"')
+			name += '"';
+		name += c;
+	}
+	name += '"';
+	return name;
+}
@@ -0,0 +1,260 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_inserter.h>
+#include <connection.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <string.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Construct an inserter of the readings of a batch
+ *
+ * @param connection	The connection the readings are inserted on
+ * @param table		The readings table
+ * @param epoch		The readings use epoch timestamps
+ * @param now		The time of the batch in microseconds since the epoch,
+ *			stored as the ts of the readings
+ * @param escape	Double the quotes of the readings
+ */
+ReadingsInserter::ReadingsInserter(Connection *connection, const string& table, bool epoch, int64_t now, bool escape) :
+	m_connection(connection), m_table(table), m_epoch(epoch), m_escape(escape), m_now(now), m_count(0), m_rows(0),
+	m_collect(NULL), m_nextId(0), m_contiguous(true)
+{
+	m_params = 4;
+	// Milliseconds, as the default ts of the readings table has them
+	ReadingsTimestamp::format(m_now / 1000 * 1000, 3, true, m_ts);
+	if (m_connection->m_latest)
+	{
+		// Anything held is from an append that was rolled back
+		m_connection->m_latest->clear();
+	}
+	int limit = sqlite3_limit(m_connection->dbHandle, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+	m_maxRows = INSERT_MAX_ROWS;
+	while (m_maxRows > 1 && m_maxRows * m_params > limit)
+	{
+		m_maxRows /= INSERT_ROWS_FACTOR;
+	}
+}
+
+/**
+ * Add a reading, inserting the readings held once there are enough to
+ * fill the largest statement. The asset code and reading must remain
+ * valid until the reading has been inserted.
+ *
+ * @param userTs		The formatted user timestamp
+ * @param usecs			The user timestamp in microseconds since the epoch
+ * @param assetCode		The asset code
+ * @param assetCodeLength	The length of the asset code
+ * @param reading		The JSON text of the reading
+ * @param readingLength		The length of the reading
+ * @return bool			False if an insert failed
+ */
+bool ReadingsInserter::add(const char *userTs, int64_t usecs,
+			const char *assetCode, int assetCodeLength,
+			const char *reading, int readingLength)
+{
+	Row& row = m_pending[m_count];
+	if (!m_epoch)
+	{
+		strncpy(row.userTs, userTs, TIMESTAMP_BUFFER_LEN - 1);
+		row.userTs[TIMESTAMP_BUFFER_LEN - 1] = 0;
+		if (m_connection->m_latest || m_collect)
+		{
+			// The latest and collected readings use the timestamps as microseconds
+			ReadingsTimestamp::parse(row.userTs, usecs);
+		}
+	}
+	row.usecs = usecs;
+	row.assetCode = assetCode;
+	row.assetCodeLength = assetCodeLength;
+	if (m_escape && memchr(reading, '\'', readingLength))
+	{
+		// Quotes are doubled as they are by the other appends
+		row.escaped = m_connection->escape(string(reading, readingLength));
+		row.reading = row.escaped.c_str();
+		row.readingLength = row.escaped.length();
+	}
+	else
+	{
+		row.reading = reading;
+		row.readingLength = readingLength;
+	}
+
+	if (++m_count == m_maxRows)
+	{
+		bool ok = insert(0, m_count);
+		m_count = 0;
+		return ok;
+	}
+	return true;
+}
+
+/**
+ * Collect the readings inserted as the rows of a readings fetch, each
+ * row is appended to the string following a comma if it is not empty.
+ * The rows are those fetchReadings would return, with the timestamps in
+ * UTC, so long as contiguous returns true.
+ *
+ * @param rows		The string the rows are appended to
+ */
+void ReadingsInserter::collect(string *rows)
+{
+	m_collect = rows;
+}
+
+/**
+ * Insert the readings that are held, with statements of fewer rows, and
+ * update the latest readings of the assets
+ *
+ * @return bool		False if an insert failed
+ */
+bool ReadingsInserter::flush()
+{
+	int first = 0;
+	int rows = m_maxRows;
+	while (first < m_count)
+	{
+		while (rows > m_count - first)
+		{
+			rows /= INSERT_ROWS_FACTOR;
+		}
+		if (rows < 1)
+		{
+			rows = 1;
+		}
+		if (!insert(first, rows))
+		{
+			m_count = 0;
+			return false;
+		}
+		first += rows;
+	}
+	m_count = 0;
+	return !m_connection->m_latest || m_connection->m_latest->update(m_connection);
+}
+
+/**
+ * Insert readings that are held with one statement
+ *
+ * @param first		The first of the readings
+ * @param count		The number of readings, the rows of the statement
+ * @return bool		False if the insert failed
+ */
+bool ReadingsInserter::insert(int first, int count)
+{
+	string sql = "INSERT INTO " + m_table + " ( user_ts, asset_code, reading, ts ) VALUES (?,?,?,?)";
+	for (int i = 1; i < count; i++)
+	{
+		sql += ",(?,?,?,?)";
+	}
+	sqlite3_stmt *stmt = m_connection->prepare(sql);
+	if (stmt == NULL)
+	{
+		return false;
+	}
+
+	int param = 1;
+	for (int i = first; i < first + count; i++)
+	{
+		const Row& row = m_pending[i];
+		if (m_epoch)
+		{
+			sqlite3_bind_int64(stmt, param++, (sqlite3_int64)row.usecs);
+		}
+		else
+		{
+			sqlite3_bind_text(stmt, param++, row.userTs, -1, SQLITE_STATIC);
+		}
+		sqlite3_bind_text(stmt, param++, row.assetCode, row.assetCodeLength, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, param++, row.reading, row.readingLength, SQLITE_STATIC);
+		if (m_epoch)
+		{
+			sqlite3_bind_int64(stmt, param++, (sqlite3_int64)m_now);
+		}
+		else
+		{
+			sqlite3_bind_text(stmt, param++, m_ts, -1, SQLITE_STATIC);
+		}
+	}
+
+	bool ok = m_connection->SQLstep(stmt) == SQLITE_DONE;
+	sqlite3_reset(stmt);
+	if (ok)
+	{
+		m_rows += count;
+	}
+	if (!ok)
+	{
+		return false;
+	}
+
+	// The rows of the statement are given consecutive ids
+	int64_t last = sqlite3_last_insert_rowid(m_connection->dbHandle);
+	if (m_connection->m_latest)
+	{
+		int64_t id = last - count;
+		for (int i = first; i < first + count; i++)
+		{
+			const Row& row = m_pending[i];
+			m_connection->m_latest->add(row.assetCode, row.assetCodeLength, ++id,
+					row.usecs, row.reading, row.readingLength);
+		}
+	}
+	if (m_collect)
+	{
+		if (m_nextId && last - count + 1 != m_nextId)
+		{
+			m_contiguous = false;
+		}
+		m_nextId = last + 1;
+		collectRows(first, count, last - count + 1);
+	}
+	return true;
+}
+
+/**
+ * Append the rows a readings fetch returns for readings just inserted
+ * to the rows collected
+ *
+ * @param first		The first of the readings
+ * @param count		The number of readings
+ * @param id		The id of the first of the readings
+ */
+void ReadingsInserter::collectRows(int first, int count, int64_t id)
+{
+	char userTs[TIMESTAMP_BUFFER_LEN], ts[TIMESTAMP_BUFFER_LEN];
+	ReadingsTimestamp::format(m_now, 3, false, ts);
+	StringBuffer buffer;
+	for (int i = first; i < first + count; i++)
+	{
+		const Row& row = m_pending[i];
+		ReadingsTimestamp::format(row.usecs, 6, false, userTs);
+		Writer<StringBuffer> writer(buffer);
+		if (!m_collect->empty() || i > first)
+		{
+			buffer.Put(',');
+		}
+		writer.StartObject();
+		writer.Key("id");
+		writer.Int64(id++);
+		writer.Key("asset_code");
+		writer.String(row.assetCode, row.assetCodeLength);
+		writer.Key("reading");
+		writer.RawValue(row.reading, row.readingLength, kObjectType);
+		writer.Key("user_ts");
+		writer.String(userTs);
+		writer.Key("ts");
+		writer.String(ts);
+		writer.EndObject();
+	}
+	m_collect->append(buffer.GetString(), buffer.GetSize());
+}
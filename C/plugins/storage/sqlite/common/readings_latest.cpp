@@ -0,0 +1,176 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_latest.h>
+#include <connection.h>
+#include <logger.h>
+
+using namespace std;
+
+/**
+ * Construct the latest readings of an append
+ */
+ReadingsLatest::ReadingsLatest()
+{
+	m_last = m_assets.end();
+}
+
+/**
+ * Seed the table of the latest readings, which is created with the
+ * schema, from the readings already held if it is empty
+ *
+ * @param connection	The connection that appends the readings
+ * @return bool		True if the table is in place
+ */
+bool ReadingsLatest::seed(Connection *connection)
+{
+	sqlite3_stmt *stmt = connection->prepare("SELECT EXISTS (SELECT 1 FROM fledge.readings_latest);");
+	if (stmt == NULL)
+	{
+		Logger::getLogger()->warn("The latest readings are not kept, the schema has no readings_latest table");
+		return false;
+	}
+	bool empty = connection->SQLstep(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0;
+	sqlite3_reset(stmt);
+	if (!empty)
+	{
+		return true;
+	}
+
+	// The row of the latest user timestamp is the one whose columns are returned with max()
+	string sql = "INSERT INTO fledge.readings_latest (asset_code, id, user_ts, reading) "
+			"SELECT asset_code, id, fledge_epoch(max(user_ts)), reading FROM "
+			+ connection->readingsTable() + " GROUP BY asset_code;";
+	char *zErrMsg = NULL;
+	if (sqlite3_exec(connection->dbHandle, sql.c_str(), NULL, NULL, &zErrMsg) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to seed the latest readings: %s", zErrMsg);
+		sqlite3_free(zErrMsg);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Add a reading that has been inserted, it replaces the reading held for
+ * the asset unless that has a later user timestamp
+ *
+ * @param assetCode		The asset code
+ * @param assetCodeLength	The length of the asset code
+ * @param id			The id of the reading
+ * @param usecs			The user timestamp in microseconds since the epoch
+ * @param reading		The reading as it is held in the readings table
+ * @param readingLength		The length of the reading
+ */
+void ReadingsLatest::add(const char *assetCode, int assetCodeLength, int64_t id,
+			int64_t usecs, const char *reading, int readingLength)
+{
+	// The readings of an asset usually follow one another
+	if (m_last == m_assets.end()
+			|| m_last->first.compare(0, string::npos, assetCode, assetCodeLength) != 0)
+	{
+		string asset(assetCode, assetCodeLength);
+		m_last = m_assets.find(asset);
+		if (m_last == m_assets.end())
+		{
+			m_last = m_assets.emplace(asset, Latest()).first;
+			m_last->second.usecs = usecs;
+		}
+	}
+
+	Latest& latest = m_last->second;
+	if (usecs >= latest.usecs)
+	{
+		latest.id = id;
+		latest.usecs = usecs;
+		latest.reading.assign(reading, readingLength);
+	}
+}
+
+/**
+ * Write the readings held to the table, in the transaction of the append,
+ * and clear them
+ *
+ * @param connection	The connection the readings were appended on
+ * @return bool		False if the table could not be updated
+ */
+bool ReadingsLatest::update(Connection *connection)
+{
+	if (m_assets.empty())
+	{
+		return true;
+	}
+
+	sqlite3_stmt *stmt = connection->prepare("INSERT OR REPLACE INTO fledge.readings_latest "
+			"(asset_code, id, user_ts, reading) SELECT ?1, ?2, ?3, ?4 WHERE NOT EXISTS "
+			"(SELECT 1 FROM fledge.readings_latest WHERE asset_code = ?1 AND user_ts > ?3);");
+	bool ok = stmt != NULL;
+	for (auto it = m_assets.begin(); ok && it != m_assets.end(); ++it)
+	{
+		sqlite3_bind_text(stmt, 1, it->first.c_str(), it->first.length(), SQLITE_STATIC);
+		sqlite3_bind_int64(stmt, 2, (sqlite3_int64)it->second.id);
+		sqlite3_bind_int64(stmt, 3, (sqlite3_int64)it->second.usecs);
+		sqlite3_bind_text(stmt, 4, it->second.reading.c_str(), it->second.reading.length(), SQLITE_STATIC);
+		ok = connection->SQLstep(stmt) == SQLITE_DONE;
+		sqlite3_reset(stmt);
+	}
+	clear();
+	return ok;
+}
+
+/**
+ * Replace the rows of the table whose reading has been purged with the
+ * remaining reading of the asset that has the latest user timestamp, and
+ * remove those of assets that have no readings left. The readings of an
+ * asset are found with the asset code index, only the assets whose latest
+ * reading was purged are read.
+ *
+ * @param connection	The connection the readings were purged on
+ * @param limit		The highest id of the readings purged
+ * @return bool		False if the table could not be updated
+ */
+bool ReadingsLatest::purged(Connection *connection, unsigned long limit)
+{
+	sqlite3_stmt *stmt = connection->prepare("INSERT OR REPLACE INTO fledge.readings_latest "
+			"(asset_code, id, user_ts, reading) "
+			"SELECT asset_code, id, fledge_epoch(max(user_ts)), reading FROM "
+			+ connection->readingsTable() + " WHERE asset_code IN "
+			"(SELECT asset_code FROM fledge.readings_latest WHERE id <= ?1) "
+			"GROUP BY asset_code;");
+	if (stmt == NULL)
+	{
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)limit);
+	bool ok = connection->SQLstep(stmt) == SQLITE_DONE;
+	sqlite3_reset(stmt);
+	if (!ok)
+	{
+		return false;
+	}
+
+	// The rows that were not replaced are those of assets without readings
+	stmt = connection->prepare("DELETE FROM fledge.readings_latest WHERE id <= ?;");
+	if (stmt == NULL)
+	{
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)limit);
+	ok = connection->SQLstep(stmt) == SQLITE_DONE;
+	sqlite3_reset(stmt);
+	return ok;
+}
+
+/**
+ * Clear the readings held, those of an append that has been rolled back
+ */
+void ReadingsLatest::clear()
+{
+	m_assets.clear();
+	m_last = m_assets.end();
+}
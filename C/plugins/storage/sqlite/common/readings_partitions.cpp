@@ -0,0 +1,417 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_partitions.h>
+#include <logger.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+using namespace std;
+
+/**
+ * The schema of a partition, the sequence is set so that the ids of the
+ * partition follow on from those already assigned.
+ */
+static const char *partitionSchema = R"(
+	PRAGMA journal_mode = WAL;
+	CREATE TABLE IF NOT EXISTS readings (
+		id		INTEGER			PRIMARY KEY AUTOINCREMENT,
+		asset_code	character varying(50)	NOT NULL,
+		reading		JSON			NOT NULL DEFAULT '{}',
+		user_ts		DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW')),
+		ts		DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW'))
+	);
+	CREATE INDEX IF NOT EXISTS fki_readings_fk1 ON readings (asset_code, user_ts desc);
+	CREATE INDEX IF NOT EXISTS readings_ix2 ON readings (asset_code);
+	CREATE INDEX IF NOT EXISTS readings_ix3 ON readings (user_ts);
+)";
+
+/**
+ * Return the highest reading id held by a partition that is not attached
+ *
+ * @param path		The path of the partition
+ * @return unsigned long	The highest id or 0 if the partition is empty
+ */
+static unsigned long partitionMaxId(const string& path)
+{
+	unsigned long maxId = 0;
+	sqlite3 *db;
+	if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+	{
+		sqlite3_stmt *stmt;
+		if (sqlite3_prepare_v2(db, "SELECT max(id) FROM readings;", -1, &stmt, NULL) == SQLITE_OK)
+		{
+			if (sqlite3_step(stmt) == SQLITE_ROW)
+			{
+				maxId = (unsigned long)sqlite3_column_int64(stmt, 0);
+			}
+			sqlite3_finalize(stmt);
+		}
+	}
+	sqlite3_close_v2(db);
+	return maxId;
+}
+
+/**
+ * Construct the partitioned layout, finding the partitions that already
+ * exist in the directory.
+ *
+ * Partitions that were removed while still attached are deleted. If more
+ * partitions exist than may be attached, the readings of the oldest are
+ * moved into the partition that follows it, so that no reading is lost.
+ * A partition that can not be merged is left in the directory but not
+ * used, the highest reading id it held is returned by purgedId.
+ *
+ * @param directory	The directory that holds the partitions
+ * @param hours		The window of time covered by each partition
+ */
+ReadingsPartitions::ReadingsPartitions(const string& directory, unsigned int hours) :
+	m_directory(directory), m_window(hours * 3600), m_generation(1), m_removals(0), m_purgedId(0),
+	m_retention(false), m_byRows(false), m_param(0), m_flags(0), m_sent(0)
+{
+	DIR *dir = opendir(m_directory.c_str());
+	if (dir)
+	{
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL)
+		{
+			const char *name = entry->d_name;
+			size_t prefix = strlen(PARTITION_PREFIX);
+			struct tm tm;
+			memset(&tm, 0, sizeof(tm));
+			if (strncmp(name, PARTITION_PREFIX, prefix) == 0
+					&& strlen(name) == prefix + 13
+					&& strcmp(name + prefix + 10, ".db") == 0
+					&& strptime(name + prefix, "%Y%m%d%H", &tm) == name + prefix + 10)
+			{
+				Partition found = partition(timegm(&tm));
+				if (access((found.path + PARTITION_REMOVED).c_str(), F_OK) == 0)
+				{
+					deleteFiles(found);
+				}
+				else
+				{
+					m_partitions.push_back(found);
+				}
+			}
+		}
+		closedir(dir);
+	}
+	sort(m_partitions.begin(), m_partitions.end(),
+		[](const Partition& a, const Partition& b) { return a.start < b.start; });
+	while (m_partitions.size() > PARTITION_MAX)
+	{
+		Partition& oldest = m_partitions.front();
+		Logger::getLogger()->warn("More than %d readings partitions found, merging the oldest partition %s into %s",
+				PARTITION_MAX, oldest.path.c_str(), m_partitions[1].path.c_str());
+		if (merge(oldest, m_partitions[1]))
+		{
+			deleteFiles(oldest);
+		}
+		else
+		{
+			m_purgedId = max(m_purgedId, partitionMaxId(oldest.path));
+			Logger::getLogger()->error("The readings partition %s is not used, its readings are kept in the file",
+					oldest.path.c_str());
+		}
+		m_partitions.erase(m_partitions.begin());
+	}
+	Logger::getLogger()->info("Readings are partitioned every %d hours, %d partitions exist",
+			hours, m_partitions.size());
+}
+
+/**
+ * Move the readings of a partition that is not attached into another
+ *
+ * @param from		The partition to move the readings from
+ * @param into		The partition to move the readings to
+ * @return bool		True if the readings were moved
+ */
+bool ReadingsPartitions::merge(const Partition& from, const Partition& into)
+{
+	sqlite3 *db;
+	if (sqlite3_open_v2(into.path.c_str(), &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to open readings partition %s: %s",
+				into.path.c_str(), sqlite3_errmsg(db));
+		sqlite3_close_v2(db);
+		return false;
+	}
+	string sql = "ATTACH DATABASE '" + from.path + "' AS merged;"
+		"BEGIN;"
+		"INSERT INTO readings (id, asset_code, reading, user_ts, ts) "
+			"SELECT id, asset_code, reading, user_ts, ts FROM merged.readings;"
+		"COMMIT;"
+		"DETACH DATABASE merged;";
+	char *zErrMsg = NULL;
+	bool merged = sqlite3_exec(db, sql.c_str(), NULL, NULL, &zErrMsg) == SQLITE_OK;
+	if (!merged)
+	{
+		Logger::getLogger()->error("Failed to merge readings partition %s: %s",
+				from.path.c_str(), zErrMsg);
+		sqlite3_free(zErrMsg);
+	}
+	sqlite3_close_v2(db);
+	return merged;
+}
+
+/**
+ * Keep the retention of the last purge request
+ *
+ * @param byRows	True if the purge is by rows rather than by age
+ * @param param		The age in hours or the number of rows to retain
+ * @param flags		The purge flags, bit 0 set retains unsent readings
+ * @param sent		The last reading id that has been sent
+ */
+void ReadingsPartitions::setRetention(bool byRows, unsigned long param,
+				      unsigned int flags, unsigned long sent)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_retention = true;
+	m_byRows = byRows;
+	m_param = param;
+	m_flags = flags;
+	m_sent = sent;
+}
+
+/**
+ * Return the retention of the last purge request
+ *
+ * @param byRows	Set to true if the purge is by rows rather than by age
+ * @param param		Set to the age in hours or the number of rows to retain
+ * @param flags		Set to the purge flags
+ * @param sent		Set to the last reading id that has been sent
+ * @return bool		False if no purge request has been made
+ */
+bool ReadingsPartitions::retention(bool& byRows, unsigned long& param,
+				   unsigned int& flags, unsigned long& sent)
+{
+	lock_guard<mutex> guard(m_mutex);
+	byRows = m_byRows;
+	param = m_param;
+	flags = m_flags;
+	sent = m_sent;
+	return m_retention;
+}
+
+/**
+ * Return the partitions, oldest first
+ *
+ * @param partitions	Set to the partitions
+ * @return unsigned long	The generation of the partitions returned
+ */
+unsigned long ReadingsPartitions::partitions(vector<Partition>& partitions)
+{
+	lock_guard<mutex> guard(m_mutex);
+	partitions = m_partitions;
+	return m_generation;
+}
+
+/**
+ * Find the partition that holds the readings for a time
+ *
+ * @param when		The time
+ * @param partition	Set to the partition
+ * @return bool		True if the partition exists
+ */
+bool ReadingsPartitions::find(time_t when, Partition& partition)
+{
+	lock_guard<mutex> guard(m_mutex);
+	for (auto& p : m_partitions)
+	{
+		if (p.start <= when && when < p.start + m_window)
+		{
+			partition = p;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Return if the limit of partitions has been reached, the oldest
+ * partition must then be removed before a new partition is created
+ *
+ * @return bool		True if no more partitions may be created
+ */
+bool ReadingsPartitions::full()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_partitions.size() >= PARTITION_MAX;
+}
+
+/**
+ * Create the partition that holds the readings for a time. No partition
+ * is created while the limit of partitions is reached, counting those
+ * that have been removed but are still attached to a connection.
+ *
+ * @param when		The time
+ * @param lastId	The last reading id assigned in any partition
+ * @param partition	Set to the partition
+ * @return bool		True if the partition was created
+ */
+bool ReadingsPartitions::create(time_t when, unsigned long lastId, Partition& partition)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_partitions.size() + m_removed.size() >= PARTITION_MAX)
+	{
+		Logger::getLogger()->debug("Unable to create a new readings partition, %d partitions are in use and %d waiting to be detached",
+				m_partitions.size(), m_removed.size());
+		return false;
+	}
+
+	Partition created = this->partition(when - when % m_window);
+	sqlite3 *db;
+	if (sqlite3_open_v2(created.path.c_str(), &db,
+				SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to create readings partition %s: %s",
+				created.path.c_str(), sqlite3_errmsg(db));
+		sqlite3_close_v2(db);
+		return false;
+	}
+	string sql = partitionSchema;
+	sql += "INSERT INTO sqlite_sequence (name, seq) SELECT 'readings', " + to_string(lastId);
+	sql += " WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence WHERE name = 'readings');";
+	char *zErrMsg = NULL;
+	if (sqlite3_exec(db, sql.c_str(), NULL, NULL, &zErrMsg) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to create readings partition %s: %s",
+				created.path.c_str(), zErrMsg);
+		sqlite3_free(zErrMsg);
+		sqlite3_close_v2(db);
+		return false;
+	}
+	sqlite3_close_v2(db);
+
+	m_partitions.push_back(created);
+	sort(m_partitions.begin(), m_partitions.end(),
+		[](const Partition& a, const Partition& b) { return a.start < b.start; });
+	m_generation++;
+	partition = created;
+	Logger::getLogger()->info("Created readings partition %s", created.path.c_str());
+	return true;
+}
+
+/**
+ * Remove a partition. Connections that still have the partition attached
+ * continue to see it until they next attach to the partitions, its files
+ * are deleted once the last of them has detached it. A marker file is
+ * created so that a partition that is still attached when the service
+ * stops is deleted when it next starts.
+ *
+ * @param alias		The alias of the partition
+ */
+void ReadingsPartitions::remove(const string& alias)
+{
+	lock_guard<mutex> guard(m_mutex);
+	for (auto it = m_partitions.begin(); it != m_partitions.end(); ++it)
+	{
+		if (it->alias == alias)
+		{
+			auto attachments = m_attachments.find(alias);
+			if (attachments == m_attachments.end())
+			{
+				deleteFiles(*it);
+				Logger::getLogger()->info("Removed readings partition %s", it->path.c_str());
+			}
+			else
+			{
+				int fd = open((it->path + PARTITION_REMOVED).c_str(), O_CREAT | O_WRONLY, 0644);
+				if (fd >= 0)
+				{
+					close(fd);
+				}
+				m_removed.push_back(*it);
+				Logger::getLogger()->info("Removed readings partition %s, it will be deleted once detached by %d connections",
+						it->path.c_str(), attachments->second);
+			}
+			m_partitions.erase(it);
+			m_generation++;
+			m_removals++;
+			return;
+		}
+	}
+}
+
+/**
+ * Record that a connection has attached a partition
+ *
+ * @param alias		The alias of the partition
+ */
+void ReadingsPartitions::attached(const string& alias)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_attachments[alias]++;
+}
+
+/**
+ * Record that a connection has detached a partition, the files of a
+ * removed partition are deleted once no connection has it attached
+ *
+ * @param alias		The alias of the partition
+ */
+void ReadingsPartitions::detached(const string& alias)
+{
+	lock_guard<mutex> guard(m_mutex);
+	auto attachments = m_attachments.find(alias);
+	if (attachments == m_attachments.end() || --attachments->second > 0)
+	{
+		return;
+	}
+	m_attachments.erase(attachments);
+	for (auto it = m_removed.begin(); it != m_removed.end(); ++it)
+	{
+		if (it->alias == alias)
+		{
+			deleteFiles(*it);
+			Logger::getLogger()->info("Deleted readings partition %s", it->path.c_str());
+			m_removed.erase(it);
+			return;
+		}
+	}
+}
+
+/**
+ * Delete the files of a partition
+ *
+ * @param partition	The partition
+ */
+void ReadingsPartitions::deleteFiles(const Partition& partition)
+{
+	unlink(partition.path.c_str());
+	unlink((partition.path + "-wal").c_str());
+	unlink((partition.path + "-shm").c_str());
+	unlink((partition.path + "-journal").c_str());
+	unlink((partition.path + PARTITION_REMOVED).c_str());
+}
+
+/**
+ * Return the partition for a window of time
+ *
+ * @param start		The start of the window
+ * @return Partition	The partition
+ */
+ReadingsPartitions::Partition ReadingsPartitions::partition(time_t start)
+{
+	struct tm tm;
+	char name[40];
+
+	gmtime_r(&start, &tm);
+	strftime(name, sizeof(name), PARTITION_PREFIX "%Y%m%d%H", &tm);
+
+	Partition partition;
+	partition.alias = name;
+	partition.path = m_directory + "/" + name + ".db";
+	partition.start = start;
+	return partition;
+}
@@ -0,0 +1,237 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_purge.h>
+#include <sstream>
+
+using namespace std;
+
+/**
+ * Construct the purge scheduler. Until a block has been deleted the
+ * blocks are of the minimum size.
+ */
+PurgeScheduler::PurgeScheduler() : m_costPerRow(0.0), m_load(0.0), m_lastBlockUs(0),
+		m_windowStart(chrono::steady_clock::now()), m_windowAppendUs(0),
+		m_continuous(false), m_retention(false), m_age(0), m_retainUnsent(false), m_sent(0),
+		m_next(chrono::steady_clock::now()), m_removed(0), m_unsentPurged(0),
+		m_totalRemoved(0), m_blocks(0), m_vacuumPages(0)
+{
+}
+
+/**
+ * Update the share of the time of the writer taken by appends, once a
+ * load window has elapsed. The load is smoothed over the windows.
+ *
+ * @param now	The current time
+ */
+void PurgeScheduler::updateLoad(chrono::steady_clock::time_point now)
+{
+	unsigned long elapsed = chrono::duration_cast<chrono::microseconds>(now - m_windowStart).count();
+	if (elapsed >= PURGE_LOAD_WINDOW_US)
+	{
+		double load = (double)m_windowAppendUs / elapsed;
+		m_load = (m_load + (load > 1.0 ? 1.0 : load)) / 2;
+		m_windowStart = now;
+		m_windowAppendUs = 0;
+	}
+}
+
+/**
+ * Record the time taken by a transaction of appends
+ *
+ * @param usecs	The duration of the transaction
+ */
+void PurgeScheduler::appended(unsigned long usecs)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_windowAppendUs += usecs;
+	updateLoad(chrono::steady_clock::now());
+}
+
+/**
+ * Record the time taken by a block of deletes
+ *
+ * @param rows	The number of readings deleted
+ * @param usecs	The duration of the block
+ */
+void PurgeScheduler::purged(int rows, unsigned long usecs)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_lastBlockUs = usecs;
+	if (rows > 0)
+	{
+		double cost = (double)usecs / rows;
+		m_costPerRow = m_costPerRow == 0.0 ? cost : m_costPerRow * 0.7 + cost * 0.3;
+		m_blocks++;
+	}
+}
+
+/**
+ * Return the number of rows to delete in the next block
+ *
+ * @return unsigned long	The block size
+ */
+unsigned long PurgeScheduler::blockSize()
+{
+	lock_guard<mutex> guard(m_mutex);
+	updateLoad(chrono::steady_clock::now());
+	if (m_costPerRow == 0.0)
+	{
+		return MIN_PURGE_DELETE_BLOCK_SIZE;
+	}
+	double target = PURGE_TARGET_BLOCK_US * (1.0 - m_load);
+	if (target < PURGE_MIN_TARGET_BLOCK_US)
+		target = PURGE_MIN_TARGET_BLOCK_US;
+	unsigned long size = (unsigned long)(target / m_costPerRow);
+	size = size / PURGE_BLOCK_SZ_GRANULARITY * PURGE_BLOCK_SZ_GRANULARITY;
+	if (size < MIN_PURGE_DELETE_BLOCK_SIZE)
+		size = MIN_PURGE_DELETE_BLOCK_SIZE;
+	if (size > MAX_PURGE_DELETE_BLOCK_SIZE)
+		size = MAX_PURGE_DELETE_BLOCK_SIZE;
+	return size;
+}
+
+/**
+ * Return the time to pause before the next increment of the continuous
+ * purge, in proportion to the time taken by the appends so that they keep
+ * that share of the writer.
+ *
+ * @return unsigned long	The pause in milliseconds
+ */
+unsigned long PurgeScheduler::pauseMs()
+{
+	lock_guard<mutex> guard(m_mutex);
+	updateLoad(chrono::steady_clock::now());
+	if (m_load >= 0.99)
+	{
+		return PURGE_MAX_PAUSE_MS;
+	}
+	unsigned long pause = (unsigned long)(m_lastBlockUs * m_load / (1.0 - m_load) / 1000);
+	return pause > PURGE_MAX_PAUSE_MS ? PURGE_MAX_PAUSE_MS : pause;
+}
+
+/**
+ * Set the retention applied by the continuous purge, that of the last
+ * purge by age
+ *
+ * @param age		The age in hours of the readings to retain
+ * @param retainUnsent	Retain the readings that have not been sent
+ * @param sent		The last reading id that has been sent
+ */
+void PurgeScheduler::setRetention(unsigned long age, bool retainUnsent, unsigned long sent)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (!m_continuous || age == 0)
+	{
+		return;
+	}
+	m_retention = true;
+	m_age = age;
+	m_retainUnsent = retainUnsent;
+	m_sent = sent;
+}
+
+/**
+ * Return the retention of the continuous purge
+ *
+ * @return bool		False if there is no retention to apply
+ */
+bool PurgeScheduler::retention(unsigned long& age, bool& retainUnsent, unsigned long& sent)
+{
+	lock_guard<mutex> guard(m_mutex);
+	age = m_age;
+	retainUnsent = m_retainUnsent;
+	sent = m_sent;
+	return m_retention;
+}
+
+/**
+ * Return whether the next increment of the continuous purge is due
+ */
+bool PurgeScheduler::due()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_retention && chrono::steady_clock::now() >= m_next;
+}
+
+/**
+ * Record an increment of the continuous purge and schedule the next
+ *
+ * @param removed	The number of readings removed, -1 on failure
+ * @param unsentPurged	The number of those readings that had not been sent
+ */
+void PurgeScheduler::increment(int removed, int unsentPurged)
+{
+	unsigned long pause = removed > 0 ? pauseMs() : PURGE_IDLE_INTERVAL_MS;
+
+	lock_guard<mutex> guard(m_mutex);
+	if (removed > 0)
+	{
+		m_removed += removed;
+		m_unsentPurged += unsentPurged;
+		m_totalRemoved += removed;
+	}
+	m_next = chrono::steady_clock::now() + chrono::milliseconds(pause);
+}
+
+/**
+ * Return the readings removed by the continuous purge since the last
+ * purge request
+ *
+ * @param removed	Set to the number of readings removed
+ * @param unsentPurged	Set to the number of those that had not been sent
+ */
+void PurgeScheduler::takeRemoved(unsigned long& removed, unsigned long& unsentPurged)
+{
+	lock_guard<mutex> guard(m_mutex);
+	removed = m_removed;
+	unsentPurged = m_unsentPurged;
+	m_removed = 0;
+	m_unsentPurged = 0;
+}
+
+/**
+ * Return the readings removed by the continuous purge since it started
+ *
+ * @return unsigned long	The number of readings removed
+ */
+unsigned long PurgeScheduler::totalRemoved()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_totalRemoved;
+}
+
+/**
+ * Record the pages returned to the file system by an incremental vacuum
+ *
+ * @param pages	The number of pages
+ */
+void PurgeScheduler::vacuumed(unsigned long pages)
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_vacuumPages += pages;
+}
+
+/**
+ * Return the state of the scheduler as JSON
+ *
+ * @return string	The state as a JSON object
+ */
+string PurgeScheduler::toJSON()
+{
+	lock_guard<mutex> guard(m_mutex);
+	ostringstream convert;
+
+	convert << "{ \"blocks\" : " << m_blocks << ",";
+	convert << " \"rowCostUs\" : " << m_costPerRow << ",";
+	convert << " \"appendLoad\" : " << m_load << ",";
+	convert << " \"continuous\" : " << (m_retention ? "true" : "false") << ",";
+	convert << " \"continuousRemoved\" : " << m_totalRemoved << ",";
+	convert << " \"vacuumPages\" : " << m_vacuumPages << " }";
+	return convert.str();
+}
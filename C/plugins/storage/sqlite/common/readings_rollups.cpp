@@ -0,0 +1,90 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_rollups.h>
+#include <logger.h>
+#include <sstream>
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace std;
+
+/**
+ * Construct the rollups
+ *
+ * @param sizes	The bucket sizes in seconds, separated by commas
+ */
+ReadingsRollups::ReadingsRollups(const string& sizes)
+{
+	stringstream list(sizes);
+	string size;
+	while (getline(list, size, ','))
+	{
+		long value = atol(size.c_str());
+		if (value > 0 && !has(value))
+		{
+			m_sizes.push_back(value);
+		}
+		else
+		{
+			Logger::getLogger()->warn("Ignoring the readings rollup size '%s'", size.c_str());
+		}
+	}
+	sort(m_sizes.begin(), m_sizes.end());
+}
+
+/**
+ * Return whether there is a rollup of a bucket size
+ *
+ * @param size	The bucket size in seconds
+ * @return bool	True if there is a rollup of that size
+ */
+bool ReadingsRollups::has(unsigned long size) const
+{
+	return find(m_sizes.begin(), m_sizes.end(), size) != m_sizes.end();
+}
+
+/**
+ * Add the rollups that are not in the catalogue. A rollup that is new
+ * starts from the first reading.
+ *
+ * @param db	The database connection of the readings writer
+ * @return bool	True if the rollups are in place
+ */
+bool ReadingsRollups::seed(sqlite3 *db)
+{
+	string sql;
+	for (auto size : m_sizes)
+	{
+		sql += "INSERT OR IGNORE INTO fledge.readings_rollups (size, last_id) VALUES ("
+			+ to_string(size) + ", 0); ";
+	}
+
+	char *zErrMsg = NULL;
+	if (sqlite3_exec(db, sql.c_str(), NULL, NULL, &zErrMsg) != SQLITE_OK)
+	{
+		Logger::getLogger()->error("Failed to seed the readings rollups: %s", zErrMsg);
+		sqlite3_free(zErrMsg);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Return the expression of the bucket of a timestamp. The bucket is
+ * calculated as the timebucket queries calculate it.
+ *
+ * @param column	The timestamp column
+ * @param size		The bucket size in seconds
+ * @return string	The bucket expression
+ */
+string ReadingsRollups::bucket(const string& column, unsigned long size)
+{
+	return "CAST(round((julianday(" + column + ") - 2440587.5) * 86400.0 / "
+		+ to_string(size) + ") AS INTEGER)";
+}
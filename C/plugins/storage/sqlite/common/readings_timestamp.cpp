@@ -0,0 +1,252 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_timestamp.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#define USECS_PER_SEC	1000000LL
+
+/**
+ * Parse a fixed number of decimal digits
+ *
+ * @param p		The text, advanced past the digits
+ * @param digits	The number of digits
+ * @param value		Set to the value of the digits
+ * @return bool		True if the digits were present
+ */
+static inline bool digits(const char *&p, int digits, int& value)
+{
+	value = 0;
+	while (digits--)
+	{
+		if (*p < '0' || *p > '9')
+			return false;
+		value = value * 10 + (*p++ - '0');
+	}
+	return true;
+}
+
+/**
+ * The number of days since 1970-01-01 of a date in the Gregorian calendar
+ */
+static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = (unsigned)(y - era * 400);
+	const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+/**
+ * The date in the Gregorian calendar of a number of days since 1970-01-01
+ */
+static void civilFromDays(int64_t z, int& y, int& m, int& d)
+{
+	z += 719468;
+	const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned doe = (unsigned)(z - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = (int)(yoe + era * 400) + (m <= 2);
+}
+
+/**
+ * Parse a timestamp of the form YYYY-MM-DD HH:MM:SS, optionally followed
+ * by fractional seconds and a timezone of Z or +/-HH[:MM]. Fractional
+ * digits beyond the microseconds are ignored.
+ *
+ * @param text		The timestamp
+ * @param usecs		Set to the microseconds since the epoch
+ * @return bool		False if the text is not a timestamp of that form
+ */
+bool ReadingsTimestamp::parse(const char *text, int64_t& usecs)
+{
+	const char *p = text;
+	int year, month, day, hour, min, sec;
+
+	if (!digits(p, 4, year) || *p++ != '-' || !digits(p, 2, month) || *p++ != '-'
+			|| !digits(p, 2, day) || (*p != ' ' && *p != 'T'))
+	{
+		return false;
+	}
+	p++;
+	if (!digits(p, 2, hour) || *p++ != ':' || !digits(p, 2, min) || *p++ != ':'
+			|| !digits(p, 2, sec))
+	{
+		return false;
+	}
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60)
+	{
+		return false;
+	}
+
+	int64_t fraction = 0;
+	if (*p == '.')
+	{
+		p++;
+		int n = 0;
+		while (*p >= '0' && *p <= '9')
+		{
+			if (n++ < 6)
+				fraction = fraction * 10 + (*p - '0');
+			p++;
+		}
+		for (; n < 6; n++)
+			fraction *= 10;
+	}
+
+	int offset = 0;
+	if (*p == 'Z')
+	{
+		p++;
+	}
+	else if (*p == '+' || *p == '-')
+	{
+		int sign = *p++ == '-' ? -1 : 1;
+		int tzHour, tzMin = 0;
+		if (!digits(p, 2, tzHour))
+		{
+			return false;
+		}
+		if (*p == ':')
+		{
+			p++;
+			if (!digits(p, 2, tzMin))
+				return false;
+		}
+		offset = sign * (tzHour * 3600 + tzMin * 60);
+	}
+	if (*p)
+	{
+		return false;
+	}
+
+	int64_t secs = daysFromCivil(year, month, day) * 86400 + hour * 3600 + min * 60 + sec - offset;
+	usecs = secs * USECS_PER_SEC + fraction;
+	return true;
+}
+
+/**
+ * Format the microseconds since the epoch as a UTC timestamp of the
+ * form YYYY-MM-DD HH:MM:SS.ffffff
+ *
+ * @param usecs		The microseconds since the epoch
+ * @param digits	The number of digits of fractional seconds, 0 to 6
+ * @param zone		Append the timezone, +00:00
+ * @param buffer	The buffer of at least TIMESTAMP_BUFFER_LEN characters
+ * @return int		The length of the timestamp
+ */
+int ReadingsTimestamp::format(int64_t usecs, int digits, bool zone, char *buffer)
+{
+	int64_t secs = usecs / USECS_PER_SEC;
+	int64_t fraction = usecs % USECS_PER_SEC;
+	if (fraction < 0)
+	{
+		fraction += USECS_PER_SEC;
+		secs--;
+	}
+	int64_t days = secs / 86400;
+	int64_t rem = secs % 86400;
+	if (rem < 0)
+	{
+		rem += 86400;
+		days--;
+	}
+	int year, month, day;
+	civilFromDays(days, year, month, day);
+
+	int len = snprintf(buffer, TIMESTAMP_BUFFER_LEN, "%04d-%02d-%02d %02d:%02d:%02d",
+			year, month, day, (int)(rem / 3600), (int)(rem / 60 % 60), (int)(rem % 60));
+	if (digits > 6)
+		digits = 6;
+	if (digits > 0)
+	{
+		char frac[8];
+		snprintf(frac, sizeof(frac), "%06d", (int)fraction);
+		buffer[len++] = '.';
+		for (int i = 0; i < digits; i++)
+			buffer[len++] = frac[i];
+		buffer[len] = 0;
+	}
+	if (zone)
+	{
+		len += snprintf(buffer + len, TIMESTAMP_BUFFER_LEN - len, "+00:00");
+	}
+	return len;
+}
+
+/**
+ * The current time in microseconds since the epoch
+ */
+int64_t ReadingsTimestamp::now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * USECS_PER_SEC + tv.tv_usec;
+}
+
+/**
+ * SQL function fledge_ts(value, digits, zone)
+ */
+static void fledgeTs(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+	int64_t usecs;
+	switch (sqlite3_value_type(argv[0]))
+	{
+		case SQLITE_INTEGER:
+			usecs = sqlite3_value_int64(argv[0]);
+			break;
+		case SQLITE_TEXT:
+			if (ReadingsTimestamp::parse((const char *)sqlite3_value_text(argv[0]), usecs))
+				break;
+			// Fall through
+		default:
+			sqlite3_result_value(context, argv[0]);
+			return;
+	}
+	char buffer[TIMESTAMP_BUFFER_LEN];
+	int len = ReadingsTimestamp::format(usecs, sqlite3_value_int(argv[1]),
+			sqlite3_value_int(argv[2]) != 0, buffer);
+	sqlite3_result_text(context, buffer, len, SQLITE_TRANSIENT);
+}
+
+/**
+ * SQL function fledge_epoch(value)
+ */
+static void fledgeEpoch(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+	int64_t usecs;
+	if (sqlite3_value_type(argv[0]) == SQLITE_TEXT
+			&& ReadingsTimestamp::parse((const char *)sqlite3_value_text(argv[0]), usecs))
+	{
+		sqlite3_result_int64(context, usecs);
+	}
+	else
+	{
+		sqlite3_result_value(context, argv[0]);
+	}
+}
+
+/**
+ * Register the timestamp conversion functions on a database connection
+ *
+ * @param db	The database connection
+ */
+void ReadingsTimestamp::registerFunctions(sqlite3 *db)
+{
+	sqlite3_create_function(db, "fledge_ts", 3, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+			NULL, fledgeTs, NULL, NULL);
+	sqlite3_create_function(db, "fledge_epoch", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+			NULL, fledgeEpoch, NULL, NULL);
+}
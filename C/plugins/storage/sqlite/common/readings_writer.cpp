@@ -0,0 +1,282 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <readings_writer.h>
+#include <connection.h>
+#include <readings_rollups.h>
+#include <logger.h>
+#include <sstream>
+
+using namespace std;
+
+/**
+ * Thread entry point for the writer
+ *
+ * @param writer	The readings writer
+ */
+static void writerThread(ReadingsWriter *writer)
+{
+	writer->run();
+}
+
+/**
+ * Create the readings writer, its connection and the writer thread
+ *
+ * @param partitions	The partitioned layout of the readings or NULL
+ * @param columns	The columnar layout of the readings or NULL
+ * @param rollups	The rollups of the readings or NULL
+ */
+ReadingsWriter::ReadingsWriter(ReadingsPartitions *partitions, ReadingsColumns *columns,
+				ReadingsRollups *rollups) : m_running(true)
+{
+	m_connection = new Connection();
+	m_connection->setPartitions(partitions);
+	m_connection->setColumns(columns);
+	if (columns && columns->load(m_connection->dbHandle))
+	{
+		columns->publish();
+	}
+	if (ReadingsLatest::seed(m_connection))
+	{
+		m_connection->m_latest = new ReadingsLatest();
+		if (partitions && partitions->purgedId())
+		{
+			// Replace the latest readings that were in partitions purged at startup
+			ReadingsLatest::purged(m_connection, partitions->purgedId());
+		}
+	}
+	m_migrating = m_connection->startTimestampMigration();
+	m_vacuum = m_connection->setupVacuum();
+	m_rollup = rollups && rollups->seed(m_connection->dbHandle);
+	if (m_rollup)
+	{
+		m_connection->setRollups(rollups);
+	}
+	m_rollupBehind = m_rollup;
+	m_rollupNext = chrono::steady_clock::now();
+	m_thread = new thread(writerThread, this);
+}
+
+/**
+ * Destructor for the readings writer. The work that has been queued
+ * is completed before the thread exits and the connection is closed.
+ */
+ReadingsWriter::~ReadingsWriter()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	m_thread->join();
+	delete m_thread;
+	delete m_connection;
+}
+
+/**
+ * Queue work for the writer and wait for it to be executed
+ *
+ * @param work		The work to execute on the connection of the writer
+ * @param type		The type of the work, appends may be grouped
+ * @return int		The result of the work
+ */
+int ReadingsWriter::execute(WorkFunction work, WorkType type)
+{
+	Work item(work, type);
+
+	unique_lock<mutex> lck(m_mutex);
+	m_queue.push_back(&item);
+	m_cv.notify_one();
+	while (!item.done)
+	{
+		m_doneCv.wait(lck);
+	}
+	return item.result;
+}
+
+/**
+ * The writer thread. Takes the work from the queue, the appends at the
+ * head of the queue are taken together as a group. The increments of the
+ * continuous purge are run between the groups when they are due. While
+ * the queue is empty the timestamps of the readings are migrated and the
+ * free pages of the database vacuumed, a block at a time.
+ */
+void ReadingsWriter::run()
+{
+	unique_lock<mutex> lck(m_mutex);
+	while (m_running || !m_queue.empty())
+	{
+		if (m_running && m_purge.due())
+		{
+			lck.unlock();
+			purgeIncrement();
+			lck.lock();
+		}
+		if (m_rollup && ((m_rollupBehind && m_queue.empty())
+					|| chrono::steady_clock::now() >= m_rollupNext))
+		{
+			lck.unlock();
+			m_rollupBehind = m_connection->updateRollups();
+			m_rollup = m_rollupBehind;
+			m_rollupNext = chrono::steady_clock::now() + chrono::milliseconds(ROLLUPS_INTERVAL_MS);
+			lck.lock();
+		}
+		if (m_queue.empty())
+		{
+			if (m_migrating && m_running)
+			{
+				lck.unlock();
+				m_migrating = m_connection->migrateTimestamps();
+				lck.lock();
+			}
+			else if (m_vacuum && m_running)
+			{
+				lck.unlock();
+				unsigned long pages = m_connection->incrementalVacuum();
+				m_purge.vacuumed(pages);
+				m_vacuum = pages > 0;
+				lck.lock();
+			}
+			else
+			{
+				// Wake periodically for the continuous purge
+				m_cv.wait_for(lck, chrono::seconds(1));
+			}
+			continue;
+		}
+		deque<Work *> group;
+		group.push_back(m_queue.front());
+		m_queue.pop_front();
+		while (group.front()->type == Append && !m_queue.empty()
+				&& m_queue.front()->type == Append && group.size() < WRITER_GROUP_MAX)
+		{
+			group.push_back(m_queue.front());
+			m_queue.pop_front();
+		}
+		lck.unlock();
+
+		commit(group);
+
+		lck.lock();
+		for (auto& item : group)
+		{
+			item->done = true;
+		}
+		m_doneCv.notify_all();
+	}
+}
+
+/**
+ * Execute a group of work in a single transaction. Should the commit
+ * of the transaction fail all of the work in the group fails.
+ *
+ * @param group		The work to execute
+ */
+void ReadingsWriter::commit(deque<Work *>& group)
+{
+	auto start = chrono::steady_clock::now();
+	for (auto& item : group)
+	{
+		(item->type == Append ? m_appendWait : m_purgeWait).record(
+			chrono::duration_cast<chrono::microseconds>(start - item->queued).count());
+	}
+
+	if (group.front()->type == Append)
+	{
+		// Create and attach the partition to append to before the transaction starts
+		m_connection->appendTable();
+	}
+
+	sqlite3 *db = m_connection->dbHandle;
+	bool transaction = group.size() > 1
+			&& sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL) == SQLITE_OK;
+	ReadingsColumns *columns = m_connection->m_columns;
+	for (auto& item : group)
+	{
+		item->result = item->work(m_connection);
+		if (item->result < 0 && columns && columns->pending())
+		{
+			// Tables or columns added by the work may have been rolled back
+			columns->load(db);
+		}
+	}
+	if (transaction && sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		m_connection->raiseError("appendReadings", "Executing the commit of the transaction :%s:",
+				sqlite3_errmsg(db));
+		sqlite3_exec(db, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+		for (auto& item : group)
+		{
+			item->result = -1;
+		}
+		if (columns && columns->pending())
+		{
+			columns->load(db);
+		}
+	}
+	if (columns && columns->pending())
+	{
+		// The tables and columns added are now visible to the other connections
+		columns->publish();
+	}
+	unsigned long usecs = chrono::duration_cast<chrono::microseconds>(
+				chrono::steady_clock::now() - start).count();
+	m_transactions.record(usecs);
+	m_rollup = m_connection->m_rollups != NULL;
+	if (group.front()->type == Append)
+	{
+		m_purge.appended(usecs);
+	}
+	else
+	{
+		m_purge.purged(group.front()->result, usecs);
+		m_vacuum = true;
+	}
+}
+
+/**
+ * Run an increment of the continuous purge, deleting a block of the
+ * readings that are older than the retention of the last purge by age
+ */
+void ReadingsWriter::purgeIncrement()
+{
+	unsigned long age, sent;
+	bool retainUnsent;
+	if (!m_purge.retention(age, retainUnsent, sent))
+	{
+		return;
+	}
+	int unsentPurged = 0;
+	auto start = chrono::steady_clock::now();
+	int removed = m_connection->purgeIncrement(age, retainUnsent, sent, m_purge.blockSize(), unsentPurged);
+	if (removed > 0)
+	{
+		m_purge.purged(removed, chrono::duration_cast<chrono::microseconds>(
+					chrono::steady_clock::now() - start).count());
+		m_vacuum = true;
+		m_rollup = m_connection->m_rollups != NULL;
+	}
+	m_purge.increment(removed, unsentPurged);
+}
+
+/**
+ * Return the statistics of the writer as JSON, the time work waits in
+ * the queue and the time taken by the transactions of the writer.
+ *
+ * @return string	The statistics as a JSON object
+ */
+string ReadingsWriter::statistics()
+{
+	ostringstream convert;
+
+	convert << "{ \"appendQueueWait\" : " << m_appendWait.toJSON() << ",";
+	convert << " \"purgeQueueWait\" : " << m_purgeWait.toJSON() << ",";
+	convert << " \"transactions\" : " << m_transactions.toJSON() << ",";
+	convert << " \"purge\" : " << m_purge.toJSON() << " }";
+	return convert.str();
+}
@@ -0,0 +1,83 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <statement_cache.h>
+
+using namespace std;
+
+/**
+ * Construct a statement cache for a database connection
+ *
+ * @param db	The database connection the statements are prepared on
+ * @param size	The maximum number of statements to hold
+ */
+StatementCache::StatementCache(sqlite3 *db, unsigned int size) :
+	m_db(db), m_size(size), m_hits(0), m_misses(0)
+{
+}
+
+/**
+ * Destructor for the statement cache, all cached statements are
+ * finalized. This must be called before the connection is closed.
+ */
+StatementCache::~StatementCache()
+{
+	clear();
+}
+
+/**
+ * Return a prepared statement for the given SQL text, preparing it
+ * if it is not already in the cache. The least recently used statement
+ * is finalized if the cache is full.
+ *
+ * @param sql		The SQL text of the statement
+ * @return sqlite3_stmt*	The statement or NULL if it could not be prepared,
+ *			sqlite3_errmsg will report the reason
+ */
+sqlite3_stmt *StatementCache::prepare(const string& sql)
+{
+	auto it = m_index.find(sql);
+	if (it != m_index.end())
+	{
+		m_hits++;
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		sqlite3_stmt *stmt = it->second->second;
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		return stmt;
+	}
+
+	m_misses++;
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(m_db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return NULL;
+	}
+	if (m_lru.size() >= m_size)
+	{
+		sqlite3_finalize(m_lru.back().second);
+		m_index.erase(m_lru.back().first);
+		m_lru.pop_back();
+	}
+	m_lru.emplace_front(sql, stmt);
+	m_index[sql] = m_lru.begin();
+	return stmt;
+}
+
+/**
+ * Finalize and remove all of the statements in the cache
+ */
+void StatementCache::clear()
+{
+	for (auto& entry : m_lru)
+	{
+		sqlite3_finalize(entry.second);
+	}
+	m_lru.clear();
+	m_index.clear();
+}
@@ -23,6 +23,7 @@
 #include <logger.h>
 #include <plugin_exception.h>
 #include <reading_stream.h>
+#include <readings_writer.h>
 
 using namespace std;
 using namespace rapidjson;
@@ -60,6 +61,7 @@ PLUGIN_HANDLE plugin_init()
 {
 ConnectionManager *manager = ConnectionManager::getInstance();
 
+	manager->startWriter();
 	manager->growPool(5);
 	return manager;
 }
@@ -134,6 +136,40 @@ Connection        *connection = manager->allocate();
 	return result;;
 }
 
+/**
+ * Append a batch of readings to the readings buffer
+ */
+int plugin_reading_append_batch(PLUGIN_HANDLE handle, const ReadingBatch *batch)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocate();
+
+	int result = connection->appendReadingBatch(batch);
+	manager->release(connection);
+	return result;
+}
+
+/**
+ * Append a batch of readings to the readings buffer and return them as
+ * plugin_reading_fetch would, without reading them back. The rows are
+ * set to NULL if they can not be returned.
+ */
+int plugin_reading_append_batch_rows(PLUGIN_HANDLE handle, const ReadingBatch *batch, char **rows)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocate();
+std::string	  appended;
+
+	*rows = NULL;
+	int result = connection->appendReadingBatch(batch, &appended);
+	manager->release(connection);
+	if (result > 0 && !appended.empty())
+	{
+		*rows = strdup(appended.c_str());
+	}
+	return result;
+}
+
 /**
  * Append a stream of readings to the readings buffer
  */
@@ -155,7 +191,7 @@ int plugin_readingStream(PLUGIN_HANDLE handle, ReadingStream **readings, bool co
 char *plugin_reading_fetch(PLUGIN_HANDLE handle, unsigned long id, unsigned int blksize)
 {
 ConnectionManager *manager = (ConnectionManager *)handle;
-Connection        *connection = manager->allocate();
+Connection        *connection = manager->allocateReader();
 std::string	  resultSet;
 
 	connection->fetchReadings(id, blksize, resultSet);
@@ -163,13 +199,39 @@ std::string	  resultSet;
 	return strdup(resultSet.c_str());
 }
 
+/**
+ * Return the latest reading of each asset, or of a single asset if
+ * asset is not NULL. NULL is returned on failure.
+ */
+char *plugin_reading_latest(PLUGIN_HANDLE handle, const char *asset)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocateReader();
+std::string	  resultSet;
+
+	bool rval = connection->latestReadings(asset, resultSet);
+	manager->release(connection);
+	return rval ? strdup(resultSet.c_str()) : NULL;
+}
+
+/**
+ * Return the purge generation of the plugin, this changes whenever the
+ * plugin removes readings other than in response to a purge request.
+ */
+unsigned long plugin_reading_purge_generation(PLUGIN_HANDLE handle)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+
+	return manager->purgeGeneration();
+}
+
 /**
  * Retrieve some readings from the readings buffer
  */
 char *plugin_reading_retrieve(PLUGIN_HANDLE handle, char *condition)
 {
 ConnectionManager *manager = (ConnectionManager *)handle;
-Connection        *connection = manager->allocate();
+Connection        *connection = manager->allocateReader();
 std::string results;
 
 	connection->retrieveReadings(std::string(condition), results);
@@ -210,6 +272,18 @@ void plugin_release(PLUGIN_HANDLE handle, char *results)
 	free(results);
 }
 
+/**
+ * Return the internal performance statistics of the plugin, the time
+ * work waits for the readings writer and the time taken by its
+ * transactions. The result is released with plugin_release.
+ */
+char *plugin_performance(PLUGIN_HANDLE handle)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+
+	return strdup(manager->getWriter()->statistics().c_str());
+}
+
 /**
  * Return details on the last error that occured.
  */
@@ -10,6 +10,8 @@
 #include <connection.h>
 #include <connection_manager.h>
 #include <common.h>
+#include <readings_payload.h>
+#include <readings_inserter.h>
 
 /**
  * SQLite3 storage plugin for Fledge
@@ -27,9 +29,26 @@ static time_t connectErrorTime = 0;
 
 /**
  * Create a SQLite3 database connection
+ *
+ * @param readOnly	The connection only reads the readings
  */
-Connection::Connection()
+Connection::Connection(bool readOnly)
 {
+	m_readOnly = readOnly;
+	m_statements = NULL;
+	m_writer = NULL;
+	m_partitions = NULL;
+	m_partitionGeneration = 0;
+	m_columns = NULL;
+	m_columnsGeneration = 0;
+	m_epochTimestamps = getenv("FLEDGE_READINGS_EPOCH_TIMESTAMPS") != NULL;
+	m_timestampView = false;
+	m_migrateId = 0;
+	m_migrateMaxId = 0;
+	m_incrementalVacuum = false;
+	m_rollups = NULL;
+	m_rollupsMinId = 0;
+	m_latest = NULL;
 	if (getenv("FLEDGE_TRACE_SQL"))
 	{
 		m_logSQL = true;
@@ -55,6 +74,14 @@ Connection::Connection()
 
 	const char * createReadingsFk = "CREATE INDEX fki_readings_fk1 ON readings (asset_code);";
 
+	// The latest reading of each asset, user_ts in microseconds since the epoch
+	const char * createReadingsLatest = "CREATE TABLE fledge.readings_latest (" \
+					"asset_code	TEXT			PRIMARY KEY," \
+					"id		INTEGER			NOT NULL," \
+					"user_ts	INTEGER			NOT NULL," \
+					"reading	TEXT			NOT NULL" \
+					") WITHOUT ROWID;";
+
 	// Allow usage of URI for filename
         sqlite3_config(SQLITE_CONFIG_URI, 1);
 
@@ -79,6 +106,9 @@ Connection::Connection()
 		Logger::getLogger()->info("Connected to IN_MEMORY SQLite3 database: %s",
 					  dbHandleConn);
 
+		// Conversions of the timestamps of the readings
+		ReadingsTimestamp::registerFunctions(dbHandle);
+
 		int rc;
                 // Exec the statements without getting error messages, for now
 
@@ -103,143 +133,106 @@ Connection::Connection()
 				  NULL,
 				  NULL);
 
+		// CREATE TABLE readings_latest
+		rc = sqlite3_exec(dbHandle,
+				  createReadingsLatest,
+				  NULL,
+				  NULL,
+				  NULL);
+
+		// The latest reading of each asset, updated by the appends
+		if (ReadingsLatest::seed(this))
+		{
+			m_latest = new ReadingsLatest();
+		}
+
 	}
 
 }
 
 /**
- * Append a set of readings to the readings table
+ * Append a set of readings to the readings table. The payload is parsed
+ * into a batch that refers to the JSON text of each reading, rather than
+ * into a document from which each reading is serialised again.
  */
 int Connection::appendReadings(const char *readings)
 {
-// Default template parameter uses UTF8 and MemoryPoolAllocator.
-Document 	doc;
-SQLBuffer	sql;
-int		row = 0;
-bool 		add_row = false;
+ReadingsPayload payload;
 
-	ParseResult ok = doc.Parse(readings);
-	if (!ok)
+	if (!payload.parse(readings))
 	{
- 		raiseError("appendReadings", GetParseError_En(doc.GetParseError()));
+		raiseError("appendReadings", payload.error().c_str());
 		return -1;
 	}
+	return appendReadingBatch(payload.batch());
+}
 
-	sql.append("INSERT INTO fledge.readings ( user_ts, asset_code, reading ) VALUES ");
+/**
+ * Append a batch of readings to the readings table. The batch has been
+ * parsed by the storage service, the values of each reading are bound
+ * to multi-row insert statements as they are.
+ *
+ * The readings appended are not returned as rows by this plugin.
+ *
+ * @param batch		The batch of readings
+ * @param rows		Left empty
+ * @return int		The number of readings appended or -1 on failure
+ */
+int Connection::appendReadingBatch(const ReadingBatch *batch, string *rows)
+{
+int		row = 0;
+char		formatted_date[LEN_BUFFER_DATE];
+int64_t		usecs = 0, now_usecs = ReadingsTimestamp::now();
 
-	if (!doc.HasMember("readings"))
+	if (batch->version != READING_BATCH_VERSION)
 	{
- 		raiseError("appendReadings", "Payload is missing a readings array");
-	        return -1;
-	}
-	Value &rdings = doc["readings"];
-	if (!rdings.IsArray())
-	{
-		raiseError("appendReadings", "Payload is missing the readings array");
+		raiseError("appendReadings", "Unsupported reading batch version %d", batch->version);
 		return -1;
 	}
-	for (Value::ConstValueIterator itr = rdings.Begin(); itr != rdings.End(); ++itr)
+
+	if (rows)
 	{
-		if (!itr->IsObject())
-		{
-			raiseError("appendReadings",
-				   "Each reading in the readings array must be an object");
-			return -1;
-		}
+		rows->clear();
+	}
+
+	ReadingsInserter inserter(this, "fledge.readings", m_epochTimestamps, now_usecs, false);
+	sqlite3_exec(dbHandle, "BEGIN TRANSACTION", NULL, NULL, NULL);
 
-		add_row = true;
+	for (uint32_t i = 0; i < batch->count; i++)
+	{
+		const ReadingBatchEntry *entry = &batch->readings[i];
 
 		// Handles - user_ts
-		const char *str = (*itr)["user_ts"].GetString();
-		if (strcmp(str, "now()") == 0)
+		const char *user_ts = entry->userTs;
+		if (!userTimestamp(user_ts, formatted_date, usecs, now_usecs))
 		{
-			if (row)
-			{
-				sql.append(", (");
-			}
-			else
-			{
-				sql.append('(');
-			}
-
-			sql.append(SQLITE3_NOW_READING);
-		}
-		else
-		{
-			char formatted_date[LEN_BUFFER_DATE] = {0};
-			if (! formatDate(formatted_date, sizeof(formatted_date), str) )
-			{
-				raiseError("appendReadings", "Invalid date |%s|", str);
-				add_row = false;
-			}
-			else
-			{
-				if (row)
-				{
-					sql.append(", (");
-				}
-				else
-				{
-					sql.append('(');
-				}
-
-				sql.append('\'');
-				sql.append(formatted_date);
-				sql.append('\'');
-			}
+			raiseError("appendReadings", "Invalid date |%s|", user_ts);
+			continue;
 		}
 
-		if (add_row)
+		if (!inserter.add(user_ts, usecs, entry->assetCode, entry->assetCodeLength,
+					entry->reading, entry->readingLength))
 		{
-			row++;
-
-			// Handles - asset_code
-			sql.append(",\'");
-			sql.append((*itr)["asset_code"].GetString());
-			sql.append("\',\'");
-
-			// Handles - reading
-			StringBuffer buffer;
-			Writer<StringBuffer> writer(buffer);
-			(*itr)["reading"].Accept(writer);
-			sql.append(buffer.GetString());
-			sql.append('\'');
-
-			sql.append(')');
+			raiseError("appendReadings", sqlite3_errmsg(dbHandle));
+			sqlite3_exec(dbHandle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+			return -1;
 		}
-
 	}
-	sql.append(';');
-
-	const char *query = sql.coalesce();
-	logSQL("ReadingsAppend", query);
-	char *zErrMsg = NULL;
-	int rc;
-
-	// Exec the INSERT statement: no callback, no result set
-	rc = SQLexec(dbHandle,
-		     query,
-		     NULL,
-		     NULL,
-		     &zErrMsg);
-
-	// Release memory for 'query' var
-	delete[] query;
 
-	// Check result code
-	if (rc == SQLITE_OK)
+	if (!inserter.flush())
 	{
-		// Success
-		return sqlite3_changes(dbHandle);
+		raiseError("appendReadings", sqlite3_errmsg(dbHandle));
+		sqlite3_exec(dbHandle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+		return -1;
 	}
-	else
-	{
-	 	raiseError("appendReadings", zErrMsg);
-		sqlite3_free(zErrMsg);
+	row = inserter.rows();
 
-		// Failure
-		return -1;
+	if (sqlite3_exec(dbHandle, "END TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		raiseError("appendReadings", sqlite3_errmsg(dbHandle));
+		row = -1;
 	}
+	return row;
 }
 
 /**
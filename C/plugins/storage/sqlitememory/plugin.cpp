@@ -75,6 +75,19 @@ Connection        *connection = manager->allocate();
 	return result;;
 }
 
+/**
+ * Append a batch of readings to the readings buffer
+ */
+int plugin_reading_append_batch(PLUGIN_HANDLE handle, const ReadingBatch *batch)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocate();
+
+	int result = connection->appendReadingBatch(batch);
+	manager->release(connection);
+	return result;
+}
+
 /**
  * Fetch a block of readings from the readings buffer
  */
@@ -89,6 +102,32 @@ std::string	  resultSet;
 	return strdup(resultSet.c_str());
 }
 
+/**
+ * Return the latest reading of each asset, or of a single asset if
+ * asset is not NULL. NULL is returned on failure.
+ */
+char *plugin_reading_latest(PLUGIN_HANDLE handle, const char *asset)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+Connection        *connection = manager->allocate();
+std::string	  resultSet;
+
+	bool rval = connection->latestReadings(asset, resultSet);
+	manager->release(connection);
+	return rval ? strdup(resultSet.c_str()) : NULL;
+}
+
+/**
+ * Return the purge generation of the plugin, this changes whenever the
+ * plugin removes readings other than in response to a purge request.
+ */
+unsigned long plugin_reading_purge_generation(PLUGIN_HANDLE handle)
+{
+ConnectionManager *manager = (ConnectionManager *)handle;
+
+	return manager->purgeGeneration();
+}
+
 /**
  * Retrieve some readings from the readings buffer
  */
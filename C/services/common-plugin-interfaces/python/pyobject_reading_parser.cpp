@@ -14,12 +14,294 @@
 #include <Python.h>
 #include <vector>
 
+/**
+ * Convert the items of a numeric buffer to doubles
+ *
+ * @param view		The C contiguous buffer
+ * @param values	The vector to fill
+ * @return		False if the items are not the size of the C type
+ */
+template<typename T> static bool copyBuffer(const Py_buffer& view, std::vector<double>& values)
+{
+	if (view.itemsize != sizeof(T))
+	{
+		return false;
+	}
+	const T *src = (const T *)view.buf;
+	Py_ssize_t n = view.len / view.itemsize;
+	values.resize(n);
+	for (Py_ssize_t i = 0; i < n; i++)
+	{
+		values[i] = (double)src[i];
+	}
+	return true;
+}
+
 extern "C" {
 
 static void logErrorMessage();
 DatapointValue* Py2C_createDictDPV(PyObject *data);
 DatapointValue* Py2C_createListDPV(PyObject *data);
 
+/**
+ * Get the name of a datapoint from its key in a Python dict
+ *
+ * @param key	The key of the datapoint
+ * @param name	Set to the name of the datapoint
+ * @return	False if the key is not a string, the datapoint is skipped
+ */
+static bool Py2C_getDatapointName(PyObject *key, std::string& name)
+{
+	const char *str = PyUnicode_Check(key) ? PyUnicode_AsUTF8(key) : NULL;
+	if (!str)
+	{
+		PyErr_Clear();
+		Logger::getLogger()->info("Skipping datapoint whose key is not a string: Py_TYPE(key)=%s",
+					  (Py_TYPE(key))->tp_name);
+		return false;
+	}
+	name = str;
+	return true;
+}
+
+/**
+ * Python object that owns the values of a T_FLOAT_ARRAY datapoint
+ * and exposes them, without copying, as a read-only buffer of doubles
+ */
+typedef struct {
+	PyObject_HEAD
+	std::vector<double>	*values;
+	Py_ssize_t		shape[1];
+	Py_ssize_t		strides[1];
+} FloatArrayObject;
+
+static void FloatArray_dealloc(FloatArrayObject *self)
+{
+	delete self->values;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int FloatArray_getbuffer(PyObject *obj, Py_buffer *view, int flags)
+{
+	FloatArrayObject *self = (FloatArrayObject *)obj;
+
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "float array datapoint is read-only");
+		view->obj = NULL;
+		return -1;
+	}
+
+	self->shape[0] = (Py_ssize_t)self->values->size();
+	self->strides[0] = sizeof(double);
+
+	view->obj = obj;
+	Py_INCREF(obj);
+	view->buf = self->values->data();
+	view->len = self->shape[0] * sizeof(double);
+	view->readonly = 1;
+	view->itemsize = sizeof(double);
+	view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char *)"d" : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	return 0;
+}
+
+static PyBufferProcs FloatArray_as_buffer = { FloatArray_getbuffer, NULL };
+
+static PyTypeObject FloatArrayType = { PyVarObject_HEAD_INIT(NULL, 0) "fledge.FloatArray" };
+
+/**
+ * Create a read-only memoryview of the values of a T_FLOAT_ARRAY datapoint
+ *
+ * When move is true the values are taken from the datapoint, which
+ * is left with an empty array, and no copy is done. Otherwise the
+ * values are copied once into memory owned by the returned view.
+ *
+ * @param value		The T_FLOAT_ARRAY datapoint value
+ * @param move		Take ownership of the datapoint values
+ * @return		New reference to a memoryview or NULL on error
+ */
+PyObject *Py2C_createFloatArrayView(DatapointValue& value, bool move)
+{
+	if (!FloatArrayType.tp_basicsize)
+	{
+		FloatArrayType.tp_basicsize = sizeof(FloatArrayObject);
+		FloatArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+		FloatArrayType.tp_dealloc = (destructor)FloatArray_dealloc;
+		FloatArrayType.tp_as_buffer = &FloatArray_as_buffer;
+		FloatArrayType.tp_doc = "Fledge float array datapoint values";
+		if (PyType_Ready(&FloatArrayType) < 0)
+		{
+			FloatArrayType.tp_basicsize = 0;
+			logErrorMessage();
+			return NULL;
+		}
+	}
+
+	FloatArrayObject *array = PyObject_New(FloatArrayObject, &FloatArrayType);
+	if (!array)
+	{
+		return NULL;
+	}
+	if (move)
+	{
+		array->values = value.takeDpArr();
+	}
+	else
+	{
+		array->values = new std::vector<double>(*value.getDpArr());
+	}
+
+	// The memoryview holds the only reference to the array object
+	PyObject *view = PyMemoryView_FromObject((PyObject *)array);
+	Py_DECREF(array);
+
+	return view;
+}
+
+/**
+ * Check whether a Python object is a one dimensional numeric
+ * buffer (NumPy array, array.array, memoryview) that can be
+ * stored as a T_FLOAT_ARRAY datapoint. Numbers are never arrays,
+ * nor are the zero dimensional buffers of NumPy scalars.
+ *
+ * @param obj	Python Object
+ * @return	True if the object is a numeric buffer
+ */
+bool Py2C_isFloatArray(PyObject *obj)
+{
+	if (!obj ||
+		PyFloat_Check(obj) ||
+		PyLong_Check(obj) ||
+		PyBytes_Check(obj) ||
+		PyByteArray_Check(obj) ||
+		PyUnicode_Check(obj) ||
+		!PyObject_CheckBuffer(obj))
+	{
+		return false;
+	}
+
+	Py_buffer view;
+	if (PyObject_GetBuffer(obj, &view, PyBUF_ND) < 0)
+	{
+		PyErr_Clear();
+		return false;
+	}
+	bool array = view.ndim == 1;
+	PyBuffer_Release(&view);
+	return array;
+}
+
+/**
+ * Copy the numeric buffer values into a vector of doubles. The items
+ * must have the size of the C type of their format, the standard
+ * sizes of the '<' and '=' formats may differ from the native ones.
+ *
+ * @param view		The C contiguous buffer
+ * @param values	The vector to fill
+ * @return		False if the buffer format is not supported
+ */
+static bool fillFloatArray(const Py_buffer& view, std::vector<double>& values)
+{
+	const char *fmt = view.format ? view.format : "B";
+	// Native byte order prefixes
+	if (*fmt == '@' || *fmt == '=' || *fmt == '<')
+	{
+		fmt++;
+	}
+	if (fmt[0] == 0 || fmt[1] != 0)
+	{
+		return false;
+	}
+
+	switch (*fmt)
+	{
+	case 'd':
+		{
+		if (view.itemsize != sizeof(double))
+		{
+			return false;
+		}
+		// Single memcpy of the whole buffer
+		const double *src = (const double *)view.buf;
+		values.assign(src, src + view.len / sizeof(double));
+		return true;
+		}
+	case 'f': return copyBuffer<float>(view, values);
+	case 'b': return copyBuffer<signed char>(view, values);
+	case 'B': return copyBuffer<unsigned char>(view, values);
+	case 'h': return copyBuffer<short>(view, values);
+	case 'H': return copyBuffer<unsigned short>(view, values);
+	case 'i': return copyBuffer<int>(view, values);
+	case 'I': return copyBuffer<unsigned int>(view, values);
+	case 'l': return copyBuffer<long>(view, values);
+	case 'L': return copyBuffer<unsigned long>(view, values);
+	case 'q': return copyBuffer<long long>(view, values);
+	case 'Q': return copyBuffer<unsigned long long>(view, values);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Create a T_FLOAT_ARRAY Datapoint from a Python numeric buffer
+ *
+ * The buffer content is copied directly into the datapoint values,
+ * without creating any intermediate Python or C++ objects.
+ *
+ * @param name	The datapoint name
+ * @param obj	Python Object supporting the buffer protocol
+ * @return	Pointer to a new Datapoint object
+ *		or NULL in case of error
+ */
+Datapoint *Py2C_createFloatArrayDatapoint(const std::string& name, PyObject *obj)
+{
+	Py_buffer view;
+	if (PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+	{
+		PyErr_Clear();
+		Logger::getLogger()->info("Unable to get a contiguous buffer for datapoint '%s': Py_TYPE=%s",
+					  name.c_str(),
+					  (Py_TYPE(obj))->tp_name);
+		return NULL;
+	}
+
+	Datapoint *dp = NULL;
+	if (view.ndim == 1)
+	{
+		std::vector<double> *values = new std::vector<double>();
+		if (fillFloatArray(view, *values))
+		{
+			std::vector<double> empty;
+			DatapointValue dpv(empty);
+			dp = new Datapoint(name, dpv);
+			// The datapoint takes the filled array without copying it
+			dp->getData().setValue(values);
+		}
+		else
+		{
+			Logger::getLogger()->info("Unsupported buffer format '%s' of %d byte items for datapoint '%s'",
+						  view.format ? view.format : "B",
+						  (int)view.itemsize,
+						  name.c_str());
+			delete values;
+		}
+	}
+	else
+	{
+		Logger::getLogger()->info("Buffer for datapoint '%s' has %d dimensions, only one is supported",
+					  name.c_str(),
+					  view.ndim);
+	}
+	PyBuffer_Release(&view);
+
+	return dp;
+}
 
 /**
  * Creating DatapointValue object from Python object
@@ -46,7 +328,14 @@ DatapointValue *Py2C_createBasicDPV(PyObject *dValue)
 	}
 	else if (PyBytes_Check(dValue) || PyUnicode_Check(dValue))
 	{
-		dpv = new DatapointValue(std::string(PyUnicode_AsUTF8(dValue)));
+		const char *str = PyBytes_Check(dValue) ? PyBytes_AsString(dValue) : PyUnicode_AsUTF8(dValue);
+		if (!str)
+		{
+			PyErr_Clear();
+			Logger::getLogger()->info("Unable to convert dValue to a string");
+			return NULL;
+		}
+		dpv = new DatapointValue(std::string(str));
 	}
 	else
 	{
@@ -82,7 +371,21 @@ DatapointValue* Py2C_createDictDPV(PyObject *data)
 	// dKey and dValue are borrowed references
 	while (PyDict_Next(data, &dPos, &dKey, &dValue))
 	{
+		std::string name;
+		if (!Py2C_getDatapointName(dKey, name))
+		{
+			continue;
+		}
 		DatapointValue* dpv;
+		if (Py2C_isFloatArray(dValue))
+		{
+			Datapoint *dp = Py2C_createFloatArrayDatapoint(name, dValue);
+			if (dp)
+			{
+				dpVec->emplace_back(dp);
+			}
+			continue;
+		}
 		if (PyLong_Check(dValue) || PyFloat_Check(dValue) || PyBytes_Check(dValue) || PyUnicode_Check(dValue))
 		{
 			dpv = Py2C_createBasicDPV(dValue);
@@ -97,12 +400,12 @@ DatapointValue* Py2C_createDictDPV(PyObject *data)
 		}
 		else
 		{
-			Logger::getLogger()->info("Unable to parse dValue in 'data' dict: dKey=%s, Py_TYPE(dValue)=%s", std::string(PyUnicode_AsUTF8(dKey)).c_str(), (Py_TYPE(dValue))->tp_name);
+			Logger::getLogger()->info("Unable to parse dValue in 'data' dict: dKey=%s, Py_TYPE(dValue)=%s", name.c_str(), (Py_TYPE(dValue))->tp_name);
 			dpv = NULL;
 		}
 		if (dpv)
 		{
-			dpVec->emplace_back(new Datapoint(std::string(PyUnicode_AsUTF8(dKey)), *dpv));
+			dpVec->emplace_back(new Datapoint(name, *dpv));
 			delete dpv;
 		}
 	}
@@ -151,6 +454,15 @@ DatapointValue* Py2C_createListDPV(PyObject *data)
 
 			return NULL;
 		}
+		else if (Py2C_isFloatArray(element))
+		{
+			Datapoint *dp = Py2C_createFloatArrayDatapoint(std::string("unnamed_list_elem#") + std::to_string(i), element);
+			if (dp)
+			{
+				dpVec->emplace_back(dp);
+			}
+			continue;
+		}
 		else if (PyDict_Check(element))
 		{
 			dpv = Py2C_createDictDPV(element);
@@ -247,7 +559,29 @@ Reading* Py2C_parseReadingElement(PyObject *reading, std::string assetName)
 
 	while (PyDict_Next(reading, &dPos, &dKey, &dValue))
 	{
+		std::string name;
+		if (!Py2C_getDatapointName(dKey, name))
+		{
+			continue;
+		}
 		DatapointValue* dataPoint;
+		if (Py2C_isFloatArray(dValue))
+		{
+			Datapoint *dp = Py2C_createFloatArrayDatapoint(name, dValue);
+			if (dp == NULL)
+			{
+				continue;
+			}
+			if (newReading == NULL)
+			{
+				newReading = new Reading(assetName, dp);
+			}
+			else
+			{
+				newReading->addDatapoint(dp);
+			}
+			continue;
+		}
 		if (PyLong_Check(dValue) || PyFloat_Check(dValue) || PyBytes_Check(dValue) || PyUnicode_Check(dValue))
 		{
 			dataPoint = Py2C_createBasicDPV(dValue);
@@ -262,7 +596,7 @@ Reading* Py2C_parseReadingElement(PyObject *reading, std::string assetName)
 		}
 		else
 		{
-			Logger::getLogger()->info("Unable to parse dValue in readings dict: dKey=%s, Py_TYPE(dValue)=%s", std::string(PyUnicode_AsUTF8(dKey)).c_str(), (Py_TYPE(dValue))->tp_name);
+			Logger::getLogger()->info("Unable to parse dValue in readings dict: dKey=%s, Py_TYPE(dValue)=%s", name.c_str(), (Py_TYPE(dValue))->tp_name);
 			return NULL;
 		}
 
@@ -275,8 +609,7 @@ Reading* Py2C_parseReadingElement(PyObject *reading, std::string assetName)
 				continue;
 			}
 			newReading = new Reading(assetName,
-							new Datapoint(std::string(PyUnicode_AsUTF8(dKey)),
-								*dataPoint));
+							new Datapoint(name, *dataPoint));
 		}
 		else
 		{
@@ -285,8 +618,7 @@ Reading* Py2C_parseReadingElement(PyObject *reading, std::string assetName)
 				Logger::getLogger()->info("%s:%d: dataPoint is NULL", __FUNCTION__, __LINE__);
 				continue;
 			}
-			newReading->addDatapoint(new Datapoint(std::string(PyUnicode_AsUTF8(dKey)),
-										*dataPoint));
+			newReading->addDatapoint(new Datapoint(name, *dataPoint));
 		}
 
 		// Remove temp objects
@@ -507,6 +839,180 @@ std::vector<Reading *>* Py2C_getReadings(PyObject *polledData)
 	return newReadings;
 }
 
+/**
+ * Creating vector of Reading objects from a column oriented Python object
+ *
+ * The object is a dict of the form
+ *	{
+ *		"asset" : "name",
+ *		"timestamps" : [ "2019-01-07 19:06:35.366100+01:00", ... ],
+ *		"columns" : { "dp1" : [ 1, 2, ... ], "dp2" : [ 1.5, 2.5, ... ] }
+ *	}
+ * where each column holds one value per reading. The "timestamps"
+ * sequence is optional, when present it sets the user timestamp of
+ * each reading. All sequences must have the same length.
+ *
+ * The GIL must be held by the caller.
+ *
+ * @param columns	Python Object (dict)
+ * @return		Pointer to a vector of Reading objects
+ *				or NULL in case of error
+ */
+std::vector<Reading *>* Py2C_getColumnReadings(PyObject *columns)
+{
+	if (!columns || !PyDict_Check(columns))
+	{
+		Logger::getLogger()->info("Column readings object is NULL or not a PyDict");
+		return NULL;
+	}
+
+	// Borrowed references
+	PyObject* assetCode = PyDict_GetItemString(columns, "asset");
+	PyObject* data = PyDict_GetItemString(columns, "columns");
+	PyObject* timestamps = PyDict_GetItemString(columns, "timestamps");
+	const char *asset = assetCode && PyUnicode_Check(assetCode) ? PyUnicode_AsUTF8(assetCode) : NULL;
+	if (!asset || !data || !PyDict_Check(data))
+	{
+		PyErr_Clear();
+		Logger::getLogger()->info("Couldn't get 'asset' and 'columns' fields "
+					  "from Python column readings object");
+		return NULL;
+	}
+
+	std::string assetName(asset);
+
+	// Get a fast sequence for every column, all of the same length
+	std::vector<std::string> names;
+	std::vector<PyObject *> sequences;	// New references
+	Py_ssize_t nRows = -1;
+	PyObject *dKey, *dValue;
+	Py_ssize_t dPos = 0;
+	bool valid = true;
+	while (PyDict_Next(data, &dPos, &dKey, &dValue))
+	{
+		std::string name;
+		if (!Py2C_getDatapointName(dKey, name))
+		{
+			continue;
+		}
+		PyObject *seq = PySequence_Fast(dValue, "column is not a sequence");
+		if (!seq)
+		{
+			logErrorMessage();
+			valid = false;
+			break;
+		}
+		sequences.push_back(seq);
+		names.push_back(name);
+		Py_ssize_t len = PySequence_Fast_GET_SIZE(seq);
+		if (nRows == -1)
+		{
+			nRows = len;
+		}
+		else if (nRows != len)
+		{
+			Logger::getLogger()->info("Column '%s' of asset '%s' has %ld values, expected %ld",
+						  names.back().c_str(),
+						  assetName.c_str(),
+						  (long)len,
+						  (long)nRows);
+			valid = false;
+			break;
+		}
+	}
+
+	PyObject *tsSeq = NULL;
+	if (valid && timestamps && timestamps != Py_None)
+	{
+		tsSeq = PySequence_Fast(timestamps, "timestamps is not a sequence");
+		if (!tsSeq)
+		{
+			logErrorMessage();
+			valid = false;
+		}
+		else if (nRows != -1 && PySequence_Fast_GET_SIZE(tsSeq) != nRows)
+		{
+			Logger::getLogger()->info("Asset '%s' has %ld timestamps for %ld readings",
+						  assetName.c_str(),
+						  (long)PySequence_Fast_GET_SIZE(tsSeq),
+						  (long)nRows);
+			valid = false;
+		}
+	}
+
+	std::vector<Reading *>* newReadings = NULL;
+	if (valid)
+	{
+		newReadings = new std::vector<Reading *>();
+		newReadings->reserve(nRows > 0 ? nRows : 0);
+		for (Py_ssize_t row = 0; row < nRows; row++)
+		{
+			std::vector<Datapoint *> values;
+			values.reserve(sequences.size());
+			for (size_t col = 0; col < sequences.size(); col++)
+			{
+				// Borrowed reference
+				PyObject *value = PySequence_Fast_GET_ITEM(sequences[col], row);
+				DatapointValue *dpv;
+				if (Py2C_isFloatArray(value))
+				{
+					Datapoint *dp = Py2C_createFloatArrayDatapoint(names[col], value);
+					if (dp)
+					{
+						values.push_back(dp);
+					}
+					continue;
+				}
+				if (PyList_Check(value))
+				{
+					dpv = Py2C_createListDPV(value);
+				}
+				else if (PyDict_Check(value))
+				{
+					dpv = Py2C_createDictDPV(value);
+				}
+				else
+				{
+					dpv = Py2C_createBasicDPV(value);
+				}
+				if (dpv)
+				{
+					values.push_back(new Datapoint(names[col], *dpv));
+					delete dpv;
+				}
+			}
+			if (values.size() == 0)
+			{
+				continue;
+			}
+
+			Reading *newReading = new Reading(assetName, values);
+			if (tsSeq)
+			{
+				PyObject *ts = PySequence_Fast_GET_ITEM(tsSeq, row);
+				const char *tsStr = PyUnicode_Check(ts) ? PyUnicode_AsUTF8(ts) : NULL;
+				if (tsStr)
+				{
+					newReading->setUserTimestamp(tsStr);
+				}
+				else
+				{
+					PyErr_Clear();
+				}
+			}
+			newReadings->push_back(newReading);
+		}
+	}
+
+	for (auto seq : sequences)
+	{
+		Py_DECREF(seq);
+	}
+	Py_XDECREF(tsSeq);
+
+	return newReadings;
+}
+
 /**
  * Function to log error message encountered while interfacing with
  * Python runtime
@@ -544,10 +1050,16 @@ static void logErrorMessage()
  * Create a list od dict Python object (PyList) from
  * a vector of Readind pointers
  *
+ * T_FLOAT_ARRAY datapoints are returned as read-only memoryviews
+ * of doubles. If the caller is about to delete the readings it can
+ * set moveArrays so that the array values are handed over to Python
+ * without being copied.
+ *
  * @param    readings	The input readings vector
+ * @param    moveArrays	Move float array values out of the readings
  * @return		PyList object on success or NULL on errors
  */
-PyObject* createReadingsList(const std::vector<Reading *>& readings)
+PyObject* createReadingsList(const std::vector<Reading *>& readings, bool moveArrays)
 {
 	// TODO add checks to all PyList_XYZ methods
 	PyObject* readingsList = PyList_New(0);
@@ -579,6 +1091,15 @@ PyObject* createReadingsList(const std::vector<Reading *>& readings)
 			{
 				value = PyFloat_FromDouble((*it)->getData().toDouble());
 			}
+			else if (dataType == DatapointValue::dataTagType::T_FLOAT_ARRAY)
+			{
+				value = Py2C_createFloatArrayView((*it)->getData(), moveArrays);
+				if (!value)
+				{
+					logErrorMessage();
+					value = PyUnicode_FromString((*it)->getData().toString().c_str());
+				}
+			}
 			else
 			{
 				value = PyUnicode_FromString((*it)->getData().toString().c_str());
@@ -20,6 +20,7 @@
 #define PING			"/fledge/service/ping"
 #define SERVICE_SHUTDOWN	"/fledge/service/shutdown"
 #define CONFIG_CHANGE		"/fledge/change"
+#define PERFORMANCE		"/fledge/service/performance"
 
 using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
 
@@ -36,6 +37,7 @@ class ManagementApi {
 		void stop();
 		void stopServer();
 		void registerStats(JSONProvider *statsProvider);
+		void registerPerformance(JSONProvider *performanceProvider);
 		void registerService(ServiceHandler *serviceHandler) {
 			m_serviceHandler = serviceHandler;
 		}
@@ -45,6 +47,7 @@ class ManagementApi {
 		void ping(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 		void shutdown(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 		void configChange(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void performance(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 
 	protected:
 		static ManagementApi *m_instance;
@@ -53,6 +56,7 @@ class ManagementApi {
 		time_t		m_startTime;
 		HttpServer	*m_server;
 		JSONProvider	*m_statsProvider;
+		JSONProvider	*m_performanceProvider;
 		ServiceHandler	*m_serviceHandler;
 		std::thread	*m_thread;
 	private:
@@ -47,6 +47,15 @@ void configChangeWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<H
         api->configChange(response, request);
 }
 
+/**
+ * Wrapper for performance method
+ */
+void performanceWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+        ManagementApi *api = ManagementApi::getInstance();
+        api->performance(response, request);
+}
+
 /**
  * Construct a microservices management API manager class
  */
@@ -57,9 +66,11 @@ ManagementApi::ManagementApi(const string& name, const unsigned short port) : m_
 	m_server->config.port = port;
 	m_startTime = time(0);
 	m_statsProvider = 0;
+	m_performanceProvider = 0;
 	m_server->resource[PING]["GET"] = pingWrapper;
 	m_server->resource[SERVICE_SHUTDOWN]["POST"] = shutdownWrapper;
 	m_server->resource[CONFIG_CHANGE]["POST"] = configChangeWrapper;
+	m_server->resource[PERFORMANCE]["GET"] = performanceWrapper;
 
 	m_instance = this;
 
@@ -121,6 +132,14 @@ void ManagementApi::registerStats(JSONProvider *statsProvider)
 	m_statsProvider = statsProvider;
 }
 
+/**
+ * Register a provider of performance statistics
+ */
+void ManagementApi::registerPerformance(JSONProvider *performanceProvider)
+{
+	m_performanceProvider = performanceProvider;
+}
+
 /**
  * Received a ping request, construct a reply and return to caller
  */
@@ -176,6 +195,26 @@ string	category, items, payload;
 	respond(response, responsePayload);
 }
 
+/**
+ * Received a performance request, return the performance statistics
+ * of the service if it provides them
+ */
+void ManagementApi::performance(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+string responsePayload;
+
+	(void)request;	// Unsused argument
+	if (m_performanceProvider)
+	{
+		m_performanceProvider->asJSON(responsePayload);
+	}
+	else
+	{
+		responsePayload = "{ }";
+	}
+	respond(response, responsePayload);
+}
+
 /**
  * HTTP response method
  */
@@ -35,7 +35,7 @@ extern PLUGIN_INFORMATION *Py2C_PluginInfo(PyObject *);
 extern void logErrorMessage();
 extern PLUGIN_INFORMATION *plugin_info_fn();
 extern void plugin_shutdown_fn(PLUGIN_HANDLE);
-extern PyObject* createReadingsList(const vector<Reading *>& readings);
+extern PyObject* createReadingsList(const vector<Reading *>& readings, bool moveArrays);
 extern void setImportParameters(string& shimLayerPath, string& fledgePythonDir);
 
 /**
@@ -245,8 +245,10 @@ void filter_plugin_ingest_fn(PLUGIN_HANDLE handle, READINGSET *data)
 
 	// Create a dict of readings
 	// - 1 - Create Python list of dicts as input to the filter
+	// The input readings are removed after the call, so float
+	// array values can be moved to Python without a copy
 	PyObject* readingsList =
-		createReadingsList(((ReadingSet *)data)->getAllReadings());
+		createReadingsList(((ReadingSet *)data)->getAllReadings(), true);
 
 	PyObject* pReturn = PyObject_CallFunction(pFunc,
 						  "OO",
@@ -17,9 +17,11 @@ extern "C" {
 
 typedef void (*INGEST_CB2)(void *, std::vector<Reading *>*);
 std::vector<Reading *>* Py2C_getReadings(PyObject *polledData);
+std::vector<Reading *>* Py2C_getColumnReadings(PyObject *columns);
 Reading* Py2C_parseReadingObject(PyObject *element);
 
 void plugin_ingest_fn(PyObject *ingest_callback, PyObject *ingest_obj_ref_data, PyObject *readingsObj);
+long plugin_ingest_bulk_fn(PyObject *ingest_callback, PyObject *ingest_obj_ref_data, PyObject *readingsObj);
 
 static PyObject *IngestError;
 
@@ -39,8 +41,36 @@ ingest_callback(PyObject *self, PyObject *args)
 	return Py_None;
 }
 
+/**
+ * Bulk variant of ingest_callback
+ *
+ * Accepts either a list of reading dicts or a column oriented
+ * dict (see Py2C_getColumnReadings) and returns the number of
+ * readings passed to the ingest callback.
+ */
+static PyObject *
+ingest_callback_bulk(PyObject *self, PyObject *args)
+{
+	PyObject *readings;
+	PyObject *callback;
+	PyObject *ingestData;
+
+	if (!PyArg_ParseTuple(args, "OOO", &callback, &ingestData, &readings))
+		return NULL;
+
+	long count = plugin_ingest_bulk_fn(callback, ingestData, readings);
+	if (count < 0)
+	{
+		PyErr_SetString(IngestError, "Unable to parse readings object");
+		return NULL;
+	}
+
+	return PyLong_FromLong(count);
+}
+
 static PyMethodDef IngestMethods[] = {
 	{"ingest_callback",  ingest_callback, METH_VARARGS, "Invoke ingest callback"},
+	{"ingest_callback_bulk",  ingest_callback_bulk, METH_VARARGS, "Invoke ingest callback with a list or columns of readings"},
 	{NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -92,4 +122,58 @@ void plugin_ingest_fn(PyObject *ingest_callback, PyObject *ingest_obj_ref_data,
 	else
 		Logger::getLogger()->error("PyC interface: plugin_ingest_fn: Py2C_getReadings() returned NULL");
 }
+
+/**
+ * Convert a bulk readings object and pass it to the ingest callback
+ *
+ * The whole Python object is converted while the GIL is held by the
+ * caller, the GIL is then released while the readings are handed to
+ * the ingest routine so that the plugin threads are not blocked by
+ * the ingest queue locking.
+ *
+ * @param ingest_callback	Capsule of the ingest routine
+ * @param ingest_obj_ref_data	Capsule of the ingest routine data
+ * @param readingsObj		A list of readings or a column oriented dict
+ * @return			Number of readings ingested or -1 on error
+ */
+long plugin_ingest_bulk_fn(PyObject *ingest_callback, PyObject *ingest_obj_ref_data, PyObject *readingsObj)
+{
+	if (ingest_callback == NULL || ingest_obj_ref_data == NULL || readingsObj == NULL)
+	{
+		Logger::getLogger()->error("PyC interface: plugin_ingest_bulk_fn: ingest_callback=%p, ingest_obj_ref_data=%p, readingsObj=%p",
+						ingest_callback, ingest_obj_ref_data, readingsObj);
+		return -1;
+	}
+
+	std::vector<Reading *> *vec;
+	if (PyDict_Check(readingsObj) && PyDict_GetItemString(readingsObj, "columns"))
+		vec = Py2C_getColumnReadings(readingsObj);
+	else
+		vec = Py2C_getReadings(readingsObj);
+
+	if (!vec)
+	{
+		Logger::getLogger()->error("PyC interface: plugin_ingest_bulk_fn: unable to parse readings object");
+		return -1;
+	}
+
+	long count = (long)vec->size();
+	if (count == 0)
+	{
+		delete vec;
+		return 0;
+	}
+
+	INGEST_CB2 cb = (INGEST_CB2) PyCapsule_GetPointer(ingest_callback, NULL);
+	void *data = PyCapsule_GetPointer(ingest_obj_ref_data, NULL);
+
+	Py_BEGIN_ALLOW_THREADS
+	(*cb)(data, vec);
+	Py_END_ALLOW_THREADS
+
+	// Reading objects have been moved to the ingest queue
+	delete vec;
+
+	return count;
+}
 }; // end of extern "C" block
@@ -20,10 +20,12 @@
 #include <sstream>
 #include <unordered_set>
 #include <condition_variable>
+#include <future>
 #include <filter_plugin.h>
 #include <filter_pipeline.h>
 #include <asset_tracking.h>
 #include <service_handler.h>
+#include <ingest_blocks.h>
 
 #define SERVICE_NAME  "Fledge South"
 
@@ -71,6 +73,7 @@ private:
 						std::lock_guard<std::mutex> guard(m_statsMutex);
 						m_statsCv.notify_all();
 					};
+	void				blockStored(std::vector<Reading *> *data, bool resent);
 
 	StorageClient&			m_storage;
 	long				m_timeout;
@@ -92,8 +95,7 @@ private:
 	std::condition_variable		m_statsCv;
 	// Data ready to be filtered/sent
 	std::vector<Reading *>*		m_data;
-	std::vector<std::vector<Reading *>*>
-					m_resendQueues;
+	IngestBlocks			m_blocks;
 	std::queue<std::vector<Reading *>*>
 					m_fullQueues;
 	std::mutex			m_fqMutex;
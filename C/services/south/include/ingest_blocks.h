@@ -0,0 +1,60 @@
+#ifndef _INGEST_BLOCKS_H
+#define _INGEST_BLOCKS_H
+/*
+ * Fledge reading ingest.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <reading.h>
+#include <vector>
+#include <deque>
+#include <future>
+#include <functional>
+
+/**
+ * The blocks of readings the ingest class sends to the storage layer.
+ *
+ * One block at a time is appended asynchronously, so that the next block
+ * may pass through the filter pipeline meanwhile. A block whose append
+ * fails is held to be resent, as are the blocks sent after it until it
+ * has been stored, so that the blocks reach the storage layer in the
+ * order they were queued.
+ */
+class IngestBlocks {
+	public:
+		typedef std::vector<Reading *>	Block;
+		/**
+		 * Append a block asynchronously
+		 */
+		typedef std::function<std::future<bool>(const Block&)>	AppendFunction;
+		/**
+		 * Append a block that is being resent
+		 */
+		typedef std::function<bool(const Block&)>		ResendFunction;
+		/**
+		 * Called once a block has been stored, and whether it was
+		 * resent, to release the block
+		 */
+		typedef std::function<void(Block *, bool)>		StoredFunction;
+
+		IngestBlocks(AppendFunction append, ResendFunction resend, StoredFunction stored);
+		~IngestBlocks();
+		void		send(Block *block);
+		void		complete();
+		bool		resend();
+		/**
+		 * Return the number of blocks held to be resent
+		 */
+		size_t		held() const { return m_held.size(); };
+	private:
+		AppendFunction		m_append;
+		ResendFunction		m_resend;
+		StoredFunction		m_stored;
+		std::future<bool>	m_result;
+		Block			*m_sending;
+		std::deque<Block *>	m_held;
+};
+#endif
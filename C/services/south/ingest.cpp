@@ -205,7 +205,14 @@ Ingest::Ingest(StorageClient& storage,
 			m_queueSizeThreshold(threshold),
 			m_serviceName(serviceName),
 			m_pluginName(pluginName),
-			m_mgtClient(mgmtClient)
+			m_mgtClient(mgmtClient),
+			m_blocks([&storage](const IngestBlocks::Block& block) {
+					return storage.readingAppendAsync(block);
+				 },
+				 [&storage](const IngestBlocks::Block& block) {
+					return storage.readingAppend(block);
+				 },
+				 bind(&Ingest::blockStored, this, placeholders::_1, placeholders::_2))
 {
 	m_shutdown = false;
 	m_running = true;
@@ -345,7 +352,7 @@ int nFullQueues;
 
 void Ingest::waitForQueue()
 {
-	if (m_fullQueues.size() > 0 || m_resendQueues.size() > 0)
+	if (m_fullQueues.size() > 0 || m_blocks.held() > 0)
 		return;
 	if (m_running && m_queue->size() < m_queueSizeThreshold)
 	{
@@ -380,6 +387,12 @@ void Ingest::waitForQueue()
  * is created and the old one moved to a local variable. This minimise
  * the time we hold the queue mutex to the time it takes to swap two
  * variables.
+ *
+ * When several full queues are waiting the append of one block is left
+ * in flight whilst the next block is passed through the filter pipeline.
+ * Only one append is outstanding at a time, and blocks are held behind
+ * a block that failed until it has been resent, so that blocks reach the
+ * storage layer in the order they were queued.
  */
 void Ingest::processQueue()
 {
@@ -388,39 +401,9 @@ void Ingest::processQueue()
 		 * If we have some data that has been previously filtered but failed to send,
 		 * then first try to send that data.
 		 */
-		while (m_resendQueues.size() > 0)
+		if (m_blocks.held())
 		{
-			vector<Reading *> *q = *m_resendQueues.begin();
-			if (m_storage.readingAppend(*q) == false)
-			{
-				m_logger->error("Still unable to resend buffered data, leaving on resend queue.");
-			}
-			else
-			{
-				std::map<std::string, int>		statsEntriesCurrQueue;
-				AssetTracker *tracker = AssetTracker::getAssetTracker();
-				for (vector<Reading *>::iterator it = q->begin();
-							 it != q->end(); ++it)
-				{
-					Reading *reading = *it;
-					string assetName = reading->getAssetName();
-					if (statsPendingEntries.find(assetName) != statsPendingEntries.end())
-					{
-						AssetTrackingTuple tuple(m_serviceName, m_pluginName, assetName, "Ingest");
-						if (!tracker->checkAssetTrackingCache(tuple))
-						{
-							tracker->addAssetTrackingTuple(tuple);
-						}
-					}
-					++statsEntriesCurrQueue[assetName];
-					delete reading;
-				}
-				delete q;
-				m_resendQueues.erase(m_resendQueues.begin());
-				unique_lock<mutex> lck(m_statsMutex);
-				for (auto &it : statsEntriesCurrQueue)
-					statsPendingEntries[it.first] += it.second;
-			}
+			m_blocks.resend();
 		}
 
 		{
@@ -473,7 +456,7 @@ void Ingest::processQueue()
 					ReadingSet *readingSet = new ReadingSet(m_data);
 					m_data->clear();
 					// Pass readingSet to filter chain
-					firstFilter->ingest(readingSet);
+					m_filterPipeline->ingest(readingSet);
 
 					/*
 					 * If filtering removed all the readings then simply clean up m_data and
@@ -483,6 +466,7 @@ void Ingest::processQueue()
 					{
 						delete m_data;
 						m_data = NULL;
+						m_blocks.complete();
 						return;
 					}
 				}
@@ -528,36 +512,8 @@ void Ingest::processQueue()
 		 */
 		if (!m_data->empty())
 		{
-			if (m_storage.readingAppend(*m_data) == false)
-			{
-				m_logger->warn("Failed to write readings to storage layer, queue for resend");
-				m_resendQueues.push_back(m_data);
-				m_data = NULL;
-			}
-			else
-			{
-				std::map<std::string, int>		statsEntriesCurrQueue;
-				// check if this requires addition of a new asset tracker tuple
-				// Remove the Readings in the vector
-				AssetTracker *tracker = AssetTracker::getAssetTracker();
-				for (vector<Reading *>::iterator it = m_data->begin(); it != m_data->end(); ++it)
-				{
-					Reading *reading = *it;
-					string	assetName = reading->getAssetName();
-					AssetTrackingTuple tuple(m_serviceName, m_pluginName, assetName, "Ingest");
-					if (!tracker->checkAssetTrackingCache(tuple))
-					{
-						tracker->addAssetTrackingTuple(tuple);
-					}
-					++statsEntriesCurrQueue[assetName];
-					delete reading;
-				}
-				{
-					unique_lock<mutex> lck(m_statsMutex);
-					for (auto &it : statsEntriesCurrQueue)
-						statsPendingEntries[it.first] += it.second;
-				}
-			}
+			m_blocks.send(m_data);
+			m_data = NULL;
 		}
 
 		if (m_data)
@@ -567,6 +523,45 @@ void Ingest::processQueue()
 		}
 		signalStatsUpdate();
 	} while (! m_fullQueues.empty());
+
+	m_blocks.complete();
+	signalStatsUpdate();
+}
+
+/**
+ * Called once a block of readings has been stored, the asset tracking
+ * and statistics are updated and the readings deleted.
+ *
+ * @param data		The block of readings
+ * @param resent	The block was stored when it was resent
+ */
+void Ingest::blockStored(vector<Reading *> *data, bool resent)
+{
+	std::map<std::string, int>		statsEntriesCurrQueue;
+	// check if this requires addition of a new asset tracker tuple
+	// Remove the Readings in the vector
+	AssetTracker *tracker = AssetTracker::getAssetTracker();
+	for (vector<Reading *>::iterator it = data->begin(); it != data->end(); ++it)
+	{
+		Reading *reading = *it;
+		string	assetName = reading->getAssetName();
+		if (!resent || statsPendingEntries.find(assetName) != statsPendingEntries.end())
+		{
+			AssetTrackingTuple tuple(m_serviceName, m_pluginName, assetName, "Ingest");
+			if (!tracker->checkAssetTrackingCache(tuple))
+			{
+				tracker->addAssetTrackingTuple(tuple);
+			}
+		}
+		++statsEntriesCurrQueue[assetName];
+		delete reading;
+	}
+	{
+		unique_lock<mutex> lck(m_statsMutex);
+		for (auto &it : statsEntriesCurrQueue)
+			statsPendingEntries[it.first] += it.second;
+	}
+	delete data;
 }
 
 /**
@@ -648,8 +643,9 @@ void Ingest::passToOnwardFilter(OUTPUT_HANDLE *outHandle,
  *	the m_data vector is in the ReadingSet passed in here.
  *
  *	2. The filtering has created new ReadingSet in which case
- *	the reading vector must be copied into m_data from the
- *	ReadingSet.
+ *	the reading vector must be appended to m_data from the
+ *	ReadingSet. The readings are appended as the pipeline may
+ *	output more than one set for the same block of readings.
  *
  * Note:
  * This routine must be passed to last filter "plugin_init" only
@@ -665,8 +661,8 @@ void Ingest::useFilteredData(OUTPUT_HANDLE *outHandle,
 	Ingest* ingest = (Ingest *)outHandle;
 	if (ingest->m_data != readingSet->getAllReadingsPtr())
 	{
-		ingest->m_data->clear();// Remove any pointers still in the vector
-		*(ingest->m_data) = readingSet->getAllReadings();
+		const vector<Reading *>& readings = readingSet->getAllReadings();
+		ingest->m_data->insert(ingest->m_data->end(), readings.begin(), readings.end());
 	}
 	readingSet->clear();
 	delete readingSet;
@@ -761,7 +757,7 @@ size_t Ingest::queueLength()
 
 	// Approximate the amount of data in the full queues
 	len += m_fullQueues.size() * m_queueSizeThreshold;
-	len += m_resendQueues.size() * m_queueSizeThreshold;
+	len += m_blocks.held() * m_queueSizeThreshold;
 
 	return len;
 }
@@ -0,0 +1,95 @@
+/*
+ * Fledge reading ingest.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <ingest_blocks.h>
+#include <logger.h>
+
+using namespace std;
+
+/**
+ * Construct the blocks sent by an ingest class
+ *
+ * @param append	The function that appends a block asynchronously
+ * @param resend	The function that appends a block that is resent
+ * @param stored	The function called once a block has been stored
+ */
+IngestBlocks::IngestBlocks(AppendFunction append, ResendFunction resend, StoredFunction stored) :
+	m_append(append), m_resend(resend), m_stored(stored), m_sending(NULL)
+{
+}
+
+/**
+ * Wait for the block in flight, the blocks held are left to the caller
+ */
+IngestBlocks::~IngestBlocks()
+{
+	complete();
+}
+
+/**
+ * Send a block of readings. The append of the block before it is waited
+ * for, if that or an earlier block has not been stored this block is held
+ * behind it rather than sent.
+ *
+ * @param block		The block of readings
+ */
+void IngestBlocks::send(Block *block)
+{
+	complete();
+	if (!m_held.empty())
+	{
+		m_held.push_back(block);
+		return;
+	}
+	m_sending = block;
+	m_result = m_append(*m_sending);
+}
+
+/**
+ * Wait for the append of the block in flight to complete. If the append
+ * failed the block is held for resend.
+ */
+void IngestBlocks::complete()
+{
+	if (m_sending == NULL)
+	{
+		return;
+	}
+	Block *block = m_sending;
+	m_sending = NULL;
+	if (m_result.get() == false)
+	{
+		Logger::getLogger()->warn("Failed to write readings to storage layer, queue for resend");
+		m_held.push_back(block);
+		return;
+	}
+	m_stored(block, false);
+}
+
+/**
+ * Resend the blocks held, in the order they were sent, stopping at the
+ * first that still can not be stored.
+ *
+ * @return bool		True if no blocks are held
+ */
+bool IngestBlocks::resend()
+{
+	complete();
+	while (!m_held.empty())
+	{
+		Block *block = m_held.front();
+		if (!m_resend(*block))
+		{
+			Logger::getLogger()->error("Still unable to resend buffered data, leaving on resend queue.");
+			return false;
+		}
+		m_held.pop_front();
+		m_stored(block, true);
+	}
+	return true;
+}
@@ -20,6 +20,9 @@ static const char *defaultConfiguration =
 " { \"plugin\" : { \"value\" : \"sqlite\", \"description\" : \"The main storage plugin to load\"},"
 " \"readingPlugin\" : { \"value\" : \"\", \"description\" : \"The storage plugin to load for readings data. If blank the main storage plugin is used.\"},"
 " \"threads\" : { \"value\" : \"1\", \"description\" : \"The number of threads to run\" },"
+" \"workerThreads\" : { \"value\" : \"4\", \"description\" : \"The number of threads that process readings requests\" },"
+" \"workerQueueSize\" : { \"value\" : \"100\", \"description\" : \"The maximum number of queued readings requests of each type before requests are rejected\" },"
+" \"readingCacheSize\" : { \"value\" : \"10000\", \"description\" : \"The number of recently fetched readings held in memory, 0 disables the cache\" },"
 " \"managedStatus\" : { \"value\" : \"false\", \"description\" : \"Control if Fledge should manage the storage provider\" },"
 " \"port\" : { \"value\" : \"0\", \"description\" : \"The port to listen on\" },"
 " \"managementPort\" : { \"value\" : \"0\", \"description\" : \"The management port to listen on.\" } }";
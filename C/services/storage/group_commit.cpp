@@ -0,0 +1,248 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <group_commit.h>
+#include <logger.h>
+#include <chrono>
+#include <vector>
+#include <ctype.h>
+
+using namespace std;
+
+/**
+ * Construct the group commit stage
+ *
+ * @param append	The function that appends a readings payload
+ */
+GroupCommit::GroupCommit(AppendFunction append) : m_append(append), m_committing(false)
+{
+}
+
+/**
+ * Append a readings payload, possibly as part of a group with other
+ * payloads appended at the same time. The call returns once the readings
+ * have been committed.
+ *
+ * @param payload	The JSON readings payload
+ * @param error		Set to the error payload if the append fails
+ * @return int		The number of readings appended or -1 on failure
+ */
+int GroupCommit::append(const string& payload, string& error)
+{
+	Entry entry(payload);
+
+	unique_lock<mutex> lck(m_mutex);
+	m_queue.push_back(&entry);
+	m_cv.notify_all();
+	while (!entry.done && (m_committing || m_queue.front() != &entry))
+	{
+		m_cv.wait(lck);
+	}
+	if (entry.done)
+	{
+		error = entry.error;
+		return entry.result;
+	}
+
+	// This thread is the leader for the next group. If other appends are
+	// already queued wait for more to join, otherwise commit at once
+	m_committing = true;
+	if (m_queue.size() > 1)
+	{
+		auto deadline = chrono::steady_clock::now() + chrono::milliseconds(GROUP_COMMIT_WINDOW);
+		while (m_queue.size() < GROUP_COMMIT_MAX
+				&& m_cv.wait_until(lck, deadline) == cv_status::no_timeout)
+			;
+	}
+	deque<Entry *> group;
+	size_t bytes = 0;
+	while (!m_queue.empty() && group.size() < GROUP_COMMIT_MAX
+			&& (group.empty() || bytes + m_queue.front()->payload.length() < GROUP_COMMIT_MAX_BYTES))
+	{
+		bytes += m_queue.front()->payload.length();
+		group.push_back(m_queue.front());
+		m_queue.pop_front();
+	}
+	lck.unlock();
+
+	commit(group);
+
+	lck.lock();
+	for (auto& e : group)
+	{
+		e->done = true;
+	}
+	m_committing = false;
+	m_cv.notify_all();
+	error = entry.error;
+	return entry.result;
+}
+
+/**
+ * Commit a group of appends. The payloads are merged into a single
+ * readings array and appended in one call, if this fails each payload
+ * is appended individually.
+ *
+ * @param group		The appends to commit
+ */
+void GroupCommit::commit(deque<Entry *>& group)
+{
+	vector<Entry *> merge, single;
+
+	if (group.size() > 1)
+	{
+		for (auto& e : group)
+		{
+			if ((e->count = readingsArray(e->payload, e->start, e->end)) >= 0)
+			{
+				merge.push_back(e);
+			}
+			else
+			{
+				single.push_back(e);
+			}
+		}
+	}
+	if (merge.size() > 1)
+	{
+		string merged = "{ \"readings\" : [ ";
+		bool first = true;
+		for (auto& e : merge)
+		{
+			if (e->count == 0)
+			{
+				continue;
+			}
+			if (!first)
+			{
+				merged += ", ";
+			}
+			merged.append(e->payload, e->start, e->end - e->start);
+			first = false;
+		}
+		merged += " ] }";
+		string error;
+		if (m_append(merged, error) != -1)
+		{
+			for (auto& e : merge)
+			{
+				e->result = e->count;
+			}
+			return;
+		}
+		Logger::getLogger()->warn("Group append of %d requests failed, appending individually",
+				merge.size());
+		single.insert(single.end(), merge.begin(), merge.end());
+	}
+	else
+	{
+		single.assign(group.begin(), group.end());
+	}
+	for (auto& e : single)
+	{
+		e->result = m_append(e->payload, e->error);
+	}
+}
+
+/**
+ * Locate the array of readings in a payload of the form
+ * { "readings" : [ ... ] }. Payloads with any other structure are not
+ * merged with others.
+ *
+ * @param payload	The JSON payload
+ * @param start		Set to the offset of the first character in the array
+ * @param end		Set to the offset of the closing bracket of the array
+ * @return int		The number of elements in the array or -1
+ */
+int GroupCommit::readingsArray(const string& payload, size_t& start, size_t& end)
+{
+	const char *p = payload.c_str();
+	size_t len = payload.length();
+	size_t i = 0;
+	static const char key[] = "\"readings\"";
+
+	while (i < len && isspace(p[i])) i++;
+	if (i == len || p[i++] != '{')
+		return -1;
+	while (i < len && isspace(p[i])) i++;
+	if (payload.compare(i, sizeof(key) - 1, key) != 0)
+		return -1;
+	i += sizeof(key) - 1;
+	while (i < len && isspace(p[i])) i++;
+	if (i == len || p[i++] != ':')
+		return -1;
+	while (i < len && isspace(p[i])) i++;
+	if (i == len || p[i++] != '[')
+		return -1;
+	start = i;
+
+	size_t j = len;
+	while (j > start && isspace(p[j - 1])) j--;
+	if (j == start || p[--j] != '}')
+		return -1;
+	while (j > start && isspace(p[j - 1])) j--;
+	if (j == start || p[--j] != ']')
+		return -1;
+	end = j;
+	return countElements(p + start, end - start);
+}
+
+/**
+ * Count the elements of a JSON array without parsing them, checking
+ * that the brackets and strings within it are balanced.
+ *
+ * @param array		The content of the array, without the brackets
+ * @param length	The length of the content
+ * @return int		The number of elements or -1 if the array is not well formed
+ */
+int GroupCommit::countElements(const char *array, size_t length)
+{
+	int	depth = 0, count = 0;
+	bool	inString = false, escape = false, empty = true;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		char c = array[i];
+		if (inString)
+		{
+			if (escape)
+				escape = false;
+			else if (c == '\\')
+				escape = true;
+			else if (c == '"')
+				inString = false;
+			continue;
+		}
+		if (!isspace(c))
+			empty = false;
+		switch (c)
+		{
+			case '"':
+				inString = true;
+				break;
+			case '{':
+			case '[':
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (--depth < 0)
+					return -1;
+				break;
+			case ',':
+				if (depth == 0)
+					count++;
+				break;
+		}
+	}
+	if (inString || depth != 0)
+	{
+		return -1;
+	}
+	return empty ? 0 : count + 1;
+}
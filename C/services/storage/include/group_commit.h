@@ -0,0 +1,66 @@
+#ifndef _GROUP_COMMIT_H
+#define _GROUP_COMMIT_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <string>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#define GROUP_COMMIT_WINDOW	2	// Milliseconds to wait for further appends to join a group
+#define GROUP_COMMIT_MAX	64	// Maximum number of appends merged into one group
+#define GROUP_COMMIT_MAX_BYTES	(4 * 1024 * 1024)	// Maximum size of a merged payload
+
+/**
+ * Merges reading appends that are made concurrently into a single call
+ * to the storage plugin, and so a single database transaction.
+ *
+ * The first thread to append becomes the leader and commits the group.
+ * Appends that arrive while a group is being committed are queued and
+ * form the next group, whose leader waits briefly for other appends to
+ * join it. A single append with no other append queued is committed at
+ * once.
+ * Should the merged append fail each payload in the group is appended on
+ * its own, so that one bad payload only fails the request that sent it.
+ */
+class GroupCommit {
+	public:
+		/**
+		 * The function used to append a readings payload. Returns the
+		 * number of readings appended or -1, setting the error payload.
+		 */
+		typedef std::function<int(const std::string& payload, std::string& error)>
+							AppendFunction;
+
+		GroupCommit(AppendFunction append);
+		int		append(const std::string& payload, std::string& error);
+		static int	readingsArray(const std::string& payload, size_t& start, size_t& end);
+		static int	countElements(const char *array, size_t length);
+	private:
+		class Entry {
+			public:
+				Entry(const std::string& payload) : payload(payload), start(0), end(0),
+							count(-1), result(-1), done(false) {};
+				const std::string&	payload;
+				size_t			start;
+				size_t			end;
+				int			count;
+				std::string		error;
+				int			result;
+				bool			done;
+		};
+		void		commit(std::deque<Entry *>& group);
+		AppendFunction			m_append;
+		std::deque<Entry *>		m_queue;
+		std::mutex			m_mutex;
+		std::condition_variable		m_cv;
+		bool				m_committing;
+};
+#endif
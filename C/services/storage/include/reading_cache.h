@@ -0,0 +1,72 @@
+#ifndef _READING_CACHE_H
+#define _READING_CACHE_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <json_provider.h>
+#include <string>
+#include <deque>
+#include <mutex>
+
+#define READING_CACHE_SIZE	10000	// Default number of readings held in the cache
+
+/**
+ * A bounded cache of the most recent readings returned by the storage
+ * plugin to readings fetch requests, held as serialised JSON keyed by
+ * reading id.
+ *
+ * The cache holds a contiguous range of ids, every reading in the range
+ * that is in the storage plugin is in the cache. A fetch is answered from
+ * the cache only if all the readings requested are within this range,
+ * so the result is the same as the plugin would return. Results of
+ * fetches from the plugin that adjoin the range extend it, the oldest
+ * readings are discarded once the cache is full.
+ *
+ * North tasks that are up to date fetch the same readings shortly after
+ * one another, the first fetch populates the cache and the others, or
+ * any retry, are answered from memory.
+ *
+ * Once the cache holds the most recent readings it follows the appends:
+ * plugins that return the readings of an append, with the ids they have
+ * given them, as a fetch would return them have these added to the
+ * cache without reading them back. A north task that reads the readings
+ * just appended is then answered from memory.
+ *
+ * The cache is cleared when the service purges readings. Readings the
+ * plugin removes itself are seen by a change of the plugin purge
+ * generation, which is passed to purged before each fetch.
+ */
+class ReadingCache final : public JSONProvider {
+	public:
+		ReadingCache(unsigned int size = READING_CACHE_SIZE);
+		bool		fetch(unsigned long id, unsigned int count, std::string& payload);
+		unsigned long	generation();
+		void		update(unsigned long generation, unsigned long id,
+					const std::string& payload);
+		bool		tail(unsigned long& generation, unsigned long& id);
+		void		appended(unsigned long generation, unsigned long id,
+					unsigned int count, const std::string& payload);
+		void		clear();
+		void		purged(unsigned long pluginGeneration);
+		void		asJSON(std::string& json) const;
+	private:
+		typedef std::pair<unsigned long, std::string>	Row;
+		bool		parse(const std::string& payload, std::deque<Row>& rows);
+		void		merge(unsigned long generation, unsigned long id,
+					std::deque<Row>& rows);
+		std::deque<Row>		m_rows;
+		unsigned long		m_low;
+		unsigned long		m_high;
+		unsigned int		m_size;
+		unsigned long		m_generation;
+		unsigned long		m_pluginGeneration;
+		unsigned long		m_hits;
+		unsigned long		m_misses;
+		mutable std::mutex	m_mutex;
+};
+#endif
@@ -0,0 +1,43 @@
+#ifndef _READING_STREAM_BATCH_H
+#define _READING_STREAM_BATCH_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <stdint.h>
+#include <sys/time.h>
+#include <reading_stream.h>
+#include <reading_batch.h>
+#include <string>
+#include <vector>
+
+#define STREAM_TIMESTAMP_LEN	32	// Length of a formatted user timestamp
+
+/**
+ * A block of readings that has arrived via a stream, as the batch of
+ * readings an append request is converted to. Stream blocks are then
+ * appended as the readings of an append request are, and the readings
+ * payload of an append request can be built for the interests registered.
+ *
+ * The batch refers to the asset codes and readings of the stream, these
+ * must remain valid while the batch is used. The user timestamps are
+ * formatted in UTC with microseconds.
+ */
+class ReadingStreamBatch {
+	public:
+		ReadingStreamBatch(ReadingStream **readings);
+		/**
+		 * Return the batch of the readings of the block
+		 */
+		const ReadingBatch	*batch() const { return &m_batch; };
+		void			payload(std::string& payload) const;
+	private:
+		std::vector<ReadingBatchEntry>	m_entries;
+		std::vector<char>		m_timestamps;
+		ReadingBatch			m_batch;
+};
+#endif
@@ -15,6 +15,10 @@
 #include <storage_stats.h>
 #include <storage_registry.h>
 #include <stream_handler.h>
+#include <storage_workers.h>
+#include <group_commit.h>
+#include <storage_performance.h>
+#include <reading_cache.h>
 
 using namespace std;
 using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
@@ -27,6 +31,7 @@ using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
 #define READING_ACCESS  	"^/storage/reading$"
 #define READING_QUERY   	"^/storage/reading/query"
 #define READING_PURGE   	"^/storage/reading/purge"
+#define READING_LATEST   	"^/storage/reading/latest$"
 #define READING_INTEREST	"^/storage/reading/interest/([A-Za-z\\*][a-zA-Z0-9_%]*)$"
 #define GET_TABLE_SNAPSHOTS	"^/storage/table/([A-Za-z][a-zA-Z_0-9_]*)/snapshot$"
 #define CREATE_TABLE_SNAPSHOT	GET_TABLE_SNAPSHOTS
@@ -59,6 +64,17 @@ public:
 	void	startServer();
 	void	wait();
 	void	stopServer();
+	void	setWorkerPool(const unsigned int threads, const unsigned int queueSize);
+	void	setReadingCache(const unsigned int size);
+	void	queueRequest(WorkerClass workerClass,
+			     StorageEndpoint endpoint,
+			     void (StorageApi::*handler)(shared_ptr<HttpServer::Response>, shared_ptr<HttpServer::Request>),
+			     shared_ptr<HttpServer::Response> response,
+			     shared_ptr<HttpServer::Request> request);
+	void	timedRequest(StorageEndpoint endpoint,
+			     void (StorageApi::*handler)(shared_ptr<HttpServer::Response>, shared_ptr<HttpServer::Request>),
+			     shared_ptr<HttpServer::Response> response,
+			     shared_ptr<HttpServer::Request> request);
 	unsigned short getListenerPort();
 	void	commonInsert(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
 	void	commonSimpleQuery(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
@@ -70,6 +86,7 @@ public:
 	void	readingFetch(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
 	void	readingQuery(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
 	void	readingPurge(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
+	void	readingLatest(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
 	void	readingRegister(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
 	void	readingUnregister(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
 	void	createTableSnapshot(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request);
@@ -80,9 +97,6 @@ public:
 	bool	readingStream(ReadingStream **readings, bool commit);
 	void	printList();
 
-public:
-	std::atomic<int>        m_workers_count;
-
 private:
         static StorageApi       *m_instance;
         HttpServer              *m_server;
@@ -101,7 +115,16 @@ private:
 	void			respond(shared_ptr<HttpServer::Response>, SimpleWeb::StatusCode, const string&);
 	void			internalError(shared_ptr<HttpServer::Response>, const exception&);
 	void			mapError(string&, PLUGIN_ERROR *);
+	int			appendReadings(const string& payload, string& error);
+	int			appendReadingBatch(const ReadingBatch *batch, string& error);
+	void			received(StorageEndpoint endpoint, shared_ptr<HttpServer::Request> request);
+	void			handled(StorageEndpoint endpoint, shared_ptr<HttpServer::Request> request,
+					shared_ptr<HttpServer::Response> response, unsigned long bytesIn);
 	StreamHandler		*streamHandler;
+	StorageWorkers		*m_workers;
+	GroupCommit		*m_groupCommit;
+	StoragePerformance	m_performance;
+	ReadingCache		*m_readingCache;
 };
 
 #endif
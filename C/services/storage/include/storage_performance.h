@@ -0,0 +1,57 @@
+#ifndef _STORAGE_PERFORMANCE_H
+#define _STORAGE_PERFORMANCE_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <json_provider.h>
+#include <latency_histogram.h>
+#include <storage_plugin.h>
+#include <string>
+
+/**
+ * The entry points of the storage API that are timed
+ */
+typedef enum {
+	EndpointCommonInsert = 0,
+	EndpointCommonSimpleQuery,
+	EndpointCommonQuery,
+	EndpointCommonUpdate,
+	EndpointCommonDelete,
+	EndpointReadingAppend,
+	EndpointReadingFetch,
+	EndpointReadingQuery,
+	EndpointReadingPurge,
+	EndpointReadingLatest,
+	EndpointReadingInterest,
+	EndpointSnapshot,
+	EndpointStorageStream,
+	Endpoints
+} StorageEndpoint;
+
+/**
+ * The performance statistics of the storage service. For each entry
+ * point of the storage API a histogram of the time taken to receive
+ * the request content and a histogram of the time taken to handle the
+ * request, including any time queued for a worker, together with the
+ * bytes received and sent. The time spent in each call to the storage
+ * plugins is reported by the plugins themselves.
+ */
+class StoragePerformance : public JSONProvider {
+	public:
+		StoragePerformance();
+		LatencyHistogram	*receive(StorageEndpoint endpoint) { return &m_receive[endpoint]; };
+		LatencyHistogram	*request(StorageEndpoint endpoint) { return &m_request[endpoint]; };
+		void			setPlugins(StoragePlugin *plugin, StoragePlugin *readingPlugin);
+		void			asJSON(std::string& json) const;
+	private:
+		LatencyHistogram	m_receive[Endpoints];
+		LatencyHistogram	m_request[Endpoints];
+		StoragePlugin		*m_plugin;
+		StoragePlugin		*m_readingPlugin;
+};
+#endif
@@ -14,6 +14,8 @@
 #include <plugin_manager.h>
 #include <string>
 #include <reading_stream.h>
+#include <reading_batch.h>
+#include <latency_histogram.h>
 
 #define	STORAGE_PURGE_RETAIN	0x0001U
 #define STORAGE_PURGE_SIZE	0x0002U
@@ -40,10 +42,18 @@ public:
 	int		commonUpdate(const std::string& table, const std::string& payload);
 	int		commonDelete(const std::string& table, const std::string& payload);
 	int		readingsAppend(const std::string& payload);
+	int		readingsAppendBatch(const ReadingBatch *batch);
+	bool		hasAppendBatchSupport() { return readingsAppendBatchPtr != NULL; };
+	int		readingsAppendBatch(const ReadingBatch *batch, char **rows);
+	bool		hasAppendRowsSupport() { return readingsAppendBatchRowsPtr != NULL; };
 	char		*readingsFetch(unsigned long id, unsigned int blksize);
+	char		*readingsLatest(const std::string& asset);
+	bool		hasLatestSupport() { return readingsLatestPtr != NULL; };
 	char		*readingsRetrieve(const std::string& payload);
 	char		*readingsPurge(unsigned long age, unsigned int flags, unsigned long sent);
 	long		*readingsPurge();
+	unsigned long	purgeGeneration();
+	bool		hasPurgeGeneration() { return purgeGenerationPtr != NULL; };
 	void		release(const char *response);
 	int		createTableSnapshot(const std::string& table, const std::string& id);
 	int		loadTableSnapshot(const std::string& table, const std::string& id);
@@ -52,17 +62,40 @@ public:
 	PLUGIN_ERROR	*lastError();
 	bool		hasStreamSupport() { return readingStreamPtr != NULL; };
 	int		readingStream(ReadingStream **stream, bool commit);
+	std::string	performance();
 
 private:
+	/**
+	 * The plugin calls that are timed
+	 */
+	enum PluginCall {
+		CallCommonInsert = 0,
+		CallCommonRetrieve,
+		CallCommonUpdate,
+		CallCommonDelete,
+		CallReadingsAppend,
+		CallReadingsFetch,
+		CallReadingsRetrieve,
+		CallReadingsPurge,
+		CallReadingsLatest,
+		CallReadingStream,
+		CallSnapshot,
+		PluginCalls
+	};
+	LatencyHistogram	m_calls[PluginCalls];
 	PLUGIN_HANDLE	instance;
 	int		(*commonInsertPtr)(PLUGIN_HANDLE, const char *, const char *);
 	char		*(*commonRetrievePtr)(PLUGIN_HANDLE, const char *, const char *);
 	int		(*commonUpdatePtr)(PLUGIN_HANDLE, const char *, const char *);
 	int		(*commonDeletePtr)(PLUGIN_HANDLE, const char *, const char *);
 	int		(*readingsAppendPtr)(PLUGIN_HANDLE, const char *);
+	int		(*readingsAppendBatchPtr)(PLUGIN_HANDLE, const ReadingBatch *);
+	int		(*readingsAppendBatchRowsPtr)(PLUGIN_HANDLE, const ReadingBatch *, char **);
 	char		*(*readingsFetchPtr)(PLUGIN_HANDLE, unsigned long id, unsigned int blksize);
+	char		*(*readingsLatestPtr)(PLUGIN_HANDLE, const char *asset);
 	char		*(*readingsRetrievePtr)(PLUGIN_HANDLE, const char *payload);
 	char		*(*readingsPurgePtr)(PLUGIN_HANDLE, unsigned long age, unsigned int flags, unsigned long sent);
+	unsigned long	(*purgeGenerationPtr)(PLUGIN_HANDLE);
 	void		(*releasePtr)(PLUGIN_HANDLE, const char *payload);
 	int		(*createTableSnapshotPtr)(PLUGIN_HANDLE, const char *, const char *);
 	int		(*loadTableSnapshotPtr)(PLUGIN_HANDLE, const char *, const char *);
@@ -70,6 +103,7 @@ private:
 	char		*(*getTableSnapshotsPtr)(PLUGIN_HANDLE, const char *);
 	int		(*readingStreamPtr)(PLUGIN_HANDLE, ReadingStream **, bool);
 	PLUGIN_ERROR	*(*lastErrorPtr)(PLUGIN_HANDLE);
+	char		*(*performancePtr)(PLUGIN_HANDLE);
 };
 
 #endif
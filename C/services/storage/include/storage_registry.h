@@ -3,17 +3,29 @@
 
 #include <vector>
 #include <queue>
+#include <deque>
 #include <string>
 #include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <client_http.hpp>
 
-typedef std::vector<std::pair<std::string *, std::string *> > REGISTRY;
+#define REGISTRY_DELIVERY_THREADS	4	// Threads delivering notifications to subscribers
+#define REGISTRY_MAX_QUEUED		100	// Payloads queued for a subscriber before the oldest is dropped
+#define REGISTRY_SEND_ATTEMPTS		2	// Attempts to send a payload to a subscriber that refuses the connection
 
 /**
  * StorageRegistry - a class that manages requests from other microservices
  * to register interest in new readings being inserted into the storage layer
  * that match a given asset code, or any asset code "*".
+ *
+ * Registrations are indexed by asset code. Each payload is parsed once
+ * and split into a payload per subscriber URL, these are then delivered
+ * by a pool of threads over a persistent connection to each subscriber.
  */
 class StorageRegistry {
 	public:
@@ -21,21 +33,48 @@ class StorageRegistry {
 		~StorageRegistry();
 		void		registerAsset(const std::string& asset, const std::string& url);
 		void		unregisterAsset(const std::string& asset, const std::string& url);
+		bool		hasInterest();
 		void		process(const std::string& payload);
 		void		run();
 	private:
+		/**
+		 * A URL that has registered for one or more assets, with
+		 * the payloads waiting to be delivered to it
+		 */
+		class Subscriber {
+			public:
+				Subscriber(const std::string& url);
+				~Subscriber();
+				std::string		url;
+				std::string		resource;
+				SimpleWeb::Client<SimpleWeb::HTTP>
+							*client;
+				unsigned int		registrations;
+				std::deque<std::string>	queue;
+				bool			scheduled;
+		};
+		typedef std::shared_ptr<Subscriber>	SubscriberPtr;
+
 		void		processPayload(char *payload);
-		void		sendPayload(const std::string& url, char *payload);
-		void		filterPayload(const std::string& url, char *payload, const std::string& asset);
+		void		deliver(SubscriberPtr subscriber, const std::string& payload);
+		void		send(SubscriberPtr subscriber, const std::string& payload);
+		void		deliveryThread();
 		typedef 	std::pair<time_t, char *> Item;
-		REGISTRY			m_registrations;
+		std::unordered_map<std::string, std::unordered_set<std::string> >
+						m_assets;
+		std::unordered_map<std::string, SubscriberPtr>
+						m_subscribers;
+		std::mutex			m_registrationsMutex;
 		std::queue<StorageRegistry::Item>
 						m_queue;
 		std::mutex			m_qMutex;
 		std::thread			*m_thread;
 		std::condition_variable		m_cv;
-		std::mutex			m_cvMutex;
-		bool				m_running;
+		std::atomic<bool>		m_running;
+		std::deque<SubscriberPtr>	m_ready;
+		std::mutex			m_deliveryMutex;
+		std::condition_variable		m_deliveryCv;
+		std::vector<std::thread>	m_deliveryThreads;
 };
 
 #endif
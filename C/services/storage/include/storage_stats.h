@@ -16,6 +16,8 @@ class StorageStats : public JSONProvider {
 	public:
 		StorageStats();
 		void		asJSON(std::string &) const;
+		void		setWorkers(const JSONProvider *workers) { m_workers = workers; };
+		void		setReadingCache(const JSONProvider *cache) { m_readingCache = cache; };
 		unsigned int commonInsert;
 		unsigned int commonSimpleQuery;
 		unsigned int commonQuery;
@@ -25,5 +27,9 @@ class StorageStats : public JSONProvider {
 		unsigned int readingFetch;
 		unsigned int readingQuery;
 		unsigned int readingPurge;
+		unsigned int readingLatest;
+	private:
+		const JSONProvider	*m_workers;
+		const JSONProvider	*m_readingCache;
 };
 #endif
@@ -0,0 +1,77 @@
+#ifndef _STORAGE_WORKERS_H
+#define _STORAGE_WORKERS_H
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <json_provider.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#define WORKER_POOL_THREADS	4	// Default number of worker threads
+#define WORKER_QUEUE_SIZE	100	// Default maximum number of queued requests per class
+#define WORKER_MAX_WAIT		5000	// Milliseconds after which a lower priority request is run first
+
+/**
+ * The classes of request handled by the worker pool, in priority order
+ */
+typedef enum {
+	WorkerAppend = 0,
+	WorkerFetch,
+	WorkerQuery,
+	WorkerPurge,
+	WorkerClasses
+} WorkerClass;
+
+/**
+ * A fixed size pool of threads that runs the readings requests of the
+ * storage API. Each class of request has its own bounded queue, requests
+ * that can not be queued are rejected so that the caller may return an
+ * overloaded status to the client.
+ *
+ * Idle workers take the oldest request of the highest priority class,
+ * unless a lower priority request has waited longer than WORKER_MAX_WAIT,
+ * so that a continuous stream of appends can not starve purges.
+ */
+class StorageWorkers final : public JSONProvider {
+	public:
+		StorageWorkers(unsigned int threads = WORKER_POOL_THREADS,
+				unsigned int queueSize = WORKER_QUEUE_SIZE);
+		~StorageWorkers();
+		bool		submit(WorkerClass workerClass, const std::function<void()>& task);
+		void		shutdown();
+		void		asJSON(std::string& json) const;
+	private:
+		typedef std::chrono::steady_clock	Clock;
+		typedef std::pair<Clock::time_point, std::function<void()> >
+							Job;
+		class ClassStats {
+			public:
+				ClassStats() : executed(0), rejected(0), totalWait(0), maxWait(0) {};
+				unsigned long	executed;
+				unsigned long	rejected;
+				double		totalWait;
+				double		maxWait;
+		};
+		void		worker();
+		int		nextClass(Clock::time_point now);
+		std::deque<Job>			m_queues[WorkerClasses];
+		ClassStats			m_stats[WorkerClasses];
+		std::vector<std::thread>	m_threads;
+		mutable std::mutex		m_mutex;
+		std::condition_variable		m_cv;
+		unsigned int			m_queueSize;
+		unsigned int			m_busy;
+		bool				m_running;
+};
+#endif
@@ -12,14 +12,17 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <vector>
 #include <map>
 #include <sys/epoll.h>
 #include <reading_stream.h>
+#include <reading_ring.h>
 
 #define MAX_EVENTS	  40	// Number of epoll events in one epoll_wait call
 #define RDS_BLOCK	 10000	// Number of readings to insert in each call to the storage plugin
 #define BLOCK_POOL_SIZES 512	// Increments of block sizes in a block pool
+#define RING_RETRY_TIME	 1000	// Milliseconds before storing a block from the ring is retried
 
 class StorageApi;
 
@@ -36,6 +39,8 @@ class StreamHandler {
 				~Stream();
 				uint32_t	create(int epollfd, uint32_t *token);
 				void		handleEvent(int epollfd, StorageApi *api, uint32_t events);
+				void		retryRing(int epollfd, StorageApi *api);
+				bool		isClosed() { return m_status == Closed; };
 			private:
 				/**
 				 * A simple memory pool we use to store the messages we receive.
@@ -62,15 +67,27 @@ class StreamHandler {
 									m_pool;
 					};
 					void		setNonBlocking(int fd);
+					void		createUnixListener(int epollfd);
+					void		closeUnixListener(int epollfd);
 					int		available(int fd);
+					void		readBlocks(int epollfd, StorageApi *api);
 					void		queueInsert(StorageApi *api, unsigned int nReadings, bool commit);
+					bool		acknowledge(int epollfd, bool complete = true);
+					bool		receiveToken(int epollfd);
+					void		consumeRing(StorageApi *api);
+					bool		insertRingBlock(StorageApi *api, const std::string& block);
+					void		closeConnection(int epollfd);
 					void		dump(int n);
-					enum { Closed, Listen, AwaitingToken, Connected }
+					enum { Closed, Listen, AwaitingToken, Connected, RingConnected }
 				       			m_status;
 					int		m_socket;
+					int		m_unixSocket;
 					uint32_t	m_port;
 					uint32_t	m_token;
 					uint32_t	m_blockNo;
+					uint32_t	m_currentBlock;
+					bool		m_blockFailed;
+					uint32_t	m_blockStored;
 					enum { BlkHdr, RdHdr, RdBody }
 				       			m_protocolState;
 					uint32_t	m_readingNo;
@@ -81,6 +98,13 @@ class StreamHandler {
 					ReadingStream	*m_readings[RDS_BLOCK+1];
 					ReadingStream	*m_currentReading;
 					MemoryPool	*m_blockPool;
+					ReadingRing	*m_ring;
+					// Readings of the block at the head of the ring already stored
+					uint32_t	m_ringStored;
+					bool		m_ringFailed;
+					bool		m_ringClosing;
+					std::chrono::steady_clock::time_point
+							m_ringRetry;
 					std::string	m_lastAsset;
 					bool		m_sameAsset;
 		};
@@ -0,0 +1,264 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <reading_cache.h>
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Construct an empty reading cache
+ *
+ * @param size	The maximum number of readings to hold
+ */
+ReadingCache::ReadingCache(unsigned int size) : m_low(0), m_high(0), m_size(size),
+	m_generation(0), m_pluginGeneration(0), m_hits(0), m_misses(0)
+{
+}
+
+/**
+ * Answer a readings fetch from the cache
+ *
+ * @param id		The id of the first reading to return
+ * @param count		The number of readings to return
+ * @param payload	Set to the readings if they are all in the cache
+ * @return bool		True if the fetch was answered from the cache
+ */
+bool ReadingCache::fetch(unsigned long id, unsigned int count, string& payload)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (count == 0 || m_rows.empty() || id < m_low || id > m_high)
+	{
+		m_misses++;
+		return false;
+	}
+	auto first = lower_bound(m_rows.begin(), m_rows.end(), id,
+			[](const Row& row, unsigned long id) { return row.first < id; });
+	if ((unsigned long)(m_rows.end() - first) < count)
+	{
+		m_misses++;
+		return false;
+	}
+	payload = "{\"count\":" + to_string(count) + ",\"rows\":[";
+	for (auto it = first; it != first + count; ++it)
+	{
+		if (it != first)
+		{
+			payload += ',';
+		}
+		payload += it->second;
+	}
+	payload += "]}";
+	m_hits++;
+	return true;
+}
+
+/**
+ * Return the generation of the cache, this changes each time the cache
+ * is cleared. It is taken before fetching readings from the plugin so
+ * that readings fetched before a purge are not added to the cache.
+ *
+ * @return unsigned long	The cache generation
+ */
+unsigned long ReadingCache::generation()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_generation;
+}
+
+/**
+ * Add the result of a readings fetch from the plugin to the cache.
+ *
+ * @param generation	The cache generation before the readings were fetched
+ * @param id		The id of the first reading requested
+ * @param payload	The readings returned by the plugin
+ */
+void ReadingCache::update(unsigned long generation, unsigned long id, const string& payload)
+{
+	deque<Row> rows;
+	if (m_size == 0 || !parse(payload, rows))
+	{
+		return;
+	}
+	merge(generation, id, rows);
+}
+
+/**
+ * Return the id the next reading appended is expected to have if the
+ * cache holds the most recent readings, this is taken before appending
+ * readings so that the append can be added to the cache.
+ *
+ * @param generation	Set to the generation of the cache
+ * @param id		Set to the id following the last reading in the cache
+ * @return bool		False if the cache is empty
+ */
+bool ReadingCache::tail(unsigned long& generation, unsigned long& id)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (m_size == 0 || m_rows.empty())
+	{
+		return false;
+	}
+	generation = m_generation;
+	id = m_high + 1;
+	return true;
+}
+
+/**
+ * Add the readings of an append to the cache.
+ *
+ * The payload holds the readings appended, as a fetch returns them,
+ * with the ids the plugin has given them. If the first of them has the
+ * id returned by tail before the append they followed the last reading
+ * in the cache and the range is extended. Otherwise other readings were
+ * added meanwhile and the cache is left as it is.
+ *
+ * @param generation	The cache generation returned by tail
+ * @param id		The id returned by tail
+ * @param count		The number of readings appended
+ * @param payload	The readings appended, returned by the plugin
+ */
+void ReadingCache::appended(unsigned long generation, unsigned long id,
+			    unsigned int count, const string& payload)
+{
+	deque<Row> rows;
+	if (!parse(payload, rows) || rows.size() != count || rows.front().first != id)
+	{
+		return;
+	}
+	merge(generation, id, rows);
+}
+
+/**
+ * Parse the readings returned by the plugin into cache rows
+ *
+ * @param payload	The readings returned by the plugin
+ * @param rows		The rows of the readings
+ * @return bool		False if there are no readings or the payload is invalid
+ */
+bool ReadingCache::parse(const string& payload, deque<Row>& rows)
+{
+	Document doc;
+	if (doc.Parse(payload.c_str()).HasParseError() || !doc.IsObject()
+			|| !doc.HasMember("rows") || !doc["rows"].IsArray())
+	{
+		return false;
+	}
+	const Value& result = doc["rows"];
+	if (result.Size() == 0)
+	{
+		return false;
+	}
+	for (auto& row : result.GetArray())
+	{
+		if (!row.IsObject() || !row.HasMember("id") || !row["id"].IsUint64())
+		{
+			return false;
+		}
+		StringBuffer buffer;
+		Writer<StringBuffer> writer(buffer);
+		row.Accept(writer);
+		rows.push_back(Row(row["id"].GetUint64(), buffer.GetString()));
+	}
+	return true;
+}
+
+/**
+ * Add rows holding every reading from id up to the last row to the cache.
+ *
+ * If this range overlaps or adjoins the range in the cache the cache is
+ * extended, otherwise it replaces the content of the cache.
+ *
+ * @param generation	The cache generation before the readings were fetched
+ * @param id		The id of the first reading requested
+ * @param rows		The rows to add, in id order
+ */
+void ReadingCache::merge(unsigned long generation, unsigned long id, deque<Row>& rows)
+{
+	unsigned long last = rows.back().first;
+
+	lock_guard<mutex> guard(m_mutex);
+	if (generation != m_generation)
+	{
+		return;
+	}
+	if (!m_rows.empty() && id >= m_low && id <= m_high + 1)
+	{
+		for (auto& row : rows)
+		{
+			if (row.first > m_high)
+			{
+				m_rows.push_back(move(row));
+			}
+		}
+		m_high = max(m_high, last);
+	}
+	else
+	{
+		m_rows.swap(rows);
+		m_low = id;
+		m_high = last;
+	}
+	while (m_rows.size() > m_size)
+	{
+		m_rows.pop_front();
+		m_low = m_rows.front().first;
+	}
+}
+
+/**
+ * Discard the content of the cache, called when readings are purged
+ */
+void ReadingCache::clear()
+{
+	lock_guard<mutex> guard(m_mutex);
+	m_rows.clear();
+	m_low = m_high = 0;
+	m_generation++;
+}
+
+/**
+ * Discard the content of the cache if the storage plugin has removed
+ * readings since the last call
+ *
+ * @param pluginGeneration	The purge generation of the plugin
+ */
+void ReadingCache::purged(unsigned long pluginGeneration)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (pluginGeneration != m_pluginGeneration)
+	{
+		m_pluginGeneration = pluginGeneration;
+		m_rows.clear();
+		m_low = m_high = 0;
+		m_generation++;
+	}
+}
+
+/**
+ * Return the cache occupancy and hit rate as JSON
+ *
+ * @param json	The JSON document
+ */
+void ReadingCache::asJSON(string& json) const
+{
+	lock_guard<mutex> guard(m_mutex);
+	ostringstream convert;
+
+	convert << "{ \"size\" : " << m_size << ",";
+	convert << " \"readings\" : " << m_rows.size() << ",";
+	convert << " \"hits\" : " << m_hits << ",";
+	convert << " \"misses\" : " << m_misses << " }";
+
+	json = convert.str();
+}
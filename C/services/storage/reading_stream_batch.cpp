@@ -0,0 +1,82 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <reading_stream_batch.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Construct the batch of a block of readings from a stream
+ *
+ * @param readings	The NULL terminated array of readings of the block
+ */
+ReadingStreamBatch::ReadingStreamBatch(ReadingStream **readings)
+{
+	uint32_t count = 0;
+	while (readings[count])
+	{
+		count++;
+	}
+	m_entries.resize(count);
+	m_timestamps.resize(count * STREAM_TIMESTAMP_LEN);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const ReadingStream *reading = readings[i];
+		ReadingBatchEntry& entry = m_entries[i];
+		char *userTs = &m_timestamps[i * STREAM_TIMESTAMP_LEN];
+		struct tm timeinfo;
+		gmtime_r(&reading->userTs.tv_sec, &timeinfo);
+		int len = strftime(userTs, STREAM_TIMESTAMP_LEN, "%Y-%m-%d %H:%M:%S", &timeinfo);
+		len += snprintf(userTs + len, STREAM_TIMESTAMP_LEN - len, ".%06lu",
+				(unsigned long)reading->userTs.tv_usec);
+
+		// The asset code and the reading are each terminated in the stream
+		entry.assetCode = reading->assetCode;
+		entry.assetCodeLength = strnlen(reading->assetCode, reading->assetCodeLength);
+		entry.userTs = userTs;
+		entry.userTsLength = len;
+		entry.reading = &reading->assetCode[reading->assetCodeLength];
+		entry.readingLength = strnlen(entry.reading, reading->payloadLength);
+	}
+	m_batch.version = READING_BATCH_VERSION;
+	m_batch.count = count;
+	m_batch.readings = m_entries.data();
+}
+
+/**
+ * Build the readings payload of an append request of the readings
+ *
+ * @param payload	Set to the readings payload
+ */
+void ReadingStreamBatch::payload(string& payload) const
+{
+	StringBuffer buffer;
+	Writer<StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("readings");
+	writer.StartArray();
+	for (auto& entry : m_entries)
+	{
+		writer.StartObject();
+		writer.Key("asset_code");
+		writer.String(entry.assetCode, entry.assetCodeLength);
+		writer.Key("user_ts");
+		writer.String(entry.userTs, entry.userTsLength);
+		writer.Key("reading");
+		writer.RawValue(entry.reading, entry.readingLength, kObjectType);
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+	payload.assign(buffer.GetString(), buffer.GetSize());
+}
@@ -209,6 +209,23 @@ unsigned short servicePort;
 
 
 	api = new StorageApi(servicePort, threads);
+
+	unsigned int workerThreads = WORKER_POOL_THREADS;
+	if (config->hasValue("workerThreads"))
+	{
+		workerThreads = (unsigned int)atoi(config->getValue("workerThreads"));
+	}
+	unsigned int workerQueueSize = WORKER_QUEUE_SIZE;
+	if (config->hasValue("workerQueueSize"))
+	{
+		workerQueueSize = (unsigned int)atoi(config->getValue("workerQueueSize"));
+	}
+	api->setWorkerPool(workerThreads, workerQueueSize);
+
+	if (config->hasValue("readingCacheSize"))
+	{
+		api->setReadingCache((unsigned int)atoi(config->getValue("readingCacheSize")));
+	}
 }
 
 /**
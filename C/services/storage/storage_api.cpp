@@ -15,6 +15,8 @@
 #include "logger.h"
 #include "plugin_exception.h"
 #include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
 #include <atomic>
 
 // Added for the default_resource example
@@ -26,12 +28,9 @@
 #endif
 
 #include <string_utils.h>
-
-// Enable worker threads for readings append and fetch
-#define WORKER_THREADS		1
-
-// Threshold for logging number of threads in use for some "readings" wrappers
-#define MAX_WORKER_THREADS	5
+#include <unix_socket.h>
+#include <readings_payload.h>
+#include <reading_stream_batch.h>
 
 /**
  * Definition of the Storage Service REST API
@@ -59,7 +58,7 @@ using HttpClient = SimpleWeb::Client<SimpleWeb::HTTP>;
 void commonInsertWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->commonInsert(response, request);
+	api->timedRequest(EndpointCommonInsert, &StorageApi::commonInsert, response, request);
 }
 
 /**
@@ -68,7 +67,7 @@ void commonInsertWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<H
 void commonUpdateWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->commonUpdate(response, request);
+	api->timedRequest(EndpointCommonUpdate, &StorageApi::commonUpdate, response, request);
 }
 
 /**
@@ -77,7 +76,7 @@ void commonUpdateWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<H
 void commonDeleteWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->commonDelete(response, request);
+	api->timedRequest(EndpointCommonDelete, &StorageApi::commonDelete, response, request);
 }
 
 /**
@@ -86,7 +85,7 @@ void commonDeleteWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<H
 void commonSimpleQueryWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->commonSimpleQuery(response, request);
+	api->timedRequest(EndpointCommonSimpleQuery, &StorageApi::commonSimpleQuery, response, request);
 }
 
 /**
@@ -95,7 +94,7 @@ void commonSimpleQueryWrapper(shared_ptr<HttpServer::Response> response, shared_
 void commonQueryWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->commonQuery(response, request);
+	api->timedRequest(EndpointCommonQuery, &StorageApi::commonQuery, response, request);
 }
 
 /**
@@ -121,73 +120,17 @@ void readingAppendWrapper(shared_ptr<HttpServer::Response> response,
 			  shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-#if WORKER_THREADS
-	std::atomic<int>* cnt = &(api->m_workers_count);
-	// Check rurrent number of workers and log if threshold value is hit
-	int tVal = std::atomic_load(cnt);
-	if (tVal >= MAX_WORKER_THREADS)
-	{
-		Logger::getLogger()->warn("Storage API: readingAppend() is being run by a new thread. "
-					  "Current worker threads count %d exceeds the warning limit of %d"
-					  "%d allowed threads hit.",
-					  tVal,
-					  MAX_WORKER_THREADS);
-	}
-
-	// Start a new thread
-	thread work_thread([api, cnt, response, request]
-	{
-		// Increase count
-		std::atomic_fetch_add(cnt, 1);
-
-		api->readingAppend(response, request);
-
-		// Decrease counter 
-		std::atomic_fetch_sub(cnt, 1);
-	});
-	// Detach the new thread
-	work_thread.detach();
-#else
-	api->readingAppend(response, request);
-#endif
+	api->queueRequest(WorkerAppend, EndpointReadingAppend, &StorageApi::readingAppend, response, request);
 }
 
 /**
  * Wrapper function for the reading fetch API call.
  */
 void readingFetchWrapper(shared_ptr<HttpServer::Response> response,
-			 shared_ptr<HttpServer::Request> request)
+			  shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-#if WORKER_THREADS
-	std::atomic<int>* cnt = &(api->m_workers_count);
-	// Check rurrent number of workers and log if threshold value is hit
-	int tVal = std::atomic_load(cnt);
-	if (tVal >= MAX_WORKER_THREADS)
-	{
-		Logger::getLogger()->warn("Storage API: readingFetch() is being run by a new thread. "
-					  "Current worker threads count %d exceeds the warning limit of %d"
-					  "%d allowed threads hit.",
-					  tVal,
-					  MAX_WORKER_THREADS);
-	}
-
-	// Start a new thread
-	thread work_thread([api, cnt, response, request]
-	{
-		// Increase count
-		std::atomic_fetch_add(cnt, 1);
-
-		api->readingFetch(response, request);
-
-		// Decrease counter 
-		std::atomic_fetch_sub(cnt, 1);
-	});
-	// Detach the new thread
-	work_thread.detach();
-#else
-	api->readingFetch(response, request);
-#endif
+	api->queueRequest(WorkerFetch, EndpointReadingFetch, &StorageApi::readingFetch, response, request);
 }
 
 /**
@@ -197,44 +140,27 @@ void readingQueryWrapper(shared_ptr<HttpServer::Response> response,
 			 shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->readingQuery(response, request);
+	api->queueRequest(WorkerQuery, EndpointReadingQuery, &StorageApi::readingQuery, response, request);
 }
 
 /**
  * Wrapper function for the reading purge API call.
  */
 void readingPurgeWrapper(shared_ptr<HttpServer::Response> response,
-			 shared_ptr<HttpServer::Request> request)
+			  shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-#if WORKER_THREADS
-	std::atomic<int>* cnt = &(api->m_workers_count);
-	// Check rurrent number of workers and log if threshold value is hit
-	int tVal = std::atomic_load(cnt);
-	if (tVal >= MAX_WORKER_THREADS)
-	{
-		Logger::getLogger()->warn("Storage API: readingPurge() is being run by a new thread. "
-					  "Current worker threads count %d exceeds the warning limit of %d"
-					  "%d allowed threads hit.",
-					  tVal,
-					  MAX_WORKER_THREADS);
-	}
-
-	// Start a new thread
-	thread work_thread([api, cnt, response, request]
-	{
-		// Increase count
-		std::atomic_fetch_add(cnt, 1);
+	api->queueRequest(WorkerPurge, EndpointReadingPurge, &StorageApi::readingPurge, response, request);
+}
 
-		api->readingPurge(response, request);
-		// Decrease counter 
-		std::atomic_fetch_sub(cnt, 1);
-	});
-	// Detach the new thread
-	work_thread.detach();
-#else
-	api->readingPurge(response, request);
-#endif
+/**
+ * Wrapper function for the latest readings API call.
+ */
+void readingLatestWrapper(shared_ptr<HttpServer::Response> response,
+			  shared_ptr<HttpServer::Request> request)
+{
+	StorageApi *api = StorageApi::getInstance();
+	api->queueRequest(WorkerQuery, EndpointReadingLatest, &StorageApi::readingLatest, response, request);
 }
 
 /**
@@ -243,7 +169,7 @@ void readingPurgeWrapper(shared_ptr<HttpServer::Response> response,
 void readingRegisterWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->readingRegister(response, request);
+	api->timedRequest(EndpointReadingInterest, &StorageApi::readingRegister, response, request);
 }
 
 /**
@@ -252,7 +178,7 @@ void readingRegisterWrapper(shared_ptr<HttpServer::Response> response, shared_pt
 void readingUnregisterWrapper(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->readingUnregister(response, request);
+	api->timedRequest(EndpointReadingInterest, &StorageApi::readingUnregister, response, request);
 }
 
 /**
@@ -262,7 +188,7 @@ void createTableSnapshotWrapper(shared_ptr<HttpServer::Response> response,
 				shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->createTableSnapshot(response, request);
+	api->timedRequest(EndpointSnapshot, &StorageApi::createTableSnapshot, response, request);
 }
 
 /**
@@ -272,7 +198,7 @@ void loadTableSnapshotWrapper(shared_ptr<HttpServer::Response> response,
 			      shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->loadTableSnapshot(response, request);
+	api->timedRequest(EndpointSnapshot, &StorageApi::loadTableSnapshot, response, request);
 }
 
 /**
@@ -282,7 +208,7 @@ void deleteTableSnapshotWrapper(shared_ptr<HttpServer::Response> response,
 				shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->deleteTableSnapshot(response, request);
+	api->timedRequest(EndpointSnapshot, &StorageApi::deleteTableSnapshot, response, request);
 }
 
 /**
@@ -292,7 +218,7 @@ void getTableSnapshotsWrapper(shared_ptr<HttpServer::Response> response,
 				shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->getTableSnapshots(response, request);
+	api->timedRequest(EndpointSnapshot, &StorageApi::getTableSnapshots, response, request);
 }
 
 /**
@@ -302,13 +228,14 @@ void createStorageStreamWrapper(shared_ptr<HttpServer::Response> response,
 				shared_ptr<HttpServer::Request> request)
 {
 	StorageApi *api = StorageApi::getInstance();
-	api->createStorageStream(response, request);
+	api->timedRequest(EndpointStorageStream, &StorageApi::createStorageStream, response, request);
 }
 
 /**
  * Construct the singleton Storage API 
  */
-StorageApi::StorageApi(const unsigned short port, const unsigned int threads) : readingPlugin(0), streamHandler(0)
+StorageApi::StorageApi(const unsigned short port, const unsigned int threads) : readingPlugin(0), streamHandler(0),
+	m_workers(0), m_readingCache(0)
 {
 
 	m_port = port;
@@ -316,6 +243,8 @@ StorageApi::StorageApi(const unsigned short port, const unsigned int threads) :
 	m_server = new HttpServer();
 	m_server->config.port = port;
 	m_server->config.thread_pool_size = threads;
+	m_groupCommit = new GroupCommit(bind(&StorageApi::appendReadings, this, placeholders::_1, placeholders::_2));
+	m_readingCache = new ReadingCache();
 	StorageApi::m_instance = this;
 }
 
@@ -345,8 +274,13 @@ unsigned short StorageApi::getListenerPort()
  */
 void StorageApi::initResources()
 {
-	// Initialise workers threads counter
-	m_workers_count = ATOMIC_VAR_INIT(0);
+	if (!m_workers)
+	{
+		m_workers = new StorageWorkers();
+	}
+	stats.setWorkers(m_workers);
+	stats.setReadingCache(m_readingCache);
+	m_performance.setPlugins(plugin, readingPlugin);
 
 	// Initialise the API entry points
 	m_server->resource[COMMON_ACCESS]["POST"] = commonInsertWrapper;
@@ -371,6 +305,7 @@ void StorageApi::initResources()
 	m_server->resource[READING_ACCESS]["GET"] = readingFetchWrapper;
 	m_server->resource[READING_QUERY]["PUT"] = readingQueryWrapper;
 	m_server->resource[READING_PURGE]["PUT"] = readingPurgeWrapper;
+	m_server->resource[READING_LATEST]["GET"] = readingLatestWrapper;
 
 	m_server->resource[CREATE_STORAGE_STREAM]["POST"] = createStorageStreamWrapper;
 
@@ -378,6 +313,7 @@ void StorageApi::initResources()
 
 	ManagementApi *management = ManagementApi::getInstance();
 	management->registerStats(&stats);
+	management->registerPerformance(&m_performance);
 }
 
 void startService()
@@ -392,13 +328,150 @@ void StorageApi::start() {
 	m_thread = new thread(startService);
 }
 
+/**
+ * Start the HTTP server. Once the TCP port is known the server also
+ * listens on a Unix domain socket named after the port, in the sockets
+ * directory of Fledge, which clients on the same host use in preference
+ * to the loopback interface.
+ */
 void StorageApi::startServer() {
-	m_server->start();
+	m_server->start([this](unsigned short port) {
+		SimpleWeb::error_code ec;
+		string name = unixSocketListenName(port);
+		if (name.empty())
+		{
+			Logger::getLogger()->warn("No Unix domain socket may be created for port %d", port);
+			return;
+		}
+		m_server->listen_local(name, ec);
+		if (ec)
+		{
+			Logger::getLogger()->warn("Unable to listen on Unix domain socket for port %d: %s",
+					port, ec.message().c_str());
+		}
+	});
 }
 
 void StorageApi::stopServer() {
 	m_server->stop();
+	if (m_workers)
+	{
+		m_workers->shutdown();
+	}
+}
+
+/**
+ * Create the pool of worker threads that runs the readings requests.
+ * Must be called before initResources to override the default pool.
+ *
+ * @param threads	The number of worker threads
+ * @param queueSize	The maximum number of queued requests for each class of request
+ */
+void StorageApi::setWorkerPool(const unsigned int threads, const unsigned int queueSize)
+{
+	if (m_workers)
+	{
+		delete m_workers;
+	}
+	m_workers = new StorageWorkers(threads, queueSize);
+}
+
+/**
+ * Set the number of recently fetched readings held in memory to answer
+ * readings fetches, a size of zero disables the cache. Must be called
+ * before initResources.
+ *
+ * @param size	The maximum number of readings in the cache
+ */
+void StorageApi::setReadingCache(const unsigned int size)
+{
+	delete m_readingCache;
+	m_readingCache = size ? new ReadingCache(size) : NULL;
+}
+
+/**
+ * Queue a request to be run by the worker pool. If the queue for
+ * the class of request is full the request is rejected with a 503
+ * status, the client should retry the request later.
+ *
+ * @param workerClass	The class of the request
+ * @param endpoint	The entry point the request is timed against
+ * @param handler	The method that handles the request
+ * @param response	The response stream to send the response on
+ * @param request	The HTTP request
+ */
+void StorageApi::queueRequest(WorkerClass workerClass,
+			      StorageEndpoint endpoint,
+			      void (StorageApi::*handler)(shared_ptr<HttpServer::Response>, shared_ptr<HttpServer::Request>),
+			      shared_ptr<HttpServer::Response> response,
+			      shared_ptr<HttpServer::Request> request)
+{
+	unsigned long bytesIn = request->content.size();
+	received(endpoint, request);
+	if (!m_workers->submit(workerClass, [this, endpoint, handler, response, request, bytesIn]() {
+				(this->*handler)(response, request);
+				handled(endpoint, request, response, bytesIn);
+			}))
+	{
+		Logger::getLogger()->warn("Storage service overloaded, rejecting %s %s request",
+				request->method.c_str(), request->path.c_str());
+		respond(response, SimpleWeb::StatusCode::server_error_service_unavailable,
+				"{ \"error\" : \"The storage service is overloaded, retry later\" }");
+	}
+}
+
+/**
+ * Run a request on the HTTP server thread, recording the time taken
+ * to receive and handle it.
+ *
+ * @param endpoint	The entry point the request is timed against
+ * @param handler	The method that handles the request
+ * @param response	The response stream to send the response on
+ * @param request	The HTTP request
+ */
+void StorageApi::timedRequest(StorageEndpoint endpoint,
+			      void (StorageApi::*handler)(shared_ptr<HttpServer::Response>, shared_ptr<HttpServer::Request>),
+			      shared_ptr<HttpServer::Response> response,
+			      shared_ptr<HttpServer::Request> request)
+{
+	unsigned long bytesIn = request->content.size();
+	received(endpoint, request);
+	(this->*handler)(response, request);
+	handled(endpoint, request, response, bytesIn);
+}
+
+/**
+ * Record the time taken to receive the content of a request, from
+ * reading the request header to the request being dispatched.
+ *
+ * @param endpoint	The entry point of the request
+ * @param request	The HTTP request
+ */
+void StorageApi::received(StorageEndpoint endpoint, shared_ptr<HttpServer::Request> request)
+{
+	auto usec = chrono::duration_cast<chrono::microseconds>(
+			chrono::system_clock::now() - request->header_read_time).count();
+	m_performance.receive(endpoint)->record(usec > 0 ? (unsigned long)usec : 0UL);
+}
+
+/**
+ * Record the time taken to handle a request, from reading the request
+ * header to the response being ready to send, and the bytes received
+ * and sent.
+ *
+ * @param endpoint	The entry point of the request
+ * @param request	The HTTP request
+ * @param response	The response to the request
+ * @param bytesIn	The size of the request content
+ */
+void StorageApi::handled(StorageEndpoint endpoint, shared_ptr<HttpServer::Request> request,
+			 shared_ptr<HttpServer::Response> response, unsigned long bytesIn)
+{
+	auto usec = chrono::duration_cast<chrono::microseconds>(
+			chrono::system_clock::now() - request->header_read_time).count();
+	m_performance.request(endpoint)->record(usec > 0 ? (unsigned long)usec : 0UL, bytesIn, response->size());
 }
+
 /**
  * Wait for the HTTP server to shutdown
  */
@@ -739,7 +812,7 @@ string  responsePayload;
 	stats.readingAppend++;
 	try {
 		payload = request->content.string();
-		int rval = (readingPlugin ? readingPlugin : plugin)->readingsAppend(payload);
+		int rval = m_groupCommit->append(payload, responsePayload);
 		if (rval != -1)
 		{
 			registry.process(payload);
@@ -750,7 +823,6 @@ string  responsePayload;
 		}
 		else
 		{
-			mapError(responsePayload, (readingPlugin ? readingPlugin : plugin)->lastError());
 			respond(response, SimpleWeb::StatusCode::client_error_bad_request, responsePayload);
 		}
 
@@ -760,6 +832,81 @@ string  responsePayload;
 	}
 }
 
+/**
+ * Append a payload of readings using the storage plugin. Called by the
+ * group commit stage with either a single request or several merged
+ * requests. If the plugin supports batches of readings the payload is
+ * converted to a batch so that the plugin does not parse it.
+ *
+ * @param payload	The readings payload
+ * @param error		Set to the error payload if the append fails
+ * @return int		The number of readings appended or -1 on failure
+ */
+int StorageApi::appendReadings(const string& payload, string& error)
+{
+	StoragePlugin *appendPlugin = readingPlugin ? readingPlugin : plugin;
+	ReadingsPayload batch;
+	if (appendPlugin->hasAppendBatchSupport() && batch.parse(payload.c_str()))
+	{
+		return appendReadingBatch(batch.batch(), error);
+	}
+	int rval = appendPlugin->readingsAppend(payload);
+	if (rval == -1)
+	{
+		mapError(error, appendPlugin->lastError());
+	}
+	return rval;
+}
+
+/**
+ * Append a batch of readings using the storage plugin, which supports
+ * batches. If the reading cache holds the most recent readings and the
+ * plugin returns the readings of the batch with the ids it has given
+ * them, these are added to the cache for the north tasks to fetch.
+ *
+ * @param batch		The batch of readings
+ * @param error		Set to the error payload if the append fails
+ * @return int		The number of readings appended or -1 on failure
+ */
+int StorageApi::appendReadingBatch(const ReadingBatch *batch, string& error)
+{
+	StoragePlugin *appendPlugin = readingPlugin ? readingPlugin : plugin;
+	int rval;
+	unsigned long generation = 0, next = 0;
+	bool follow = false;
+	if (m_readingCache)
+	{
+		if (appendPlugin->hasPurgeGeneration())
+		{
+			m_readingCache->purged(appendPlugin->purgeGeneration());
+		}
+		follow = m_readingCache->tail(generation, next);
+	}
+	char *rows = NULL;
+	if (follow && appendPlugin->hasAppendRowsSupport())
+	{
+		rval = appendPlugin->readingsAppendBatch(batch, &rows);
+	}
+	else
+	{
+		rval = appendPlugin->readingsAppendBatch(batch);
+	}
+	if (rval == -1)
+	{
+		mapError(error, appendPlugin->lastError());
+	}
+	if (rows)
+	{
+		// The rows hold the ids the plugin has given the readings
+		if (rval > 0)
+		{
+			m_readingCache->appended(generation, next, (unsigned int)rval, rows);
+		}
+		free(rows);
+	}
+	return rval;
+}
+
 /**
  * Fetch a block of readings.
  *
@@ -803,14 +950,32 @@ unsigned long			   count = 0;
 			count = (unsigned)atol(search->second.c_str());
 		}
 
+		StoragePlugin *fetchPlugin = readingPlugin ? readingPlugin : plugin;
+		string res;
+		if (m_readingCache && fetchPlugin->hasPurgeGeneration())
+		{
+			// Discard readings the plugin has since purged itself
+			m_readingCache->purged(fetchPlugin->purgeGeneration());
+		}
+		if (m_readingCache && m_readingCache->fetch(id, count, res))
+		{
+			respond(response, res);
+			return;
+		}
+		unsigned long generation = m_readingCache ? m_readingCache->generation() : 0;
+
 		// Get plugin data
-		char *responsePayload = (readingPlugin ? readingPlugin : plugin)->readingsFetch(id, count);
-		string res = responsePayload;
+		char *responsePayload = fetchPlugin->readingsFetch(id, count);
+		res = responsePayload;
 
 		// Reply to client
 		respond(response, res);
 		// Free plugin data
 		free(responsePayload);
+		if (m_readingCache)
+		{
+			m_readingCache->update(generation, id, res);
+		}
 	} catch (exception ex) {
 		internalError(response, ex);
 	}
@@ -923,6 +1088,10 @@ static std::atomic<bool> already_running(false);
 			already_running.store(false);
 			return;
 		}
+		if (m_readingCache)
+		{
+			m_readingCache->clear();
+		}
 		respond(response, purged);
 		free(purged);
 	}
@@ -945,6 +1114,55 @@ static std::atomic<bool> already_running(false);
 	already_running.store(false);
 }
 
+/**
+ * Return the latest reading of each asset, or of the asset given by the
+ * asset query parameter. The storage plugin keeps the latest reading of
+ * each asset as the readings are appended.
+ *
+ * @param response	The response stream to send the response on
+ * @param request	The HTTP request
+ */
+void StorageApi::readingLatest(shared_ptr<HttpServer::Response> response, shared_ptr<HttpServer::Request> request)
+{
+SimpleWeb::CaseInsensitiveMultimap query;
+string asset;
+
+	stats.readingLatest++;
+	try {
+		StoragePlugin *storage = readingPlugin ? readingPlugin : plugin;
+		if (!storage->hasLatestSupport())
+		{
+			string payload = "{ \"error\" : \"The storage plugin does not keep the latest readings\" }";
+			respond(response, SimpleWeb::StatusCode::server_error_not_implemented, payload);
+			return;
+		}
+
+		query = request->parse_query_string();
+		auto search = query.find("asset");
+		if (search != query.end())
+		{
+			asset = search->second;
+		}
+
+		char *resultSet = storage->readingsLatest(asset);
+		if (resultSet)
+		{
+			string res = resultSet;
+
+			respond(response, res);
+			free(resultSet);
+		}
+		else
+		{
+			string responsePayload;
+			mapError(responsePayload, storage->lastError());
+			respond(response, SimpleWeb::StatusCode::client_error_bad_request, responsePayload);
+		}
+	} catch (exception ex) {
+		internalError(response, ex);
+	}
+}
+
 /**
  * Register interest in readings for an asset
  */
@@ -1059,49 +1277,48 @@ string	responsePayload;
 }
 
 /**
- * Append the readings that have arrived via a stream to the storage plugin
+ * Append the readings that have arrived via a stream to the storage plugin.
+ * The readings are appended as those of an append request are, they are
+ * counted, added to the reading cache and passed to the interests
+ * registered. Plugins that do not support batches of readings are passed
+ * the stream, or a readings payload if they do not support streams either.
  *
  * @param readings	A Null terminiunated array of points to ReadingStream structures
  * @param commit	A flag to commit the readings block
+ * @return bool		True if the readings were stored
  */
 bool StorageApi::readingStream(ReadingStream **readings, bool commit)
 {
-	int c;
-	for (c = 0; readings[c]; c++);
-	Logger::getLogger()->debug("ReadingStream called with %d", c);
-	if ((readingPlugin ? readingPlugin : plugin)->hasStreamSupport())
+	StoragePlugin *streamPlugin = readingPlugin ? readingPlugin : plugin;
+	ReadingStreamBatch block(readings);
+	string payload;
+	int rval;
+
+	Logger::getLogger()->debug("ReadingStream called with %d", block.batch()->count);
+	stats.readingAppend++;
+	if (streamPlugin->hasAppendBatchSupport())
+	{
+		string error;
+		rval = appendReadingBatch(block.batch(), error);
+	}
+	else if (streamPlugin->hasStreamSupport())
 	{
-		return (readingPlugin ? readingPlugin : plugin)->readingStream(readings, commit);
+		rval = streamPlugin->readingStream(readings, commit);
 	}
 	else
 	{
-		// Plugin does not support streaming input
-		ostringstream convert;
-		char	ts[60], micro_s[10];
-		
-
-		convert << "{\"readings\":[";
-		for (int i = 0; readings[i]; i++)
+		block.payload(payload);
+		rval = streamPlugin->readingsAppend(payload);
+	}
+	if (rval >= 0 && registry.hasInterest())
+	{
+		if (payload.empty())
 		{
-			if (i > 0)
-				convert << ",";
-			convert << "{\"asset_code\":\"";
-			convert << readings[i]->assetCode;
-			convert << "\",\"user_ts\":\"";
-			struct tm timeinfo;
-			gmtime_r(&readings[i]->userTs.tv_sec, &timeinfo);
-			std::strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &timeinfo);
-			snprintf(micro_s, sizeof(micro_s), ".%06lu", readings[i]->userTs.tv_usec);
-			convert << ts << micro_s;
-			convert << "\",\"reading\":";
-			convert << &(readings[i]->assetCode[readings[i]->assetCodeLength]);
-			convert << "}";
+			block.payload(payload);
 		}
-		convert << "]}";
-		Logger::getLogger()->debug("Fallback created payload: %s", convert.str().c_str());
-		(readingPlugin ? readingPlugin : plugin)->readingsAppend(convert.str());
-	}	
-	return false;
+		registry.process(payload);
+	}
+	return rval >= 0;
 }
 
 /**
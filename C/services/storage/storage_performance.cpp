@@ -0,0 +1,70 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <storage_performance.h>
+#include <sstream>
+
+using namespace std;
+
+/**
+ * The names of the timed entry points, indexed by StorageEndpoint
+ */
+static const char *endpointNames[] = {
+	"commonInsert", "commonSimpleQuery", "commonQuery", "commonUpdate", "commonDelete",
+	"readingAppend", "readingFetch", "readingQuery", "readingPurge", "readingLatest",
+	"readingInterest", "snapshot", "storageStream"
+};
+
+/**
+ * Construct the performance statistics of the storage service
+ */
+StoragePerformance::StoragePerformance() : m_plugin(0), m_readingPlugin(0)
+{
+}
+
+/**
+ * Set the storage plugins whose calls are reported
+ *
+ * @param plugin	The storage plugin
+ * @param readingPlugin	The readings plugin, if a separate plugin is used for readings
+ */
+void StoragePerformance::setPlugins(StoragePlugin *plugin, StoragePlugin *readingPlugin)
+{
+	m_plugin = plugin;
+	m_readingPlugin = readingPlugin;
+}
+
+/**
+ * Serialise the performance statistics as JSON
+ *
+ * @param json	The JSON document
+ */
+void StoragePerformance::asJSON(string& json) const
+{
+	ostringstream convert;
+
+	convert << "{ \"endpoints\" : {";
+	for (int i = 0; i < Endpoints; i++)
+	{
+		convert << (i ? ", " : " ") << "\"" << endpointNames[i] << "\" : { ";
+		convert << "\"receive\" : " << m_receive[i].toJSON() << ",";
+		convert << " \"request\" : " << m_request[i].toJSON() << " }";
+	}
+	convert << " }";
+	if (m_plugin)
+	{
+		convert << ", \"plugin\" : " << m_plugin->performance();
+	}
+	if (m_readingPlugin && m_readingPlugin != m_plugin)
+	{
+		convert << ", \"readingPlugin\" : " << m_readingPlugin->performance();
+	}
+	convert << " }";
+
+	json = convert.str();
+}
@@ -8,9 +8,28 @@
  * Author: Mark Riddoch
  */
 #include <storage_plugin.h>
+#include <sstream>
+#include <string.h>
 
 using namespace std;
 
+/**
+ * The names of the timed plugin calls, indexed by PluginCall
+ */
+static const char *callNames[] = {
+	"commonInsert", "commonRetrieve", "commonUpdate", "commonDelete",
+	"readingsAppend", "readingsFetch", "readingsRetrieve", "readingsPurge",
+	"readingsLatest", "readingStream", "snapshot"
+};
+
+/**
+ * Return the length of a result returned by the plugin
+ */
+static inline unsigned long resultLength(const char *result)
+{
+	return result ? strlen(result) : 0;
+}
+
 /**
  * Constructor for the class that wraps the storage plugin
  *
@@ -38,12 +57,20 @@ StoragePlugin::StoragePlugin(PLUGIN_HANDLE handle) : Plugin(handle)
 				manager->resolveSymbol(handle, "plugin_common_delete");
 	readingsAppendPtr = (int (*)(PLUGIN_HANDLE, const char *))
 				manager->resolveSymbol(handle, "plugin_reading_append");
+	readingsAppendBatchPtr = (int (*)(PLUGIN_HANDLE, const ReadingBatch *))
+				manager->resolveSymbol(handle, "plugin_reading_append_batch");
+	readingsAppendBatchRowsPtr = (int (*)(PLUGIN_HANDLE, const ReadingBatch *, char **))
+				manager->resolveSymbol(handle, "plugin_reading_append_batch_rows");
 	readingsFetchPtr = (char * (*)(PLUGIN_HANDLE, unsigned long id, unsigned int blksize))
 				manager->resolveSymbol(handle, "plugin_reading_fetch");
+	readingsLatestPtr = (char * (*)(PLUGIN_HANDLE, const char *))
+				manager->resolveSymbol(handle, "plugin_reading_latest");
 	readingsRetrievePtr = (char * (*)(PLUGIN_HANDLE, const char *))
 				manager->resolveSymbol(handle, "plugin_reading_retrieve");
 	readingsPurgePtr = (char * (*)(PLUGIN_HANDLE, unsigned long age, unsigned int flags, unsigned long sent))
 				manager->resolveSymbol(handle, "plugin_reading_purge");
+	purgeGenerationPtr = (unsigned long (*)(PLUGIN_HANDLE))
+				manager->resolveSymbol(handle, "plugin_reading_purge_generation");
 	releasePtr = (void (*)(PLUGIN_HANDLE, const char *))
 				manager->resolveSymbol(handle, "plugin_release");
 	lastErrorPtr = (PLUGIN_ERROR * (*)(PLUGIN_HANDLE))
@@ -63,6 +90,9 @@ StoragePlugin::StoragePlugin(PLUGIN_HANDLE handle) : Plugin(handle)
 	readingStreamPtr =
 			(int (*)(PLUGIN_HANDLE, ReadingStream **, bool))
 			      manager->resolveSymbol(handle, "plugin_readingStream");
+	performancePtr =
+			(char * (*)(PLUGIN_HANDLE))
+			      manager->resolveSymbol(handle, "plugin_performance");
 }
 
 /**
@@ -70,6 +100,8 @@ StoragePlugin::StoragePlugin(PLUGIN_HANDLE handle) : Plugin(handle)
  */
 int StoragePlugin::commonInsert(const string& table, const string& payload)
 {
+	LatencyTimer timer(&m_calls[CallCommonInsert]);
+	timer.bytes(payload.length(), 0);
 	return this->commonInsertPtr(instance, table.c_str(), payload.c_str());
 }
 
@@ -78,7 +110,10 @@ int StoragePlugin::commonInsert(const string& table, const string& payload)
  */
 char *StoragePlugin::commonRetrieve(const string& table, const string& payload)
 {
-	return this->commonRetrievePtr(instance, table.c_str(), payload.c_str());
+	LatencyTimer timer(&m_calls[CallCommonRetrieve]);
+	char *result = this->commonRetrievePtr(instance, table.c_str(), payload.c_str());
+	timer.bytes(payload.length(), resultLength(result));
+	return result;
 }
 
 /**
@@ -86,6 +121,8 @@ char *StoragePlugin::commonRetrieve(const string& table, const string& payload)
  */
 int StoragePlugin::commonUpdate(const string& table, const string& payload)
 {
+	LatencyTimer timer(&m_calls[CallCommonUpdate]);
+	timer.bytes(payload.length(), 0);
 	return this->commonUpdatePtr(instance, table.c_str(), payload.c_str());
 }
 
@@ -94,6 +131,8 @@ int StoragePlugin::commonUpdate(const string& table, const string& payload)
  */
 int StoragePlugin::commonDelete(const string& table, const string& payload)
 {
+	LatencyTimer timer(&m_calls[CallCommonDelete]);
+	timer.bytes(payload.length(), 0);
 	return this->commonDeletePtr(instance, table.c_str(), payload.c_str());
 }
 
@@ -102,15 +141,54 @@ int StoragePlugin::commonDelete(const string& table, const string& payload)
  */
 int StoragePlugin::readingsAppend(const string& payload)
 {
+	LatencyTimer timer(&m_calls[CallReadingsAppend]);
+	timer.bytes(payload.length(), 0);
 	return this->readingsAppendPtr(instance, payload.c_str());
 }
 
+/**
+ * Call the readings append batch method in the plugin
+ */
+int StoragePlugin::readingsAppendBatch(const ReadingBatch *batch)
+{
+	LatencyTimer timer(&m_calls[CallReadingsAppend]);
+	return this->readingsAppendBatchPtr(instance, batch);
+}
+
+/**
+ * Call the readings append batch method in the plugin that also returns
+ * the readings appended, in the form the readings fetch method returns
+ * them. The rows are set to NULL if the plugin can not return them and
+ * must otherwise be freed by the caller.
+ */
+int StoragePlugin::readingsAppendBatch(const ReadingBatch *batch, char **rows)
+{
+	LatencyTimer timer(&m_calls[CallReadingsAppend]);
+	return this->readingsAppendBatchRowsPtr(instance, batch, rows);
+}
+
 /**
  * Call the readings fetch method in the plugin
  */
 char * StoragePlugin::readingsFetch(unsigned long id, unsigned int blksize)
 {
-	return this->readingsFetchPtr(instance, id, blksize);
+	LatencyTimer timer(&m_calls[CallReadingsFetch]);
+	char *result = this->readingsFetchPtr(instance, id, blksize);
+	timer.bytes(0, resultLength(result));
+	return result;
+}
+
+/**
+ * Call the latest readings method in the plugin
+ *
+ * @param asset	The asset code, or empty for every asset
+ */
+char *StoragePlugin::readingsLatest(const string& asset)
+{
+	LatencyTimer timer(&m_calls[CallReadingsLatest]);
+	char *result = this->readingsLatestPtr(instance, asset.empty() ? NULL : asset.c_str());
+	timer.bytes(0, resultLength(result));
+	return result;
 }
 
 /**
@@ -118,7 +196,10 @@ char * StoragePlugin::readingsFetch(unsigned long id, unsigned int blksize)
  */
 char *StoragePlugin::readingsRetrieve(const string& payload)
 {
-	return this->readingsRetrievePtr(instance, payload.c_str());
+	LatencyTimer timer(&m_calls[CallReadingsRetrieve]);
+	char *result = this->readingsRetrievePtr(instance, payload.c_str());
+	timer.bytes(payload.length(), resultLength(result));
+	return result;
 }
 
 /**
@@ -126,9 +207,20 @@ char *StoragePlugin::readingsRetrieve(const string& payload)
  */
 char *StoragePlugin::readingsPurge(unsigned long age, unsigned int flags, unsigned long sent)
 {
+	LatencyTimer timer(&m_calls[CallReadingsPurge]);
 	return this->readingsPurgePtr(instance, age, flags, sent);
 }
 
+/**
+ * Return the purge generation of the plugin. This changes each time the
+ * plugin removes readings other than in response to readingsPurge, for
+ * example a continuous purge or the removal of a partition.
+ */
+unsigned long StoragePlugin::purgeGeneration()
+{
+	return this->purgeGenerationPtr(instance);
+}
+
 /**
  * Release a result from a retrieve
  */
@@ -150,6 +242,7 @@ PLUGIN_ERROR *StoragePlugin::lastError()
  */
 int StoragePlugin::createTableSnapshot(const string& table, const string& id)
 {
+	LatencyTimer timer(&m_calls[CallSnapshot]);
         return this->createTableSnapshotPtr(instance, table.c_str(), id.c_str());
 }
 
@@ -158,6 +251,7 @@ int StoragePlugin::createTableSnapshot(const string& table, const string& id)
  */
 int StoragePlugin::loadTableSnapshot(const string& table, const string& id)
 {
+	LatencyTimer timer(&m_calls[CallSnapshot]);
         return this->loadTableSnapshotPtr(instance, table.c_str(), id.c_str());
 }
 
@@ -166,6 +260,7 @@ int StoragePlugin::loadTableSnapshot(const string& table, const string& id)
  */
 int StoragePlugin::deleteTableSnapshot(const string& table, const string& id)
 {
+	LatencyTimer timer(&m_calls[CallSnapshot]);
         return this->deleteTableSnapshotPtr(instance, table.c_str(), id.c_str());
 }
 
@@ -182,5 +277,35 @@ char *StoragePlugin::getTableSnapshots(const string& table)
  */
 int StoragePlugin::readingStream(ReadingStream **stream, bool commit)
 {
+	LatencyTimer timer(&m_calls[CallReadingStream]);
         return this->readingStreamPtr(instance, stream, commit);
 }
+
+/**
+ * Return the time spent in each call to the plugin as JSON. If the
+ * plugin reports its own performance statistics these are included.
+ *
+ * @return string	The plugin performance as a JSON object
+ */
+string StoragePlugin::performance()
+{
+	ostringstream convert;
+
+	convert << "{ \"calls\" : {";
+	for (int i = 0; i < PluginCalls; i++)
+	{
+		convert << (i ? ", " : " ") << "\"" << callNames[i] << "\" : " << m_calls[i].toJSON();
+	}
+	convert << " }";
+	if (performancePtr)
+	{
+		char *internal = this->performancePtr(instance);
+		if (internal)
+		{
+			convert << ", \"internal\" : " << internal;
+			release(internal);
+		}
+	}
+	convert << " }";
+	return convert.str();
+}
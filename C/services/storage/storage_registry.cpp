@@ -47,13 +47,18 @@ static void worker(StorageRegistry *registry)
  * data arrives for the particular asset.
  *
  * The servce registry maintians a worker thread that is responsible
- * for sending these notifications such that the main flow of data into
- * the storage layer is minimally impacted by the registration and
- * delivery of these messages to interested microservices.
+ * for examining the payloads and a pool of threads that deliver the
+ * notifications, such that the main flow of data into the storage layer
+ * is minimally impacted by the registration and delivery of these
+ * messages to interested microservices.
  */
-StorageRegistry::StorageRegistry()
+StorageRegistry::StorageRegistry() : m_running(true)
 {
 	m_thread = new thread(worker, this);
+	for (int i = 0; i < REGISTRY_DELIVERY_THREADS; i++)
+	{
+		m_deliveryThreads.push_back(thread(&StorageRegistry::deliveryThread, this));
+	}
 }
 
 /**
@@ -62,7 +67,54 @@ StorageRegistry::StorageRegistry()
 StorageRegistry::~StorageRegistry()
 {
 	m_running = false;
+	m_cv.notify_all();
 	m_thread->join();
+	delete m_thread;
+	{
+		lock_guard<mutex> guard(m_deliveryMutex);
+		m_deliveryCv.notify_all();
+	}
+	for (auto& t : m_deliveryThreads)
+	{
+		t.join();
+	}
+}
+
+/**
+ * Create a subscriber for a registered URL
+ *
+ * @param url	The URL to send notifications to
+ */
+StorageRegistry::Subscriber::Subscriber(const string& url) : url(url), client(NULL),
+	registrations(0), scheduled(false)
+{
+	size_t found = url.find("://");
+	size_t start = (found == string::npos) ? 0 : found + 3;
+	size_t found1 = url.find_first_of("/", start);
+	string hostport = url.substr(start, found1 == string::npos ? string::npos : found1 - start);
+	resource = (found1 == string::npos) ? "/" : url.substr(found1);
+	client = new HttpClient(hostport);
+}
+
+/**
+ * Destroy a subscriber, closing the connection to it
+ */
+StorageRegistry::Subscriber::~Subscriber()
+{
+	delete client;
+}
+
+/**
+ * Return if any microservice has registered an interest in an asset,
+ * so that the payload passed to process need only be built if so.
+ *
+ * @return bool		True if there are registrations
+ */
+bool
+StorageRegistry::hasInterest()
+{
+	lock_guard<mutex> guard(m_registrationsMutex);
+	return !m_assets.empty();
 }
 
 /**
@@ -75,7 +127,12 @@ StorageRegistry::~StorageRegistry()
 void
 StorageRegistry::process(const string& payload)
 {
-	if (m_registrations.size() != 0)
+	bool registered;
+	{
+		lock_guard<mutex> guard(m_registrationsMutex);
+		registered = !m_assets.empty();
+	}
+	if (registered)
 	{
 		/*
 		 * We have some registrations so queue a copy of the payload
@@ -103,7 +160,18 @@ StorageRegistry::process(const string& payload)
 void
 StorageRegistry::registerAsset(const string& asset, const string& url)
 {
-	m_registrations.push_back(pair<string *, string *>(new string(asset), new string(url)));
+	lock_guard<mutex> guard(m_registrationsMutex);
+	if (!m_assets[asset].insert(url).second)
+	{
+		// Already registered
+		return;
+	}
+	SubscriberPtr& subscriber = m_subscribers[url];
+	if (!subscriber)
+	{
+		subscriber = SubscriberPtr(new Subscriber(url));
+	}
+	subscriber->registrations++;
 }
 
 /**
@@ -115,18 +183,21 @@ StorageRegistry::registerAsset(const string& asset, const string& url)
 void
 StorageRegistry::unregisterAsset(const string& asset, const string& url)
 {
-	for (auto it = m_registrations.begin(); it != m_registrations.end(); )
+	lock_guard<mutex> guard(m_registrationsMutex);
+	auto it = m_assets.find(asset);
+	if (it == m_assets.end() || it->second.erase(url) == 0)
 	{
-		if (asset.compare(*(it->first)) == 0 && url.compare(*(it->second)) == 0)
-		{
-			delete it->first;
-			delete it->second;
-			it = m_registrations.erase(it);
-		}
-		else
-		{
-			++it;
-        	}
+		return;
+	}
+	if (it->second.empty())
+	{
+		m_assets.erase(it);
+	}
+	auto sub = m_subscribers.find(url);
+	if (sub != m_subscribers.end() && --sub->second->registrations == 0)
+	{
+		// Any queued payloads are still delivered
+		m_subscribers.erase(sub);
 	}
 }
 
@@ -137,13 +208,12 @@ StorageRegistry::unregisterAsset(const string& asset, const string& url)
 void
 StorageRegistry::run()
 {
-	m_running = true;
 	while (m_running)
 	{
 		char *data = NULL;
 		time_t qTime;
 		{
-			unique_lock<mutex> mlock(m_cvMutex);
+			unique_lock<mutex> mlock(m_qMutex);
 			while (m_queue.size() == 0)
 			{
 				m_cv.wait_for(mlock, std::chrono::seconds(REGISTRY_SLEEP_TIME));
@@ -173,143 +243,232 @@ StorageRegistry::run()
 
 /**
  * Process an incoming payload and distribute as required to registered
- * services
+ * services. Subscribers to all assets are sent the payload unchanged,
+ * otherwise the payload is parsed once and each subscriber sent the
+ * readings for the assets it has registered for.
  *
  * @param payload	The payload to potentially distribute
  */
 void
 StorageRegistry::processPayload(char *payload)
 {
-bool allDone = true;
+vector<SubscriberPtr>	all;
+bool			specific;
 
-	// First of all deal with those that registered for all assets
-	for (REGISTRY::const_iterator it = m_registrations.cbegin(); it != m_registrations.cend(); it++)
 	{
-		if (it->first->compare("*") == 0)
-		{
-			sendPayload(*(it->second), payload);
-		}
-		else
+		lock_guard<mutex> guard(m_registrationsMutex);
+		auto it = m_assets.find("*");
+		if (it != m_assets.end())
 		{
-			allDone = false;
+			for (auto& url : it->second)
+			{
+				auto sub = m_subscribers.find(url);
+				if (sub != m_subscribers.end())
+				{
+					all.push_back(sub->second);
+				}
+			}
 		}
+		specific = m_assets.size() > (it == m_assets.end() ? 0 : 1);
+	}
+
+	// First of all deal with those that registered for all assets
+	for (auto& subscriber : all)
+	{
+		deliver(subscriber, payload);
 	}
-	if (allDone)
+	if (!specific)
 	{
 		// No registrations for individual assets, no need to parse payload
 		return;
 	}
-	for (REGISTRY::const_iterator it = m_registrations.cbegin(); it != m_registrations.cend(); it++)
+
+	Document doc;
+	doc.Parse(payload);
+	if (doc.HasParseError())
+	{
+		Logger::getLogger()->error("processPayload: Parse error in payload");
+		return;
+	}
+	if (!doc.HasMember("readings"))
+	{
+		Logger::getLogger()->error("processPayload: payload has no readings object");
+		return;
+	}
+	const Value& readings = doc["readings"];
+	if (!readings.IsArray())
+	{
+		Logger::getLogger()->error("processPayload: payload readings object is not an array");
+		return;
+	}
+
+	/*
+	 * Loop over the readings, look up the subscribers for the asset
+	 * of each one and add the reading to the payload of each of those
+	 * subscribers. The subscribers of each asset are looked up once
+	 * per payload and each reading is converted once.
+	 */
+	unordered_map<string, vector<SubscriberPtr> >		assets;
+	unordered_map<Subscriber *, pair<SubscriberPtr, string> >	payloads;
+	for (auto& reading : readings.GetArray())
 	{
-		if (it->first->compare("*") != 0)
+		if (!reading.IsObject() || !reading.HasMember("asset_code") || !reading["asset_code"].IsString())
 		{
-			try {
-				filterPayload(*(it->second), payload, *(it->first));
-			} catch (const exception& e) {
-				Logger::getLogger()->error("filterPayload: exception %s", e.what());
+			continue;
+		}
+		string asset = reading["asset_code"].GetString();
+		auto subscribers = assets.find(asset);
+		if (subscribers == assets.end())
+		{
+			vector<SubscriberPtr> interested;
+			lock_guard<mutex> guard(m_registrationsMutex);
+			auto it = m_assets.find(asset);
+			if (it != m_assets.end())
+			{
+				for (auto& url : it->second)
+				{
+					auto sub = m_subscribers.find(url);
+					if (sub != m_subscribers.end())
+					{
+						interested.push_back(sub->second);
+					}
+				}
+			}
+			subscribers = assets.insert(make_pair(asset, interested)).first;
+		}
+		if (subscribers->second.empty())
+		{
+			continue;
+		}
+		string json;
+		try {
+			JSONReading value(reading);
+			json = value.toJSON();
+		} catch (const exception& e) {
+			Logger::getLogger()->error("processPayload: exception %s", e.what());
+			continue;
+		}
+		for (auto& subscriber : subscribers->second)
+		{
+			auto& p = payloads[subscriber.get()];
+			if (!p.first)
+			{
+				p.first = subscriber;
+				p.second = "{ \"readings\" : [ ";
+			}
+			else
+			{
+				p.second += ",";
 			}
+			p.second += json;
 		}
 	}
-}
 
+	for (auto& p : payloads)
+	{
+		p.second.second += "] }";
+		deliver(p.second.first, p.second.second);
+	}
+}
 
 /**
- * Send the copy of the payload to the given URL
+ * Queue a payload for delivery to a subscriber. If the subscriber is not
+ * keeping up the oldest queued payload is discarded.
  *
- * @param url		The URL to send the payload to
+ * @param subscriber	The subscriber to send the payload to
  * @param payload	The payload to send
  */
 void
-StorageRegistry::sendPayload(const string& url, char *payload)
+StorageRegistry::deliver(SubscriberPtr subscriber, const string& payload)
 {
-	size_t found = url.find_first_of("://");
-	size_t found1 = url.find_first_of("/", found + 3);
-	string hostport = url.substr(found+3, found1 - found - 3);
-	string resource = url.substr(found1);
-
-	HttpClient client(hostport);
-	try {
-		client.request("POST", resource, payload);
-	} catch (const exception& e) {
-		Logger::getLogger()->error("sendPayload: exception %s sending reading data to interested party %s", e.what(), url.c_str());
+	lock_guard<mutex> guard(m_deliveryMutex);
+	if (subscriber->queue.size() >= REGISTRY_MAX_QUEUED)
+	{
+		Logger::getLogger()->error("Interested party %s is not accepting reading data quickly enough, data has been discarded",
+				subscriber->url.c_str());
+		subscriber->queue.pop_front();
+	}
+	subscriber->queue.push_back(payload);
+	if (!subscriber->scheduled)
+	{
+		subscriber->scheduled = true;
+		m_ready.push_back(subscriber);
+		m_deliveryCv.notify_one();
 	}
 }
 
 /**
- * Send a filtered copy of the payload to the given URL
+ * Send a payload to a subscriber.
  *
- * @param url		The URL to send the payload to
+ * The HTTP client itself reconnects once if the subscriber has closed
+ * the persistent connection. The only failure retried here is a refused
+ * connection, the request has then not reached the subscriber so sending
+ * it again can not deliver the readings twice. Any other failure may have
+ * happened after the subscriber received the request and is not retried.
+ *
+ * @param subscriber	The subscriber to send the payload to
  * @param payload	The payload to send
- * @param asset		The asset code to filter
  */
 void
-StorageRegistry::filterPayload(const string& url, char *payload, const string& asset)
+StorageRegistry::send(SubscriberPtr subscriber, const string& payload)
 {
-ostringstream convert;
-
-	size_t found = url.find_first_of("://");
-	size_t found1 = url.find_first_of("/", found + 3);
-	string hostport = url.substr(found+3, found1 - found - 3);
-	string resource = url.substr(found1);
-
-	// Filter the payload to include just the one asset
-	Document doc;
-	doc.Parse(payload);
-	if (doc.HasParseError())
+	for (int attempt = 0; attempt < REGISTRY_SEND_ATTEMPTS; attempt++)
 	{
-		Logger::getLogger()->error("filterPayload: Parse error in payload");
-		return;
-	}
-	if (!doc.HasMember("readings"))
-	{
-		Logger::getLogger()->error("filterPayload: payload has no readings object");
-		return;
-	}
-	const Value& readings = doc["readings"];
-	if (!readings.IsArray())
-	{
-		Logger::getLogger()->error("filterPayload: payload readings object is not an array");
-		return;
-	}
-	convert << "{ \"readings\" : [ ";
-	int count = 0;
-	/*
-	 * Loop over the readings and create a reading object for
-	 * each, check if it matches the asset name and incldue in the
-	 * new payload if it does. In eother case free that object
-	 * immediately to reduce the memory requirement.
-	 */
-	for (auto& reading : readings.GetArray())
-	{
-		if (reading.IsObject())
-		{
-			JSONReading *value = new JSONReading(reading);
-			if (value->getAssetName().compare(asset) == 0)
+		try {
+			subscriber->client->request("POST", subscriber->resource, payload);
+			return;
+		} catch (const SimpleWeb::system_error& e) {
+			if (e.code() != SimpleWeb::error::connection_refused)
 			{
-				if (count)
-					convert << ",";
-				count++;
-				convert << value->toJSON();
+				Logger::getLogger()->error("deliveryThread: exception %s sending reading data to interested party %s",
+						e.what(), subscriber->url.c_str());
+				return;
 			}
-			delete value;
+		} catch (const exception& e) {
+			Logger::getLogger()->error("deliveryThread: exception %s sending reading data to interested party %s",
+					e.what(), subscriber->url.c_str());
+			return;
 		}
 	}
-	
-	convert << "] }";
+	Logger::getLogger()->error("deliveryThread: interested party %s refused the connection, reading data has been discarded",
+			subscriber->url.c_str());
+}
 
-	/*
-	 * Check if any assets inthe filtered payload
-	 */
-	if (count == 0)
+/**
+ * A delivery thread. Each subscriber is handled by at most one
+ * delivery thread at a time, so payloads are delivered in order and
+ * the connection to the subscriber is reused.
+ */
+void
+StorageRegistry::deliveryThread()
+{
+	unique_lock<mutex> lck(m_deliveryMutex);
+	while (true)
 	{
-		// Nothing to send
-		return;
-	}
+		while (m_ready.empty() && m_running)
+		{
+			m_deliveryCv.wait(lck);
+		}
+		if (m_ready.empty())
+		{
+			return;
+		}
+		SubscriberPtr subscriber = m_ready.front();
+		m_ready.pop_front();
+		string payload = subscriber->queue.front();
+		subscriber->queue.pop_front();
+		lck.unlock();
 
-	HttpClient client(hostport);
-	try {
-		client.request("POST", resource, convert.str());
-	} catch (const exception& e) {
-		Logger::getLogger()->error("filterPayload: exception %s sending reading data to interested party %s", e.what(), url.c_str());
+		send(subscriber, payload);
+
+		lck.lock();
+		if (subscriber->queue.empty())
+		{
+			subscriber->scheduled = false;
+		}
+		else
+		{
+			m_ready.push_back(subscriber);
+		}
 	}
 }
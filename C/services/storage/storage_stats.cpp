@@ -19,7 +19,8 @@ using namespace std;
 StorageStats::StorageStats() : commonInsert(0), commonSimpleQuery(0),
 				commonQuery(0), commonUpdate(0), commonDelete(0),
 				readingAppend(0), readingFetch(0),
-				readingQuery(0), readingPurge(0)
+				readingQuery(0), readingPurge(0), readingLatest(0), m_workers(0),
+				m_readingCache(0)
 {
 }
 
@@ -38,7 +39,21 @@ ostringstream convert;   // stream used for the conversion
 	convert << " \"readingAppend\" : " << readingAppend << ",";
 	convert << " \"readingFetch\" : " << readingFetch << ",";
 	convert << " \"readingQuery\" : " << readingQuery << ",";
-	convert << " \"readingPurge\" : " << readingPurge << " }";
+	convert << " \"readingPurge\" : " << readingPurge << ",";
+	convert << " \"readingLatest\" : " << readingLatest;
+	if (m_workers)
+	{
+		string workers;
+		m_workers->asJSON(workers);
+		convert << ", \"workers\" : " << workers;
+	}
+	if (m_readingCache)
+	{
+		string cache;
+		m_readingCache->asJSON(cache);
+		convert << ", \"readingCache\" : " << cache;
+	}
+	convert << " }";
 
 	json = convert.str();
 }
@@ -0,0 +1,177 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <storage_workers.h>
+#include <logger.h>
+#include <sstream>
+
+using namespace std;
+
+static const char *classNames[] = { "append", "fetch", "query", "purge" };
+
+/**
+ * Create the worker pool and start the worker threads
+ *
+ * @param threads	The number of worker threads
+ * @param queueSize	The maximum number of requests queued for each class
+ */
+StorageWorkers::StorageWorkers(unsigned int threads, unsigned int queueSize) :
+	m_queueSize(queueSize), m_busy(0), m_running(true)
+{
+	if (threads == 0)
+	{
+		threads = 1;
+	}
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		m_threads.push_back(thread(&StorageWorkers::worker, this));
+	}
+	Logger::getLogger()->info("Storage worker pool of %d threads, %d queued requests per class",
+			threads, queueSize);
+}
+
+/**
+ * Destroy the worker pool, requests already queued are completed
+ */
+StorageWorkers::~StorageWorkers()
+{
+	shutdown();
+}
+
+/**
+ * Queue a request to be run by the worker pool
+ *
+ * @param workerClass	The class of the request
+ * @param task		The request to run
+ * @return bool		False if the queue for the class is full
+ */
+bool StorageWorkers::submit(WorkerClass workerClass, const function<void()>& task)
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (!m_running || m_queues[workerClass].size() >= m_queueSize)
+	{
+		m_stats[workerClass].rejected++;
+		return false;
+	}
+	m_queues[workerClass].push_back(Job(Clock::now(), task));
+	m_cv.notify_one();
+	return true;
+}
+
+/**
+ * Stop the worker threads once the queued requests have been run
+ */
+void StorageWorkers::shutdown()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_running = false;
+		m_cv.notify_all();
+	}
+	for (auto& t : m_threads)
+	{
+		t.join();
+	}
+	m_threads.clear();
+}
+
+/**
+ * Choose the class of the next request to run. Called with the mutex held.
+ *
+ * @param now	The current time
+ * @return int	The class to run or -1 if all the queues are empty
+ */
+int StorageWorkers::nextClass(Clock::time_point now)
+{
+	int next = -1;
+	for (int i = 0; i < WorkerClasses; i++)
+	{
+		if (m_queues[i].empty())
+		{
+			continue;
+		}
+		if (next == -1)
+		{
+			next = i;
+		}
+		else if (now - m_queues[i].front().first > chrono::milliseconds(WORKER_MAX_WAIT))
+		{
+			return i;
+		}
+	}
+	return next;
+}
+
+/**
+ * The worker thread, runs queued requests until the pool is shutdown
+ */
+void StorageWorkers::worker()
+{
+	unique_lock<mutex> lck(m_mutex);
+	while (true)
+	{
+		Clock::time_point now = Clock::now();
+		int next = nextClass(now);
+		if (next == -1)
+		{
+			if (!m_running)
+			{
+				return;
+			}
+			m_cv.wait(lck);
+			continue;
+		}
+		Job job = m_queues[next].front();
+		m_queues[next].pop_front();
+		double wait = chrono::duration<double, milli>(now - job.first).count();
+		ClassStats& stats = m_stats[next];
+		stats.executed++;
+		stats.totalWait += wait;
+		if (wait > stats.maxWait)
+		{
+			stats.maxWait = wait;
+		}
+		m_busy++;
+		lck.unlock();
+		try {
+			job.second();
+		} catch (exception& e) {
+			Logger::getLogger()->error("Storage %s request failed: %s", classNames[next], e.what());
+		}
+		lck.lock();
+		m_busy--;
+	}
+}
+
+/**
+ * Return the queue depths and wait times of the worker pool as JSON
+ *
+ * @param json	The JSON document
+ */
+void StorageWorkers::asJSON(string& json) const
+{
+	lock_guard<mutex> guard(m_mutex);
+	ostringstream convert;
+
+	convert << "{ \"threads\" : " << m_threads.size() << ",";
+	convert << " \"busy\" : " << m_busy << ",";
+	convert << " \"queueSize\" : " << m_queueSize;
+	for (int i = 0; i < WorkerClasses; i++)
+	{
+		const ClassStats& stats = m_stats[i];
+		convert << ", \"" << classNames[i] << "\" : { ";
+		convert << "\"queued\" : " << m_queues[i].size() << ",";
+		convert << " \"executed\" : " << stats.executed << ",";
+		convert << " \"rejected\" : " << stats.rejected << ",";
+		convert << " \"averageWaitMs\" : " << (stats.executed ? stats.totalWait / stats.executed : 0) << ",";
+		convert << " \"maxWaitMs\" : " << stats.maxWait << " }";
+	}
+	convert << " }";
+
+	json = convert.str();
+}
@@ -9,9 +9,10 @@
  */
 #include <stream_handler.h>
 #include <storage_api.h>
-#include <storage_api.h>
 #include <reading_stream.h>
+#include <unix_socket.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
@@ -19,6 +20,7 @@
 #include <chrono>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 
 using namespace std;
@@ -79,6 +81,20 @@ void StreamHandler::handler()
 				Stream *stream = (Stream *)events[i].data.ptr;
 				stream->handleEvent(m_pollfd, m_api, events[i].events);
 			}
+			// Remove any streams whose connection has been closed
+			for (auto it = m_streams.begin(); it != m_streams.end(); )
+			{
+				(*it)->retryRing(m_pollfd, m_api);
+				if ((*it)->isClosed())
+				{
+					delete *it;
+					it = m_streams.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
 		}
 	}
 }
@@ -106,7 +122,8 @@ uint32_t StreamHandler::createStream(uint32_t *token)
 /**
  * Create a stream object to deal with the stream protocol
  */
-StreamHandler::Stream::Stream() : m_status(Closed)
+StreamHandler::Stream::Stream() : m_status(Closed), m_unixSocket(-1), m_ring(NULL),
+	m_ringStored(0), m_ringFailed(false), m_ringClosing(false)
 {
 }
 
@@ -122,7 +139,8 @@ StreamHandler::Stream::~Stream()
  * Create a new stream object. Add that stream to the epoll structure.
  * A listener socket is created and the port sent back to the caller. The client
  * will connect to this port and then send the token to verify they are the 
- * service that requested the stream to be connected.
+ * service that requested the stream to be connected. Clients on the same host
+ * may instead connect to a Unix domain socket named after the port.
  *
  * @param epollfd	The epoll descriptor
  * @param token		The single use token the client will send in the connect request
@@ -139,7 +157,7 @@ struct sockaddr_in	address;
 
 	if ((m_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
 	{
-		Logger::getLogger()->error("Failed to create socket: %s", sys_errlist[errno]);
+		Logger::getLogger()->error("Failed to create socket: %s", strerror(errno));
 		return 0;
 	}
 	address.sin_family = AF_INET;
@@ -148,19 +166,19 @@ struct sockaddr_in	address;
 
 	if (bind(m_socket, (struct sockaddr *)&address, sizeof(address)) < 0)
 	{
-		Logger::getLogger()->error("Failed to bind socket: %s", sys_errlist[errno]);
+		Logger::getLogger()->error("Failed to bind socket: %s", strerror(errno));
 		return 0;
 	}
 	socklen_t len = sizeof(address);
 	if (getsockname(m_socket, (struct sockaddr *)&address, &len) == -1)
-		Logger::getLogger()->error("Failed to get socket name, %s", sys_errlist[errno]);
+		Logger::getLogger()->error("Failed to get socket name, %s", strerror(errno));
 	m_port = ntohs(address.sin_port);
 	Logger::getLogger()->info("Stream port bound to %d", m_port);
 	setNonBlocking(m_socket);
 
 	if (listen(m_socket, 3) < 0)
 	{
-		Logger::getLogger()->error("Failed to listen: %s", sys_errlist[errno]);
+		Logger::getLogger()->error("Failed to listen: %s", strerror(errno));
 		return 0;
     	}
 	m_status = Listen;
@@ -174,12 +192,73 @@ struct sockaddr_in	address;
 	m_event.events = EPOLLIN | EPOLLRDHUP;
 	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, m_socket, &m_event) < 0)
 	{
-		Logger::getLogger()->error("Failed to add listening port %d to epoll fileset, %s", m_port, sys_errlist[errno]);
+		Logger::getLogger()->error("Failed to add listening port %d to epoll fileset, %s", m_port, strerror(errno));
 	}
 
+	createUnixListener(epollfd);
+
 	return m_port;
 }
 
+/**
+ * Create the Unix domain socket listener for the stream. Failure is not
+ * fatal as clients will then connect via the TCP port.
+ *
+ * @param epollfd	The epoll descriptor
+ */
+void StreamHandler::Stream::createUnixListener(int epollfd)
+{
+struct sockaddr_un	address;
+string			name = unixSocketListenName(m_port);
+
+	if (name.empty())
+	{
+		Logger::getLogger()->warn("No Unix domain socket may be created for stream port %d", m_port);
+		m_unixSocket = -1;
+		return;
+	}
+	if ((m_unixSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	{
+		Logger::getLogger()->warn("Failed to create Unix domain socket: %s", strerror(errno));
+		m_unixSocket = -1;
+		return;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, name.data(), name.length());
+	if (bind(m_unixSocket, (struct sockaddr *)&address,
+				offsetof(struct sockaddr_un, sun_path) + name.length()) < 0
+			|| listen(m_unixSocket, 3) < 0)
+	{
+		Logger::getLogger()->warn("Failed to listen on Unix domain socket for stream port %d: %s",
+				m_port, strerror(errno));
+		close(m_unixSocket);
+		m_unixSocket = -1;
+		return;
+	}
+	setNonBlocking(m_unixSocket);
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, m_unixSocket, &m_event) < 0)
+	{
+		Logger::getLogger()->error("Failed to add Unix domain socket to epoll fileset, %s", strerror(errno));
+	}
+}
+
+/**
+ * Close the Unix domain socket listener, if any, and remove its socket.
+ *
+ * @param epollfd	The epoll descriptor
+ */
+void StreamHandler::Stream::closeUnixListener(int epollfd)
+{
+	if (m_unixSocket != -1)
+	{
+		epoll_ctl(epollfd, EPOLL_CTL_DEL, m_unixSocket, &m_event);
+		close(m_unixSocket);
+		m_unixSocket = -1;
+		unlink(unixSocketName(m_port).c_str());
+	}
+}
+
 /**
  * Set the file descriptor to be non blocking
  *
@@ -197,20 +276,44 @@ void StreamHandler::Stream::setNonBlocking(int fd)
  * Handle an epoll event. The precise handling will depend
  * on the state of the stream.
  *
- * TODO Improve memory handling, use seperate threads for inserts, send acknowledgements
+ * Each block is acknowledged once all of its readings have been
+ * passed to the storage plugin, with a RDS_NACK_MAGIC acknowledgement
+ * sent if the plugin failed to store them. Each chunk of a block that
+ * is committed before the end of the block is acknowledged with a
+ * RDS_CHUNK_MAGIC acknowledgement. A client that loses its connection
+ * will resend the readings that were not acknowledged.
+ *
+ * TODO Improve memory handling, use seperate threads for inserts
  *
  * @param epollfd	The epoll file descriptor
  */
 void StreamHandler::Stream::handleEvent(int epollfd, StorageApi *api, uint32_t events)
 {
-ssize_t n;
-
 	if (events & EPOLLRDHUP)
 	{
-		// TODO mark this stream for destruction
-		epoll_ctl(epollfd, EPOLL_CTL_DEL, m_socket, &m_event);
-		close(m_socket);
+		if (m_status == RingConnected)
+		{
+			// Store what the client wrote to the ring before it closed
+			consumeRing(api);
+			if (m_ringFailed)
+			{
+				// Keep the ring until the blocks left in it have been stored
+				Logger::getLogger()->warn("Stream closed by the client, "
+						"storing the readings left in the shared memory ring");
+				epoll_ctl(epollfd, EPOLL_CTL_DEL, m_socket, &m_event);
+				m_ringClosing = true;
+				return;
+			}
+		}
+		else if (m_status == Connected)
+		{
+			// Store the blocks received before the client shut down the stream
+			readBlocks(epollfd, api);
+		}
+		// Unacknowledged data will be resent by the client
 		Logger::getLogger()->warn("Closing stream...");
+		closeConnection(epollfd);
+		return;
 	}
 	if (events & EPOLLIN)
 	{
@@ -220,13 +323,19 @@ ssize_t n;
 			struct sockaddr	addr;
 			socklen_t	addrlen = sizeof(addr);
 			if ((conn_sock = accept(m_socket,
-						  (struct sockaddr *)&addr, &addrlen)) == -1)
+						  (struct sockaddr *)&addr, &addrlen)) == -1
+					&& m_unixSocket != -1)
+			{
+				conn_sock = accept(m_unixSocket, NULL, NULL);
+			}
+			if (conn_sock == -1)
 			{
-				Logger::getLogger()->info("Accept failed for streaming socket: %s", sys_errlist[errno]);
+				Logger::getLogger()->info("Accept failed for streaming socket: %s", strerror(errno));
 				return;
 			}
 			epoll_ctl(epollfd, EPOLL_CTL_DEL, m_socket, &m_event);
 			close(m_socket);
+			closeUnixListener(epollfd);
 			Logger::getLogger()->info("Stream connection established");
 			m_socket = conn_sock;
 			m_status = AwaitingToken;
@@ -237,170 +346,520 @@ ssize_t n;
 		}
 		else if (m_status == AwaitingToken)
 		{
-			RDSConnectHeader	hdr;
-			if (available(m_socket) < sizeof(hdr))
+			if (available(m_socket) < sizeof(RDSConnectHeader))
 			{
 				return;
 			}
-			if ((n = read(m_socket, &hdr, sizeof(hdr))) != sizeof(hdr))
-				Logger::getLogger()->warn("Token exchange: Short read of %d bytes: %s", n, sys_errlist[errno]);
-			if (hdr.magic == RDS_CONNECTION_MAGIC && hdr.token == m_token)
+			if (receiveToken(epollfd) && m_status == RingConnected)
+			{
+				consumeRing(api);
+			}
+		}
+		else if (m_status == RingConnected)
+		{
+			consumeRing(api);
+		}
+		else if (m_status == Connected)
+		{
+			readBlocks(epollfd, api);
+		}
+	}
+}
+
+/**
+ * Read the blocks of readings the client has sent on the socket and pass
+ * them to the storage plugin. Returns when no more complete headers or
+ * readings are available or the connection has been closed.
+ *
+ * A block larger than RDS_BLOCK readings is stored in several chunks,
+ * each committed on its own. Once a chunk of a block has failed, the
+ * rest of the block is not stored and the negative acknowledgement
+ * carries the number of readings stored before the failure, so the
+ * client only resends the readings that follow them. Every chunk
+ * committed before the end of the block is acknowledged as it is
+ * stored, so a client that loses the connection part way through a
+ * block does not resend the chunks already committed.
+ *
+ * @param epollfd	The epoll file descriptor
+ * @param api		The storage API to insert the readings with
+ */
+void StreamHandler::Stream::readBlocks(int epollfd, StorageApi *api)
+{
+ssize_t n;
+
+	while (1)
+	{
+		Logger::getLogger()->debug("Connected in protocol state %d, readingNo %d", m_protocolState, m_readingNo);
+		if (m_protocolState == BlkHdr)
+		{
+			RDSBlockHeader blkHdr;
+			if (available(m_socket) < sizeof(blkHdr))
+			{
+				Logger::getLogger()->debug("Not enough bytes for block header");
+				return;
+			}
+			if ((n = read(m_socket, &blkHdr, sizeof(blkHdr))) != sizeof(blkHdr))
+			{
+				if (errno == EAGAIN)
+					return;
+				Logger::getLogger()->warn("Block Header: Short read of %d bytes: %s", n, strerror(errno));
+				return;
+			}
+			if (blkHdr.magic != RDS_BLOCK_MAGIC)
+			{
+				Logger::getLogger()->error("Expected block header %d, but incorrect header found 0x%x", m_blockNo, blkHdr.magic);
+				Logger::getLogger()->error("Previous block size was %d", m_blockSize);
+				dump(10);
+				closeConnection(epollfd);
+				return;
+			}
+			m_blockNo++;
+			m_currentBlock = blkHdr.blockNumber;
+			m_blockFailed = false;
+			m_blockStored = 0;
+			m_blockSize = blkHdr.count;
+			m_readingNo = 0;
+			Logger::getLogger()->debug("New block %d of %d readings", blkHdr.blockNumber, blkHdr.count);
+			if (m_blockSize == 0)
+			{
+				if (!acknowledge(epollfd))
+					return;
+				continue;
+			}
+			m_protocolState = RdHdr;
+		}
+		else if (m_protocolState == RdHdr)
+		{
+			RDSReadingHeader rdhdr;
+			if (available(m_socket) < sizeof(rdhdr))
+			{
+				Logger::getLogger()->debug("Not enough bytes for reading header");
+				return;
+			}
+			if (read(m_socket, &rdhdr, sizeof(rdhdr)) < sizeof(rdhdr))
+			{
+				if (errno == EAGAIN)
+					return;
+				Logger::getLogger()->warn("Not enough bytes for reading header");
+				return;
+			}
+			if (rdhdr.magic != RDS_READING_MAGIC)
+			{
+				Logger::getLogger()->error("Expected reading header %d of %d in block %d, but incorrect header found 0x%x", m_readingNo, m_blockSize, m_blockNo, rdhdr.magic);
+				dump(10);
+				closeConnection(epollfd);
+				return;
+			}
+			Logger::getLogger()->debug("Reading Header: assetCodeLngth %d, payloadLength %d", rdhdr.assetLength, rdhdr.payloadLength);
+			m_readingSize = sizeof(struct timeval) + rdhdr.assetLength + rdhdr.payloadLength;
+			uint32_t extra = 0;
+			if (rdhdr.assetLength)
+			{
+				m_sameAsset = false;
+				extra = 0;
+			}
+			else
+			{
+				m_sameAsset = true;
+				extra = m_lastAsset.length() + 1;
+				rdhdr.assetLength = extra;
+			}
+			extra  += 2 * sizeof(uint32_t);
+			m_currentReading = (ReadingStream *)m_blockPool->allocate(m_readingSize + extra);
+			m_readings[m_readingNo % RDS_BLOCK] = m_currentReading;
+			m_currentReading->assetCodeLength = rdhdr.assetLength;
+			m_currentReading->payloadLength = rdhdr.payloadLength;
+			m_protocolState = RdBody;
+		}
+		else if (m_protocolState == RdBody)
+		{
+			if (available(m_socket) < m_readingSize)
+			{
+				Logger::getLogger()->debug("Not enough bytes for reading %d", m_readingSize);
+				return;
+			}
+			if (m_sameAsset)
+			{
+				if ((n = read(m_socket, &m_currentReading->userTs, sizeof(struct timeval))) != sizeof(struct timeval))
+					Logger::getLogger()->warn("Short read of %d bytes for timestamp: %s", n, strerror(errno));
+				int plen = m_readingSize - sizeof(struct timeval);
+				uint32_t assetLen = m_currentReading->assetCodeLength;
+				if ((n = read(m_socket, &m_currentReading->assetCode[assetLen], plen)) != plen)
+					Logger::getLogger()->warn("Short read of %d bytes for payload: %s", n, strerror(errno));
+				memcpy(&m_currentReading->assetCode[0], m_lastAsset.c_str(), assetLen);
+			}
+			else
+			{
+				if ((n = read(m_socket, &m_currentReading->userTs, m_readingSize)) != m_readingSize)
+					Logger::getLogger()->warn("Short read of %d bytes for reading: %s", n, strerror(errno));
+				m_lastAsset = m_currentReading->assetCode;
+			}
+			m_readingNo++;
+			if ((m_readingNo % RDS_BLOCK) == 0)
+			{
+				queueInsert(api, RDS_BLOCK, false);
+				for (int i = 0; i < RDS_BLOCK; i++)
+					m_blockPool->release(m_readings[i]);
+				if (m_readingNo < m_blockSize && !m_blockFailed
+						&& !acknowledge(epollfd, false))
+					return;
+			}
+			else if (m_readingNo == m_blockSize)
+			{
+				// We have completed the block, insert readings and wait
+				// for a block header
+				queueInsert(api, m_readingNo % RDS_BLOCK, true);
+				for (uint32_t i = 0; i < m_readingNo % RDS_BLOCK; i++)
+					m_blockPool->release(m_readings[i]);
+			}
+			if (m_readingNo >= m_blockSize)
 			{
-				m_status = Connected;
-				m_blockNo = 0;
-				m_readingNo = 0;
 				m_protocolState = BlkHdr;
-				Logger::getLogger()->info("Token for streaming socket exchanged");
+				if (!acknowledge(epollfd))
+					return;
 			}
 			else
 			{
-				Logger::getLogger()->warn("Incorrect token for streaming socket");
-				close(m_socket);
+				m_protocolState = RdHdr;
 			}
 		}
-		else if (m_status == Connected)
+	}
+}
+
+/**
+ * Read the connection header and check the token. A client on the same
+ * host may pass the descriptors of a shared memory ring with the header,
+ * readings are then consumed from the ring rather than the socket.
+ *
+ * @param epollfd	The epoll file descriptor
+ * @return bool		True if the stream is now connected
+ */
+bool StreamHandler::Stream::receiveToken(int epollfd)
+{
+	RDSConnectHeader	hdr;
+	int			fds[3];
+	size_t			nfds = 0;
+	char			control[CMSG_SPACE(sizeof(fds))];
+	struct iovec		iov;
+	struct msghdr		msg;
+	ssize_t			n;
+
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if ((n = recvmsg(m_socket, &msg, MSG_CMSG_CLOEXEC)) != sizeof(hdr))
+	{
+		Logger::getLogger()->warn("Token exchange: Short read of %d bytes: %s", n, strerror(errno));
+	}
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
 		{
-			while (1)
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			if (nfds > sizeof(fds) / sizeof(int))
 			{
-				Logger::getLogger()->debug("Connected in protocol state %d, readingNo %d", m_protocolState, m_readingNo);
-				if (m_protocolState == BlkHdr)
-				{
-					RDSBlockHeader blkHdr;
-					if (available(m_socket) < sizeof(blkHdr))
-					{
-						Logger::getLogger()->debug("Not enough bytes for block header");
-						return;
-					}
-					if ((n = read(m_socket, &blkHdr, sizeof(blkHdr))) != sizeof(blkHdr))
-					{
-						if (errno == EAGAIN)
-							return;
-						Logger::getLogger()->warn("Block Header: Short read of %d bytes: %s", n, sys_errlist[errno]);
-						return;
-					}
-					if (blkHdr.magic != RDS_BLOCK_MAGIC)
-					{
-						Logger::getLogger()->error("Expected block header %d, but incorrect header found 0x%x", m_blockNo, blkHdr.magic);
-						Logger::getLogger()->error("Previous block size was %d", m_blockSize);
-						dump(10);
-						close(m_socket);
-						return;
-					}
-					if (blkHdr.blockNumber != m_blockNo)
-					{
-					}
-					m_blockNo++;
-					m_blockSize = blkHdr.count;
-					m_protocolState = RdHdr;
-					m_readingNo = 0;
-					Logger::getLogger()->debug("New block %d of %d readings", blkHdr.blockNumber, blkHdr.count);
-				}
-				else if (m_protocolState == RdHdr)
-				{
-					RDSReadingHeader rdhdr;
-					if (available(m_socket) < sizeof(rdhdr))
-					{
-						Logger::getLogger()->debug("Not enough bytes for reading header");
-						return;
-					}
-					if (read(m_socket, &rdhdr, sizeof(rdhdr)) < sizeof(rdhdr))
-					{
-						if (errno == EAGAIN)
-							return;
-						Logger::getLogger()->warn("Not enough bytes for reading header");
-						return;
-					}
-					if (rdhdr.magic != RDS_READING_MAGIC)
-					{
-						Logger::getLogger()->error("Expected reading header %d of %d in block %d, but incorrect header found 0x%x", m_readingNo, m_blockSize, m_blockNo, rdhdr.magic);
-						dump(10);
-						close(m_socket);
-						return;
-					}
-					Logger::getLogger()->debug("Reading Header: assetCodeLngth %d, payloadLength %d", rdhdr.assetLength, rdhdr.payloadLength);
-					m_readingSize = sizeof(struct timeval) + rdhdr.assetLength + rdhdr.payloadLength;
-					uint32_t extra = 0;
-					if (rdhdr.assetLength)
-					{
-						m_sameAsset = false;
-						extra = 0;
-					}
-					else
-					{
-						m_sameAsset = true;
-						extra = m_lastAsset.length() + 1;
-						rdhdr.assetLength = extra;
-					}
-					extra  += 2 * sizeof(uint32_t);
-					m_currentReading = (ReadingStream *)m_blockPool->allocate(m_readingSize + extra);
-					m_readings[m_readingNo % RDS_BLOCK] = m_currentReading;
-					m_currentReading->assetCodeLength = rdhdr.assetLength;
-					m_currentReading->payloadLength = rdhdr.payloadLength;
-					m_protocolState = RdBody;
-				}
-				else if (m_protocolState == RdBody)
-				{
-					if (available(m_socket) < m_readingSize)
-					{
-						Logger::getLogger()->debug("Not enough bytes for reading %d", m_readingSize);
-						return;
-					}
-					if (m_sameAsset)
-					{
-						if ((n = read(m_socket, &m_currentReading->userTs, sizeof(struct timeval))) != sizeof(struct timeval))
-							Logger::getLogger()->warn("Short read of %d bytes for timestamp: %s", n, sys_errlist[errno]);
-						int plen = m_readingSize - sizeof(struct timeval);
-						uint32_t assetLen = m_currentReading->assetCodeLength;
-						if ((n = read(m_socket, &m_currentReading->assetCode[assetLen], plen)) != plen)
-							Logger::getLogger()->warn("Short read of %d bytes for payload: %s", n, sys_errlist[errno]);
-						memcpy(&m_currentReading->assetCode[0], m_lastAsset.c_str(), assetLen);
-					}
-					else
-					{
-						if ((n = read(m_socket, &m_currentReading->userTs, m_readingSize)) != m_readingSize)
-							Logger::getLogger()->warn("Short read of %d bytes for reading: %s", n, sys_errlist[errno]);
-						m_lastAsset = m_currentReading->assetCode;
-					}
-					m_readingNo++;
-					if ((m_readingNo % RDS_BLOCK) == 0)
-					{
-						queueInsert(api, RDS_BLOCK, false);
-						for (int i = 0; i < RDS_BLOCK; i++)
-							m_blockPool->release(m_readings[i]);
-					}
-					else if (m_readingNo == m_blockSize)
-					{
-						// We have completed the block, insert readings and wait
-						// for a block header
-						queueInsert(api, m_readingNo % RDS_BLOCK, true);
-						for (uint32_t i = 0; i < m_readingNo % RDS_BLOCK; i++)
-							m_blockPool->release(m_readings[i]);
-					}
-					if (m_readingNo >= m_blockSize)
-					{
-						m_protocolState = BlkHdr;
-					}
-					else
-					{
-						m_protocolState = RdHdr;
-					}
-				}
+				nfds = sizeof(fds) / sizeof(int);
+			}
+			memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+		}
+	}
+
+	if (n == sizeof(hdr) && hdr.token == m_token && hdr.magic == RDS_CONNECTION_MAGIC && nfds == 0)
+	{
+		m_status = Connected;
+		m_blockNo = 0;
+		m_readingNo = 0;
+		m_protocolState = BlkHdr;
+		Logger::getLogger()->info("Token for streaming socket exchanged");
+		return true;
+	}
+	if (n == sizeof(hdr) && hdr.token == m_token && hdr.magic == RDS_RING_CONNECTION_MAGIC && nfds == 3)
+	{
+		m_ring = new ReadingRing();
+		if (m_ring->attach(fds[0], fds[1], fds[2]))
+		{
+			struct epoll_event event;
+			event.data.ptr = this;
+			event.events = EPOLLIN;
+			if (epoll_ctl(epollfd, EPOLL_CTL_ADD, m_ring->dataEvent(), &event) == 0)
+			{
+				m_status = RingConnected;
+				Logger::getLogger()->info("Token for streaming socket exchanged, using shared memory");
+				return true;
 			}
+			Logger::getLogger()->error("Failed to add reading ring to epoll fileset, %s", strerror(errno));
+		}
+		delete m_ring;		// Closes the descriptors
+		m_ring = NULL;
+		nfds = 0;
+	}
+	for (size_t i = 0; i < nfds; i++)
+	{
+		close(fds[i]);
+	}
+	Logger::getLogger()->warn("Incorrect token for streaming socket");
+	closeConnection(epollfd);
+	return false;
+}
+
+/**
+ * Consume the blocks of readings the client has written to the shared
+ * memory ring. Each block is removed from the ring once it has been
+ * stored by the storage plugin.
+ *
+ * If the plugin fails to store a block it is left at the head of the
+ * ring and storing it is retried after RING_RETRY_TIME milliseconds.
+ * The readings of the block that were stored are not stored again.
+ * Meanwhile the client waits for space in the ring.
+ *
+ * @param api		The storage API to insert the readings with
+ */
+void StreamHandler::Stream::consumeRing(StorageApi *api)
+{
+	string block;
+
+	if (m_ringFailed && chrono::steady_clock::now() < m_ringRetry)
+	{
+		m_ring->clearEvent();
+		return;
+	}
+	while (true)
+	{
+		bool progress = false;
+		m_ring->clearEvent();
+		while (m_ring->next(block))
+		{
+			if (!insertRingBlock(api, block))
+			{
+				Logger::getLogger()->error("Discarding invalid block of readings from the shared memory ring");
+			}
+			else if (m_blockFailed)
+			{
+				Logger::getLogger()->error("Failed to store block %d from the shared memory ring, "
+						"%d readings stored, retrying in %d ms",
+						m_currentBlock, m_ringStored, RING_RETRY_TIME);
+				m_ringFailed = true;
+				m_ringRetry = chrono::steady_clock::now() + chrono::milliseconds(RING_RETRY_TIME);
+				return;
+			}
+			m_ringFailed = false;
+			m_ringStored = 0;
+			m_ring->consume();
+			progress = true;
+		}
+		// Always mark the ring idle before returning so the client will wake us
+		if (m_ring->idle() || !progress)
+		{
+			break;
+		}
+	}
+}
+
+/**
+ * Retry storing a block from the shared memory ring that the storage
+ * plugin failed to store, once the retry time has been reached. A ring
+ * kept after the client closed the stream is released once empty.
+ *
+ * @param epollfd	The epoll file descriptor
+ * @param api		The storage API to insert the readings with
+ */
+void StreamHandler::Stream::retryRing(int epollfd, StorageApi *api)
+{
+	if (m_status != RingConnected || !m_ringFailed
+			|| chrono::steady_clock::now() < m_ringRetry)
+	{
+		return;
+	}
+	consumeRing(api);
+	if (m_ringClosing && !m_ringFailed)
+	{
+		closeConnection(epollfd);
+	}
+}
+
+/**
+ * Unpack a block of readings taken from the shared memory ring and insert
+ * them. The block uses the same layout as blocks sent on the socket. The
+ * first m_ringStored readings have already been stored and are skipped.
+ *
+ * On return m_blockFailed is set if the plugin failed to store readings
+ * and m_ringStored is the number of readings of the block stored.
+ *
+ * @param api		The storage API to insert the readings with
+ * @param block		The block of readings
+ * @return bool		False if the block is invalid
+ */
+bool StreamHandler::Stream::insertRingBlock(StorageApi *api, const string& block)
+{
+	const char		*ptr = block.data();
+	const char		*end = ptr + block.length();
+	RDSBlockHeader		blkHdr;
+	RDSReadingHeader	rdhdr;
+	const char		*asset = NULL;
+	uint32_t		assetLength = 0;
+	unsigned int		nReadings = 0;
+
+	if (block.length() < sizeof(blkHdr))
+	{
+		return false;
+	}
+	memcpy(&blkHdr, ptr, sizeof(blkHdr));
+	ptr += sizeof(blkHdr);
+	if (blkHdr.magic != RDS_BLOCK_MAGIC)
+	{
+		Logger::getLogger()->error("Incorrect block header 0x%x in reading ring", blkHdr.magic);
+		return false;
+	}
+	m_currentBlock = blkHdr.blockNumber;
+	m_blockFailed = false;
+	m_blockStored = m_ringStored;
+	bool valid = true;
+	for (uint32_t i = 0; i < blkHdr.count; i++)
+	{
+		if (end - ptr < (ssize_t)(sizeof(rdhdr) + sizeof(struct timeval)))
+			break;
+		memcpy(&rdhdr, ptr, sizeof(rdhdr));
+		ptr += sizeof(rdhdr);
+		const char *userTs = ptr;
+		ptr += sizeof(struct timeval);
+		if (rdhdr.magic != RDS_READING_MAGIC
+				|| (size_t)(end - ptr) < (size_t)rdhdr.assetLength + rdhdr.payloadLength
+				|| (rdhdr.assetLength == 0 && asset == NULL))
+		{
+			Logger::getLogger()->error("Incorrect reading %d in block %d of reading ring", i, blkHdr.blockNumber);
+			valid = false;
+			break;
+		}
+		if (rdhdr.assetLength)
+		{
+			asset = ptr;
+			assetLength = rdhdr.assetLength;
+			ptr += rdhdr.assetLength;
+		}
+		if (i < m_ringStored)
+		{
+			ptr += rdhdr.payloadLength;
+			continue;
+		}
+		ReadingStream *reading = (ReadingStream *)m_blockPool->allocate(
+				offsetof(ReadingStream, assetCode) + assetLength + rdhdr.payloadLength);
+		reading->assetCodeLength = assetLength;
+		reading->payloadLength = rdhdr.payloadLength;
+		memcpy(&reading->userTs, userTs, sizeof(struct timeval));
+		memcpy(reading->assetCode, asset, assetLength);
+		memcpy(&reading->assetCode[assetLength], ptr, rdhdr.payloadLength);
+		ptr += rdhdr.payloadLength;
+		m_readings[nReadings++] = reading;
+		if (nReadings == RDS_BLOCK)
+		{
+			queueInsert(api, nReadings, false);
+			for (unsigned int j = 0; j < nReadings; j++)
+				m_blockPool->release(m_readings[j]);
+			nReadings = 0;
 		}
 	}
+	if (nReadings)
+	{
+		queueInsert(api, nReadings, true);
+		for (unsigned int j = 0; j < nReadings; j++)
+			m_blockPool->release(m_readings[j]);
+	}
+	m_ringStored = m_blockStored;
+	return valid;
 }
 
 /**
  * Queue a block of readings to be inserted into the database. The readings
- * are available via the m_readings array.
+ * are available via the m_readings array. Nothing more is inserted for a
+ * block once one of its chunks has failed.
  *
  * @param nReadings	The number of readings to insert
  * @param commit	Perform commit at end of this block
  */
 void StreamHandler::Stream::queueInsert(StorageApi *api, unsigned int nReadings, bool commit)
 {
+	if (m_blockFailed)
+	{
+		return;
+	}
 	m_readings[nReadings] = NULL;
-	api->readingStream(m_readings, commit);
+	if (!api->readingStream(m_readings, commit))
+	{
+		m_blockFailed = true;
+	}
+	else
+	{
+		m_blockStored += nReadings;
+	}
+}
+
+/**
+ * Acknowledge the current block, the acknowledgement is negative if
+ * any of the readings in the block could not be stored. It then gives
+ * the number of readings at the start of the block that were stored.
+ * Before the end of the block the acknowledgement reports the readings
+ * of the block committed so far.
+ *
+ * @param epollfd	The epoll file descriptor
+ * @param complete	All the readings of the block have been received
+ * @return bool		False if the acknowledgement could not be sent
+ */
+bool StreamHandler::Stream::acknowledge(int epollfd, bool complete)
+{
+	RDSAcknowledge ack;
+	if (!complete)
+		ack.magic = RDS_CHUNK_MAGIC;
+	else
+		ack.magic = m_blockFailed ? RDS_NACK_MAGIC : RDS_ACK_MAGIC;
+	ack.block = m_currentBlock;
+	ack.count = m_blockStored;
+	if (send(m_socket, &ack, sizeof(ack), MSG_NOSIGNAL) != sizeof(ack))
+	{
+		Logger::getLogger()->warn("Failed to acknowledge block %d: %s", m_currentBlock, strerror(errno));
+		closeConnection(epollfd);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Close the connection for this stream and remove it from the epoll set.
+ * Any readings of a partially received block are returned to the memory
+ * pool. The stream is removed by the handler once it has been closed.
+ *
+ * The shared memory ring, if any, is detached before the socket is closed
+ * as the client only recovers the blocks left in the ring once the
+ * socket has been closed.
+ *
+ * @param epollfd	The epoll file descriptor
+ */
+void StreamHandler::Stream::closeConnection(int epollfd)
+{
+	if (m_status == Closed)
+	{
+		return;
+	}
+	if (m_ring)
+	{
+		epoll_ctl(epollfd, EPOLL_CTL_DEL, m_ring->dataEvent(), &m_event);
+		delete m_ring;
+		m_ring = NULL;
+	}
+	epoll_ctl(epollfd, EPOLL_CTL_DEL, m_socket, &m_event);
+	close(m_socket);
+	closeUnixListener(epollfd);
+	if (m_status == Connected && m_protocolState != BlkHdr)
+	{
+		for (uint32_t i = 0; i < m_readingNo % RDS_BLOCK; i++)
+			m_blockPool->release(m_readings[i]);
+		if (m_protocolState == RdBody)
+			m_blockPool->release(m_currentReading);
+	}
+	m_status = Closed;
 }
 
 /**
@@ -415,7 +874,7 @@ int	avail;
 
 	if (ioctl(fd, FIONREAD, &avail) < 0)
 	{
-		Logger::getLogger()->warn("FIONREAD failed: %s", sys_errlist[errno]);
+		Logger::getLogger()->warn("FIONREAD failed: %s", strerror(errno));
 		return 0;
 	}
 	return avail;
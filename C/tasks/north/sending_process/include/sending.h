@@ -79,6 +79,7 @@ class SendingProcess : public FledgeProcess
 							READINGSET* readings);
 		static void		passToOnwardFilter(OUTPUT_HANDLE *outHandle,
 							   READINGSET* readings);
+		static ReadingSet*	takeFilteredData();
 
 	private:
 		std::string             retrieveTableInformationName(const char* dataSource);
@@ -101,6 +102,7 @@ class SendingProcess : public FledgeProcess
 		std::vector<ReadingSet *>	m_buffer;
 		std::thread*			m_thread_load;
 		std::thread*			m_thread_send;
+		std::thread*			m_thread_filter;
 		NorthPlugin*			m_plugin;
 		std::vector<unsigned long>	m_last_read_id;
 		NorthFilterPipeline*		filterPipeline;
@@ -124,6 +126,8 @@ class SendingProcess : public FledgeProcess
 		// static pointer for data buffer access
 		static std::vector<ReadingSet *>*
 						m_buffer_ptr;
+		// static pointer for the output of the filter pipeline
+		static ReadingSet*		m_filtered_ptr;
 		AssetTracker			*m_assetTracker;
 };
 
@@ -73,17 +73,13 @@ bool NorthFilterPipeline::setupFiltersPipeline(void *passToOnwardFilter, void *u
 		}
 
 		// Iterate the load filters set in the Ingest class m_filters member 
+		OUTPUT_HANDLE *outHandle;
+		OUTPUT_STREAM output;
 		if ((it + 1) != m_filters.end())
 		{
 			// Set next filter pointer as OUTPUT_HANDLE
-			if (!(*it)->init(updatedCfg,
-					(OUTPUT_HANDLE *)(*(it + 1)),
-					filterReadingSetFn(passToOnwardFilter)))
-			{
-				errMsg += (*it)->getName() + "'";
-				initErrors = true;
-				break;
-			}
+			outHandle = (OUTPUT_HANDLE *)(*(it + 1));
+			output = filterReadingSetFn(passToOnwardFilter);
 		}
 		else
 		{
@@ -91,15 +87,15 @@ bool NorthFilterPipeline::setupFiltersPipeline(void *passToOnwardFilter, void *u
 			SendingProcess *sendingProcess = (SendingProcess *) _sendingProcess;
 			const unsigned long* bufferIndex = sendingProcess->getLoadBufferIndexPtr();
 			
-			// Set the Ingest class pointer as OUTPUT_HANDLE
-			if (!(*it)->init(updatedCfg,
-					 (OUTPUT_HANDLE *)(bufferIndex),
-					 filterReadingSetFn(useFilteredData)))
-			{
-				errMsg += (*it)->getName() + "'";
-				initErrors = true;
-				break;
-			}
+			outHandle = (OUTPUT_HANDLE *)(bufferIndex);
+			output = filterReadingSetFn(useFilteredData);
+		}
+		setFilterOutput(it - m_filters.begin(), outHandle, output);
+		if (!(*it)->init(updatedCfg, outHandle, output))
+		{
+			errMsg += (*it)->getName() + "'";
+			initErrors = true;
+			break;
 		}
 
 		if ((*it)->persistData())
@@ -125,6 +121,8 @@ bool NorthFilterPipeline::setupFiltersPipeline(void *passToOnwardFilter, void *u
 		return false;
 	}
 
+	fuseFilters();
+
 	//Success
 	return true;
 }
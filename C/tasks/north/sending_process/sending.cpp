@@ -58,6 +58,7 @@ const map<string, std::tuple<string, string, string>>  data_source_to_informatio
 
 // static pointer to data buffers for filter plugins
 std::vector<ReadingSet*>* SendingProcess::m_buffer_ptr = 0;
+ReadingSet* SendingProcess::m_filtered_ptr = 0;
 
 // Used to identifies logs
 const string LOG_SERVICE_NAME = "SendingProcess/sending";
@@ -119,6 +120,7 @@ SendingProcess::~SendingProcess()
 {
 	delete m_thread_load;
 	delete m_thread_send;
+	delete m_thread_filter;
 	delete m_plugin;
 }
 
@@ -148,6 +150,11 @@ SendingProcess::SendingProcess(int argc, char** argv) : FledgeProcess(argc, argv
 	// NorthPlugin
 	m_plugin = NULL;
 
+	// Threads
+	m_thread_load = NULL;
+	m_thread_send = NULL;
+	m_thread_filter = NULL;
+
 	// Set vars & counters to 0, false
 	m_last_sent_id  = 0;
 	m_tot_sent = 0;
@@ -405,6 +412,10 @@ void SendingProcess::stop()
 
 	// Threads execution has completed.
 	this->m_thread_load->join();
+	if (this->m_thread_filter)
+	{
+		this->m_thread_filter->join();
+	}
         this->m_thread_send->join();
 
 	// Remove the data buffers
@@ -939,21 +950,48 @@ bool SendingProcess::loadFilters(const string& categoryName)
  * Use the current input readings (they have been filtered
  * by all filters)
  *
+ * The readings are collected here and moved to the data buffer
+ * by the filter thread once the filter pipeline has returned,
+ * so that the send thread never sees a partially filtered block.
+ *
  * Note:
  * This routine must passed to last filter "plugin_init" only
  *
  * Static method
  *
  * @param outHandle	Pointer to current buffer index
- *			where to add the readings
+ *			the readings belong to
  * @param readings	Filtered readings to add to buffer[index]
  */ 	
 void SendingProcess::useFilteredData(OUTPUT_HANDLE *outHandle,
 				     READINGSET *readings)
 {
-	// Handle the readings set by adding readings set to data buffer[index]
-	unsigned long* loadBufferIndex = (unsigned long *)outHandle;
-	SendingProcess::getDataBuffers()->at(*loadBufferIndex) = (ReadingSet *)readings;
+	if (m_filtered_ptr == NULL)
+	{
+		m_filtered_ptr = (ReadingSet *)readings;
+	}
+	else
+	{
+		// The pipeline has output more than one set for this block
+		m_filtered_ptr->append((ReadingSet *)readings);
+		delete (ReadingSet *)readings;
+	}
+}
+
+/**
+ * Return the readings output by the filter pipeline
+ * for the current block and reset the output
+ *
+ * Static method
+ *
+ * @return	The filtered readings or NULL if the
+ *		pipeline has not output any data
+ */
+ReadingSet* SendingProcess::takeFilteredData()
+{
+	ReadingSet* filtered = m_filtered_ptr;
+	m_filtered_ptr = NULL;
+	return filtered;
 }
 
 /**
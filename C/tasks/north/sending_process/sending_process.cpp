@@ -10,6 +10,8 @@
 
 #include <sending.h>
 #include <condition_variable>
+#include <deque>
+#include <future>
 #include <reading_set.h>
 #include <plugin_manager.h>
 #include <plugin_api.h>
@@ -42,6 +44,14 @@ mutex	waitMutex;
 // Block the calling thread until notified to resume.
 condition_variable cond_var;
 
+// Blocks loaded from storage waiting to be filtered:
+// buffer index and readings
+deque<pair<unsigned int, ReadingSet *>> filterQueue;
+// Mutex for filterQueue access
+mutex	filterMutex;
+// Wakes up the filter thread
+condition_variable filterCv;
+
 // Buffer max elements
 unsigned long memoryBufferSize;
 
@@ -58,6 +68,8 @@ const string LOG_SERVICE_NAME = "SendingProcess/sending_process";
 static void loadDataThread(SendingProcess *loadData);
 // Send data from historian
 static void sendDataThread(SendingProcess *sendData);
+// Apply the filters to the loaded data
+static void filterDataThread(SendingProcess *filterData);
 
 int main(int argc, char** argv)
 {
@@ -68,6 +80,12 @@ int main(int argc, char** argv)
 
 		memoryBufferSize = sendingProcess.getMemoryBufferSize();
 
+		// Launch the filter thread, if we have filters
+		if (sendingProcess.filterPipeline &&
+		    sendingProcess.filterPipeline->getFilterCount() > 0)
+		{
+			sendingProcess.m_thread_filter = new thread(filterDataThread, &sendingProcess);
+		}
 		// Launch the load thread
 		sendingProcess.m_thread_load = new thread(loadDataThread, &sendingProcess);
 		// Launch the send thread
@@ -76,8 +94,9 @@ int main(int argc, char** argv)
 		// Run: max execution time or caught signals can stop it
 		sendingProcess.run();
 
-		// Unlock load & send threads
+		// Unlock load, filter & send threads
 		cond_var.notify_all();
+		filterCv.notify_all();
 
 		// End processing
 		sendingProcess.stop();
@@ -112,14 +131,10 @@ int main(int argc, char** argv)
 void applyFilters(SendingProcess* loadData,
 		  ReadingSet* readingSet)
 {
-	// Get first filter
-	FilterPlugin *firstFilter = loadData->filterPipeline->getFirstFilterPlugin();
-	
 	// Call first filter "ingest"
 	// Note:
 	// next filters will be automatically called
-	if (firstFilter)
-		firstFilter->ingest(readingSet);
+	loadData->filterPipeline->ingest(readingSet);
 }
 
 /**
@@ -130,6 +145,9 @@ void applyFilters(SendingProcess* loadData,
 static void loadDataThread(SendingProcess *loadData)
 {
         unsigned int    readIdx = 0;
+	// Fetch of the next block of readings, requested whilst the current one is buffered
+	std::future<ReadingSet *>	prefetch;
+	unsigned long			prefetchId = 0;
 
 	// Read from the storage last Id already sent
 	loadData->setLastFetchId(loadData->getLastSentId());
@@ -142,12 +160,15 @@ static void loadDataThread(SendingProcess *loadData)
                 }
 
 		/**
-		 * Check whether m_buffer[readIdx] is NULL or contains a ReadingSet
+		 * Check whether m_buffer[readIdx] is NULL or contains a ReadingSet.
+		 * A buffer with a last read id and no ReadingSet yet is
+		 * being filtered.
 		 *
 		 * Access is protected by a mutex.
 		 */
                 readMutex.lock();
-                ReadingSet *canLoad = loadData->m_buffer.at(readIdx);
+                bool canLoad = loadData->m_buffer.at(readIdx) != NULL ||
+			       loadData->m_last_read_id.at(readIdx) != 0;
                 readMutex.unlock();
 
                 if (canLoad)
@@ -183,8 +204,15 @@ static void loadDataThread(SendingProcess *loadData)
 				{
 					// Read from storage all readings with id > last sent id
 					unsigned long lastReadId = loadData->getLastFetchId() + 1;
-					readings = loadData->getStorageClient()->readingFetch(lastReadId,
-											      loadData->getReadBlockSize());
+					if (prefetch.valid() && prefetchId == lastReadId)
+					{
+						readings = prefetch.get();
+					}
+					else
+					{
+						readings = loadData->getStorageClient()->readingFetch(lastReadId,
+												      loadData->getReadBlockSize());
+					}
 				}
 				else
 				{
@@ -243,21 +271,33 @@ static void loadDataThread(SendingProcess *loadData)
 				//Update last fetched reading Id
 				loadData->setLastFetchId(readings->getLastId());
 
+				/**
+				 * Request the next block now, so that it is
+				 * fetched while this block is buffered and
+				 * while the load thread waits for a free buffer
+				 */
+				if (loadData->getDataSourceType().compare("statistics") && loadData->isRunning())
+				{
+					prefetchId = readings->getLastId() + 1;
+					prefetch = loadData->getStorageClient()->readingFetchAsync(prefetchId,
+												loadData->getReadBlockSize());
+				}
+
+				/**
+				 * The buffer access is protected by a mutex
+				 */
+                	        readMutex.lock();
+
 				/**
 				 * Set last fetched reading Id for buffer index
 				 * This is used by send thread whiule updating the next
 				 * position to read from db.
 				 * NOTE:
 				 * The saved position is not ffected by the filters
-				 * called below which can skip some or all input readings.
+				 * which can skip some or all input readings.
 				 */
 				loadData->m_last_read_id.at(readIdx) = readings->getLastId();
 
-				/**
-				 * The buffer access is protected by a mutex
-				 */
-                	        readMutex.lock();
-
 				/**
 				 * Set now the buffer at index to ReadingSet pointer
 				 * Note: the ReadingSet pointer will be deleted by
@@ -266,27 +306,10 @@ static void loadDataThread(SendingProcess *loadData)
 				 * at program exit by a cleanup routine
 				 *					
 				 * Note: the readings set can be optionally filtered
-				 * if plugin filters are set.
+				 * if plugin filters are set, this is done by the
+				 * filter thread which then sets the buffer.
 				 */
-
-				// Apply filters to the reading set
-				if (loadData->filterPipeline)
-				{
-					FilterPlugin *firstFilter = loadData->filterPipeline->getFirstFilterPlugin();
-					if (firstFilter)
-					{
-						// Make the load readIdx available to filters
-						loadData->setLoadBufferIndex(readIdx);
-						// Apply filters
-						applyFilters(loadData, readings);
-					}
-					else
-					{
-						// No filters: just set buffer with current data
-						loadData->m_buffer.at(readIdx) = readings;
-					}
-				}
-				else
+				if (!loadData->m_thread_filter)
 				{
 					// No filters: just set buffer with current data
 					loadData->m_buffer.at(readIdx) = readings;
@@ -294,11 +317,21 @@ static void loadDataThread(SendingProcess *loadData)
 
 				readMutex.unlock();
 
-				readIdx++;
+				if (loadData->m_thread_filter)
+				{
+					// Queue the readings for the filter thread
+					lock_guard<mutex> guard(filterMutex);
+					filterQueue.push_back(make_pair(readIdx, readings));
+					filterCv.notify_one();
+				}
+				else
+				{
+					// Unlock the sendData thread
+					unique_lock<mutex> lock(waitMutex);
+					cond_var.notify_one();
+				}
 
-				// Unlock the sendData thread
-				unique_lock<mutex> lock(waitMutex);
-				cond_var.notify_one();
+				readIdx++;
 			}
 			else
 			{
@@ -320,6 +353,18 @@ static void loadDataThread(SendingProcess *loadData)
 				  loadData->getLastFetchId());
 #endif
 
+	// Discard any block fetched ahead that will not be used
+	if (prefetch.valid())
+	{
+		try
+		{
+			delete prefetch.get();
+		}
+		catch (...)
+		{
+		}
+	}
+
 	/**
 	 * The loop is over: unlock the sendData thread
 	 */
@@ -327,6 +372,72 @@ static void loadDataThread(SendingProcess *loadData)
 	cond_var.notify_one();
 }
 
+/**
+ * Thread to filter the data loaded from storage
+ *
+ * The filters are applied outside of the buffer mutex, so that
+ * loading, filtering and sending of different blocks overlap.
+ * The filtered block is then set in the data buffer at the index
+ * the load thread has reserved for it.
+ *
+ * @param filterData    pointer to SendingProcess instance
+ */
+static void filterDataThread(SendingProcess *filterData)
+{
+	while (true)
+	{
+		unique_lock<mutex> lock(filterMutex);
+		if (filterQueue.empty())
+		{
+			if (!filterData->isRunning())
+			{
+				break;
+			}
+			filterCv.wait_for(lock, chrono::milliseconds(TASK_FETCH_SLEEP));
+			continue;
+		}
+		unsigned int filterIdx = filterQueue.front().first;
+		ReadingSet *readings = filterQueue.front().second;
+		filterQueue.pop_front();
+		lock.unlock();
+
+		// Make the load readIdx available to filters
+		filterData->setLoadBufferIndex(filterIdx);
+		// Apply filters
+		applyFilters(filterData, readings);
+
+		ReadingSet *filtered = SendingProcess::takeFilteredData();
+		if (!filtered)
+		{
+			// All the readings have been removed by the filters:
+			// the send thread still needs to update the last sent id
+			filtered = new ReadingSet();
+		}
+
+		readMutex.lock();
+		filterData->m_buffer.at(filterIdx) = filtered;
+		readMutex.unlock();
+
+		// Unlock the sendData thread
+		unique_lock<mutex> waitLock(waitMutex);
+		cond_var.notify_all();
+	}
+
+	// Remove the blocks not filtered
+	lock_guard<mutex> guard(filterMutex);
+	for (auto it = filterQueue.begin(); it != filterQueue.end(); ++it)
+	{
+		delete it->second;
+	}
+	filterQueue.clear();
+
+	/**
+	 * The loop is over: unlock the sendData thread
+	 */
+	unique_lock<mutex> waitLock(waitMutex);
+	cond_var.notify_all();
+}
+
 /**
  * Thread to send data to historian service
  *
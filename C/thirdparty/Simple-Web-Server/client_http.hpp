@@ -144,6 +144,8 @@ namespace SimpleWeb {
       std::size_t max_response_streambuf_size = std::numeric_limits<std::size_t>::max();
       /// Set proxy server (server:port)
       std::string proxy_server;
+      /// Path of a Unix domain socket to try before connecting to the server over TCP.
+      std::string local_socket;
     };
 
   protected:
@@ -841,6 +843,31 @@ namespace SimpleWeb {
     }
 
     void connect(const std::shared_ptr<Session> &session) override {
+      if(!session->connection->socket->lowest_layer().is_open() && !config.local_socket.empty())
+        connect_local(session);
+      else
+        connect_tcp(session);
+    }
+
+    /// Connect using the Unix domain socket, the descriptor is handed to the TCP socket
+    /// as only stream operations are performed on it. Falls back to TCP on failure.
+    void connect_local(const std::shared_ptr<Session> &session) {
+      auto local_socket = std::make_shared<asio::local::stream_protocol::socket>(*io_service);
+      local_socket->async_connect(asio::local::stream_protocol::endpoint(config.local_socket), [this, session, local_socket](const error_code &ec) {
+        auto lock = session->connection->handler_runner->continue_lock();
+        if(!lock)
+          return;
+        error_code assign_ec = ec;
+        if(!assign_ec)
+          session->connection->socket->assign(asio::ip::tcp::v6(), local_socket->release(), assign_ec);
+        if(!assign_ec)
+          this->write(session);
+        else
+          this->connect_tcp(session);
+      });
+    }
+
+    void connect_tcp(const std::shared_ptr<Session> &session) {
       if(!session->connection->socket->lowest_layer().is_open()) {
         auto resolver = std::make_shared<asio::ip::tcp::resolver>(*io_service);
         session->connection->set_timeout(config.timeout_connect);
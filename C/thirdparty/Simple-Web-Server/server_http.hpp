@@ -12,6 +12,7 @@
 #include <sstream>
 #include <thread>
 #include <unordered_set>
+#include <unistd.h>
 
 // Late 2017 TODO: remove the following checks and always use std::regex
 #ifdef USE_BOOST_REGEX
@@ -454,6 +455,31 @@ namespace SimpleWeb {
       }
     }
 
+    /// Also accept connections on a Unix domain socket. The socket is created at
+    /// path, which should be in a directory only its owner may access, and is
+    /// removed when the server stops. Call once the server has been started, for
+    /// instance from the start() callback.
+    void listen_local(const std::string &path, error_code &ec) noexcept {
+      std::lock_guard<std::mutex> lock(start_stop_mutex);
+
+      if(!io_service || local_acceptor) {
+        ec = make_error_code::make_error_code(errc::operation_not_permitted);
+        return;
+      }
+      local_acceptor = std::unique_ptr<asio::local::stream_protocol::acceptor>(new asio::local::stream_protocol::acceptor(*io_service));
+      local_acceptor->open(asio::local::stream_protocol(), ec);
+      if(!ec)
+        local_acceptor->bind(asio::local::stream_protocol::endpoint(path), ec);
+      if(!ec)
+        local_acceptor->listen(asio::socket_base::max_listen_connections, ec);
+      if(ec) {
+        local_acceptor.reset();
+        return;
+      }
+      local_path = path;
+      accept_local();
+    }
+
     // MR - added method to return the port we are listening on
     unsigned short getLocalPort() {
 	if (acceptor)
@@ -471,6 +497,15 @@ namespace SimpleWeb {
     void stop() noexcept {
       std::lock_guard<std::mutex> lock(start_stop_mutex);
 
+      if(local_acceptor) {
+        error_code ec;
+        local_acceptor->close(ec);
+        if(!local_path.empty()) {
+          ::unlink(local_path.c_str());
+          local_path.clear();
+        }
+      }
+
       if(acceptor) {
         error_code ec;
         acceptor->close(ec);
@@ -498,6 +533,8 @@ namespace SimpleWeb {
     bool internal_io_service = false;
 
     std::unique_ptr<asio::ip::tcp::acceptor> acceptor;
+    std::unique_ptr<asio::local::stream_protocol::acceptor> local_acceptor;
+    std::string local_path;
     std::vector<std::thread> threads;
 
     struct Connections {
@@ -512,6 +549,7 @@ namespace SimpleWeb {
 
     virtual void after_bind() {}
     virtual void accept() = 0;
+    virtual void accept_local() {}
 
     template <typename... Args>
     std::shared_ptr<Connection> create_connection(Args &&... args) noexcept {
@@ -820,6 +858,35 @@ namespace SimpleWeb {
           this->on_error(session->request, ec);
       });
     }
+
+    /// The request handling is written in terms of a TCP socket. Connections accepted on
+    /// the Unix domain socket hand their descriptor to that socket, only stream operations
+    /// are performed on it so the protocol of the descriptor does not matter.
+    void accept_local() override {
+      auto connection = create_connection(*io_service);
+      auto local_socket = std::make_shared<asio::local::stream_protocol::socket>(*io_service);
+
+      local_acceptor->async_accept(*local_socket, [this, connection, local_socket](const error_code &ec) {
+        auto lock = connection->handler_runner->continue_lock();
+        if(!lock)
+          return;
+
+        // Immediately start accepting a new connection (unless io_service has been stopped)
+        if(ec != error::operation_aborted)
+          this->accept_local();
+
+        auto session = std::make_shared<Session>(config.max_request_streambuf_size, connection);
+
+        error_code assign_ec = ec;
+        if(!assign_ec)
+          session->connection->socket->assign(asio::ip::tcp::v6(), local_socket->release(), assign_ec);
+
+        if(!assign_ec)
+          this->read(session);
+        else if(this->on_error)
+          this->on_error(session->request, assign_ec);
+      });
+    }
   };
 } // namespace SimpleWeb
 
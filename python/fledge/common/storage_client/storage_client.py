@@ -16,6 +16,7 @@ import aiohttp
 import http.client
 import json
 import time
+import urllib.parse
 from abc import ABC, abstractmethod
 
 from fledge.common import logger
@@ -490,6 +491,31 @@ class ReadingsStorageClientAsync(StorageClientAsync):
 
         return jdoc
 
+    async def latest(self, asset=None):
+        """
+
+        :param asset: the asset code whose latest reading is returned, all assets if None
+        :return: the latest reading of each asset
+        :Example:
+            curl -X  GET http://0.0.0.0:8080/storage/reading/latest?asset=sinusoid
+
+        """
+
+        get_url = '/storage/reading/latest'
+        if asset is not None:
+            get_url += '?asset={}'.format(urllib.parse.quote(asset))
+        url = 'http://' + self._base_url + get_url
+        async with aiohttp.ClientSession() as session:
+            async with session.get(url) as resp:
+                status_code = resp.status
+                jdoc = await resp.json()
+                if status_code not in range(200, 209):
+                    _LOGGER.error("GET url: %s, Error code: %d, reason: %s, details: %s", url, resp.status,
+                                  resp.reason, jdoc)
+                    raise StorageServerError(code=resp.status, reason=resp.reason, error=jdoc)
+
+        return jdoc
+
     async def query(self, query_payload):
         """
 
@@ -18,6 +18,7 @@ from aiohttp import web
 import aiohttp
 import json
 import signal
+import stat
 from datetime import datetime
 
 from fledge.common import logger
@@ -62,6 +63,7 @@ _SCRIPTS_DIR = os.path.expanduser(_FLEDGE_ROOT + '/scripts')
 # PID dir and filename
 _FLEDGE_PID_DIR= "/var/run"
 _FLEDGE_PID_FILE = "fledge.core.pid"
+_FLEDGE_SOCKET_DIR = "/var/run/sockets"
 
 
 SSL_PROTOCOLS = (asyncio.sslproto.SSLProtocol,)
@@ -286,6 +288,9 @@ class Server:
     _pidfile = None
     """ The PID file name """
 
+    _unix_socket = None
+    """ The Unix domain socket of the core management API """
+
     _asset_tracker = None
     """ Asset tracker """
 
@@ -596,6 +601,50 @@ class Server:
         server = loop.run_until_complete(coro)
         return server, handler
 
+    @staticmethod
+    def unix_socket_filename(port):
+        """ Get the full path of the Unix domain socket named after a port """
+        if _FLEDGE_DATA is None:
+            path = _FLEDGE_ROOT + "/data"
+        else:
+            path = _FLEDGE_DATA
+        return path + _FLEDGE_SOCKET_DIR + "/fledge.{}".format(port)
+
+    @classmethod
+    def _start_unix_app(cls, loop, handler, port):
+        """ Also serve the app on the Unix domain socket named after its port,
+        C services on the same host connect via this in preference to TCP loopback.
+        The socket directory is only accessible by the user Fledge runs as """
+        path = cls.unix_socket_filename(port)
+        try:
+            directory = os.path.dirname(path)
+            os.makedirs(directory, mode=0o700, exist_ok=True)
+            st = os.lstat(directory)
+            if not stat.S_ISDIR(st.st_mode) or st.st_uid != os.geteuid():
+                raise OSError('{} is not a directory owned by this user'.format(directory))
+            if st.st_mode & 0o077:
+                os.chmod(directory, 0o700)
+            # A socket left by an earlier run
+            if os.path.exists(path) and stat.S_ISSOCK(os.lstat(path).st_mode):
+                os.remove(path)
+            coro = loop.create_unix_server(handler, path)
+            server = loop.run_until_complete(coro)
+            cls._unix_socket = path
+            return server
+        except (OSError, NotImplementedError) as ex:
+            _logger.warning('Unable to listen on Unix domain socket for port %s: %s', port, str(ex))
+        return None
+
+    @classmethod
+    def _remove_unix_socket(cls):
+        """ Remove the Unix domain socket of the core management API """
+        if cls._unix_socket is not None:
+            try:
+                os.remove(cls._unix_socket)
+            except OSError:
+                pass
+            cls._unix_socket = None
+
     @staticmethod
     def pid_filename():
         """ Get the full path of Fledge PID file """
@@ -775,6 +824,7 @@ class Server:
             cls.core_server, cls.core_server_handler = cls._start_app(loop, cls.core_app, host, 0)
             address, cls.core_management_port = cls.core_server.sockets[0].getsockname()
             _logger.info('Management API started on http://%s:%s', address, cls.core_management_port)
+            cls._start_unix_app(loop, cls.core_server_handler, cls.core_management_port)
             # see http://<core_mgt_host>:<core_mgt_port>/fledge/service for registered services
             # start storage
             loop.run_until_complete(cls._start_storage(loop))
@@ -935,6 +985,9 @@ class Server:
             # stop core management api
             # loop.stop does it all
 
+            # Remove the Unix domain socket of the core management API
+            cls._remove_unix_socket()
+
             # Remove PID file
             cls._remove_pid()
         except Exception:
@@ -0,0 +1 @@
+DROP TABLE IF EXISTS fledge.readings_latest;
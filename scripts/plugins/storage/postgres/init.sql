@@ -390,6 +390,16 @@ CREATE INDEX readings_ix2
 CREATE INDEX readings_ix3
     ON fledge.readings USING btree (user_ts);
 
+-- Latest readings table
+-- The latest reading of each asset, kept by the storage plugin as the
+-- readings are appended and purged.
+CREATE TABLE fledge.readings_latest (
+    asset_code character varying(50)       NOT NULL,
+    id         bigint                      NOT NULL,                      -- The id of the reading in the readings table
+    reading    jsonb                       NOT NULL DEFAULT '{}'::jsonb,
+    user_ts    timestamp(6) with time zone NOT NULL,
+    CONSTRAINT readings_latest_pkey PRIMARY KEY (asset_code) );
+
 
 -- Streams table
 -- List of the streams to the Cloud.
@@ -0,0 +1,9 @@
+-- The latest reading of each asset, kept by the storage plugin as the
+-- readings are appended and purged.
+-- The storage plugin fills the table from the readings when it is empty.
+CREATE TABLE IF NOT EXISTS fledge.readings_latest (
+    asset_code character varying(50)       NOT NULL,
+    id         bigint                      NOT NULL,
+    reading    jsonb                       NOT NULL DEFAULT '{}'::jsonb,
+    user_ts    timestamp(6) with time zone NOT NULL,
+    CONSTRAINT readings_latest_pkey PRIMARY KEY (asset_code) );
@@ -0,0 +1,3 @@
+DROP TABLE IF EXISTS fledge.readings_latest;
+DROP TABLE IF EXISTS fledge.readings_rollups;
+DROP TABLE IF EXISTS fledge.readings_rollup_buckets;
@@ -48,6 +48,11 @@
 -- SCHEMA CREATION
 ----------------------------------------------------------------------
 
+-- Freed pages of purged readings are returned to the file system by the
+-- storage plugin in small steps, rather than by a full VACUUM.
+-- This must be set before any table is created.
+PRAGMA fledge.auto_vacuum = INCREMENTAL;
+
 ----- TABLES
 
 -- Log Codes Table
@@ -231,6 +236,38 @@ CREATE INDEX readings_ix2
 CREATE INDEX readings_ix3
     ON readings (user_ts);
 
+-- Latest readings table
+-- The latest reading of each asset, kept by the storage plugin as the
+-- readings are appended and purged. user_ts is in microseconds since the epoch.
+CREATE TABLE fledge.readings_latest (
+    asset_code TEXT                        PRIMARY KEY,
+    id         INTEGER                     NOT NULL,                         -- The id of the reading in the readings table
+    user_ts    INTEGER                     NOT NULL,
+    reading    TEXT                        NOT NULL
+) WITHOUT ROWID;
+
+-- Readings rollups
+-- The rollups of the readings kept by the storage plugin, by bucket size in
+-- seconds, and the id of the last reading added to each.
+CREATE TABLE fledge.readings_rollups (
+    size       INTEGER                     PRIMARY KEY,
+    last_id    INTEGER                     NOT NULL
+);
+
+-- The min, max, sum and count of each datapoint of each asset per time bucket
+-- of each rollup. The values are untyped, they compare as those of the readings do.
+CREATE TABLE fledge.readings_rollup_buckets (
+    size       INTEGER                     NOT NULL,
+    asset_code TEXT                        NOT NULL,
+    datapoint  TEXT                        NOT NULL,
+    bucket     INTEGER                     NOT NULL,                         -- The user timestamp in seconds divided by the size
+    min,
+    max,
+    sum,
+    count      INTEGER                     NOT NULL,
+    PRIMARY KEY (size, asset_code, bucket, datapoint)
+) WITHOUT ROWID;
+
 -- Streams table
 -- List of the streams to the Cloud.
 CREATE TABLE fledge.streams (
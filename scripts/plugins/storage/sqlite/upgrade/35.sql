@@ -0,0 +1,29 @@
+-- The latest reading of each asset, kept by the storage plugin as the
+-- readings are appended and purged. user_ts is in microseconds since the epoch.
+-- The storage plugin fills the table from the readings when it is empty.
+CREATE TABLE IF NOT EXISTS fledge.readings_latest (
+    asset_code TEXT                        PRIMARY KEY,
+    id         INTEGER                     NOT NULL,
+    user_ts    INTEGER                     NOT NULL,
+    reading    TEXT                        NOT NULL
+) WITHOUT ROWID;
+
+-- The rollups of the readings, by bucket size in seconds, and the id of the
+-- last reading added to each. The rollups are rebuilt from the readings.
+DROP TABLE IF EXISTS fledge.readings_rollups;
+CREATE TABLE fledge.readings_rollups (
+    size       INTEGER                     PRIMARY KEY,
+    last_id    INTEGER                     NOT NULL
+);
+
+CREATE TABLE IF NOT EXISTS fledge.readings_rollup_buckets (
+    size       INTEGER                     NOT NULL,
+    asset_code TEXT                        NOT NULL,
+    datapoint  TEXT                        NOT NULL,
+    bucket     INTEGER                     NOT NULL,
+    min,
+    max,
+    sum,
+    count      INTEGER                     NOT NULL,
+    PRIMARY KEY (size, asset_code, bucket, datapoint)
+) WITHOUT ROWID;
@@ -0,0 +1,119 @@
+/*
+ * Fledge filter plugin used by the filter pipeline unit tests
+ *
+ * Copyright (c) 2026 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ */
+#include <plugin_api.h>
+#include <config_category.h>
+#include <filter_plugin.h>
+#include <reading_set.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * The filter adds a datapoint named after its category to each
+ * reading and drops the readings of the asset given by the
+ * "drop" item of its configuration, if any.
+ *
+ * When built with TEST_FILTER_INGEST_READING the filter also
+ * exports the "plugin_ingest_reading" entry point and may be
+ * fused with the filters around it. The value of the datapoint
+ * is the entry point that added it: 1 for "plugin_ingest" and 2
+ * for "plugin_ingest_reading".
+ */
+typedef struct
+{
+	string		tag;
+	string		drop;
+	OUTPUT_HANDLE	*outHandle;
+	OUTPUT_STREAM	output;
+} FILTER_INFO;
+
+static PLUGIN_INFORMATION info = {
+	TEST_FILTER_NAME,	// Name
+	"1.0.0",		// Version
+	0,			// Flags
+	PLUGIN_TYPE_FILTER,	// Type
+	"1.0.0",		// Interface version
+	"{ \"plugin\" : { \"description\" : \"Test filter\", \"type\" : \"string\", "
+		"\"default\" : \"" TEST_FILTER_NAME "\", \"readonly\" : \"true\" } }"
+};
+
+/**
+ * Filter a single reading
+ *
+ * @param filter	The filter instance
+ * @param reading	The reading, modified in place
+ * @param entry		The entry point called
+ * @return		False if the reading is dropped
+ */
+static bool filterReading(FILTER_INFO *filter, Reading *reading, long entry)
+{
+	if (reading->getAssetName().compare(filter->drop) == 0)
+	{
+		return false;
+	}
+	DatapointValue value(entry);
+	reading->addDatapoint(new Datapoint(filter->tag, value));
+	return true;
+}
+
+extern "C" {
+
+PLUGIN_INFORMATION *plugin_info()
+{
+	return &info;
+}
+
+PLUGIN_HANDLE plugin_init(ConfigCategory *config,
+			  OUTPUT_HANDLE *outHandle,
+			  OUTPUT_STREAM output)
+{
+	FILTER_INFO *filter = new FILTER_INFO;
+	filter->tag = config->getName();
+	if (config->itemExists("drop"))
+	{
+		filter->drop = config->getValue("drop");
+	}
+	filter->outHandle = outHandle;
+	filter->output = output;
+	return (PLUGIN_HANDLE)filter;
+}
+
+void plugin_ingest(PLUGIN_HANDLE handle, READINGSET *readingSet)
+{
+	FILTER_INFO *filter = (FILTER_INFO *)handle;
+	vector<Reading *>* readings = readingSet->getAllReadingsPtr();
+	for (auto it = readings->begin(); it != readings->end(); ++it)
+	{
+		if (!filterReading(filter, *it, 1))
+		{
+			delete *it;
+			*it = NULL;
+		}
+	}
+	readingSet->compact();
+	filter->output(filter->outHandle, readingSet);
+}
+
+#ifdef TEST_FILTER_INGEST_READING
+bool plugin_ingest_reading(PLUGIN_HANDLE handle, Reading *reading)
+{
+	return filterReading((FILTER_INFO *)handle, reading, 2);
+}
+#endif
+
+void plugin_reconfigure(PLUGIN_HANDLE handle, const string& newConfig)
+{
+}
+
+void plugin_shutdown(PLUGIN_HANDLE handle)
+{
+	delete (FILTER_INFO *)handle;
+}
+
+};
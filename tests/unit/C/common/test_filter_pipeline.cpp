@@ -0,0 +1,279 @@
+#include <gtest/gtest.h>
+#include <filter_pipeline.h>
+#include <storage_client.h>
+#include <reading.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * A filter pipeline built from the test filter plugins, without the
+ * configuration categories the management client would provide
+ */
+class TestFilterPipeline : public FilterPipeline
+{
+public:
+	TestFilterPipeline(StorageClient& storage) : FilterPipeline(NULL, storage, "test"),
+						     m_outputCalls(0)
+	{
+		setenv("FLEDGE_PLUGIN_PATH", TEST_PLUGIN_PATH, 1);
+	};
+	~TestFilterPipeline()
+	{
+		cleanupFilters("test");
+		for (auto it = m_output.begin(); it != m_output.end(); ++it)
+		{
+			delete *it;
+		}
+	};
+
+	/**
+	 * Load and set up the filters
+	 *
+	 * @param filters	The filter name, plugin and asset to drop of each filter
+	 * @param assets	The JSON object with the asset routes, if any
+	 */
+	void	load(const vector<vector<string>>& filters, const char *assets = NULL)
+	{
+		cleanupFilters("test");
+		PluginManager *manager = PluginManager::getInstance();
+		for (auto it = filters.cbegin(); it != filters.cend(); ++it)
+		{
+			PLUGIN_HANDLE handle = manager->loadPlugin((*it)[1], PLUGIN_TYPE_FILTER);
+			ASSERT_TRUE(handle != NULL);
+			m_filters.push_back(new FilterPlugin((*it)[0], handle));
+		}
+		if (assets)
+		{
+			Document doc;
+			doc.Parse(assets);
+			loadAssetRoutes(doc);
+		}
+		for (unsigned int i = 0; i < m_filters.size(); i++)
+		{
+			string items("{}");
+			if (!filters[i][2].empty())
+			{
+				items = "{ \"drop\" : { \"description\" : \"drop\", \"type\" : \"string\", "
+					"\"default\" : \"\", \"value\" : \"" + filters[i][2] + "\" } }";
+			}
+			ConfigCategory config(filters[i][0], items);
+			OUTPUT_HANDLE *outHandle;
+			OUTPUT_STREAM output;
+			if (i + 1 < m_filters.size())
+			{
+				outHandle = (OUTPUT_HANDLE *)m_filters[i + 1];
+				output = passToOnwardFilter;
+			}
+			else
+			{
+				outHandle = (OUTPUT_HANDLE *)this;
+				output = useFilteredData;
+			}
+			setFilterOutput(i, outHandle, output);
+			m_filters[i]->init(config, outHandle, output);
+		}
+		fuseFilters();
+	};
+
+	unsigned int	stageCount() const { return m_stages.size(); };
+
+	static void	passToOnwardFilter(OUTPUT_HANDLE *outHandle, READINGSET *readings)
+	{
+		((FilterPlugin *)outHandle)->ingest(readings);
+	};
+
+	static void	useFilteredData(OUTPUT_HANDLE *outHandle, READINGSET *readings)
+	{
+		TestFilterPipeline *pipeline = (TestFilterPipeline *)outHandle;
+		pipeline->m_outputCalls++;
+		const vector<Reading *>& all = readings->getAllReadings();
+		pipeline->m_output.insert(pipeline->m_output.end(), all.begin(), all.end());
+		readings->clear();
+		delete readings;
+	};
+
+	vector<Reading *>	m_output;
+	unsigned int		m_outputCalls;
+};
+
+/**
+ * Build a reading set with one reading for each asset name
+ */
+static ReadingSet *readingsOf(const vector<string>& assets)
+{
+	vector<Reading *> readings;
+	for (auto it = assets.cbegin(); it != assets.cend(); ++it)
+	{
+		DatapointValue value((long)0);
+		readings.push_back(new Reading(*it, new Datapoint("value", value)));
+	}
+	return new ReadingSet(&readings);
+}
+
+/**
+ * Return the names of the datapoints of a reading
+ */
+static string datapointsOf(Reading *reading)
+{
+	string names;
+	vector<Datapoint *>& datapoints = reading->getReadingData();
+	for (auto it = datapoints.cbegin(); it != datapoints.cend(); ++it)
+	{
+		if (!names.empty())
+			names += ",";
+		names += (*it)->getName();
+	}
+	return names;
+}
+
+TEST(FilterPipelineTest, RoutedOrder)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfilter", "" }, { "b", "testfilter", "" } },
+		      "{ \"a\" : \"x.*\" }");
+	ASSERT_EQ(2, pipeline.stageCount());
+
+	pipeline.ingest(readingsOf({ "x1", "y1", "y2", "x2", "y3" }));
+	ASSERT_EQ(5, pipeline.m_output.size());
+	ASSERT_EQ("x1", pipeline.m_output[0]->getAssetName());
+	ASSERT_EQ("y1", pipeline.m_output[1]->getAssetName());
+	ASSERT_EQ("y2", pipeline.m_output[2]->getAssetName());
+	ASSERT_EQ("x2", pipeline.m_output[3]->getAssetName());
+	ASSERT_EQ("y3", pipeline.m_output[4]->getAssetName());
+	ASSERT_EQ("value,a,b", datapointsOf(pipeline.m_output[0]));
+	ASSERT_EQ("value,b", datapointsOf(pipeline.m_output[1]));
+	ASSERT_EQ("value,a,b", datapointsOf(pipeline.m_output[3]));
+}
+
+TEST(FilterPipelineTest, RoutedInterleaved)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfilter", "" }, { "b", "testfilter", "" } },
+		      "{ \"a\" : \"x.*\", \"b\" : \"y.*\" }");
+
+	pipeline.ingest(readingsOf({ "x1", "y1", "x2", "y2", "x3", "y3" }));
+	// The pipeline output is called once for the whole set
+	ASSERT_EQ(1, pipeline.m_outputCalls);
+	ASSERT_EQ(6, pipeline.m_output.size());
+	const char *assets[] = { "x1", "y1", "x2", "y2", "x3", "y3" };
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		ASSERT_EQ(assets[i], pipeline.m_output[i]->getAssetName());
+		ASSERT_EQ(i % 2 ? "value,b" : "value,a", datapointsOf(pipeline.m_output[i]));
+	}
+}
+
+TEST(FilterPipelineTest, RoutedDrop)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfilter", "x2" }, { "b", "testfilter", "" } },
+		      "{ \"a\" : \"x.*\" }");
+
+	pipeline.ingest(readingsOf({ "y1", "x1", "x2", "y2" }));
+	ASSERT_EQ(1, pipeline.m_outputCalls);
+	ASSERT_EQ(3, pipeline.m_output.size());
+	ASSERT_EQ("y1", pipeline.m_output[0]->getAssetName());
+	ASSERT_EQ("x1", pipeline.m_output[1]->getAssetName());
+	ASSERT_EQ("y2", pipeline.m_output[2]->getAssetName());
+}
+
+TEST(FilterPipelineTest, Reload)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfilter", "" }, { "b", "testfilter", "" } },
+		      "{ \"a\" : \"x.*\" }");
+	pipeline.ingest(readingsOf({ "x1", "y1" }));
+	ASSERT_EQ("value,a,b", datapointsOf(pipeline.m_output[0]));
+	ASSERT_EQ("value,b", datapointsOf(pipeline.m_output[1]));
+
+	// New routes replace the previous ones and their cached results
+	pipeline.load({ { "a", "testfilter", "" }, { "b", "testfilter", "" } },
+		      "{ \"a\" : \"y.*\" }");
+	ASSERT_EQ(2, pipeline.stageCount());
+	pipeline.ingest(readingsOf({ "x1", "y1" }));
+	ASSERT_EQ(4, pipeline.m_output.size());
+	ASSERT_EQ("value,b", datapointsOf(pipeline.m_output[2]));
+	ASSERT_EQ("value,a,b", datapointsOf(pipeline.m_output[3]));
+
+	// No routes at all
+	pipeline.load({ { "a", "testfilter", "" }, { "b", "testfilter", "" } });
+	ASSERT_EQ(0, pipeline.stageCount());
+	pipeline.ingest(readingsOf({ "x1", "y1" }));
+	ASSERT_EQ(6, pipeline.m_output.size());
+	ASSERT_EQ("value,a,b", datapointsOf(pipeline.m_output[4]));
+	ASSERT_EQ("value,a,b", datapointsOf(pipeline.m_output[5]));
+}
+
+/**
+ * Return the names of the datapoints of a reading, with the entry
+ * point of the test filter that added them
+ */
+static string entriesOf(Reading *reading)
+{
+	string names;
+	vector<Datapoint *>& datapoints = reading->getReadingData();
+	for (auto it = datapoints.cbegin() + 1; it != datapoints.cend(); ++it)
+	{
+		if (!names.empty())
+			names += ",";
+		names += (*it)->getName() + "=" + (*it)->getData().toString();
+	}
+	return names;
+}
+
+TEST(FilterPipelineTest, Fused)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfusefilter", "" },
+			{ "b", "testfusefilter", "x2" },
+			{ "c", "testfilter", "" },
+			{ "d", "testfusefilter", "" } });
+
+	pipeline.ingest(readingsOf({ "x1", "x2", "x3" }));
+	ASSERT_EQ(2, pipeline.m_output.size());
+	ASSERT_EQ("x1", pipeline.m_output[0]->getAssetName());
+	ASSERT_EQ("x3", pipeline.m_output[1]->getAssetName());
+	// The first two filters are executed in a single pass
+	ASSERT_EQ("a=2,b=2,c=1,d=1", entriesOf(pipeline.m_output[0]));
+	ASSERT_EQ("a=2,b=2,c=1,d=1", entriesOf(pipeline.m_output[1]));
+}
+
+TEST(FilterPipelineTest, FusedAll)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfusefilter", "x1" },
+			{ "b", "testfusefilter", "x3" } });
+
+	pipeline.ingest(readingsOf({ "x1", "x2", "x3" }));
+	ASSERT_EQ(1, pipeline.m_output.size());
+	ASSERT_EQ("x2", pipeline.m_output[0]->getAssetName());
+	ASSERT_EQ("a=2,b=2", entriesOf(pipeline.m_output[0]));
+
+	// Every reading dropped
+	pipeline.ingest(readingsOf({ "x1", "x3" }));
+	ASSERT_EQ(1, pipeline.m_output.size());
+}
+
+TEST(FilterPipelineTest, RoutedNotFused)
+{
+	StorageClient storage("localhost", 8080);
+	TestFilterPipeline pipeline(storage);
+	pipeline.load({ { "a", "testfusefilter", "" },
+			{ "b", "testfusefilter", "" } },
+		      "{ \"b\" : \"x.*\" }");
+
+	pipeline.ingest(readingsOf({ "x1", "y1" }));
+	ASSERT_EQ(2, pipeline.m_output.size());
+	ASSERT_EQ("a=1,b=1", entriesOf(pipeline.m_output[0]));
+	ASSERT_EQ("a=1", entriesOf(pipeline.m_output[1]));
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <latency_histogram.h>
+#include <rapidjson/document.h>
+#include <string>
+
+using namespace std;
+using namespace rapidjson;
+
+TEST(LatencyHistogram, Empty)
+{
+	LatencyHistogram histogram;
+	ASSERT_EQ(0UL, histogram.count());
+	ASSERT_EQ(0UL, histogram.percentile(50));
+	Document doc;
+	ASSERT_FALSE(doc.Parse(histogram.toJSON().c_str()).HasParseError());
+	ASSERT_EQ(0, doc["count"].GetInt());
+	ASSERT_EQ(0, doc["buckets"].MemberCount());
+}
+
+TEST(LatencyHistogram, Buckets)
+{
+	LatencyHistogram histogram;
+	histogram.record(0);
+	histogram.record(1);
+	histogram.record(3, 100, 10);
+	histogram.record(4, 50, 5);
+	histogram.record(1000);
+	ASSERT_EQ(5UL, histogram.count());
+
+	Document doc;
+	ASSERT_FALSE(doc.Parse(histogram.toJSON().c_str()).HasParseError());
+	ASSERT_EQ(5, doc["count"].GetInt());
+	ASSERT_EQ(1000, doc["maxUs"].GetInt());
+	ASSERT_EQ(150, doc["bytesIn"].GetInt());
+	ASSERT_EQ(15, doc["bytesOut"].GetInt());
+	ASSERT_EQ(2, doc["buckets"]["1"].GetInt());
+	ASSERT_EQ(2, doc["buckets"]["4"].GetInt());
+	ASSERT_EQ(1, doc["buckets"]["1024"].GetInt());
+	ASSERT_EQ(4UL, histogram.percentile(50));
+	ASSERT_EQ(1024UL, histogram.percentile(99));
+}
+
+TEST(LatencyHistogram, Overflow)
+{
+	LatencyHistogram histogram;
+	histogram.record(60000000);
+	ASSERT_EQ(60000000UL, histogram.percentile(99));
+}
+
+TEST(LatencyHistogram, Timer)
+{
+	LatencyHistogram histogram;
+	{
+		LatencyTimer timer(&histogram);
+		timer.bytes(10, 20);
+	}
+	{
+		LatencyTimer disabled(NULL);
+	}
+	ASSERT_EQ(1UL, histogram.count());
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <reading_ring.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <string>
+
+using namespace std;
+
+TEST(ReadingRing, SizeMustBePowerOfTwo)
+{
+	ReadingRing ring;
+	ASSERT_FALSE(ring.create(5000));
+}
+
+TEST(ReadingRing, WriteAndConsume)
+{
+	ReadingRing producer, consumer;
+	ASSERT_TRUE(producer.create(4096));
+	ASSERT_TRUE(consumer.attach(dup(producer.memFd()), dup(producer.dataEvent()),
+				dup(producer.spaceEvent())));
+
+	string record;
+	ASSERT_FALSE(consumer.next(record));
+	ASSERT_TRUE(consumer.idle());
+
+	ASSERT_TRUE(producer.write("first", 5, 0));
+	ASSERT_TRUE(producer.write("second", 6, 0));
+	ASSERT_FALSE(consumer.idle());
+
+	ASSERT_TRUE(consumer.next(record));
+	ASSERT_EQ(0, record.compare("first"));
+	// The record is not removed until it is consumed
+	ASSERT_TRUE(consumer.next(record));
+	ASSERT_EQ(0, record.compare("first"));
+	consumer.consume();
+	ASSERT_TRUE(consumer.next(record));
+	ASSERT_EQ(0, record.compare("second"));
+	consumer.consume();
+	ASSERT_FALSE(consumer.next(record));
+}
+
+TEST(ReadingRing, Wrap)
+{
+	ReadingRing producer, consumer;
+	ASSERT_TRUE(producer.create(1024));
+	ASSERT_TRUE(consumer.attach(dup(producer.memFd()), dup(producer.dataEvent()),
+				dup(producer.spaceEvent())));
+
+	string record;
+	for (int i = 0; i < 100; i++)
+	{
+		string data(300, 'a' + (i % 26));
+		ASSERT_TRUE(producer.write(data.data(), data.length(), 0));
+		ASSERT_TRUE(consumer.next(record));
+		ASSERT_EQ(data, record);
+		consumer.consume();
+	}
+}
+
+TEST(ReadingRing, Full)
+{
+	ReadingRing producer, consumer;
+	ASSERT_TRUE(producer.create(1024));
+	ASSERT_TRUE(consumer.attach(dup(producer.memFd()), dup(producer.dataEvent()),
+				dup(producer.spaceEvent())));
+
+	string data(500, 'x');
+	ASSERT_TRUE(producer.write(data.data(), data.length(), 0));
+	ASSERT_TRUE(producer.write(data.data(), data.length(), 0));
+	ASSERT_FALSE(producer.write(data.data(), data.length(), 10));
+	ASSERT_FALSE(producer.write(data.data(), 2000, 0));
+
+	string record;
+	ASSERT_TRUE(consumer.next(record));
+	consumer.consume();
+	ASSERT_TRUE(producer.write(data.data(), data.length(), 0));
+}
+
+TEST(ReadingRing, Sealed)
+{
+	ReadingRing producer;
+	ASSERT_TRUE(producer.create(4096));
+	// The size of the shared memory can not be changed once created
+	ASSERT_EQ(-1, ftruncate(producer.memFd(), 1024));
+	ASSERT_EQ(-1, ftruncate(producer.memFd(), 1024 * 1024));
+	ASSERT_EQ(-1, fcntl(producer.memFd(), F_ADD_SEALS, F_SEAL_WRITE));
+}
+
+TEST(ReadingRing, UnsealedRejected)
+{
+	ReadingRing producer, consumer;
+	ASSERT_TRUE(producer.create(4096));
+
+	// A copy of the ring in shared memory that could be truncated
+	int memFd = memfd_create("unsealed", MFD_CLOEXEC);
+	ASSERT_NE(-1, memFd);
+	ASSERT_EQ(0, ftruncate(memFd, 4096 + 4096));
+	void *addr = mmap(NULL, 4096 + 4096, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+	void *ring = mmap(NULL, 4096 + 4096, PROT_READ, MAP_SHARED, producer.memFd(), 0);
+	ASSERT_NE(MAP_FAILED, addr);
+	ASSERT_NE(MAP_FAILED, ring);
+	memcpy(addr, ring, 4096 + 4096);
+	munmap(addr, 4096 + 4096);
+	munmap(ring, 4096 + 4096);
+
+	ASSERT_FALSE(consumer.attach(memFd, dup(producer.dataEvent()), dup(producer.spaceEvent())));
+}
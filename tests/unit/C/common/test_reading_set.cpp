@@ -60,3 +60,14 @@ TEST(ReadingSet, NotificationIndex)
 	ASSERT_NE(json.find(string("\"readkey\" : ")), 0);
 	ASSERT_NE(json.find(string("\"user_ts\" : \"2017-09-22 14:47:18.872708\"")), 0);
 }
+
+TEST(ReadingSet, Compact)
+{
+	ReadingSet readingSet(input);
+	vector<Reading *>* readings = readingSet.getAllReadingsPtr();
+	delete (*readings)[0];
+	(*readings)[0] = NULL;
+	readingSet.compact();
+	ASSERT_EQ(1, readingSet.getCount());
+	ASSERT_EQ(2, readingSet[0]->getId());
+}
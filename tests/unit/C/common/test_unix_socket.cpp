@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <unix_socket.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+/**
+ * Run the tests with FLEDGE_DATA set to a directory of their own
+ */
+class UnixSocketTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			const char *data = getenv("FLEDGE_DATA");
+			m_saved = data != NULL;
+			if (data)
+				m_data = data;
+			char dir[] = "/tmp/unix_socket_XXXXXX";
+			ASSERT_TRUE(mkdtemp(dir) != NULL);
+			m_dir = dir;
+			setenv("FLEDGE_DATA", m_dir.c_str(), 1);
+		}
+		void TearDown()
+		{
+			string cmd = "rm -rf " + m_dir;
+			system(cmd.c_str());
+			if (m_saved)
+				setenv("FLEDGE_DATA", m_data.c_str(), 1);
+			else
+				unsetenv("FLEDGE_DATA");
+		}
+		string	m_dir;
+		string	m_data;
+		bool	m_saved;
+};
+
+TEST_F(UnixSocketTest, Name)
+{
+	ASSERT_EQ(m_dir + "/var/run/sockets/fledge.8080", unixSocketName(8080));
+	ASSERT_EQ(unixSocketName(8080), unixSocketFor("localhost", 8080));
+	ASSERT_EQ("", unixSocketFor("192.0.2.1", 8080));
+}
+
+TEST_F(UnixSocketTest, NameTooLong)
+{
+	setenv("FLEDGE_DATA", (m_dir + "/" + string(100, 'd')).c_str(), 1);
+	ASSERT_EQ("", unixSocketName(8080));
+	ASSERT_EQ("", unixSocketListenName(8080));
+}
+
+TEST_F(UnixSocketTest, DirectoryOwnerOnly)
+{
+	string name = unixSocketListenName(8080);
+	ASSERT_EQ(unixSocketName(8080), name);
+
+	struct stat st;
+	ASSERT_EQ(0, stat((m_dir + "/var/run/sockets").c_str(), &st));
+	ASSERT_TRUE(S_ISDIR(st.st_mode));
+	ASSERT_EQ(0700, st.st_mode & 0777);
+
+	// Access by others is taken away again
+	chmod((m_dir + "/var/run/sockets").c_str(), 0777);
+	ASSERT_EQ(name, unixSocketListenName(8080));
+	ASSERT_EQ(0, stat((m_dir + "/var/run/sockets").c_str(), &st));
+	ASSERT_EQ(0700, st.st_mode & 0777);
+}
+
+TEST_F(UnixSocketTest, StaleSocketRemoved)
+{
+	string name = unixSocketListenName(8080);
+	FILE *fp = fopen(name.c_str(), "w");
+	ASSERT_TRUE(fp != NULL);
+	fclose(fp);
+	ASSERT_EQ(name, unixSocketListenName(8080));
+	struct stat st;
+	ASSERT_NE(0, stat(name.c_str(), &st));
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <sql_buffer.h>
+#include <readings_payload.h>
 #include <string.h>
 #include <string>
 
@@ -206,3 +207,134 @@ SQLBuffer	sql;
 	delete[] buf;
 }
 
+
+/**
+ * Test the readings of a payload refer to the JSON text they were sent as
+ */
+TEST(ReadingsPayloadTest, readings) {
+ReadingsPayload	payload;
+
+	ASSERT_TRUE(payload.parse("{ \"readings\" : [ "
+		"{ \"asset_code\" : \"a1\", \"user_ts\" : \"2020-01-01 10:00:00.1\", \"reading\" : { \"x\" : 1.50, \"s\" : \"a b\" } }, "
+		"{ \"reading\" : {\"y\":[1, {\"z\" : null}]}, \"read_key\" : { \"asset_code\" : 1 }, \"asset_code\" : \"a2\", \"user_ts\" : \"now()\" } ] }"));
+	const ReadingBatch *batch = payload.batch();
+	ASSERT_EQ(2, batch->count);
+	ASSERT_STREQ("a1", batch->readings[0].assetCode);
+	ASSERT_EQ(2, batch->readings[0].assetCodeLength);
+	ASSERT_STREQ("2020-01-01 10:00:00.1", batch->readings[0].userTs);
+	ASSERT_STREQ("{\"x\":1.50,\"s\":\"a b\"}", batch->readings[0].reading);
+	ASSERT_EQ(strlen(batch->readings[0].reading), batch->readings[0].readingLength);
+	ASSERT_STREQ("a2", batch->readings[1].assetCode);
+	ASSERT_STREQ("now()", batch->readings[1].userTs);
+	ASSERT_STREQ("{\"y\":[1,{\"z\":null}]}", batch->readings[1].reading);
+}
+
+/**
+ * Test an asset code with escape sequences is decoded
+ */
+TEST(ReadingsPayloadTest, escaped) {
+ReadingsPayload	payload;
+
+	ASSERT_TRUE(payload.parse("{ \"readings\" : [ { \"asset_code\" : \"a\\u0031\\\"\", "
+		"\"user_ts\" : \"now()\", \"reading\" : { \"s\" : \"\\\" }\" } } ] }"));
+	ASSERT_EQ(1, payload.batch()->count);
+	ASSERT_STREQ("a1\"", payload.batch()->readings[0].assetCode);
+	ASSERT_EQ(3, payload.batch()->readings[0].assetCodeLength);
+	ASSERT_STREQ("{\"s\":\"\\\" }\"}", payload.batch()->readings[0].reading);
+}
+
+/**
+ * Test payloads that are refused
+ */
+TEST(ReadingsPayloadTest, invalid) {
+ReadingsPayload	payload;
+
+	ASSERT_FALSE(payload.parse("{ \"readings\" : [ "));
+	ASSERT_FALSE(payload.parse("{ \"values\" : [] }"));
+	ASSERT_STREQ("Payload is missing a readings array", payload.error().c_str());
+	ASSERT_FALSE(payload.parse("{ \"readings\" : {} }"));
+	ASSERT_STREQ("Payload is missing the readings array", payload.error().c_str());
+	ASSERT_FALSE(payload.parse("{ \"readings\" : [ 1 ] }"));
+	ASSERT_STREQ("Each reading in the readings array must be an object", payload.error().c_str());
+	ASSERT_FALSE(payload.parse("{ \"readings\" : [ { \"asset_code\" : \"a\", \"reading\" : {} } ] }"));
+	ASSERT_FALSE(payload.parse("{ \"readings\" : [ { \"asset_code\" : 1, \"user_ts\" : \"now()\", \"reading\" : {} } ] }"));
+	ASSERT_TRUE(payload.parse("{ \"readings\" : [], \"other\" : [ {} ] }"));
+	ASSERT_EQ(0, payload.batch()->count);
+}
+
+/**
+ * Test properties other than those of the batch are skipped
+ */
+TEST(ReadingsPayloadTest, valid) {
+ReadingsPayload	payload;
+
+	ASSERT_TRUE(payload.parse("{ \"readings\" : [ "
+		"{ \"asset_code\" : \"pump\", \"user_ts\" : \"2020-01-01 10:00:00.000000\", "
+			"\"reading\" : { \"speed\" : 10, \"state\" : \"on\" } }, "
+		"{ \"read_key\" : \"x\", \"asset_code\" : \"valve\", \"user_ts\" : \"now()\", "
+			"\"reading\" : { \"open\" : [ 1, 2 ] } } ] }"));
+	const ReadingBatch *batch = payload.batch();
+	ASSERT_EQ(2, batch->count);
+	ASSERT_STREQ("pump", batch->readings[0].assetCode);
+	ASSERT_EQ(4, batch->readings[0].assetCodeLength);
+	ASSERT_STREQ("2020-01-01 10:00:00.000000", batch->readings[0].userTs);
+	ASSERT_STREQ("{\"speed\":10,\"state\":\"on\"}", batch->readings[0].reading);
+	ASSERT_STREQ("valve", batch->readings[1].assetCode);
+	ASSERT_STREQ("now()", batch->readings[1].userTs);
+	ASSERT_STREQ("{\"open\":[1,2]}", batch->readings[1].reading);
+	ASSERT_EQ(strlen(batch->readings[1].reading), batch->readings[1].readingLength);
+}
+
+/**
+ * Test the whitespace and escaped quotes within the strings of a reading are kept
+ */
+TEST(ReadingsPayloadTest, escapedQuote) {
+ReadingsPayload	payload;
+
+	ASSERT_TRUE(payload.parse("{ \"readings\" : [ { \"asset_code\" : \"a\", \"user_ts\" : \"now()\", "
+			"\"reading\" : { \"text\" : \"say \\\"} { ]\\\" \" } } ] }"));
+	ASSERT_STREQ("{\"text\":\"say \\\"} { ]\\\" \"}", payload.batch()->readings[0].reading);
+
+	ASSERT_TRUE(payload.parse("{ \"readings\" : [ { \"asset_code\" : \"a\\\"b\", \"user_ts\" : \"now()\", "
+			"\"reading\" : { \"x\" : 1 } } ] }"));
+	ASSERT_STREQ("a\"b", payload.batch()->readings[0].assetCode);
+}
+
+/**
+ * Test readings that are not well formed JSON are refused
+ */
+TEST(ReadingsPayloadTest, malformed) {
+ReadingsPayload	payload;
+const char *readings[] = {
+		"{ \"a\" : }",
+		"{ \"a\" 1 }",
+		"{ \"a\" : 1, }",
+		"{ \"a\" : [ 1 } ]",
+		"{ \"a\" : tru }",
+		"{ a : 1 }"
+	};
+
+	for (auto reading : readings)
+	{
+		string json = "{ \"readings\" : [ { \"asset_code\" : \"a\", \"user_ts\" : \"now()\", \"reading\" : ";
+		json += reading;
+		json += " } ] }";
+		ASSERT_FALSE(payload.parse(json.c_str())) << reading;
+		ASSERT_EQ(0, payload.batch()->count);
+	}
+}
+
+/**
+ * Test every truncation of a payload is refused
+ */
+TEST(ReadingsPayloadTest, truncated) {
+ReadingsPayload	payload;
+string json = "{ \"readings\" : [ { \"asset_code\" : \"a\", \"user_ts\" : \"now()\", "
+			"\"reading\" : { \"x\" : 1 } } ] }";
+
+	ASSERT_TRUE(payload.parse(json.c_str()));
+	for (size_t length = 0; length < json.length(); length++)
+	{
+		ASSERT_FALSE(payload.parse(json.substr(0, length).c_str())) << length;
+	}
+}
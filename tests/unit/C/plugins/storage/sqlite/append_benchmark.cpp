@@ -0,0 +1,155 @@
+/*
+ * Fledge storage service.
+ *
+ * Copyright (c) 2020 Dianomic Systems Inc.
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ */
+#include <reading_batch.h>
+#include <logger.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+#define BATCH_READINGS	10000
+#define ASSETS		10
+
+typedef void *PLUGIN_HANDLE;
+
+static PLUGIN_HANDLE (*pluginInit)();
+static int (*pluginAppend)(PLUGIN_HANDLE, const char *);
+static int (*pluginAppendBatch)(PLUGIN_HANDLE, const ReadingBatch *);
+static bool (*pluginShutdown)(PLUGIN_HANDLE);
+
+/**
+ * The readings of a batch, held so that the batch can refer to them
+ */
+class Readings {
+	public:
+		Readings(bool now);
+		vector<string>			assetCodes;
+		vector<string>			userTs;
+		vector<string>			readings;
+		vector<ReadingBatchEntry>	entries;
+		ReadingBatch			batch;
+		string				payload;
+};
+
+/**
+ * Create a batch of readings and the JSON payload of the same readings
+ *
+ * @param now	Use now() as the user timestamp of the readings
+ */
+Readings::Readings(bool now)
+{
+	char buffer[80];
+
+	payload = "{ \"readings\" : [ ";
+	for (int i = 0; i < BATCH_READINGS; i++)
+	{
+		assetCodes.push_back("benchmark" + to_string(i % ASSETS));
+		snprintf(buffer, sizeof(buffer), "2020-01-01 %02d:%02d:%02d.%06d+00:00",
+				i / 3600 % 24, i / 60 % 60, i % 60, i);
+		userTs.push_back(now ? "now()" : buffer);
+		snprintf(buffer, sizeof(buffer), "{\"value\":%d,\"ratio\":%.3f,\"state\":\"on\"}", i, i / 7.0);
+		readings.push_back(buffer);
+		payload += string(i ? ", " : "") + "{ \"asset_code\" : \"" + assetCodes[i]
+			+ "\", \"user_ts\" : \"" + userTs[i] + "\", \"reading\" : " + readings[i] + " }";
+	}
+	payload += " ] }";
+
+	for (int i = 0; i < BATCH_READINGS; i++)
+	{
+		ReadingBatchEntry entry;
+		entry.assetCode = assetCodes[i].c_str();
+		entry.assetCodeLength = assetCodes[i].length();
+		entry.userTs = userTs[i].c_str();
+		entry.userTsLength = userTs[i].length();
+		entry.reading = readings[i].c_str();
+		entry.readingLength = readings[i].length();
+		entries.push_back(entry);
+	}
+	batch.version = READING_BATCH_VERSION;
+	batch.count = entries.size();
+	batch.readings = entries.data();
+}
+
+/**
+ * Append the readings a number of times and report the time per reading
+ *
+ * @param handle	The plugin handle
+ * @param name		The name of the case
+ * @param readings	The readings to append
+ * @param json		Append the JSON payload rather than the batch
+ * @param batches	The number of times to append the readings
+ */
+static void run(PLUGIN_HANDLE handle, const char *name, const Readings& readings, bool json, int batches)
+{
+	long rows = 0;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < batches; i++)
+	{
+		int n = json ? pluginAppend(handle, readings.payload.c_str())
+				: pluginAppendBatch(handle, &readings.batch);
+		if (n < 0)
+		{
+			fprintf(stderr, "%s: append failed\n", name);
+			return;
+		}
+		rows += n;
+	}
+	double usecs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	printf("%-12s %8ld rows %10.0f ms %8.3f us/row\n", name, rows, usecs / 1000, rows ? usecs / rows : 0.0);
+}
+
+/**
+ * Measure the time taken to append batches of 10000 readings to the
+ * readings table of a SQLite storage plugin.
+ *
+ * Usage: RunBenchmark <plugin library> [batches]
+ *
+ * The plugin uses the database given by DEFAULT_SQLITE_DB_FILE.
+ */
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <plugin library> [batches]\n", argv[0]);
+		return 1;
+	}
+	int batches = argc > 2 ? atoi(argv[2]) : 10;
+
+	void *library = dlopen(argv[1], RTLD_NOW | RTLD_GLOBAL);
+	if (!library)
+	{
+		fprintf(stderr, "%s\n", dlerror());
+		return 1;
+	}
+	pluginInit = (PLUGIN_HANDLE (*)())dlsym(library, "plugin_init");
+	pluginAppend = (int (*)(PLUGIN_HANDLE, const char *))dlsym(library, "plugin_reading_append");
+	pluginAppendBatch = (int (*)(PLUGIN_HANDLE, const ReadingBatch *))dlsym(library, "plugin_reading_append_batch");
+	pluginShutdown = (bool (*)(PLUGIN_HANDLE))dlsym(library, "plugin_shutdown");
+	if (!pluginInit || !pluginAppend || !pluginAppendBatch || !pluginShutdown)
+	{
+		fprintf(stderr, "%s is not a storage plugin with batch appends\n", argv[1]);
+		return 1;
+	}
+
+	Logger::getLogger()->setMinLevel("warning");
+	Readings timestamped(false), now(true);
+	PLUGIN_HANDLE handle = pluginInit();
+
+	run(handle, "batch", timestamped, false, batches);
+	run(handle, "batch now()", now, false, batches);
+	run(handle, "json", timestamped, true, batches);
+	run(handle, "json now()", now, true, batches);
+
+	pluginShutdown(handle);
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <readings_columns.h>
+#include <sqlite3.h>
+#include <string>
+
+using namespace std;
+
+/**
+ * A fixture that gives each test an in memory fledge database with
+ * a readings table
+ */
+class ReadingsColumnsTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			ASSERT_EQ(sqlite3_open(":memory:", &m_db), SQLITE_OK);
+			exec("ATTACH DATABASE ':memory:' AS fledge;");
+			exec("CREATE TABLE fledge.readings (id INTEGER PRIMARY KEY AUTOINCREMENT, asset_code TEXT, reading JSON);");
+			exec("INSERT INTO fledge.readings (asset_code, reading) VALUES ('pump', '{}');");
+		}
+		void TearDown()
+		{
+			sqlite3_close(m_db);
+		}
+		void exec(const string& sql)
+		{
+			ASSERT_EQ(sqlite3_exec(m_db, sql.c_str(), NULL, NULL, NULL), SQLITE_OK) << sql;
+		}
+		/**
+		 * Return the number of columns of a table
+		 */
+		int columnCount(const string& table)
+		{
+			sqlite3_stmt *stmt;
+			int count = 0;
+			string sql = "PRAGMA fledge.table_info(" + table + ");";
+			if (sqlite3_prepare_v2(m_db, sql.c_str(), -1, &stmt, NULL) == SQLITE_OK)
+			{
+				while (sqlite3_step(stmt) == SQLITE_ROW)
+					count++;
+				sqlite3_finalize(stmt);
+			}
+			return count;
+		}
+		sqlite3	*m_db;
+};
+
+TEST_F(ReadingsColumnsTest, Table)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	ASSERT_TRUE(table != NULL);
+	ASSERT_EQ(table->assetCode, "pump");
+	ASSERT_EQ(table->firstId, 2);
+	ASSERT_EQ(columns.table(m_db, "pump"), table);
+	ASSERT_EQ(columnCount(table->table), 1);
+	ASSERT_TRUE(columns.pending());
+}
+
+TEST_F(ReadingsColumnsTest, Column)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	ASSERT_EQ(columns.column(m_db, *table, "speed", true), 0);
+	ASSERT_EQ(columns.column(m_db, *table, "temperature", false), 1);
+	ASSERT_EQ(columns.column(m_db, *table, "speed", true), 0);
+	ASSERT_EQ(columnCount(table->table), 3);
+}
+
+TEST_F(ReadingsColumnsTest, OtherType)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	ASSERT_EQ(columns.column(m_db, *table, "speed", true), 0);
+	ASSERT_EQ(columns.column(m_db, *table, "speed", false), -1);
+	ASSERT_EQ(columnCount(table->table), 2);
+}
+
+TEST_F(ReadingsColumnsTest, CaseDiffers)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	ASSERT_EQ(columns.column(m_db, *table, "Temp", false), 0);
+	ASSERT_EQ(columns.column(m_db, *table, "temp", false), -1);
+	ASSERT_EQ(columns.column(m_db, *table, "temp", false), -1);
+	ASSERT_EQ(columns.column(m_db, *table, "Temp", false), 0);
+	ASSERT_EQ(columnCount(table->table), 2);
+}
+
+TEST_F(ReadingsColumnsTest, FailureRemembered)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	exec("DROP TABLE fledge." + table->table + ";");
+	ASSERT_EQ(columns.column(m_db, *table, "speed", true), -1);
+
+	// Adding the column is not attempted again
+	exec("CREATE TABLE fledge." + table->table + " (id INTEGER PRIMARY KEY);");
+	ASSERT_EQ(columns.column(m_db, *table, "speed", true), -1);
+	ASSERT_EQ(columnCount(table->table), 1);
+	ASSERT_EQ(columns.column(m_db, *table, "flow", true), 0);
+}
+
+TEST_F(ReadingsColumnsTest, Limit)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	for (int i = 0; i < COLUMNS_COLUMNS_MAX; i++)
+	{
+		ASSERT_EQ(columns.column(m_db, *table, "dp" + to_string(i), true), i);
+	}
+	ASSERT_EQ(columns.column(m_db, *table, "extra", true), -1);
+}
+
+TEST_F(ReadingsColumnsTest, Load)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	columns.column(m_db, *table, "speed", true);
+	columns.column(m_db, *table, "temperature", false);
+	columns.column(m_db, *table, "Speed", true);
+
+	ReadingsColumns loaded;
+	ASSERT_TRUE(loaded.load(m_db));
+	table = loaded.table(m_db, "pump");
+	ASSERT_EQ(table->columns.size(), 2);
+	ASSERT_TRUE(table->columns[loaded.column(m_db, *table, "speed", true)].integer);
+	ASSERT_FALSE(table->columns[loaded.column(m_db, *table, "temperature", false)].integer);
+	ASSERT_EQ(loaded.column(m_db, *table, "Speed", true), -1);
+	ASSERT_FALSE(loaded.pending());
+}
+
+TEST_F(ReadingsColumnsTest, Publish)
+{
+	ReadingsColumns columns;
+	ASSERT_TRUE(columns.load(m_db));
+	ReadingsColumns::AssetTable *table = columns.table(m_db, "pump");
+	columns.column(m_db, *table, "speed", true);
+
+	vector<ReadingsColumns::AssetTable> tables;
+	unsigned long generation = columns.tables(tables);
+	ASSERT_TRUE(tables.empty());
+	columns.publish();
+	ASSERT_EQ(columns.tables(tables), generation + 1);
+	ASSERT_EQ(tables.size(), 1);
+	ASSERT_EQ(tables[0].columns.size(), 1);
+	ASSERT_FALSE(columns.pending());
+}
+
+TEST(ReadingsColumns, ColumnName)
+{
+	ASSERT_EQ(ReadingsColumns::columnName("speed"), "\"d_speed\"");
+	ASSERT_EQ(ReadingsColumns::columnName("a\"b"), "\"d_a\"\"b\"");
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <connection.h>
+#include <readings_payload.h>
+#include <rapidjson/document.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * A fixture that gives each test a connection to a readings table that
+ * holds epoch timestamps, with readings of two assets a second apart
+ */
+class ReadingsEpochTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			char path[] = "/tmp/readingsXXXXXX";
+			int fd = mkstemp(path);
+			ASSERT_NE(-1, fd);
+			close(fd);
+			m_path = path;
+			sqlite3 *db;
+			sqlite3_open(m_path.c_str(), &db);
+			sqlite3_exec(db, "CREATE TABLE readings ("
+				"id INTEGER PRIMARY KEY AUTOINCREMENT, "
+				"asset_code character varying(50) NOT NULL, "
+				"reading JSON NOT NULL DEFAULT '{}', "
+				"user_ts DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW')), "
+				"ts DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW'))); "
+				"CREATE INDEX readings_ix3 ON readings (user_ts);",
+				NULL, NULL, NULL);
+			sqlite3_close(db);
+			setenv("DEFAULT_SQLITE_DB_FILE", m_path.c_str(), 1);
+			setenv("FLEDGE_READINGS_EPOCH_TIMESTAMPS", "1", 1);
+			m_connection = new Connection();
+
+			string payload = "{\"readings\":[";
+			for (int i = 5; i <= 9; i++)
+			{
+				if (i > 5)
+					payload += ",";
+				payload += "{\"asset_code\":\"" + string(i % 2 ? "pump" : "valve")
+					+ "\",\"user_ts\":\"2020-01-02 03:04:0" + to_string(i)
+					+ ".000000+00:00\",\"reading\":{\"value\":" + to_string(i) + "}}";
+			}
+			payload += "]}";
+			ReadingsPayload readings;
+			ASSERT_TRUE(readings.parse(payload.c_str()));
+			ASSERT_EQ(5, m_connection->appendReadingBatch(readings.batch()));
+		}
+		void TearDown()
+		{
+			delete m_connection;
+			unsetenv("FLEDGE_READINGS_EPOCH_TIMESTAMPS");
+			unsetenv("DEFAULT_SQLITE_DB_FILE");
+			unlink(m_path.c_str());
+			unlink((m_path + "-wal").c_str());
+			unlink((m_path + "-shm").c_str());
+		}
+		/**
+		 * Return the values of the readings a where clause selects
+		 */
+		string values(const string& where)
+		{
+			string resultSet;
+			if (!m_connection->retrieveReadings("{\"where\":" + where
+					+ ",\"sort\":{\"column\":\"id\",\"direction\":\"asc\"}}", resultSet))
+			{
+				return "error";
+			}
+			Document doc;
+			doc.Parse(resultSet.c_str());
+			string result;
+			for (auto& row : doc["rows"].GetArray())
+			{
+				result += to_string(row["reading"]["value"].GetInt());
+			}
+			return result;
+		}
+		string		m_path;
+		Connection	*m_connection;
+};
+
+TEST_F(ReadingsEpochTest, Range)
+{
+	ASSERT_EQ("789", values("{\"column\":\"user_ts\",\"condition\":\">=\",\"value\":\"2020-01-02 03:04:07\"}"));
+	ASSERT_EQ("89", values("{\"column\":\"user_ts\",\"condition\":\">\",\"value\":\"2020-01-02 03:04:07\"}"));
+	ASSERT_EQ("56", values("{\"column\":\"user_ts\",\"condition\":\"<\",\"value\":\"2020-01-02 03:04:07.000000+00:00\"}"));
+	ASSERT_EQ("567", values("{\"column\":\"user_ts\",\"condition\":\"<=\",\"value\":\"2020-01-02 04:04:07+01:00\"}"));
+}
+
+TEST_F(ReadingsEpochTest, RangeAndAsset)
+{
+	ASSERT_EQ("79", values("{\"column\":\"user_ts\",\"condition\":\">=\",\"value\":\"2020-01-02 03:04:06\","
+			"\"and\":{\"column\":\"asset_code\",\"condition\":\"=\",\"value\":\"pump\"}}"));
+	ASSERT_EQ("68", values("{\"column\":\"asset_code\",\"condition\":\"=\",\"value\":\"valve\","
+			"\"and\":{\"column\":\"user_ts\",\"condition\":\"<\",\"value\":\"2020-01-02 03:04:09\"}}"));
+}
+
+TEST_F(ReadingsEpochTest, OlderNewer)
+{
+	ASSERT_EQ("56789", values("{\"column\":\"user_ts\",\"condition\":\"older\",\"value\":3600}"));
+	ASSERT_EQ("", values("{\"column\":\"user_ts\",\"condition\":\"newer\",\"value\":3600}"));
+}
+
+TEST_F(ReadingsEpochTest, Unconverted)
+{
+	// Conditions that are not ranges of times are compared as formatted
+	ASSERT_EQ("7", values("{\"column\":\"user_ts\",\"condition\":\"=\",\"value\":\"2020-01-02 03:04:07.000000+00:00\"}"));
+	ASSERT_EQ("56789", values("{\"column\":\"user_ts\",\"condition\":\">=\",\"value\":\"2020\"}"));
+}
+
+TEST_F(ReadingsEpochTest, ReadOnly)
+{
+	Connection reader(true);
+	string resultSet;
+	ASSERT_TRUE(reader.retrieveReadings("{\"where\":{\"column\":\"user_ts\",\"condition\":\">\","
+				"\"value\":\"2020-01-02 03:04:08\"}}", resultSet));
+	Document doc;
+	doc.Parse(resultSet.c_str());
+	ASSERT_EQ(1, doc["count"].GetInt());
+
+	ReadingsPayload readings;
+	ASSERT_TRUE(readings.parse("{\"readings\":[{\"asset_code\":\"pump\","
+				"\"user_ts\":\"2020-01-02 03:04:10\",\"reading\":{\"value\":10}}]}"));
+	ASSERT_EQ(-1, reader.appendReadingBatch(readings.batch()));
+}
@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include <connection.h>
+#include <readings_inserter.h>
+#include <readings_payload.h>
+#include <rapidjson/document.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <set>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * The variable limit given to the databases opened, and the last opened
+ */
+static int	variableLimit;
+static sqlite3	*opened;
+
+/**
+ * Set the variable limit of a database as it is opened
+ */
+static int limitVariables(sqlite3 *db, char **, const sqlite3_api_routines *)
+{
+	sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, variableLimit);
+	opened = db;
+	return SQLITE_OK;
+}
+
+/**
+ * A fixture that gives each test a connection to an empty readings table
+ */
+class ReadingsInserterTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			char path[] = "/tmp/readingsXXXXXX";
+			int fd = mkstemp(path);
+			ASSERT_NE(-1, fd);
+			close(fd);
+			m_path = path;
+			sqlite3 *db;
+			sqlite3_open(m_path.c_str(), &db);
+			sqlite3_exec(db, "CREATE TABLE readings ("
+				"id INTEGER PRIMARY KEY AUTOINCREMENT, "
+				"asset_code character varying(50) NOT NULL, "
+				"reading JSON NOT NULL DEFAULT '{}', "
+				"user_ts DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW')), "
+				"ts DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW')));",
+				NULL, NULL, NULL);
+			sqlite3_close(db);
+			setenv("DEFAULT_SQLITE_DB_FILE", m_path.c_str(), 1);
+			m_connection = new Connection();
+		}
+		void TearDown()
+		{
+			delete m_connection;
+			unsetenv("DEFAULT_SQLITE_DB_FILE");
+			unlink(m_path.c_str());
+			unlink((m_path + "-wal").c_str());
+			unlink((m_path + "-shm").c_str());
+		}
+		/**
+		 * A payload of readings of two assets, those given have an
+		 * invalid user timestamp
+		 */
+		string readings(int count, const set<int>& invalid = {})
+		{
+			string payload = "{\"readings\":[";
+			for (int i = 0; i < count; i++)
+			{
+				if (i)
+					payload += ",";
+				payload += "{\"asset_code\":\"" + string(i % 2 ? "pump" : "valve \\\"2\\\"")
+					+ "\",\"user_ts\":\"" + (invalid.count(i) ? string("never")
+						: "2020-01-02 03:04:05." + to_string(100000 + i) + "+01:00")
+					+ "\",\"reading\":{\"value\":" + to_string(i)
+					+ ",\"name\":\"it's\"}}";
+			}
+			return payload + "]}";
+		}
+		/**
+		 * Reconnect to the database with a limit on the variables of a
+		 * statement
+		 */
+		void reconnect(int limit)
+		{
+			delete m_connection;
+			variableLimit = limit;
+			sqlite3_auto_extension((void (*)())limitVariables);
+			m_connection = new Connection();
+			sqlite3_reset_auto_extension();
+			m_db = opened;
+		}
+		/**
+		 * Return the numbers of rows of the insert statements prepared
+		 * on the connection, in increasing order
+		 */
+		vector<int> inserts()
+		{
+			vector<int> rows;
+			for (sqlite3_stmt *stmt = sqlite3_next_stmt(m_db, NULL); stmt; stmt = sqlite3_next_stmt(m_db, stmt))
+			{
+				string sql = sqlite3_sql(stmt);
+				if (sql.compare(0, 12, "INSERT INTO ") == 0)
+				{
+					int count = 0;
+					for (size_t pos = sql.find("(?,?,?,?)"); pos != string::npos; pos = sql.find("(?,?,?,?)", pos + 1))
+					{
+						count++;
+					}
+					rows.push_back(count);
+				}
+			}
+			sort(rows.begin(), rows.end());
+			return rows;
+		}
+		/**
+		 * Return the values of the readings fetched
+		 */
+		string values()
+		{
+			string fetched;
+			if (!m_connection->fetchReadings(1, 1000, fetched))
+			{
+				return "error";
+			}
+			Document doc;
+			doc.Parse(fetched.c_str());
+			string result;
+			for (auto& row : doc["rows"].GetArray())
+			{
+				if (!result.empty())
+					result += ",";
+				result += to_string(row["reading"]["value"].GetInt());
+			}
+			return result;
+		}
+		string		m_path;
+		Connection	*m_connection;
+		sqlite3		*m_db;
+};
+
+TEST_F(ReadingsInserterTest, AppendedRows)
+{
+	ReadingsPayload payload;
+	// More readings than the largest insert statement takes
+	ASSERT_TRUE(payload.parse(readings(INSERT_MAX_ROWS + 5).c_str()));
+	string rows;
+	ASSERT_EQ(INSERT_MAX_ROWS + 5, m_connection->appendReadingBatch(payload.batch(), &rows));
+
+	// The rows are those a fetch returns, without reading them back
+	string fetched;
+	ASSERT_TRUE(m_connection->fetchReadings(1, INSERT_MAX_ROWS + 5, fetched));
+	Document appended, expected;
+	ASSERT_FALSE(appended.Parse(rows.c_str()).HasParseError());
+	ASSERT_FALSE(expected.Parse(fetched.c_str()).HasParseError());
+	ASSERT_EQ(INSERT_MAX_ROWS + 5, appended["count"].GetInt());
+	ASSERT_TRUE(appended == expected);
+	ASSERT_STREQ("2020-01-02 02:04:05.100000", appended["rows"][0]["user_ts"].GetString());
+}
+
+TEST_F(ReadingsInserterTest, AppendedRowsInvalidDate)
+{
+	ReadingsPayload payload;
+	ASSERT_TRUE(payload.parse("{\"readings\":["
+		"{\"asset_code\":\"a\",\"user_ts\":\"2020-01-02 03:04:05.1\",\"reading\":{\"v\":1}},"
+		"{\"asset_code\":\"a\",\"user_ts\":\"never\",\"reading\":{\"v\":2}}]}"));
+	string rows;
+	// Not every reading was appended, they are not returned
+	ASSERT_EQ(1, m_connection->appendReadingBatch(payload.batch(), &rows));
+	ASSERT_TRUE(rows.empty());
+}
+
+TEST_F(ReadingsInserterTest, VariableLimit)
+{
+	// The variables of 16 rows just fit, those of 64 do not, so no
+	// statement has more rows than 16
+	reconnect(16 * 4);
+	ReadingsPayload payload;
+	ASSERT_TRUE(payload.parse(readings(64 + 5).c_str()));
+	ASSERT_EQ(64 + 5, m_connection->appendReadingBatch(payload.batch()));
+	ASSERT_EQ(vector<int>({ 1, 4, 16 }), inserts());
+
+	string expected;
+	for (int i = 0; i < 64 + 5; i++)
+	{
+		expected += (i ? "," : "") + to_string(i);
+	}
+	ASSERT_EQ(expected, values());
+}
+
+TEST_F(ReadingsInserterTest, VariableLimitBelow)
+{
+	// One variable short, the statements are of a quarter of the rows
+	reconnect(16 * 4 - 1);
+	ReadingsPayload payload;
+	ASSERT_TRUE(payload.parse(readings(16).c_str()));
+	ASSERT_EQ(16, m_connection->appendReadingBatch(payload.batch()));
+	ASSERT_EQ(vector<int>({ 4 }), inserts());
+}
+
+TEST_F(ReadingsInserterTest, MixedInvalidDates)
+{
+	reconnect(16 * 4);
+	ReadingsPayload payload;
+	// Invalid readings first, last and on either side of the end of a statement
+	ASSERT_TRUE(payload.parse(readings(70, { 0, 15, 16, 17, 69 }).c_str()));
+	string rows;
+	ASSERT_EQ(65, m_connection->appendReadingBatch(payload.batch(), &rows));
+	ASSERT_TRUE(rows.empty());
+
+	// The valid readings are inserted in order, in full statements first
+	string expected;
+	for (int i = 1; i < 69; i++)
+	{
+		if (i < 15 || i > 17)
+			expected += (expected.empty() ? "" : ",") + to_string(i);
+	}
+	ASSERT_EQ(expected, values());
+	ASSERT_EQ(vector<int>({ 1, 16 }), inserts());
+}
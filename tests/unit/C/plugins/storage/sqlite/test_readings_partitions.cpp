@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+#include <readings_partitions.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define HOUR	3600
+
+/**
+ * A fixture that gives each test an empty directory for the partitions
+ */
+class ReadingsPartitionsTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			char dir[] = "/tmp/partitionsXXXXXX";
+			ASSERT_TRUE(mkdtemp(dir) != NULL);
+			m_dir = dir;
+			m_base = time(0);
+			m_base -= m_base % HOUR + 20 * HOUR;
+		}
+		void TearDown()
+		{
+			DIR *dir = opendir(m_dir.c_str());
+			struct dirent *entry;
+			while ((entry = readdir(dir)) != NULL)
+			{
+				if (entry->d_name[0] != '.')
+					unlink((m_dir + "/" + entry->d_name).c_str());
+			}
+			closedir(dir);
+			rmdir(m_dir.c_str());
+		}
+		bool exists(const string& path)
+		{
+			return access(path.c_str(), F_OK) == 0;
+		}
+		/**
+		 * Execute SQL against a partition
+		 */
+		long query(const string& path, const string& sql)
+		{
+			sqlite3 *db;
+			sqlite3_stmt *stmt;
+			long value = -1;
+			sqlite3_open(path.c_str(), &db);
+			if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) == SQLITE_OK)
+			{
+				if (sqlite3_step(stmt) == SQLITE_ROW)
+					value = sqlite3_column_int64(stmt, 0);
+				sqlite3_finalize(stmt);
+			}
+			sqlite3_close(db);
+			return value;
+		}
+		/**
+		 * Create partition files for successive hours with a reading
+		 * each, as if left by an earlier run
+		 */
+		void populate(int count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				time_t start = m_base + i * HOUR;
+				struct tm tm;
+				char name[40];
+				gmtime_r(&start, &tm);
+				strftime(name, sizeof(name), PARTITION_PREFIX "%Y%m%d%H.db", &tm);
+				string path = m_dir + "/" + name;
+				query(path, "CREATE TABLE readings (id INTEGER PRIMARY KEY AUTOINCREMENT, asset_code TEXT, reading TEXT, user_ts TEXT, ts TEXT);");
+				query(path, "INSERT INTO readings (id, asset_code, reading) VALUES (" + to_string(i * 10 + 1) + ", 'a', '{}');");
+				m_paths.push_back(path);
+			}
+		}
+		string		m_dir;
+		time_t		m_base;
+		vector<string>	m_paths;
+};
+
+TEST_F(ReadingsPartitionsTest, Create)
+{
+	ReadingsPartitions partitions(m_dir, 1);
+	vector<ReadingsPartitions::Partition> list;
+	unsigned long generation = partitions.partitions(list);
+	ASSERT_EQ(0, list.size());
+
+	ReadingsPartitions::Partition partition;
+	ASSERT_FALSE(partitions.find(m_base, partition));
+	ASSERT_TRUE(partitions.create(m_base + 10, 100, partition));
+	ASSERT_EQ(m_base, partition.start);
+	ASSERT_EQ(m_base + HOUR, partitions.end(partition));
+	ASSERT_TRUE(exists(partition.path));
+	ASSERT_NE(generation, partitions.generation());
+	// The ids follow on from the last id assigned
+	ASSERT_EQ(100, query(partition.path, "SELECT seq FROM sqlite_sequence WHERE name = 'readings';"));
+	query(partition.path, "INSERT INTO readings (asset_code, reading) VALUES ('a', '{}');");
+	ASSERT_EQ(101, query(partition.path, "SELECT max(id) FROM readings;"));
+
+	ASSERT_TRUE(partitions.find(m_base + HOUR - 1, partition));
+	ASSERT_FALSE(partitions.find(m_base + HOUR, partition));
+
+	// The partitions are found again
+	ReadingsPartitions again(m_dir, 1);
+	ASSERT_EQ(1, again.partitions(list) ? list.size() : 0);
+	ASSERT_EQ(partition.alias, list[0].alias);
+}
+
+TEST_F(ReadingsPartitionsTest, Rotate)
+{
+	ReadingsPartitions partitions(m_dir, 1);
+	ReadingsPartitions::Partition partition;
+	for (int i = 0; i < PARTITION_MAX; i++)
+	{
+		ASSERT_FALSE(partitions.full());
+		ASSERT_TRUE(partitions.create(m_base + i * HOUR, 0, partition));
+	}
+	ASSERT_TRUE(partitions.full());
+	ASSERT_FALSE(partitions.create(m_base + PARTITION_MAX * HOUR, 0, partition));
+	ASSERT_EQ(0, partitions.removals());
+
+	vector<ReadingsPartitions::Partition> list;
+	partitions.partitions(list);
+	partitions.remove(list.front().alias);
+	ASSERT_FALSE(exists(list.front().path));
+	ASSERT_EQ(1, partitions.removals());
+	ASSERT_FALSE(partitions.full());
+	ASSERT_TRUE(partitions.create(m_base + PARTITION_MAX * HOUR, 0, partition));
+	partitions.partitions(list);
+	ASSERT_EQ(PARTITION_MAX, list.size());
+	ASSERT_EQ(m_base + HOUR, list.front().start);
+	ASSERT_EQ(m_base + PARTITION_MAX * HOUR, list.back().start);
+}
+
+TEST_F(ReadingsPartitionsTest, RemoveAttached)
+{
+	ReadingsPartitions partitions(m_dir, 1);
+	ReadingsPartitions::Partition partition;
+	for (int i = 0; i < PARTITION_MAX; i++)
+	{
+		ASSERT_TRUE(partitions.create(m_base + i * HOUR, 0, partition));
+	}
+	vector<ReadingsPartitions::Partition> list;
+	partitions.partitions(list);
+	ReadingsPartitions::Partition oldest = list.front();
+	partitions.attached(oldest.alias);
+	partitions.attached(oldest.alias);
+
+	unsigned long generation = partitions.generation();
+	partitions.remove(oldest.alias);
+	ASSERT_NE(generation, partitions.generation());
+	ASSERT_EQ(1, partitions.removals());
+	ASSERT_FALSE(partitions.full());
+	// Still attached, the files are kept and no partition may be created
+	ASSERT_TRUE(exists(oldest.path));
+	ASSERT_TRUE(exists(oldest.path + PARTITION_REMOVED));
+	ASSERT_FALSE(partitions.create(m_base + PARTITION_MAX * HOUR, 0, partition));
+
+	partitions.detached(oldest.alias);
+	ASSERT_TRUE(exists(oldest.path));
+	partitions.detached(oldest.alias);
+	ASSERT_FALSE(exists(oldest.path));
+	ASSERT_FALSE(exists(oldest.path + PARTITION_REMOVED));
+	ASSERT_TRUE(partitions.create(m_base + PARTITION_MAX * HOUR, 0, partition));
+}
+
+TEST_F(ReadingsPartitionsTest, RemovedAtStartup)
+{
+	string path;
+	{
+		ReadingsPartitions partitions(m_dir, 1);
+		ReadingsPartitions::Partition partition;
+		ASSERT_TRUE(partitions.create(m_base, 0, partition));
+		ASSERT_TRUE(partitions.create(m_base + HOUR, 0, partition));
+		partitions.attached(partition.alias);
+		partitions.remove(partition.alias);
+		path = partition.path;
+	}
+	// The service stopped before the partition was detached
+	ASSERT_TRUE(exists(path));
+	ReadingsPartitions partitions(m_dir, 1);
+	vector<ReadingsPartitions::Partition> list;
+	partitions.partitions(list);
+	ASSERT_EQ(1, list.size());
+	ASSERT_EQ(m_base, list[0].start);
+	ASSERT_FALSE(exists(path));
+	ASSERT_FALSE(exists(path + PARTITION_REMOVED));
+}
+
+TEST_F(ReadingsPartitionsTest, MergedAtStartup)
+{
+	populate(PARTITION_MAX + 2);
+	ReadingsPartitions partitions(m_dir, 1);
+	vector<ReadingsPartitions::Partition> list;
+	partitions.partitions(list);
+	ASSERT_EQ(PARTITION_MAX, list.size());
+	ASSERT_EQ(m_base + 2 * HOUR, list.front().start);
+	ASSERT_FALSE(exists(m_paths[0]));
+	ASSERT_FALSE(exists(m_paths[1]));
+	ASSERT_TRUE(exists(m_paths[2]));
+	// The readings of the two oldest partitions are kept in the third
+	ASSERT_EQ(3, query(m_paths[2], "SELECT count(*) FROM readings;"));
+	ASSERT_EQ(1, query(m_paths[2], "SELECT min(id) FROM readings;"));
+	ASSERT_EQ(0, partitions.purgedId());
+	ASSERT_EQ(0, partitions.removals());
+}
+
+TEST_F(ReadingsPartitionsTest, Retention)
+{
+	ReadingsPartitions partitions(m_dir, 1);
+	bool byRows;
+	unsigned long param, sent;
+	unsigned int flags;
+	// No partition is removed to make room before a purge request
+	ASSERT_FALSE(partitions.retention(byRows, param, flags, sent));
+	partitions.setRetention(false, 72, 0x01, 500);
+	ASSERT_TRUE(partitions.retention(byRows, param, flags, sent));
+	ASSERT_FALSE(byRows);
+	ASSERT_EQ(72, param);
+	ASSERT_EQ(0x01, flags);
+	ASSERT_EQ(500, sent);
+}
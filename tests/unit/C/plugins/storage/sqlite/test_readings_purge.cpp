@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include <readings_purge.h>
+#include <readings_writer.h>
+#include <connection.h>
+#include <rapidjson/document.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * Return a value of the state of a purge scheduler
+ */
+static double state(PurgeScheduler& scheduler, const char *name)
+{
+	Document doc;
+	doc.Parse(scheduler.toJSON().c_str());
+	return doc[name].GetDouble();
+}
+
+TEST(PurgeSchedulerTest, FirstBlock)
+{
+	PurgeScheduler scheduler;
+	ASSERT_EQ(MIN_PURGE_DELETE_BLOCK_SIZE, scheduler.blockSize());
+	// A block that deleted nothing tells nothing of the cost of a row
+	scheduler.purged(0, 1000);
+	ASSERT_EQ(MIN_PURGE_DELETE_BLOCK_SIZE, scheduler.blockSize());
+	ASSERT_EQ(0, state(scheduler, "blocks"));
+}
+
+TEST(PurgeSchedulerTest, BlockSize)
+{
+	PurgeScheduler scheduler;
+	// 10us a row, the block is sized to take the target time
+	scheduler.purged(100, 1000);
+	ASSERT_EQ(PURGE_TARGET_BLOCK_US / 10, scheduler.blockSize());
+
+	// The cost is smoothed over the blocks
+	scheduler.purged(100, 2000);
+	ASSERT_EQ(13, state(scheduler, "rowCostUs"));
+	ASSERT_EQ(5380U, scheduler.blockSize());
+	ASSERT_EQ(0U, scheduler.blockSize() % PURGE_BLOCK_SZ_GRANULARITY);
+}
+
+TEST(PurgeSchedulerTest, BlockSizeLimits)
+{
+	PurgeScheduler slow;
+	slow.purged(10, 1000000);
+	ASSERT_EQ(MIN_PURGE_DELETE_BLOCK_SIZE, slow.blockSize());
+
+	PurgeScheduler fast;
+	fast.purged(100000, 1000);
+	ASSERT_EQ(MAX_PURGE_DELETE_BLOCK_SIZE, fast.blockSize());
+}
+
+TEST(PurgeSchedulerTest, AppendLoad)
+{
+	PurgeScheduler scheduler;
+	scheduler.purged(100, 1000);
+	unsigned long idle = scheduler.blockSize();
+
+	// Appends that take all of the writer for a load window
+	this_thread::sleep_for(chrono::microseconds(PURGE_LOAD_WINDOW_US));
+	scheduler.appended(2 * PURGE_LOAD_WINDOW_US);
+	ASSERT_EQ(0.5, state(scheduler, "appendLoad"));
+	ASSERT_EQ(idle / 2, scheduler.blockSize());
+}
+
+TEST(PurgeSchedulerTest, Continuous)
+{
+	PurgeScheduler scheduler;
+	unsigned long age, sent;
+	bool retainUnsent;
+
+	// Only a continuous purge keeps the retention, and not an age of 0
+	scheduler.setRetention(10, true, 100);
+	ASSERT_FALSE(scheduler.retention(age, retainUnsent, sent));
+	ASSERT_FALSE(scheduler.due());
+	scheduler.setContinuous(true);
+	scheduler.setRetention(0, true, 100);
+	ASSERT_FALSE(scheduler.due());
+
+	scheduler.setRetention(10, true, 100);
+	ASSERT_TRUE(scheduler.retention(age, retainUnsent, sent));
+	ASSERT_EQ(10U, age);
+	ASSERT_TRUE(retainUnsent);
+	ASSERT_EQ(100U, sent);
+	ASSERT_TRUE(scheduler.due());
+
+	// Without appends the next increment follows at once
+	scheduler.increment(50, 5);
+	ASSERT_TRUE(scheduler.due());
+
+	// Nothing left to remove, the next increment is deferred
+	scheduler.increment(0, 0);
+	ASSERT_FALSE(scheduler.due());
+	scheduler.increment(-1, 0);
+	ASSERT_FALSE(scheduler.due());
+
+	unsigned long removed, unsentPurged;
+	scheduler.takeRemoved(removed, unsentPurged);
+	ASSERT_EQ(50U, removed);
+	ASSERT_EQ(5U, unsentPurged);
+	scheduler.takeRemoved(removed, unsentPurged);
+	ASSERT_EQ(0U, removed);
+	ASSERT_EQ(50U, scheduler.totalRemoved());
+}
+
+/**
+ * A fixture that gives each test a writer of a readings table with some
+ * readings, in a database that returns its free pages by incremental
+ * vacuum or not
+ */
+class ReadingsVacuumTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			char path[] = "/tmp/readingsXXXXXX";
+			int fd = mkstemp(path);
+			ASSERT_NE(-1, fd);
+			close(fd);
+			m_path = path;
+			setenv("DEFAULT_SQLITE_DB_FILE", m_path.c_str(), 1);
+		}
+		void TearDown()
+		{
+			unsetenv("DEFAULT_SQLITE_DB_FILE");
+			unlink(m_path.c_str());
+			unlink((m_path + "-wal").c_str());
+			unlink((m_path + "-shm").c_str());
+		}
+		void populate(bool incremental)
+		{
+			sqlite3 *db;
+			sqlite3_open(m_path.c_str(), &db);
+			sqlite3_exec(db, incremental ? "PRAGMA auto_vacuum = INCREMENTAL;" : "PRAGMA auto_vacuum = NONE;",
+					NULL, NULL, NULL);
+			sqlite3_exec(db, "CREATE TABLE readings ("
+				"id INTEGER PRIMARY KEY AUTOINCREMENT, "
+				"asset_code character varying(50) NOT NULL, "
+				"reading JSON NOT NULL DEFAULT '{}', "
+				"user_ts DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW')), "
+				"ts DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW'))); "
+				"WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000) "
+				"INSERT INTO readings (asset_code, reading) "
+				"SELECT 'pump', json_object('value', i, 'pad', hex(randomblob(200))) FROM n;",
+				NULL, NULL, NULL);
+			sqlite3_close(db);
+		}
+		long freePages()
+		{
+			sqlite3 *db;
+			sqlite3_stmt *stmt;
+			long pages = -1;
+			sqlite3_open(m_path.c_str(), &db);
+			if (sqlite3_prepare_v2(db, "PRAGMA freelist_count;", -1, &stmt, NULL) == SQLITE_OK)
+			{
+				if (sqlite3_step(stmt) == SQLITE_ROW)
+					pages = sqlite3_column_int64(stmt, 0);
+				sqlite3_finalize(stmt);
+			}
+			sqlite3_close(db);
+			return pages;
+		}
+		/**
+		 * Purge all but 10 of the readings through the writer
+		 */
+		void purge(ReadingsWriter& writer)
+		{
+			Connection connection;
+			connection.setWriter(&writer);
+			string results;
+			ASSERT_EQ(1990U, connection.purgeReadingsByRows(10, 0, 0, results));
+		}
+		/**
+		 * Wait for the writer to have returned free pages
+		 */
+		bool vacuumed(ReadingsWriter& writer, int ms)
+		{
+			for (int i = 0; i < ms / 50; i++)
+			{
+				if (state(writer.purgeScheduler(), "vacuumPages") > 0 && freePages() == 0)
+					return true;
+				this_thread::sleep_for(chrono::milliseconds(50));
+			}
+			return false;
+		}
+		string		m_path;
+};
+
+TEST_F(ReadingsVacuumTest, AfterPurge)
+{
+	populate(true);
+	ReadingsWriter writer;
+	ASSERT_EQ(0, freePages());
+
+	// The writer returns the pages the purge freed while it is idle
+	purge(writer);
+	ASSERT_TRUE(vacuumed(writer, 5000));
+}
+
+TEST_F(ReadingsVacuumTest, NotIncremental)
+{
+	populate(false);
+	ReadingsWriter writer;
+	purge(writer);
+	ASSERT_FALSE(vacuumed(writer, 500));
+	ASSERT_GT(freePages(), 0);
+	ASSERT_EQ(0, state(writer.purgeScheduler(), "vacuumPages"));
+}
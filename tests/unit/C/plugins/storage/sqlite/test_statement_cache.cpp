@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <statement_cache.h>
+#include <connection.h>
+#include <rapidjson/document.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * The number of statements prepared on a database connection
+ */
+static int statements(sqlite3 *db)
+{
+	int count = 0;
+	for (sqlite3_stmt *stmt = sqlite3_next_stmt(db, NULL); stmt; stmt = sqlite3_next_stmt(db, stmt))
+	{
+		count++;
+	}
+	return count;
+}
+
+/**
+ * A fixture that gives each test an in memory database with a table
+ */
+class StatementCacheTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &m_db));
+			ASSERT_EQ(SQLITE_OK, sqlite3_exec(m_db, "CREATE TABLE t (a INTEGER); "
+					"INSERT INTO t VALUES (1), (2), (3);", NULL, NULL, NULL));
+		}
+		void TearDown()
+		{
+			ASSERT_EQ(SQLITE_OK, sqlite3_close(m_db));
+		}
+		sqlite3		*m_db;
+};
+
+TEST_F(StatementCacheTest, Reuse)
+{
+	StatementCache cache(m_db);
+	sqlite3_stmt *stmt = cache.prepare("SELECT a FROM t WHERE a >= ? ORDER BY a;");
+	ASSERT_TRUE(stmt != NULL);
+	sqlite3_bind_int(stmt, 1, 2);
+	ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+	ASSERT_EQ(2, sqlite3_column_int(stmt, 0));
+
+	// The statement is handed out again reset and without its bindings
+	ASSERT_EQ(stmt, cache.prepare("SELECT a FROM t WHERE a >= ? ORDER BY a;"));
+	ASSERT_EQ(0, sqlite3_stmt_busy(stmt));
+	ASSERT_EQ(SQLITE_DONE, sqlite3_step(stmt));
+	sqlite3_reset(stmt);
+
+	ASSERT_EQ(1U, cache.hits());
+	ASSERT_EQ(1U, cache.misses());
+	ASSERT_EQ(1, statements(m_db));
+}
+
+TEST_F(StatementCacheTest, Eviction)
+{
+	StatementCache cache(m_db, 2);
+	sqlite3_stmt *one = cache.prepare("SELECT 1;");
+	cache.prepare("SELECT 2;");
+	ASSERT_EQ(one, cache.prepare("SELECT 1;"));
+
+	// The least recently used statement is finalized to make room
+	ASSERT_TRUE(cache.prepare("SELECT 3;") != NULL);
+	ASSERT_EQ(2, statements(m_db));
+	ASSERT_EQ(one, cache.prepare("SELECT 1;"));
+	ASSERT_TRUE(cache.prepare("SELECT 2;") != NULL);
+	ASSERT_EQ(2U, cache.hits());
+	ASSERT_EQ(4U, cache.misses());
+	ASSERT_EQ(2, statements(m_db));
+}
+
+TEST_F(StatementCacheTest, Invalid)
+{
+	StatementCache cache(m_db);
+	ASSERT_TRUE(cache.prepare("SELECT b FROM t;") == NULL);
+	ASSERT_TRUE(cache.prepare("SELECT b FROM t;") == NULL);
+	ASSERT_EQ(0, statements(m_db));
+}
+
+TEST_F(StatementCacheTest, Finalize)
+{
+	{
+		StatementCache cache(m_db);
+		sqlite3_stmt *stmt = cache.prepare("SELECT a FROM t;");
+		ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+		cache.prepare("SELECT 1;");
+		ASSERT_EQ(2, statements(m_db));
+
+		cache.clear();
+		ASSERT_EQ(0, statements(m_db));
+		cache.prepare("SELECT a FROM t;");
+	}
+	// The cache finalized its statements, so the database may be closed
+	ASSERT_EQ(0, statements(m_db));
+}
+
+/**
+ * A fixture that gives each test a connection to a database with a
+ * common table
+ */
+class CachedRetrieveTest : public ::testing::Test {
+	protected:
+		void SetUp()
+		{
+			char path[] = "/tmp/retrieveXXXXXX";
+			int fd = mkstemp(path);
+			ASSERT_NE(-1, fd);
+			close(fd);
+			m_path = path;
+			sqlite3 *db;
+			sqlite3_open(m_path.c_str(), &db);
+			sqlite3_exec(db, "CREATE TABLE settings (key TEXT, value INTEGER); "
+				"INSERT INTO settings VALUES ('a', 1), ('b', 2), ('it''s', 3), ('c', 4);",
+				NULL, NULL, NULL);
+			sqlite3_close(db);
+			setenv("DEFAULT_SQLITE_DB_FILE", m_path.c_str(), 1);
+			m_connection = new Connection();
+		}
+		void TearDown()
+		{
+			delete m_connection;
+			unsetenv("DEFAULT_SQLITE_DB_FILE");
+			unlink(m_path.c_str());
+		}
+		/**
+		 * Return the values of the rows a where clause selects
+		 */
+		string values(const string& where)
+		{
+			string resultSet;
+			if (!m_connection->retrieve("settings", "{\"where\":" + where
+					+ ",\"sort\":{\"column\":\"value\",\"direction\":\"asc\"}}", resultSet))
+			{
+				return "error";
+			}
+			Document doc;
+			doc.Parse(resultSet.c_str());
+			string result;
+			for (auto& row : doc["rows"].GetArray())
+			{
+				result += to_string(row["value"].GetInt());
+			}
+			return result;
+		}
+		string		m_path;
+		Connection	*m_connection;
+};
+
+TEST_F(CachedRetrieveTest, BoundValues)
+{
+	// The same statement is reused with each of the values
+	ASSERT_EQ("1", values("{\"column\":\"key\",\"condition\":\"=\",\"value\":\"a\"}"));
+	ASSERT_EQ("2", values("{\"column\":\"key\",\"condition\":\"=\",\"value\":\"b\"}"));
+	ASSERT_EQ("3", values("{\"column\":\"key\",\"condition\":\"=\",\"value\":\"it's\"}"));
+	ASSERT_EQ("", values("{\"column\":\"key\",\"condition\":\"=\",\"value\":\"d\"}"));
+	ASSERT_EQ("34", values("{\"column\":\"value\",\"condition\":\">\",\"value\":2}"));
+}
+
+TEST_F(CachedRetrieveTest, BoundLists)
+{
+	ASSERT_EQ("14", values("{\"column\":\"key\",\"condition\":\"in\",\"value\":[\"a\",\"c\"]}"));
+	ASSERT_EQ("23", values("{\"column\":\"key\",\"condition\":\"not in\",\"value\":[\"a\",\"c\"]}"));
+	ASSERT_EQ("24", values("{\"column\":\"value\",\"condition\":\"in\",\"value\":[2,4.0]}"));
+	ASSERT_EQ("12", values("{\"column\":\"value\",\"condition\":\"<\",\"value\":3,"
+				"\"and\":{\"column\":\"key\",\"condition\":\"in\",\"value\":[\"a\",\"b\",\"c\"]}}"));
+	ASSERT_EQ("124", values("{\"column\":\"value\",\"condition\":\"<\",\"value\":3,"
+				"\"or\":{\"column\":\"key\",\"condition\":\"=\",\"value\":\"c\"}}"));
+}
@@ -0,0 +1,14 @@
+#include <gtest/gtest.h>
+#include <logger.h>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    Logger logger("RunTests");
+    testing::InitGoogleTest(&argc, argv);
+
+    testing::GTEST_FLAG(repeat) = 5;
+    testing::GTEST_FLAG(shuffle) = true;
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,16 @@
+#include <gtest/gtest.h>
+#include <Python.h>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    testing::GTEST_FLAG(shuffle) = true;
+
+    // The tests hold the GIL of the embedded interpreter throughout
+    Py_Initialize();
+    int rc = RUN_ALL_TESTS();
+    Py_Finalize();
+    return rc;
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include <Python.h>
+#include <reading.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+extern "C" {
+std::vector<Reading *>* Py2C_getReadings(PyObject *polledData);
+}
+
+/**
+ * Evaluate a Python expression with the array module imported,
+ * returns a new reference
+ */
+static PyObject *evaluate(const char *expression, PyObject *local = NULL)
+{
+	PyObject *globals = PyDict_New();
+	PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+	PyObject *array = PyImport_ImportModule("array");
+	PyDict_SetItemString(globals, "array", array);
+	Py_DECREF(array);
+	if (local)
+	{
+		PyDict_SetItemString(globals, "local", local);
+	}
+	PyObject *result = PyRun_String(expression, Py_eval_input, globals, globals);
+	Py_DECREF(globals);
+	if (!result)
+	{
+		PyErr_Print();
+	}
+	return result;
+}
+
+/**
+ * Convert a reading whose datapoint "v" is given by an expression and
+ * return the datapoint, or NULL if it was not converted
+ */
+static Datapoint *convert(const string& value, vector<Reading *> *&readings, PyObject *local = NULL)
+{
+	string expression = "[ { 'asset' : 'test', 'readings' : { 'v' : " + value + ", 'n' : 1 } } ]";
+	PyObject *list = evaluate(expression.c_str(), local);
+	if (!list)
+	{
+		return NULL;
+	}
+	readings = Py2C_getReadings(list);
+	Py_DECREF(list);
+	if (!readings || readings->size() != 1)
+	{
+		return NULL;
+	}
+	for (auto dp : (*readings)[0]->getReadingData())
+	{
+		if (dp->getName() == "v")
+		{
+			return dp;
+		}
+	}
+	return NULL;
+}
+
+static void deleteReadings(vector<Reading *> *readings)
+{
+	if (readings)
+	{
+		for (auto reading : *readings)
+		{
+			delete reading;
+		}
+		delete readings;
+	}
+}
+
+/**
+ * An exporter of a buffer of four byte items with the standard
+ * size format "<l", which on LP64 hosts differs from a native long
+ */
+typedef struct {
+	PyObject_HEAD
+} StandardLongObject;
+
+static int32_t standardLongValues[3] = { 1, 2, 3 };
+static Py_ssize_t standardLongShape[1] = { 3 };
+static Py_ssize_t standardLongStrides[1] = { sizeof(int32_t) };
+
+static int StandardLong_getbuffer(PyObject *obj, Py_buffer *view, int flags)
+{
+	view->obj = obj;
+	Py_INCREF(obj);
+	view->buf = standardLongValues;
+	view->len = sizeof(standardLongValues);
+	view->readonly = 1;
+	view->itemsize = sizeof(int32_t);
+	view->format = (char *)"<l";
+	view->ndim = 1;
+	view->shape = standardLongShape;
+	view->strides = standardLongStrides;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static PyBufferProcs StandardLong_as_buffer = { StandardLong_getbuffer, NULL };
+
+static PyTypeObject StandardLongType = { PyVarObject_HEAD_INIT(NULL, 0) "test.StandardLong" };
+
+TEST(PythonFloatArrayTest, ArrayFormats)
+{
+	const char *formats[] = { "d", "f", "b", "B", "h", "H", "i", "I", "l", "L", "q", "Q" };
+	for (auto format : formats)
+	{
+		vector<Reading *> *readings = NULL;
+		string value = string("array.array('") + format + "', [ 1, 2, 3 ])";
+		Datapoint *dp = convert(value, readings);
+		ASSERT_TRUE(dp != NULL) << format;
+		ASSERT_EQ(DatapointValue::T_FLOAT_ARRAY, dp->getData().getType()) << format;
+		vector<double> expected = { 1, 2, 3 };
+		ASSERT_EQ(expected, *dp->getData().getDpArr()) << format;
+		ASSERT_EQ(2, (*readings)[0]->getDatapointCount());
+		deleteReadings(readings);
+	}
+}
+
+TEST(PythonFloatArrayTest, MemoryView)
+{
+	vector<Reading *> *readings = NULL;
+	Datapoint *dp = convert("memoryview(array.array('h', [ -1, 0, 7 ]))", readings);
+	ASSERT_TRUE(dp != NULL);
+	ASSERT_EQ(DatapointValue::T_FLOAT_ARRAY, dp->getData().getType());
+	vector<double> expected = { -1, 0, 7 };
+	ASSERT_EQ(expected, *dp->getData().getDpArr());
+	deleteReadings(readings);
+
+	// A cast view of the bytes of an array
+	dp = convert("memoryview(array.array('d', [ 1.5, 2.5 ])).cast('B').cast('d')", readings);
+	ASSERT_TRUE(dp != NULL);
+	ASSERT_EQ(DatapointValue::T_FLOAT_ARRAY, dp->getData().getType());
+	expected = { 1.5, 2.5 };
+	ASSERT_EQ(expected, *dp->getData().getDpArr());
+	deleteReadings(readings);
+}
+
+TEST(PythonFloatArrayTest, Scalars)
+{
+	vector<Reading *> *readings = NULL;
+	Datapoint *dp = convert("2.5", readings);
+	ASSERT_TRUE(dp != NULL);
+	ASSERT_EQ(DatapointValue::T_FLOAT, dp->getData().getType());
+	deleteReadings(readings);
+
+	dp = convert("7", readings);
+	ASSERT_TRUE(dp != NULL);
+	ASSERT_EQ(DatapointValue::T_INTEGER, dp->getData().getType());
+	deleteReadings(readings);
+
+	// A zero dimensional buffer, as NumPy scalars are, is not an array
+	dp = convert("memoryview(array.array('d', [ 1.5 ])).cast('B').cast('d', [])", readings);
+	ASSERT_TRUE(dp == NULL);
+	deleteReadings(readings);
+}
+
+TEST(PythonFloatArrayTest, Rejected)
+{
+	vector<Reading *> *readings = NULL;
+
+	// Two dimensions
+	Datapoint *dp = convert("memoryview(array.array('d', [ 1, 2, 3, 4 ])).cast('B').cast('d', [ 2, 2 ])", readings);
+	ASSERT_TRUE(dp == NULL);
+	deleteReadings(readings);
+
+	// Items of a size other than that of the native type of the format
+	if (!StandardLongType.tp_basicsize)
+	{
+		StandardLongType.tp_basicsize = sizeof(StandardLongObject);
+		StandardLongType.tp_flags = Py_TPFLAGS_DEFAULT;
+		StandardLongType.tp_as_buffer = &StandardLong_as_buffer;
+		ASSERT_EQ(0, PyType_Ready(&StandardLongType));
+	}
+	PyObject *standardLong = (PyObject *)PyObject_New(StandardLongObject, &StandardLongType);
+	ASSERT_TRUE(standardLong != NULL);
+	dp = convert("local", readings, standardLong);
+	if (sizeof(long) == sizeof(int32_t))
+	{
+		ASSERT_TRUE(dp != NULL);
+		vector<double> expected = { 1, 2, 3 };
+		ASSERT_EQ(expected, *dp->getData().getDpArr());
+	}
+	else
+	{
+		ASSERT_TRUE(dp == NULL);
+	}
+	deleteReadings(readings);
+	Py_DECREF(standardLong);
+	ASSERT_FALSE(PyErr_Occurred());
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <Python.h>
+#include <reading.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+extern "C" {
+std::vector<Reading *>* Py2C_getReadings(PyObject *polledData);
+std::vector<Reading *>* Py2C_getColumnReadings(PyObject *columns);
+long plugin_ingest_bulk_fn(PyObject *ingest_callback, PyObject *ingest_obj_ref_data, PyObject *readingsObj);
+}
+
+/**
+ * Evaluate a Python expression, returns a new reference
+ */
+static PyObject *evaluate(const char *expression)
+{
+	PyObject *globals = PyDict_New();
+	PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+	PyObject *result = PyRun_String(expression, Py_eval_input, globals, globals);
+	Py_DECREF(globals);
+	if (!result)
+	{
+		PyErr_Print();
+	}
+	return result;
+}
+
+static void deleteReadings(vector<Reading *> *readings)
+{
+	for (auto reading : *readings)
+	{
+		delete reading;
+	}
+	delete readings;
+}
+
+/**
+ * The ingest routine given to the bulk callback, keeps the readings
+ */
+static void ingest(void *data, vector<Reading *> *readings)
+{
+	vector<Reading *> *ingested = (vector<Reading *> *)data;
+	ingested->insert(ingested->end(), readings->begin(), readings->end());
+}
+
+TEST(PythonColumnReadingsTest, Columns)
+{
+	PyObject *columns = evaluate("{ 'asset' : 'pump', "
+			"'timestamps' : [ '2020-01-01 10:00:00.000000+00:00', '2020-01-01 10:00:01.000000+00:00' ], "
+			"'columns' : { 'speed' : [ 1, 2 ], 'temp' : [ 20.5, 21.5 ] } }");
+	ASSERT_TRUE(columns != NULL);
+	vector<Reading *> *readings = Py2C_getColumnReadings(columns);
+	Py_DECREF(columns);
+	ASSERT_TRUE(readings != NULL);
+	ASSERT_EQ(2, readings->size());
+	for (int i = 0; i < 2; i++)
+	{
+		Reading *reading = (*readings)[i];
+		ASSERT_EQ("pump", reading->getAssetName());
+		ASSERT_EQ(2, reading->getDatapointCount());
+		for (auto dp : reading->getReadingData())
+		{
+			if (dp->getName() == "speed")
+			{
+				ASSERT_EQ(DatapointValue::T_INTEGER, dp->getData().getType());
+				ASSERT_EQ(i + 1, dp->getData().toInt());
+			}
+			else
+			{
+				ASSERT_EQ("temp", dp->getName());
+				ASSERT_EQ(DatapointValue::T_FLOAT, dp->getData().getType());
+				ASSERT_EQ(20.5 + i, dp->getData().toDouble());
+			}
+		}
+		ASSERT_EQ("2020-01-01 10:00:0" + to_string(i) + ".000000", reading->getAssetDateUserTime());
+	}
+	deleteReadings(readings);
+}
+
+TEST(PythonColumnReadingsTest, LengthMismatch)
+{
+	PyObject *columns = evaluate("{ 'asset' : 'pump', 'columns' : { 'speed' : [ 1, 2 ], 'temp' : [ 20.5 ] } }");
+	ASSERT_TRUE(columns != NULL);
+	vector<Reading *> *readings = Py2C_getColumnReadings(columns);
+	Py_DECREF(columns);
+	ASSERT_TRUE(readings == NULL);
+	ASSERT_FALSE(PyErr_Occurred());
+}
+
+TEST(PythonColumnReadingsTest, NonStringKey)
+{
+	PyObject *columns = evaluate("{ 'asset' : 'pump', 'columns' : { 'speed' : [ 1, 2 ], 5 : [ 3, 4 ] } }");
+	ASSERT_TRUE(columns != NULL);
+	vector<Reading *> *readings = Py2C_getColumnReadings(columns);
+	Py_DECREF(columns);
+	ASSERT_TRUE(readings != NULL);
+	ASSERT_EQ(2, readings->size());
+	for (auto reading : *readings)
+	{
+		ASSERT_EQ(1, reading->getDatapointCount());
+		ASSERT_EQ("speed", reading->getReadingData()[0]->getName());
+	}
+	ASSERT_FALSE(PyErr_Occurred());
+	deleteReadings(readings);
+}
+
+TEST(PythonReadingsTest, NonStringKey)
+{
+	PyObject *list = evaluate("[ { 'asset' : 'pump', 'readings' : { 'speed' : 1, 2 : 'two', "
+			"'nested' : { 'a' : 1.5, ( 1, 2 ) : 3 } } } ]");
+	ASSERT_TRUE(list != NULL);
+	vector<Reading *> *readings = Py2C_getReadings(list);
+	Py_DECREF(list);
+	ASSERT_TRUE(readings != NULL);
+	ASSERT_EQ(1, readings->size());
+	Reading *reading = (*readings)[0];
+	ASSERT_EQ(2, reading->getDatapointCount());
+	ASSERT_EQ("{\"speed\":1,\"nested\":{\"a\":1.5}}", reading->getDatapointsJSON());
+	ASSERT_FALSE(PyErr_Occurred());
+	deleteReadings(readings);
+}
+
+TEST(PythonIngestBulkTest, List)
+{
+	vector<Reading *> ingested;
+	PyObject *callback = PyCapsule_New((void *)ingest, NULL, NULL);
+	PyObject *data = PyCapsule_New((void *)&ingested, NULL, NULL);
+	PyObject *list = evaluate("[ { 'asset' : 'a%d' % i, 'readings' : { 'value' : i } } for i in range(10) ]");
+	ASSERT_TRUE(list != NULL);
+	ASSERT_EQ(10, plugin_ingest_bulk_fn(callback, data, list));
+	ASSERT_EQ(10, ingested.size());
+	ASSERT_EQ("a9", ingested[9]->getAssetName());
+	for (auto reading : ingested)
+	{
+		delete reading;
+	}
+	Py_DECREF(list);
+	Py_DECREF(data);
+	Py_DECREF(callback);
+}
+
+TEST(PythonIngestBulkTest, Columns)
+{
+	vector<Reading *> ingested;
+	PyObject *callback = PyCapsule_New((void *)ingest, NULL, NULL);
+	PyObject *data = PyCapsule_New((void *)&ingested, NULL, NULL);
+	PyObject *columns = evaluate("{ 'asset' : 'pump', 'columns' : { 'speed' : list(range(100)) } }");
+	ASSERT_TRUE(columns != NULL);
+	ASSERT_EQ(100, plugin_ingest_bulk_fn(callback, data, columns));
+	ASSERT_EQ(100, ingested.size());
+	ASSERT_EQ(99, ingested[99]->getReadingData()[0]->getData().toInt());
+	for (auto reading : ingested)
+	{
+		delete reading;
+	}
+	Py_DECREF(columns);
+
+	// Malformed columns are an error
+	columns = evaluate("{ 'asset' : 'pump', 'columns' : { 'speed' : 1 } }");
+	ASSERT_EQ(-1, plugin_ingest_bulk_fn(callback, data, columns));
+	ASSERT_EQ(100, ingested.size());
+	Py_DECREF(columns);
+	Py_DECREF(data);
+	Py_DECREF(callback);
+}
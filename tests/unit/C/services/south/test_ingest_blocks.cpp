@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <ingest_blocks.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A storage layer whose appends fail as instructed, recording the
+ * blocks it stores in the order they were stored
+ */
+class Storage {
+	public:
+		future<bool> append(const IngestBlocks::Block& block)
+		{
+			promise<bool> result;
+			result.set_value(store(block));
+			return result.get_future();
+		}
+		bool store(const IngestBlocks::Block& block)
+		{
+			if (!failures.empty() && failures.front())
+			{
+				failures.pop_front();
+				return false;
+			}
+			if (!failures.empty())
+				failures.pop_front();
+			stored.push_back(&block);
+			return true;
+		}
+		deque<bool>				failures;
+		vector<const IngestBlocks::Block *>	stored;
+		vector<IngestBlocks::Block *>		released;
+};
+
+/**
+ * The blocks sent to the storage layer
+ */
+static IngestBlocks *blocks(Storage& storage)
+{
+	return new IngestBlocks([&storage](const IngestBlocks::Block& block) { return storage.append(block); },
+			[&storage](const IngestBlocks::Block& block) { return storage.store(block); },
+			[&storage](IngestBlocks::Block *block, bool) { storage.released.push_back(block); });
+}
+
+TEST(IngestBlocksTest, Sent)
+{
+	Storage storage;
+	IngestBlocks::Block first, second;
+	{
+		unique_ptr<IngestBlocks> sender(blocks(storage));
+		sender->send(&first);
+		sender->send(&second);
+		sender->complete();
+		ASSERT_EQ(0, sender->held());
+	}
+	ASSERT_EQ(2, storage.stored.size());
+	ASSERT_EQ(&first, storage.stored[0]);
+	ASSERT_EQ(&second, storage.stored[1]);
+	ASSERT_EQ(2, storage.released.size());
+}
+
+TEST(IngestBlocksTest, FailedBlockStoredFirst)
+{
+	Storage storage;
+	IngestBlocks::Block first, second, third;
+	unique_ptr<IngestBlocks> sender(blocks(storage));
+
+	// The append of the first block fails
+	storage.failures.push_back(true);
+	sender->send(&first);
+	sender->send(&second);
+	// The second block is held behind the first rather than sent
+	ASSERT_EQ(0, storage.stored.size());
+	ASSERT_EQ(2, sender->held());
+
+	ASSERT_TRUE(sender->resend());
+	sender->send(&third);
+	sender->complete();
+	ASSERT_EQ(3, storage.stored.size());
+	ASSERT_EQ(&first, storage.stored[0]);
+	ASSERT_EQ(&second, storage.stored[1]);
+	ASSERT_EQ(&third, storage.stored[2]);
+	ASSERT_EQ(3, storage.released.size());
+}
+
+TEST(IngestBlocksTest, ResendFails)
+{
+	Storage storage;
+	IngestBlocks::Block first, second;
+	unique_ptr<IngestBlocks> sender(blocks(storage));
+
+	storage.failures.push_back(true);
+	sender->send(&first);
+	sender->complete();
+	ASSERT_EQ(1, sender->held());
+
+	// Still failing, the block stays held and later blocks join it
+	storage.failures.push_back(true);
+	ASSERT_FALSE(sender->resend());
+	sender->send(&second);
+	ASSERT_EQ(2, sender->held());
+	ASSERT_EQ(0, storage.stored.size());
+
+	ASSERT_TRUE(sender->resend());
+	ASSERT_EQ(&first, storage.stored[0]);
+	ASSERT_EQ(&second, storage.stored[1]);
+}
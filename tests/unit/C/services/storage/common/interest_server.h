@@ -0,0 +1,75 @@
+#ifndef _INTEREST_SERVER_H
+#define _INTEREST_SERVER_H
+#include <server_http.hpp>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * An HTTP server that stands in for a service that has registered an
+ * interest in assets, it keeps the payloads of the notifications sent
+ * to it.
+ */
+class InterestServer {
+	public:
+		typedef SimpleWeb::Server<SimpleWeb::HTTP>	HttpServer;
+
+		InterestServer()
+		{
+			m_server.config.port = 0;
+			m_server.resource["^/notify$"]["POST"] =
+				[this](std::shared_ptr<HttpServer::Response> response,
+					std::shared_ptr<HttpServer::Request> request) {
+				{
+					std::lock_guard<std::mutex> guard(m_mutex);
+					m_payloads.push_back(request->content.string());
+				}
+				m_cv.notify_all();
+				*response << "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+			};
+			std::promise<unsigned short> port;
+			m_thread = std::thread([this, &port]() {
+				m_server.start([&port](unsigned short listening) {
+					port.set_value(listening);
+				});
+			});
+			m_port = port.get_future().get();
+		}
+		~InterestServer()
+		{
+			m_server.stop();
+			m_thread.join();
+		}
+		/**
+		 * The URL to register an interest with
+		 */
+		std::string url()
+		{
+			return "http://localhost:" + std::to_string(m_port) + "/notify";
+		}
+		/**
+		 * Wait for a number of notifications to have been received
+		 */
+		bool wait(unsigned int count, int ms = 5000)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_cv.wait_for(lock, std::chrono::milliseconds(ms),
+					[this, count]() { return m_payloads.size() >= count; });
+		}
+		std::vector<std::string> payloads()
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			return m_payloads;
+		}
+	private:
+		HttpServer			m_server;
+		std::thread			m_thread;
+		unsigned short			m_port;
+		std::mutex			m_mutex;
+		std::condition_variable		m_cv;
+		std::vector<std::string>	m_payloads;
+};
+#endif
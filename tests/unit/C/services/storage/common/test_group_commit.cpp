@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <group_commit.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+/**
+ * The count of elements of a JSON array content
+ */
+static int countOf(const char *array)
+{
+	return GroupCommit::countElements(array, strlen(array));
+}
+
+TEST(GroupCommitTest, CountElements)
+{
+	ASSERT_EQ(0, countOf(""));
+	ASSERT_EQ(0, countOf("  \n "));
+	ASSERT_EQ(1, countOf("1"));
+	ASSERT_EQ(3, countOf("1, 2, 3"));
+	ASSERT_EQ(2, countOf("{ \"a\" : [ 1, 2 ] }, { \"b\" : { \"c\" : 3, \"d\" : 4 } }"));
+	// Separators and brackets within strings
+	ASSERT_EQ(2, countOf("\"a,b\", \"[{\""));
+	ASSERT_EQ(1, countOf("\"a\\\",b\""));
+	ASSERT_EQ(2, countOf("\"a\\\\\", \"b\""));
+}
+
+TEST(GroupCommitTest, CountElementsMalformed)
+{
+	ASSERT_EQ(-1, countOf("{ \"a\" : 1"));
+	ASSERT_EQ(-1, countOf("{ \"a\" : 1 }}"));
+	ASSERT_EQ(-1, countOf("]"));
+	ASSERT_EQ(-1, countOf("\"abc"));
+	ASSERT_EQ(-1, countOf("\"a\\\""));
+}
+
+TEST(GroupCommitTest, ReadingsArray)
+{
+	size_t start, end;
+	string payload = " { \"readings\" : [ { \"asset_code\" : \"a\" }, { \"asset_code\" : \"b\" } ] } ";
+	ASSERT_EQ(2, GroupCommit::readingsArray(payload, start, end));
+	ASSERT_EQ(" { \"asset_code\" : \"a\" }, { \"asset_code\" : \"b\" } ",
+		  payload.substr(start, end - start));
+
+	payload = "{\"readings\":[{\"asset_code\":\"a\"}]}";
+	ASSERT_EQ(1, GroupCommit::readingsArray(payload, start, end));
+	ASSERT_EQ("{\"asset_code\":\"a\"}", payload.substr(start, end - start));
+
+	payload = "{ \"readings\" : [ ] }";
+	ASSERT_EQ(0, GroupCommit::readingsArray(payload, start, end));
+}
+
+TEST(GroupCommitTest, ReadingsArrayRejected)
+{
+	size_t start, end;
+	ASSERT_EQ(-1, GroupCommit::readingsArray("", start, end));
+	ASSERT_EQ(-1, GroupCommit::readingsArray("[ ]", start, end));
+	ASSERT_EQ(-1, GroupCommit::readingsArray("{ \"values\" : [ 1 ] }", start, end));
+	ASSERT_EQ(-1, GroupCommit::readingsArray("{ \"readings\" : { } }", start, end));
+	ASSERT_EQ(-1, GroupCommit::readingsArray("{ \"readings\" : [ 1 ]", start, end));
+	ASSERT_EQ(-1, GroupCommit::readingsArray("{ \"readings\" : [ 1 ], \"x\" : 1 }", start, end));
+	ASSERT_EQ(-1, GroupCommit::readingsArray("{ \"readings\" : [ { ] }", start, end));
+}
+
+/**
+ * A single append is passed to the plugin as it is and without
+ * waiting for other appends to join it
+ */
+TEST(GroupCommitTest, SingleAppend)
+{
+	vector<string> calls;
+	GroupCommit group([&calls](const string& payload, string& error) {
+				calls.push_back(payload);
+				return 1;
+			});
+	string payload = "{ \"readings\" : [ { \"asset_code\" : \"a\" } ] }";
+	string error;
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < 100; i++)
+	{
+		ASSERT_EQ(1, group.append(payload, error));
+	}
+	auto elapsed = chrono::steady_clock::now() - start;
+	ASSERT_EQ(100, calls.size());
+	ASSERT_EQ(payload, calls[0]);
+	// Far less than waiting GROUP_COMMIT_WINDOW for each append
+	ASSERT_LT(elapsed, chrono::milliseconds(50 * GROUP_COMMIT_WINDOW));
+}
+
+/**
+ * Appends queued while a group is committed are merged into the next group
+ */
+TEST(GroupCommitTest, MergedAppends)
+{
+	atomic<bool> release(false);
+	atomic<int> first(0);
+	vector<string> calls;
+	GroupCommit group([&](const string& payload, string& error) {
+				if (first++ == 0)
+				{
+					// Hold the first group until the others are queued
+					while (!release)
+						this_thread::sleep_for(chrono::milliseconds(1));
+				}
+				calls.push_back(payload);
+				size_t start, end;
+				return GroupCommit::readingsArray(payload, start, end);
+			});
+
+	string error;
+	string payload1 = "{ \"readings\" : [ { \"asset_code\" : \"a\" } ] }";
+	thread leader([&]() { string error; ASSERT_EQ(1, group.append(payload1, error)); });
+	while (first == 0)
+		this_thread::sleep_for(chrono::milliseconds(1));
+
+	vector<thread> threads;
+	atomic<int> appended(0);
+	for (int i = 0; i < 4; i++)
+	{
+		threads.push_back(thread([&]() {
+				string error;
+				string payload = "{ \"readings\" : [ { \"asset_code\" : \"b\" }, { \"asset_code\" : \"c\" } ] }";
+				appended += group.append(payload, error);
+			}));
+	}
+	this_thread::sleep_for(chrono::milliseconds(20));
+	release = true;
+	leader.join();
+	for (auto& t : threads)
+		t.join();
+
+	ASSERT_EQ(8, appended);
+	ASSERT_EQ(2, calls.size());
+	size_t start, end;
+	ASSERT_EQ(8, GroupCommit::readingsArray(calls[1], start, end));
+}
+
+/**
+ * When the merged append fails each payload is appended on its own
+ * and only the bad payload fails
+ */
+TEST(GroupCommitTest, MergedFailure)
+{
+	atomic<bool> release(false);
+	atomic<int> first(0);
+	GroupCommit group([&](const string& payload, string& error) {
+				if (first++ == 0)
+				{
+					while (!release)
+						this_thread::sleep_for(chrono::milliseconds(1));
+				}
+				if (payload.find("bad") != string::npos)
+				{
+					error = "{ \"message\" : \"bad reading\" }";
+					return -1;
+				}
+				size_t start, end;
+				return GroupCommit::readingsArray(payload, start, end);
+			});
+
+	thread leader([&]() {
+			string error;
+			ASSERT_EQ(1, group.append("{ \"readings\" : [ { \"asset_code\" : \"a\" } ] }", error));
+		});
+	while (first == 0)
+		this_thread::sleep_for(chrono::milliseconds(1));
+
+	int good = 0, bad = 0;
+	string badError;
+	thread t1([&]() {
+			string error;
+			good = group.append("{ \"readings\" : [ { \"asset_code\" : \"b\" } ] }", error);
+		});
+	thread t2([&]() {
+			bad = group.append("{ \"readings\" : [ { \"asset_code\" : \"bad\" } ] }", badError);
+		});
+	this_thread::sleep_for(chrono::milliseconds(20));
+	release = true;
+	leader.join();
+	t1.join();
+	t2.join();
+
+	ASSERT_EQ(1, good);
+	ASSERT_EQ(-1, bad);
+	ASSERT_EQ("{ \"message\" : \"bad reading\" }", badError);
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <reading_cache.h>
+#include <string>
+
+using namespace std;
+
+/**
+ * The payload the plugin returns for a fetch of the readings first to last
+ */
+static string rows(unsigned long first, unsigned long last)
+{
+	string payload = "{\"count\":" + to_string(last - first + 1) + ",\"rows\":[";
+	for (unsigned long id = first; id <= last; id++)
+	{
+		if (id != first)
+			payload += ',';
+		payload += "{\"id\":" + to_string(id) + ",\"asset_code\":\"a\"}";
+	}
+	payload += "]}";
+	return payload;
+}
+
+TEST(ReadingCacheTest, Empty)
+{
+	ReadingCache cache;
+	string payload;
+	ASSERT_FALSE(cache.fetch(1, 10, payload));
+}
+
+TEST(ReadingCacheTest, Fetch)
+{
+	ReadingCache cache;
+	string payload;
+	cache.update(cache.generation(), 1, rows(1, 10));
+	ASSERT_TRUE(cache.fetch(1, 10, payload));
+	ASSERT_EQ(rows(1, 10), payload);
+	ASSERT_TRUE(cache.fetch(4, 3, payload));
+	ASSERT_EQ(rows(4, 6), payload);
+	// Not all the readings requested are in the cache
+	ASSERT_FALSE(cache.fetch(8, 5, payload));
+	ASSERT_FALSE(cache.fetch(11, 1, payload));
+	ASSERT_FALSE(cache.fetch(1, 0, payload));
+
+	string json;
+	cache.asJSON(json);
+	ASSERT_EQ("{ \"size\" : 10000, \"readings\" : 10, \"hits\" : 2, \"misses\" : 3 }", json);
+}
+
+TEST(ReadingCacheTest, Extend)
+{
+	ReadingCache cache;
+	string payload;
+	cache.update(cache.generation(), 1, rows(1, 10));
+	// Adjoining fetch extends the range
+	cache.update(cache.generation(), 11, rows(11, 20));
+	ASSERT_TRUE(cache.fetch(5, 10, payload));
+	ASSERT_EQ(rows(5, 14), payload);
+	// Overlapping fetch extends the range without duplicates
+	cache.update(cache.generation(), 15, rows(15, 25));
+	ASSERT_TRUE(cache.fetch(1, 25, payload));
+	ASSERT_EQ(rows(1, 25), payload);
+}
+
+TEST(ReadingCacheTest, Replace)
+{
+	ReadingCache cache;
+	string payload;
+	cache.update(cache.generation(), 1, rows(1, 10));
+	// A fetch that leaves a gap replaces the content
+	cache.update(cache.generation(), 50, rows(50, 60));
+	ASSERT_FALSE(cache.fetch(1, 1, payload));
+	ASSERT_TRUE(cache.fetch(50, 11, payload));
+	ASSERT_EQ(rows(50, 60), payload);
+}
+
+TEST(ReadingCacheTest, Generation)
+{
+	ReadingCache cache;
+	string payload;
+	unsigned long generation = cache.generation();
+	cache.clear();
+	ASSERT_NE(generation, cache.generation());
+	// Readings fetched before the purge are not cached
+	cache.update(generation, 1, rows(1, 10));
+	ASSERT_FALSE(cache.fetch(1, 1, payload));
+
+	cache.update(cache.generation(), 1, rows(1, 10));
+	ASSERT_TRUE(cache.fetch(1, 1, payload));
+	cache.clear();
+	ASSERT_FALSE(cache.fetch(1, 1, payload));
+}
+
+TEST(ReadingCacheTest, PluginPurge)
+{
+	ReadingCache cache;
+	string payload;
+	cache.update(cache.generation(), 1, rows(1, 10));
+	// Unchanged plugin generation keeps the content
+	cache.purged(0);
+	ASSERT_TRUE(cache.fetch(1, 10, payload));
+
+	unsigned long generation = cache.generation();
+	cache.purged(1);
+	ASSERT_FALSE(cache.fetch(1, 10, payload));
+	ASSERT_NE(generation, cache.generation());
+	cache.update(generation, 1, rows(1, 10));
+	ASSERT_FALSE(cache.fetch(1, 10, payload));
+}
+
+TEST(ReadingCacheTest, Eviction)
+{
+	ReadingCache cache(10);
+	string payload;
+	cache.update(cache.generation(), 1, rows(1, 8));
+	cache.update(cache.generation(), 9, rows(9, 15));
+	// The oldest readings are discarded
+	ASSERT_FALSE(cache.fetch(5, 1, payload));
+	ASSERT_TRUE(cache.fetch(6, 10, payload));
+	ASSERT_EQ(rows(6, 15), payload);
+
+	// A single fetch larger than the cache keeps the newest readings
+	cache.update(cache.generation(), 100, rows(100, 130));
+	ASSERT_FALSE(cache.fetch(100, 1, payload));
+	ASSERT_TRUE(cache.fetch(121, 10, payload));
+}
+
+TEST(ReadingCacheTest, Disabled)
+{
+	ReadingCache cache(0);
+	string payload;
+	cache.update(cache.generation(), 1, rows(1, 10));
+	ASSERT_FALSE(cache.fetch(1, 1, payload));
+}
+
+TEST(ReadingCacheTest, BadPayload)
+{
+	ReadingCache cache;
+	string payload;
+	cache.update(cache.generation(), 1, "{\"count\":1,\"rows\":[{\"asset_code\":\"a\"}]}");
+	cache.update(cache.generation(), 1, "{\"count\":1");
+	ASSERT_FALSE(cache.fetch(1, 1, payload));
+}
+
+TEST(ReadingCacheTest, Append)
+{
+	ReadingCache cache;
+	string payload;
+	unsigned long generation, id;
+	// Nothing to follow until a fetch has populated the cache
+	ASSERT_FALSE(cache.tail(generation, id));
+	cache.update(cache.generation(), 1, rows(1, 10));
+	ASSERT_TRUE(cache.tail(generation, id));
+	ASSERT_EQ(11, id);
+
+	// The readings appended are returned by the plugin with their ids
+	cache.appended(generation, id, 5, rows(11, 15));
+	ASSERT_TRUE(cache.fetch(11, 5, payload));
+	ASSERT_EQ(rows(11, 15), payload);
+
+	// Readings were added by another append meanwhile
+	ASSERT_TRUE(cache.tail(generation, id));
+	cache.appended(generation, id, 5, rows(17, 21));
+	ASSERT_FALSE(cache.fetch(16, 1, payload));
+
+	// Purged during the append
+	ASSERT_TRUE(cache.tail(generation, id));
+	cache.clear();
+	cache.update(cache.generation(), 1, rows(1, 10));
+	cache.appended(generation, id, 5, rows(16, 20));
+	ASSERT_FALSE(cache.fetch(16, 1, payload));
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <reading_stream_batch.h>
+#include <storage_registry.h>
+#include <interest_server.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+/**
+ * A reading as the stream handler holds it, the asset code and the
+ * reading each followed by a terminator
+ */
+static ReadingStream *streamReading(const string& asset, const string& reading, time_t secs, long usecs)
+{
+	ReadingStream *stream = (ReadingStream *)malloc(offsetof(ReadingStream, assetCode)
+			+ asset.length() + reading.length() + 2);
+	stream->assetCodeLength = asset.length() + 1;
+	stream->payloadLength = reading.length() + 1;
+	stream->userTs.tv_sec = secs;
+	stream->userTs.tv_usec = usecs;
+	memcpy(stream->assetCode, asset.c_str(), asset.length() + 1);
+	memcpy(&stream->assetCode[asset.length() + 1], reading.c_str(), reading.length() + 1);
+	return stream;
+}
+
+TEST(ReadingStreamBatchTest, Batch)
+{
+	ReadingStream *readings[3];
+	readings[0] = streamReading("pump", "{\"flow\":12}", 1577934245, 100);
+	readings[1] = streamReading("valve", "{\"open\":true}", 1577934246, 999999);
+	readings[2] = NULL;
+
+	ReadingStreamBatch block(readings);
+	const ReadingBatch *batch = block.batch();
+	ASSERT_EQ(READING_BATCH_VERSION, batch->version);
+	ASSERT_EQ(2, batch->count);
+	ASSERT_EQ("pump", string(batch->readings[0].assetCode, batch->readings[0].assetCodeLength));
+	ASSERT_EQ("2020-01-02 03:04:05.000100", string(batch->readings[0].userTs, batch->readings[0].userTsLength));
+	ASSERT_EQ("{\"flow\":12}", string(batch->readings[0].reading, batch->readings[0].readingLength));
+	ASSERT_EQ("2020-01-02 03:04:06.999999", string(batch->readings[1].userTs, batch->readings[1].userTsLength));
+
+	string payload;
+	block.payload(payload);
+	ASSERT_EQ("{\"readings\":["
+		"{\"asset_code\":\"pump\",\"user_ts\":\"2020-01-02 03:04:05.000100\",\"reading\":{\"flow\":12}},"
+		"{\"asset_code\":\"valve\",\"user_ts\":\"2020-01-02 03:04:06.999999\",\"reading\":{\"open\":true}}]}",
+		payload);
+	free(readings[0]);
+	free(readings[1]);
+}
+
+TEST(ReadingStreamBatchTest, Empty)
+{
+	ReadingStream *readings[1] = { NULL };
+	ReadingStreamBatch block(readings);
+	ASSERT_EQ(0, block.batch()->count);
+	string payload;
+	block.payload(payload);
+	ASSERT_EQ("{\"readings\":[]}", payload);
+}
+
+TEST(ReadingStreamBatchTest, Interest)
+{
+	InterestServer server;
+	StorageRegistry registry;
+	ASSERT_FALSE(registry.hasInterest());
+	registry.registerAsset("pump", server.url());
+	ASSERT_TRUE(registry.hasInterest());
+
+	// A stream block is passed to the interests as an append request is
+	ReadingStream *readings[3];
+	readings[0] = streamReading("pump", "{\"flow\":12}", 1577934245, 100);
+	readings[1] = streamReading("valve", "{\"open\":true}", 1577934246, 0);
+	readings[2] = NULL;
+	ReadingStreamBatch block(readings);
+	string payload;
+	block.payload(payload);
+	registry.process(payload);
+
+	ASSERT_TRUE(server.wait(1));
+	string notified = server.payloads()[0];
+	ASSERT_NE(string::npos, notified.find("\"pump\""));
+	ASSERT_NE(string::npos, notified.find("\"flow\""));
+	ASSERT_EQ(string::npos, notified.find("\"valve\""));
+	free(readings[0]);
+	free(readings[1]);
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <storage_registry.h>
+#include <interest_server.h>
+#include <rapidjson/document.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace rapidjson;
+
+/**
+ * An append payload with a reading of each of the assets
+ */
+static string payload(const vector<string>& assets)
+{
+	string payload = "{ \"readings\" : [ ";
+	for (size_t i = 0; i < assets.size(); i++)
+	{
+		if (i)
+			payload += ", ";
+		payload += "{ \"asset_code\" : \"" + assets[i] + "\", \"user_ts\" : \"2020-01-02 03:04:05.000100\", "
+			"\"reading\" : { \"value\" : " + to_string(i) + " } }";
+	}
+	payload += " ] }";
+	return payload;
+}
+
+/**
+ * The asset codes of the readings of a notification
+ */
+static string assetsOf(const string& notification)
+{
+	Document doc;
+	doc.Parse(notification.c_str());
+	if (doc.HasParseError() || !doc.HasMember("readings"))
+	{
+		return "error";
+	}
+	string assets;
+	for (auto& reading : doc["readings"].GetArray())
+	{
+		if (!assets.empty())
+			assets += ",";
+		assets += reading["asset_code"].GetString();
+	}
+	return assets;
+}
+
+TEST(StorageRegistryTest, RegisterUnregister)
+{
+	InterestServer server;
+	StorageRegistry registry;
+	ASSERT_FALSE(registry.hasInterest());
+	registry.registerAsset("pump", server.url());
+	registry.registerAsset("pump", server.url());
+	registry.registerAsset("valve", server.url());
+	ASSERT_TRUE(registry.hasInterest());
+
+	// Removing registrations that were not made changes nothing
+	registry.unregisterAsset("motor", server.url());
+	registry.unregisterAsset("pump", "http://localhost:1/notify");
+	ASSERT_TRUE(registry.hasInterest());
+
+	// A duplicate registration is removed with the first
+	registry.unregisterAsset("pump", server.url());
+	ASSERT_TRUE(registry.hasInterest());
+	registry.unregisterAsset("valve", server.url());
+	ASSERT_FALSE(registry.hasInterest());
+
+	registry.process(payload({ "pump", "valve" }));
+	ASSERT_FALSE(server.wait(1, 200));
+}
+
+TEST(StorageRegistryTest, AllAssets)
+{
+	InterestServer server;
+	StorageRegistry registry;
+	registry.registerAsset("*", server.url());
+
+	// The payload is passed on unchanged, it is not parsed
+	string all = payload({ "pump", "valve" });
+	registry.process(all);
+	registry.process("not parsed");
+	ASSERT_TRUE(server.wait(2));
+	ASSERT_EQ(all, server.payloads()[0]);
+	ASSERT_EQ("not parsed", server.payloads()[1]);
+}
+
+TEST(StorageRegistryTest, AssetDelivery)
+{
+	InterestServer pump, valves;
+	StorageRegistry registry;
+	registry.registerAsset("pump", pump.url());
+	registry.registerAsset("valve1", valves.url());
+	registry.registerAsset("valve2", valves.url());
+
+	registry.process(payload({ "valve1", "motor", "pump", "valve2", "valve1" }));
+	ASSERT_TRUE(pump.wait(1));
+	ASSERT_TRUE(valves.wait(1));
+	ASSERT_EQ("pump", assetsOf(pump.payloads()[0]));
+	// A subscriber to several assets receives a single payload in order
+	ASSERT_EQ("valve1,valve2,valve1", assetsOf(valves.payloads()[0]));
+
+	// Only the subscribers of the assets of a payload are notified
+	registry.process(payload({ "valve2" }));
+	ASSERT_TRUE(valves.wait(2));
+	ASSERT_EQ("valve2", assetsOf(valves.payloads()[1]));
+	ASSERT_FALSE(pump.wait(2, 200));
+	ASSERT_EQ(1U, pump.payloads().size());
+}
+
+TEST(StorageRegistryTest, SubscriberDown)
+{
+	InterestServer server;
+	StorageRegistry registry;
+	string down;
+	{
+		InterestServer stopped;
+		down = stopped.url();
+	}
+	registry.registerAsset("pump", down);
+	registry.registerAsset("pump", server.url());
+
+	// A subscriber that can not be reached does not hold up the others
+	for (int i = 0; i < 3; i++)
+	{
+		registry.process(payload({ "pump" }));
+	}
+	ASSERT_TRUE(server.wait(3));
+	for (auto& notification : server.payloads())
+	{
+		ASSERT_EQ("pump", assetsOf(notification));
+	}
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <storage_workers.h>
+#include <storage_api.h>
+#include <client_http.hpp>
+#include <rapidjson/document.h>
+#include <stdlib.h>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace rapidjson;
+using HttpClient = SimpleWeb::Client<SimpleWeb::HTTP>;
+
+/**
+ * A task that blocks the worker running it until released
+ */
+class BlockingTask {
+	public:
+		BlockingTask() : m_release(m_promise.get_future().share()) {};
+		function<void()> task()
+		{
+			shared_future<void> release = m_release;
+			promise<void> *started = &m_started;
+			return [release, started]() {
+				started->set_value();
+				release.wait();
+			};
+		}
+		void waitStarted() { m_started.get_future().wait(); };
+		void release() { m_promise.set_value(); };
+	private:
+		promise<void>		m_promise;
+		shared_future<void>	m_release;
+		promise<void>		m_started;
+};
+
+/**
+ * Return the value of a statistic of a class of request
+ */
+static int statistic(StorageWorkers& workers, const char *workerClass, const char *name)
+{
+	string json;
+	workers.asJSON(json);
+	Document doc;
+	doc.Parse(json.c_str());
+	return doc[workerClass][name].GetInt();
+}
+
+TEST(StorageWorkersTest, QueueFull)
+{
+	StorageWorkers workers(1, 3);
+	BlockingTask blocking;
+	ASSERT_TRUE(workers.submit(WorkerFetch, blocking.task()));
+	blocking.waitStarted();
+
+	atomic<int> run(0);
+	for (int i = 0; i < 3; i++)
+	{
+		ASSERT_TRUE(workers.submit(WorkerFetch, [&run]() { run++; }));
+	}
+	// The queue of the class is full, other classes still queue
+	ASSERT_FALSE(workers.submit(WorkerFetch, [&run]() { run++; }));
+	ASSERT_FALSE(workers.submit(WorkerFetch, [&run]() { run++; }));
+	ASSERT_TRUE(workers.submit(WorkerQuery, [&run]() { run++; }));
+	ASSERT_EQ(3, statistic(workers, "fetch", "queued"));
+	ASSERT_EQ(2, statistic(workers, "fetch", "rejected"));
+	ASSERT_EQ(0, statistic(workers, "query", "rejected"));
+
+	blocking.release();
+	workers.shutdown();
+	ASSERT_EQ(4, run.load());
+	ASSERT_EQ(4, statistic(workers, "fetch", "executed"));
+	ASSERT_EQ(0, statistic(workers, "fetch", "queued"));
+	// Nothing is queued once the pool is shutdown
+	ASSERT_FALSE(workers.submit(WorkerAppend, [&run]() { run++; }));
+}
+
+TEST(StorageWorkersTest, Priority)
+{
+	StorageWorkers workers(1, 10);
+	BlockingTask blocking;
+	ASSERT_TRUE(workers.submit(WorkerAppend, blocking.task()));
+	blocking.waitStarted();
+
+	mutex order;
+	string classes;
+	auto task = [&order, &classes](char c) {
+		return [&order, &classes, c]() {
+			lock_guard<mutex> guard(order);
+			classes += c;
+		};
+	};
+	ASSERT_TRUE(workers.submit(WorkerPurge, task('p')));
+	ASSERT_TRUE(workers.submit(WorkerQuery, task('q')));
+	ASSERT_TRUE(workers.submit(WorkerAppend, task('a')));
+	ASSERT_TRUE(workers.submit(WorkerFetch, task('f')));
+	ASSERT_TRUE(workers.submit(WorkerAppend, task('a')));
+
+	blocking.release();
+	workers.shutdown();
+	ASSERT_EQ("aafqp", classes);
+}
+
+/**
+ * An HTTP server that queues the readings fetches it receives on the
+ * worker pool of a storage API
+ */
+class FetchServer {
+	public:
+		FetchServer(StorageApi& api)
+		{
+			m_server.config.port = 0;
+			m_server.resource[READING_ACCESS]["GET"] =
+				[&api](shared_ptr<HttpServer::Response> response,
+					shared_ptr<HttpServer::Request> request) {
+				api.queueRequest(WorkerFetch, EndpointReadingFetch,
+						&StorageApi::readingFetch, response, request);
+			};
+			promise<unsigned short> port;
+			m_thread = thread([this, &port]() {
+				m_server.start([&port](unsigned short listening) {
+					port.set_value(listening);
+				});
+			});
+			m_port = port.get_future().get();
+		}
+		~FetchServer()
+		{
+			m_server.stop();
+			m_thread.join();
+		}
+		/**
+		 * Fetch readings without the id, the storage API answers with
+		 * a bad request unless the fetch is rejected
+		 */
+		string fetch()
+		{
+			HttpClient client("localhost:" + to_string(m_port));
+			auto res = client.request("GET", "/storage/reading?count=1");
+			return res->status_code;
+		}
+	private:
+		HttpServer	m_server;
+		thread		m_thread;
+		unsigned short	m_port;
+};
+
+TEST(StorageWorkersTest, Overloaded)
+{
+	StorageApi api(0, 1);
+	api.setWorkerPool(1, 1);
+	FetchServer server(api);
+	ASSERT_EQ("400 Bad Request", server.fetch());
+
+	// A pool that can queue nothing rejects every request
+	api.setWorkerPool(1, 0);
+	ASSERT_EQ("503 Service Unavailable", server.fetch());
+	ASSERT_EQ("503 Service Unavailable", server.fetch());
+}
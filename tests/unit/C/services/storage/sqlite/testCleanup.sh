@@ -5,3 +5,4 @@ drop table fledge.test;
 delete from fledge.test2;
 drop table fledge.test2;
 EOF
+rm -f `dirname ${DEFAULT_SQLITE_DB_FILE}`/readings_20[0-9]*.db*
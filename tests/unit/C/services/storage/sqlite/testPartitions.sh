@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+#
+# Prepare the database for the storage service to be restarted with
+# partitioned readings. A partition of an earlier hour holds readings of
+# PartitionAsset, the latest readings are emptied so that they are seeded
+# again from the readings and the partitions.
+#
+dir=`dirname ${DEFAULT_SQLITE_DB_FILE}`
+rm -f ${dir}/readings_20[0-9]*.db*
+sqlite3 ${dir}/readings_2019101210.db << EOF2
+CREATE TABLE readings (
+	id		INTEGER			PRIMARY KEY AUTOINCREMENT,
+	asset_code	character varying(50)	NOT NULL,
+	reading		JSON			NOT NULL DEFAULT '{}',
+	user_ts		DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW')),
+	ts		DATETIME DEFAULT (STRFTIME('%Y-%m-%d %H:%M:%f+00:00', 'NOW'))
+);
+insert into readings values (100001, 'PartitionAsset', '{"rate":10}', '2019-10-12 10:10:00.000000+00:00', '2019-10-12 10:10:00.000000+00:00');
+insert into readings values (100002, 'PartitionAsset', '{"rate":30}', '2019-10-12 10:30:00.000000+00:00', '2019-10-12 10:30:00.000000+00:00');
+insert into readings values (100003, 'PartitionAsset', '{"rate":20}', '2019-10-12 10:20:00.000000+00:00', '2019-10-12 10:20:00.000000+00:00');
+EOF2
+sqlite3 ${DEFAULT_SQLITE_DB_FILE} << EOF2
+ATTACH DATABASE '${DEFAULT_SQLITE_DB_FILE}' AS 'fledge';
+delete from fledge.readings_latest;
+EOF2
@@ -4,6 +4,7 @@
 export FLEDGE_DATA=./plugin_cfg/sqlite          # Select the persistent storage plugin
 export storage_exec=$FLEDGE_ROOT/services/fledge.services.storage
 export TZ='Etc/UTC'
+export FLEDGE_READINGS_ROLLUPS=10               # Answer the timebucket queries of 10 seconds from a rollup
 
 show_configuration () {
 
@@ -85,6 +86,19 @@ rm -f failed
 rm -rf results
 mkdir results
 cat testset | while read name method url payload optional; do
+if [ "$method" = "SLEEP" ] ; then
+	# Wait, without counting a test, for the storage service to catch up
+	sleep $url
+	continue
+fi
+if [ "$method" = "START" ] ; then
+	# Start the storage service again, with the environment given, once
+	# the script given has prepared the database
+	./$payload > /dev/null 2>&1
+	env $url $storage_exec
+	sleep 1
+	continue
+fi
 #sleep 0.003
 echo -n "Test $testNum ${name}: "
 if [ "$payload" = "" ] ; then
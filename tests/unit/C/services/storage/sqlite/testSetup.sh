@@ -31,7 +31,33 @@ CREATE TABLE IF NOT EXISTS fledge.readings (
 -- CREATE INDEX fki_readings_fk1
 --    ON readings (asset_code);
 
+-- Tables kept by the storage plugin from the readings
+CREATE TABLE IF NOT EXISTS fledge.readings_latest (
+    asset_code TEXT PRIMARY KEY,
+    id         INTEGER NOT NULL,
+    user_ts    INTEGER NOT NULL,
+    reading    TEXT NOT NULL
+) WITHOUT ROWID;
+
+CREATE TABLE IF NOT EXISTS fledge.readings_rollups (
+    size       INTEGER PRIMARY KEY,
+    last_id    INTEGER NOT NULL
+);
+
+CREATE TABLE IF NOT EXISTS fledge.readings_rollup_buckets (
+    size       INTEGER NOT NULL,
+    asset_code TEXT NOT NULL,
+    datapoint  TEXT NOT NULL,
+    bucket     INTEGER NOT NULL,
+    min, max, sum,
+    count      INTEGER NOT NULL,
+    PRIMARY KEY (size, asset_code, bucket, datapoint)
+) WITHOUT ROWID;
+
 delete from fledge.readings;
+delete from fledge.readings_latest;
+delete from fledge.readings_rollups;
+delete from fledge.readings_rollup_buckets;
 delete from fledge.configuration;
 
 CREATE TABLE IF NOT EXISTS fledge.configuration (
@@ -43,6 +43,7 @@ class FakeFledgeStorageSrvr:
             # readings table
             web.post('/storage/reading', self.readings_append),
             web.get('/storage/reading', self.readings_fetch),
+            web.get('/storage/reading/latest', self.readings_latest),
             web.put('/storage/reading/query', self.readings_query),
             web.put('/storage/reading/purge', self.readings_purge)
         ])
@@ -133,6 +134,12 @@ class FakeFledgeStorageSrvr:
                                   "count": request.query.get('count')
                                   })
 
+    async def readings_latest(self, request):
+        if request.query.get("asset") == "internal_server_err":
+            return web.HTTPInternalServerError(reason="something wrong", text='{"key": "value"}')
+
+        return web.json_response({"count": 0, "rows": [], "asset": request.query.get("asset")})
+
     async def readings_query(self, request):
         payload = await request.json()
 
@@ -611,6 +618,37 @@ class TestReadingsStorageAsyncClient:
 
         await fake_storage_srvr.stop()
 
+    @pytest.mark.asyncio
+    async def test_latest(self, event_loop):
+        # GET, '/storage/reading/latest?asset={}'
+
+        fake_storage_srvr = FakeFledgeStorageSrvr(loop=event_loop)
+        await fake_storage_srvr.start()
+
+        mockServiceRecord = MagicMock(ServiceRecord)
+        mockServiceRecord._address = HOST
+        mockServiceRecord._type = "Storage"
+        mockServiceRecord._port = PORT
+        mockServiceRecord._management_port = 2000
+
+        rsc = ReadingsStorageClientAsync(1, 2, mockServiceRecord)
+        assert "{}:{}".format(HOST, PORT) == rsc.base_url
+
+        with pytest.raises(Exception) as excinfo:
+            with patch.object(_LOGGER, "error") as log_e:
+                await rsc.latest("internal_server_err")
+            log_e.assert_called_once_with('GET url: %s, Error code: %d, reason: %s, details: %s',
+                                          '/storage/reading/latest?asset=internal_server_err', 500, 'something wrong', {"key": "value"})
+        assert excinfo.type is aiohttp.client_exceptions.ContentTypeError
+
+        response = await rsc.latest()
+        assert {'count': 0, 'rows': [], 'asset': None} == response
+
+        response = await rsc.latest("pump 1")
+        assert {'count': 0, 'rows': [], 'asset': 'pump 1'} == response
+
+        await fake_storage_srvr.stop()
+
     @pytest.mark.asyncio
     async def test_query(self, event_loop):
         # 'PUT', '/storage/reading/query' query_payload